@@ -1,15 +1,52 @@
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 #include "accelgyro.h"
 #include "mpu6000.h"
 #include "mainloop_timer.h"
 
 #include "micros.h"
 #include "sensor_calib.h"
+#include "calib_stat.h"
+#include "gyro_tcomp.h"
+#include "flight.h"
 #include "config.h"
+#include "filter.h"
+#include "dyn_notch.h"
+#include "sensor_xform.h"
+#include "mem_section.h"
 
-#define ACCELGYRO_ACCEL_CALIBRATE_SAMPLE_COUNT        20000
-#define ACCELGYRO_GYRO_CALIBRATE_SAMPLE_COUNT         20000
+//
+// calibration stops once the 95% confidence half width of the mean is
+// below TOL, in raw LSB. gyro noise is ~1.5 LSB rms and accel ~12 LSB
+// rms so both are done in about a second still. MAX_COUNT is the old
+// fixed length and only hit when the sensor is unusually noisy.
+//
+#define ACCELGYRO_GYRO_CAL_TOL                        0.25f     // 0.008 dps
+#define ACCELGYRO_GYRO_CAL_MAX_STD                    8.0f      // 0.25 dps
+#define ACCELGYRO_GYRO_CAL_MAX_DEV                    50.0f     // 1.5 dps
+#define ACCELGYRO_GYRO_CAL_MIN_COUNT                  1000
+#define ACCELGYRO_GYRO_CAL_MAX_COUNT                  20000
+
+#define ACCELGYRO_ACCEL_CAL_TOL                       1.0f      // 0.25 mG
+#define ACCELGYRO_ACCEL_CAL_MAX_STD                   40.0f     // 10 mG
+#define ACCELGYRO_ACCEL_CAL_MAX_DEV                   200.0f    // 50 mG
+#define ACCELGYRO_ACCEL_CAL_MIN_COUNT                 1000
+#define ACCELGYRO_ACCEL_CAL_MAX_COUNT                 20000
+
+//
+// gyro bias is captured at every boot once the board sits still.
+// moving restarts it, and after the timeout the configured offset stays
+//
+#define ACCELGYRO_GYRO_BOOT_CAL_TIMEOUT               10000     // msec
+
+//
+// temperature compensation. a 2 sec still window while disarmed is one
+// learning sample. the correction is refreshed every 100ms since
+// temperature moves slowly
+//
+#define ACCELGYRO_GYRO_TC_WINDOW                      2000
+#define ACCELGYRO_GYRO_TC_REFRESH                     100
 
 ////////////////////////////////////////////////////////////////////////////////
 //
@@ -17,8 +54,12 @@
 //
 ////////////////////////////////////////////////////////////////////////////////
 static void accgyro_sample_timer_callback(SoftTimerElem* te);
+static void accgyro_bringup_timer_callback(SoftTimerElem* te);
+static void accgyro_process_sample(void);
+static void accgyro_gyro_cal_begin(bool boot);
 static void accgyro_gyro_cal_update(int16_t gx, int16_t gy, int16_t gz);
 static void accgyro_accel_cal_update(int16_t ax, int16_t ay, int16_t az);
+static void accgyro_gyro_tc_update(void);
 
 ////////////////////////////////////////////////////////////////////////////////
 //
@@ -27,6 +68,10 @@ static void accgyro_accel_cal_update(int16_t ax, int16_t ay, int16_t az);
 ////////////////////////////////////////////////////////////////////////////////
 static MPU6000_t        _mpu;
 static SoftTimerElem    _sample_timer;
+static SoftTimerElem    _bringup_timer;
+static int              _bringup_step;
+static bool             _mpu_ready;
+static bool             _start_pending;
 
 static uint16_t         _sample_rate;
 static uint16_t         _sample_count;
@@ -34,6 +79,13 @@ static uint16_t         _sample_count;
 static uint32_t last_msec;
 
 static sensor_align_t   _aalign, _galign;
+static sensor_xform_t   _accel_xform,
+                        _gyro_xform;
+
+static CCM_BSS filter3_t  _gyro_filter[FILTER_CHAIN_MAX];
+
+static accelgyro_sample_callback  _sample_cb[ACCELGYRO_SAMPLE_CB_MAX];
+static uint8_t                    _num_sample_cb;
 
 ////////////////////////////////////////////////////////////////////////////////
 //
@@ -41,11 +93,13 @@ static sensor_align_t   _aalign, _galign;
 //
 ////////////////////////////////////////////////////////////////////////////////
 int16_t accel_raw[3];
-int16_t accel_value[3];
+float   accel_body[3];
 
 int16_t gyro_raw[3];
-int16_t gyro_value[3];
-float   gyro_dps[3];
+float   gyro_body[3];
+
+uint32_t  accel_gyro_usec;
+uint32_t  accel_gyro_msec;
 
 ////////////////////////////////////////////////////////////////////////////////
 //
@@ -53,12 +107,24 @@ float   gyro_dps[3];
 //
 ////////////////////////////////////////////////////////////////////////////////
 static bool             _gyro_cal_in_prog;
-static float            _gyro_sum[3];
-static int32_t          _gyro_cal_sum_count;
+static bool             _gyro_cal_boot;
+static calib_stat_t     _gyro_cal_stat;
+static uint32_t         _gyro_cal_start;
+static accelgyro_gyro_boot_cal_t  _gyro_boot_cal;
 
 static accelgyro_gyro_calib_callback    _gyro_cal_cb;
 static void*  _gyro_cal_cb_arg;
 
+////////////////////////////////////////////////////////////////////////////////
+//
+// gyro temperature compensation related
+//
+////////////////////////////////////////////////////////////////////////////////
+static calib_stat_t     _gyro_tc_stat;
+static float            _gyro_tc_temp_sum;
+static float            _gyro_tc_body[3];     // body frame bias change since gyro_offset_temp
+static uint16_t         _gyro_tc_refresh;
+
 ////////////////////////////////////////////////////////////////////////////////
 //
 // accel calibration related
@@ -69,35 +135,41 @@ static accelgyro_accel_calib_step_callback  _accel_cal_step_cb;
 static accelgyro_accel_calib_done_callback  _accel_cal_done_cb;
 static void*  _accel_cal_cb_arg;
 
-static int32_t    _accel_cal_sample_count[6];
-static int32_t    _accel_cal_sum[6][3];
-static bool       _accel_cal_done[6];
+static calib_stat_t   _accel_cal_stat[6];
+static int32_t        _accel_cal_sum[6][3];       // mean of each face
+static bool           _accel_cal_done[6];
 
 ////////////////////////////////////////////////////////////////////////////////
 //
 // accel/gyro main functions
 //
 ////////////////////////////////////////////////////////////////////////////////
+//
+// one sample through transform, filters and calibration
+//
 static void
-accgyro_sample_timer_callback(SoftTimerElem* te)
+accgyro_process_sample(void)
 {
-  mpu6000_read_all(&_mpu, accel_raw, gyro_raw);
-  mainloop_timer_schedule(&_sample_timer, 1);
-  _sample_count++;
+  sensor_xform_apply(&_accel_xform, accel_raw, accel_body);
+  sensor_xform_apply(&_gyro_xform, gyro_raw, gyro_body);
 
-  accel_value[0] = (accel_raw[0] - GCFG->accel_offset[0]) * GCFG->accel_gain[0] / ACCELGYRO_1G_VALUE;
-  accel_value[1] = (accel_raw[1] - GCFG->accel_offset[1]) * GCFG->accel_gain[1] / ACCELGYRO_1G_VALUE;
-  accel_value[2] = (accel_raw[2] - GCFG->accel_offset[2]) * GCFG->accel_gain[2] / ACCELGYRO_1G_VALUE;
-  sensor_align_values(accel_value, _aalign);
+  accgyro_gyro_tc_update();
+  gyro_body[0] -= _gyro_tc_body[0];
+  gyro_body[1] -= _gyro_tc_body[1];
+  gyro_body[2] -= _gyro_tc_body[2];
 
-  gyro_value[0] = gyro_raw[0] - GCFG->gyro_offset[0];
-  gyro_value[1] = gyro_raw[1] - GCFG->gyro_offset[1];
-  gyro_value[2] = gyro_raw[2] - GCFG->gyro_offset[2];
-  sensor_align_values(gyro_value, _galign);
+  //
+  // FFT sees un-filtered gyro. tracking notches go before static filters
+  //
+  dyn_notch_push(gyro_body);
+  dyn_notch_apply(gyro_body);
 
-  gyro_dps[0] = gyro_value[0] * ACCELGYRO_GYRO_LSB;
-  gyro_dps[1] = gyro_value[1] * ACCELGYRO_GYRO_LSB;
-  gyro_dps[2] = gyro_value[2] * ACCELGYRO_GYRO_LSB;
+  for(int i = 0; i < FILTER_CHAIN_MAX; i++)
+  {
+    filter3_apply(&_gyro_filter[i], gyro_body);
+  }
+
+  dyn_notch_update();
 
   if(_gyro_cal_in_prog)
   {
@@ -108,6 +180,42 @@ accgyro_sample_timer_callback(SoftTimerElem* te)
   {
     accgyro_accel_cal_update(accel_raw[0], accel_raw[1], accel_raw[2]);
   }
+}
+
+//
+// everything the FIFO collected since the last tick goes through the
+// chain in order, so filters and FFT never miss a sample even if this
+// timer runs late. the sample listener sees every one of them too
+//
+static void
+accgyro_fifo_callback(MPU6000_t* mpu, const mpu6000_sample_t* s, int n)
+{
+  uint32_t  now_usec = micros_get();
+
+  for(int i = 0; i < n; i++)
+  {
+    memcpy(accel_raw, s[i].a, sizeof(accel_raw));
+    memcpy(gyro_raw, s[i].g, sizeof(gyro_raw));
+    accel_gyro_usec = s[i].usec;
+    accel_gyro_msec = __msec - (now_usec - s[i].usec) / 1000;
+
+    accgyro_process_sample();
+
+    for(int j = 0; j < _num_sample_cb; j++)
+    {
+      _sample_cb[j]();
+    }
+  }
+  _sample_count += n;
+}
+
+static void
+accgyro_sample_timer_callback(SoftTimerElem* te)
+{
+  mainloop_timer_schedule(&_sample_timer, 1);
+
+  // samples are processed as the FIFO read completes
+  mpu6000_fifo_read_start(&_mpu, accgyro_fifo_callback);
 
   if((__msec - last_msec) >= 1000)
   {
@@ -117,90 +225,357 @@ accgyro_sample_timer_callback(SoftTimerElem* te)
   }
 }
 
+static void
+accgyro_sampling_start(void)
+{
+  mpu6000_fifo_start(&_mpu);
+  mainloop_timer_schedule(&_sample_timer, 1);
+
+  _sample_count = 0;
+  _sample_rate = 0;
+  last_msec = __msec;
+
+  _gyro_boot_cal = accelgyro_gyro_boot_cal_running;
+  accgyro_gyro_cal_begin(true);
+}
+
+//
+// MPU6000 bring-up, one register write per expiry. the 300ms of reset
+// wait overlaps with the other devices and the main loop keeps running
+//
+static void
+accgyro_bringup_timer_callback(SoftTimerElem* te)
+{
+  int   wait;
+
+  wait = mpu6000_init_step(&_mpu, _bringup_step);
+  if(wait < 0)
+  {
+    _mpu_ready = true;
+    if(_start_pending)
+    {
+      _start_pending = false;
+      accgyro_sampling_start();
+    }
+    return;
+  }
+
+  _bringup_step++;
+  mainloop_timer_schedule(&_bringup_timer, wait > 0 ? wait : 1);
+}
+
 void
 accelgyro_init(sensor_align_t aalign, sensor_align_t galign)
 {
   _aalign = aalign;
   _galign = galign;
 
-  mpu6000_init(&_mpu);
+  _mpu_ready      = false;
+  _start_pending  = false;
+  _bringup_step   = 0;
+
+  soft_timer_init_elem(&_bringup_timer);
+  _bringup_timer.cb = accgyro_bringup_timer_callback;
+  mainloop_timer_schedule(&_bringup_timer, 1);
+
+  accelgyro_xform_config();
+
+  dyn_notch_init(ACCELGYRO_SAMPLE_FREQ);
+  accelgyro_filter_config();
 
   soft_timer_init_elem(&_sample_timer);
   _sample_timer.cb    = accgyro_sample_timer_callback;
 
   _gyro_cal_in_prog   = false;
   _accel_cal_in_prog  = false;
+
+  calib_stat_init(&_gyro_tc_stat, 0.0f,
+      ACCELGYRO_GYRO_CAL_MAX_STD,
+      ACCELGYRO_GYRO_CAL_MAX_DEV,
+      ACCELGYRO_GYRO_TC_WINDOW,
+      ACCELGYRO_GYRO_TC_WINDOW);
+  _gyro_tc_temp_sum = 0.0f;
+  _gyro_tc_refresh  = 0;
 }
 
+//
+// sampling begins once bring-up is done if it is still in progress
+//
 void
 accelgyro_start(void)
 {
-  mainloop_timer_schedule(&_sample_timer, 1);
-
-  _sample_count = 0;
-  _sample_rate = 0;
-  last_msec = __msec;
+  if(!_mpu_ready)
+  {
+    _start_pending = true;
+    return;
+  }
+  accgyro_sampling_start();
 }
 
 void
 accelgyro_stop(void)
 {
+  _start_pending = false;
   mainloop_timer_cancel(&_sample_timer);
 }
 
+//
+// cb runs once per sample from the main loop, right after the sample
+// went through the chain, with accel_body, gyro_body, accel_gyro_usec
+// and accel_gyro_msec holding it. listeners run in the order they were
+// added, so anything that reads the AHRS adds after imu_init()
+//
+bool
+accelgyro_add_sample_callback(accelgyro_sample_callback cb)
+{
+  if(_num_sample_cb >= ACCELGYRO_SAMPLE_CB_MAX)
+  {
+    return false;
+  }
+
+  _sample_cb[_num_sample_cb++] = cb;
+  return true;
+}
+
+bool
+accelgyro_is_ready(void)
+{
+  return _mpu_ready;
+}
+
 uint16_t
 accelgyro_sample_rate(void)
 {
   return _sample_rate;
 }
 
+void
+accelgyro_fifo_stat(uint32_t* overflow, uint16_t* frames_max)
+{
+  *overflow   = _mpu.fifo_overflow;
+  *frames_max = _mpu.fifo_frames_max;
+}
+
+void
+accelgyro_filter_config(void)
+{
+  for(int i = 0; i < FILTER_CHAIN_MAX; i++)
+  {
+    filter3_init_from_config(&_gyro_filter[i], &GCFG->gyro_filter[i], ACCELGYRO_SAMPLE_FREQ);
+  }
+
+  dyn_notch_config(GCFG->dyn_notch_peaks,
+      GCFG->dyn_notch_min_hz,
+      GCFG->dyn_notch_max_hz,
+      GCFG->dyn_notch_q / 100.0f);
+}
+
+//
+// rebuild raw to body transforms from calibration and board alignment
+//
+void
+accelgyro_xform_config(void)
+{
+  float   offset[3],
+          scale[3];
+
+  for(int i = 0; i < 3; i++)
+  {
+    offset[i] = GCFG->accel_offset[i];
+    scale[i]  = GCFG->accel_gain[i] / (float)ACCELGYRO_1G_VALUE * ACCELGYRO_ACCEL_LSB;
+  }
+  sensor_xform_build(&_accel_xform, _aalign, GCFG->board_align, offset, scale);
+
+  for(int i = 0; i < 3; i++)
+  {
+    offset[i] = GCFG->gyro_offset[i];
+    scale[i]  = ACCELGYRO_GYRO_LSB;
+  }
+  sensor_xform_build(&_gyro_xform, _galign, GCFG->board_align, offset, scale);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 //
 // gyro calibration functions
 //
 ////////////////////////////////////////////////////////////////////////////////
+static void
+accgyro_gyro_cal_begin(bool boot)
+{
+  calib_stat_init(&_gyro_cal_stat,
+      ACCELGYRO_GYRO_CAL_TOL,
+      ACCELGYRO_GYRO_CAL_MAX_STD,
+      ACCELGYRO_GYRO_CAL_MAX_DEV,
+      ACCELGYRO_GYRO_CAL_MIN_COUNT,
+      ACCELGYRO_GYRO_CAL_MAX_COUNT);
+
+  _gyro_cal_boot    = boot;
+  _gyro_cal_start   = __msec;
+  _gyro_cal_in_prog = true;
+}
+
+//
+// an explicit calibration request takes over a boot capture in progress
+//
+static void
+accgyro_gyro_boot_cal_cancel(void)
+{
+  if(_gyro_cal_in_prog && _gyro_cal_boot)
+  {
+    _gyro_cal_in_prog = false;
+    _gyro_boot_cal    = accelgyro_gyro_boot_cal_failed;
+  }
+}
+
 static void
 accgyro_gyro_cal_update(int16_t gx, int16_t gy, int16_t gz)
 {
-  _gyro_sum[0] += gx;
-  _gyro_sum[1] += gy;
-  _gyro_sum[2] += gz;
+  const int16_t   g[3] = { gx, gy, gz };
 
-  _gyro_cal_sum_count++;
+  switch(calib_stat_push(&_gyro_cal_stat, g))
+  {
+  case calib_stat_running:
+    return;
 
-  if(_gyro_cal_sum_count > ACCELGYRO_GYRO_CALIBRATE_SAMPLE_COUNT)
+  case calib_stat_motion:
+    if(!_gyro_cal_boot)
+    {
+      _gyro_cal_in_prog = false;
+      _gyro_cal_cb(false, GCFG->gyro_offset, _gyro_cal_cb_arg);
+      return;
+    }
+
+    if((__msec - _gyro_cal_start) >= ACCELGYRO_GYRO_BOOT_CAL_TIMEOUT)
+    {
+      _gyro_cal_in_prog = false;
+      _gyro_boot_cal    = accelgyro_gyro_boot_cal_failed;
+      return;
+    }
+    calib_stat_reset(&_gyro_cal_stat);
+    return;
+
+  case calib_stat_done:
+    break;
+  }
+
+  for(int i = 0; i < 3; i++)
   {
-    GCFG->gyro_offset[0] = (int16_t)(_gyro_sum[0] / _gyro_cal_sum_count);
-    GCFG->gyro_offset[1] = (int16_t)(_gyro_sum[1] / _gyro_cal_sum_count);
-    GCFG->gyro_offset[2] = (int16_t)(_gyro_sum[2] / _gyro_cal_sum_count);
+    GCFG->gyro_offset[i] = lrintf(_gyro_cal_stat.w.mean[i]);
+  }
+  GCFG->gyro_offset_temp = lrintf(_mpu.Temperature * 10.0f);
+  gyro_tcomp_learn(&GCFG->gyro_tc, _mpu.Temperature, _gyro_cal_stat.w.mean);
 
-    _gyro_cal_in_prog = false;
+  _gyro_cal_in_prog = false;
+  accelgyro_xform_config();
+  _gyro_tc_refresh  = 0;
 
-    _gyro_cal_cb(GCFG->gyro_offset, _gyro_cal_cb_arg);
+  if(_gyro_cal_boot)
+  {
+    _gyro_boot_cal = accelgyro_gyro_boot_cal_done;
+    return;
   }
+  _gyro_cal_cb(true, GCFG->gyro_offset, _gyro_cal_cb_arg);
 }
 
 bool
 accelgyro_gyro_calibrate(accelgyro_gyro_calib_callback cb, void* cb_arg)
 {
-  if(_gyro_cal_in_prog || _accel_cal_in_prog)
+  if(_accel_cal_in_prog)
+  {
+    return false;
+  }
+
+  if(_gyro_cal_in_prog && !_gyro_cal_boot)
   {
     return false;
   }
 
+  accgyro_gyro_boot_cal_cancel();
+
   _gyro_cal_cb      = cb;
   _gyro_cal_cb_arg  = cb_arg;
 
-  _gyro_sum[0]    = 
-  _gyro_sum[1]    = 
-  _gyro_sum[2]    = 0.0f;
-
-  _gyro_cal_sum_count = 0;
-  _gyro_cal_in_prog = true;
+  accgyro_gyro_cal_begin(false);
 
   return true;
 }
 
+accelgyro_gyro_boot_cal_t
+accelgyro_gyro_boot_cal_state(void)
+{
+  return _gyro_boot_cal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// gyro temperature compensation
+//
+////////////////////////////////////////////////////////////////////////////////
+
+//
+// learn from still windows while disarmed and keep the body frame
+// correction for the current temperature.
+//
+// the offset in the transform is the bias at gyro_offset_temp, so the
+// correction is the table change from there, rotated by the transform
+//
+static void
+accgyro_gyro_tc_update(void)
+{
+  float   d[3];
+
+  if(flight_state != flight_state_disarmed)
+  {
+    calib_stat_reset(&_gyro_tc_stat);
+    _gyro_tc_temp_sum = 0.0f;
+  }
+  else
+  {
+    _gyro_tc_temp_sum += _mpu.Temperature;
+
+    switch(calib_stat_push(&_gyro_tc_stat, gyro_raw))
+    {
+    case calib_stat_running:
+      break;
+
+    case calib_stat_done:
+      gyro_tcomp_learn(&GCFG->gyro_tc, _gyro_tc_temp_sum / _gyro_tc_stat.w.n, _gyro_tc_stat.w.mean);
+      // fall through
+
+    case calib_stat_motion:
+      calib_stat_reset(&_gyro_tc_stat);
+      _gyro_tc_temp_sum = 0.0f;
+      break;
+    }
+  }
+
+  if(_gyro_tc_refresh != 0)
+  {
+    _gyro_tc_refresh--;
+    return;
+  }
+  _gyro_tc_refresh = ACCELGYRO_GYRO_TC_REFRESH;
+
+  gyro_tcomp_delta(&GCFG->gyro_tc, _mpu.Temperature, GCFG->gyro_offset_temp / 10.0f, d);
+
+  for(int i = 0; i < 3; i++)
+  {
+    _gyro_tc_body[i] = _gyro_xform.m[i][0] * d[0] + _gyro_xform.m[i][1] * d[1] + _gyro_xform.m[i][2] * d[2];
+  }
+}
+
+float
+accelgyro_temperature(void)
+{
+  return _mpu.Temperature;
+}
+
+void
+accelgyro_gyro_tc_get(float bias[3])
+{
+  memcpy(bias, _gyro_tc_body, sizeof(_gyro_tc_body));
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 //
 // accel calibration functions
@@ -293,13 +668,16 @@ accgyro_accel_cal_finish(void)
   }
 
   _accel_cal_in_prog = false;
+  accelgyro_xform_config();
+
   _accel_cal_done_cb(GCFG->accel_offset, GCFG->accel_gain, _accel_cal_cb_arg);
 }
 
 static void
 accgyro_accel_cal_update(int16_t ax, int16_t ay, int16_t az)
 {
-  int32_t index = getPrimaryAxisIndex(ax, ay, az);
+  const int16_t   a[3] = { ax, ay, az };
+  int32_t         index = getPrimaryAxisIndex(ax, ay, az);
 
   if(index < 0)
   {
@@ -317,20 +695,27 @@ accgyro_accel_cal_update(int16_t ax, int16_t ay, int16_t az)
     return;
   }
 
-  _accel_cal_sum[index][X] += ax;
-  _accel_cal_sum[index][Y] += ay;
-  _accel_cal_sum[index][Z] += az;
-  _accel_cal_sample_count[index]++;
-
-  if(_accel_cal_sample_count[index] > ACCELGYRO_ACCEL_CALIBRATE_SAMPLE_COUNT)
+  switch(calib_stat_push(&_accel_cal_stat[index], a))
   {
+  case calib_stat_running:
+    break;
+
+  case calib_stat_motion:
+    //
+    // still being put down on this face. start the face over
+    //
+    calib_stat_reset(&_accel_cal_stat[index]);
+    break;
+
+  case calib_stat_done:
     _accel_cal_done[index] = true;
 
-    _accel_cal_sum[index][X] /= ACCELGYRO_ACCEL_CALIBRATE_SAMPLE_COUNT;
-    _accel_cal_sum[index][Y] /= ACCELGYRO_ACCEL_CALIBRATE_SAMPLE_COUNT;
-    _accel_cal_sum[index][Z] /= ACCELGYRO_ACCEL_CALIBRATE_SAMPLE_COUNT;
+    _accel_cal_sum[index][X] = lrintf(_accel_cal_stat[index].w.mean[X]);
+    _accel_cal_sum[index][Y] = lrintf(_accel_cal_stat[index].w.mean[Y]);
+    _accel_cal_sum[index][Z] = lrintf(_accel_cal_stat[index].w.mean[Z]);
 
     _accel_cal_step_cb(index, _accel_cal_cb_arg);
+    break;
   }
 }
 
@@ -339,11 +724,13 @@ accelgyro_accel_calibrate( accelgyro_accel_calib_step_callback step_cb,
     accelgyro_accel_calib_done_callback done_cb,
     void* cb_arg)
 {
-  if(_gyro_cal_in_prog || _accel_cal_in_prog)
+  if((_gyro_cal_in_prog && !_gyro_cal_boot) || _accel_cal_in_prog)
   {
     return false;
   }
 
+  accgyro_gyro_boot_cal_cancel();
+
   _accel_cal_step_cb = step_cb;
   _accel_cal_done_cb = done_cb;
   _accel_cal_cb_arg = cb_arg;
@@ -352,7 +739,12 @@ accelgyro_accel_calibrate( accelgyro_accel_calib_step_callback step_cb,
 
   for(int i = 0; i < 6; i++)
   {
-    _accel_cal_sample_count[i] = 0;
+    calib_stat_init(&_accel_cal_stat[i],
+        ACCELGYRO_ACCEL_CAL_TOL,
+        ACCELGYRO_ACCEL_CAL_MAX_STD,
+        ACCELGYRO_ACCEL_CAL_MAX_DEV,
+        ACCELGYRO_ACCEL_CAL_MIN_COUNT,
+        ACCELGYRO_ACCEL_CAL_MAX_COUNT);
     _accel_cal_sum[i][X] = 0;
     _accel_cal_sum[i][Y] = 0;
     _accel_cal_sum[i][Z] = 0;
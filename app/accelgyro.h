@@ -17,19 +17,52 @@
 //
 #define ACCELGYRO_1G_VALUE                            4096
 
+#define ACCELGYRO_SAMPLE_FREQ                         1000
+
+//
+// per sample listeners. AHRS, INS and altitude
+//
+#define ACCELGYRO_SAMPLE_CB_MAX                       4
+
+//
+// body frame outputs. NWU, see imu.c
+// accel in G, gyro in dps after filtering
+//
 extern int16_t accel_raw[3];
-extern int16_t accel_value[3];
+extern float accel_body[3];
 extern int16_t gyro_raw[3];
-extern int16_t gyro_value[3];
-extern float gyro_dps[3];
+extern float gyro_body[3];
+extern uint32_t accel_gyro_usec;      // sample time of the values above. micros
+extern uint32_t accel_gyro_msec;      // the same on the __msec clock
+
+typedef void (*accelgyro_sample_callback)(void);
 
 extern void accelgyro_init(sensor_align_t aalign, sensor_align_t galign);
 extern void accelgyro_start(void);
 extern void accelgyro_stop(void);
+extern bool accelgyro_add_sample_callback(accelgyro_sample_callback cb);
+extern bool accelgyro_is_ready(void);
 extern uint16_t accelgyro_sample_rate(void);
+extern void accelgyro_fifo_stat(uint32_t* overflow, uint16_t* frames_max);
+extern void accelgyro_filter_config(void);
+extern void accelgyro_xform_config(void);
+
+typedef enum
+{
+  accelgyro_gyro_boot_cal_running = 0,
+  accelgyro_gyro_boot_cal_done,
+  accelgyro_gyro_boot_cal_failed,     // never still long enough. config offset in use
+} accelgyro_gyro_boot_cal_t;
 
-typedef void (*accelgyro_gyro_calib_callback)(int16_t offset[3], void* cb_arg);
+//
+// success is false if the board moved during calibration
+//
+typedef void (*accelgyro_gyro_calib_callback)(bool success, int16_t offset[3], void* cb_arg);
 extern bool accelgyro_gyro_calibrate(accelgyro_gyro_calib_callback cb, void* cb_arg);
+extern accelgyro_gyro_boot_cal_t accelgyro_gyro_boot_cal_state(void);
+
+extern float accelgyro_temperature(void);
+extern void accelgyro_gyro_tc_get(float bias[3]);    // current temperature correction. body dps
 
 typedef void (*accelgyro_accel_calib_step_callback)(int ndx, void* cb_arg);
 typedef void (*accelgyro_accel_calib_done_callback)(int16_t offset[3], int16_t gain[3], void* cb_arg);
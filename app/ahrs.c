@@ -0,0 +1,147 @@
+#include "app_common.h"
+#include "ahrs_common.h"
+#include "ahrs.h"
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// attitude and heading reference.
+//
+// every engine keeps its state as a body to earth quaternion so seeding,
+// heading correction and euler conversion are shared. engines only differ
+// in how gyro and accel are fused at gyro rate.
+//
+////////////////////////////////////////////////////////////////////////////////
+static const char*    _ahrs_names[ahrs_type_max] =
+{
+  "madgwick",
+  "mahony",
+  "complementary",
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// private utilities
+//
+////////////////////////////////////////////////////////////////////////////////
+static inline float*
+ahrs_quat(ahrs_t* ahrs)
+{
+  switch(ahrs->type)
+  {
+  case ahrs_type_mahony:
+    return ahrs->mahony.q;
+
+  case ahrs_type_complementary:
+    return ahrs->complementary.q;
+
+  default:
+    return ahrs->madgwick.q;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// public interfaces
+//
+////////////////////////////////////////////////////////////////////////////////
+const char*
+ahrs_type_name(ahrs_type_t type)
+{
+  if(type >= ahrs_type_max)
+  {
+    return "invalid";
+  }
+  return _ahrs_names[type];
+}
+
+void
+ahrs_init(ahrs_t* ahrs, ahrs_type_t type, float sample_freq)
+{
+  ahrs->type      = type < ahrs_type_max ? type : AHRS_DEFAULT;
+  ahrs->mag_gain  = AHRS_MAG_GAIN;
+
+  switch(ahrs->type)
+  {
+  case ahrs_type_mahony:
+    mahony_init(&ahrs->mahony, sample_freq);
+    break;
+
+  case ahrs_type_complementary:
+    complementary_init(&ahrs->complementary, sample_freq);
+    break;
+
+  default:
+    madgwick_init(&ahrs->madgwick, sample_freq);
+    break;
+  }
+}
+
+void
+ahrs_seed(ahrs_t* ahrs, const float a[3], const float m[3])
+{
+  ahrs_quat_from_vectors(ahrs_quat(ahrs), a, m);
+}
+
+//
+// gyro in dps, accel in G. body frame NWU
+//
+void
+ahrs_update_imu(ahrs_t* ahrs, const float g[3], const float a[3])
+{
+  switch(ahrs->type)
+  {
+  case ahrs_type_mahony:
+    mahony_updateIMU(&ahrs->mahony, g[0], g[1], g[2], a[0], a[1], a[2]);
+    break;
+
+  case ahrs_type_complementary:
+    complementary_updateIMU(&ahrs->complementary, g[0], g[1], g[2], a[0], a[1], a[2]);
+    break;
+
+  default:
+    madgwick_updateIMU(&ahrs->madgwick, g[0], g[1], g[2], a[0], a[1], a[2]);
+    break;
+  }
+}
+
+//
+// call only on a fresh magnetometer sample
+//
+void
+ahrs_update_mag(ahrs_t* ahrs, const float m[3])
+{
+  ahrs_quat_heading_correct(ahrs_quat(ahrs), m, ahrs->mag_gain);
+}
+
+void
+ahrs_get_quaternion(ahrs_t* ahrs, float q[4])
+{
+  const float*  s = ahrs_quat(ahrs);
+
+  q[0] = s[0];
+  q[1] = s[1];
+  q[2] = s[2];
+  q[3] = s[3];
+}
+
+void
+ahrs_get_roll_pitch_yaw(ahrs_t* ahrs, int16_t data[3], float md)
+{
+  ahrs_quat_to_roll_pitch_yaw(ahrs_quat(ahrs), data, md);
+}
+
+float
+ahrs_get_accel_weight(ahrs_t* ahrs)
+{
+  switch(ahrs->type)
+  {
+  case ahrs_type_mahony:
+    return ahrs->mahony.accWeight;
+
+  case ahrs_type_complementary:
+    return ahrs->complementary.accWeight;
+
+  default:
+    return ahrs->madgwick.accWeight;
+  }
+}
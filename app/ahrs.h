@@ -0,0 +1,51 @@
+#ifndef __AHRS_DEF_H__
+#define __AHRS_DEF_H__
+
+#include "app_common.h"
+#include "madgwick.h"
+#include "mahony.h"
+#include "complementary.h"
+
+typedef enum
+{
+  ahrs_type_madgwick = 0,
+  ahrs_type_mahony,
+  ahrs_type_complementary,
+  ahrs_type_max,
+} ahrs_type_t;
+
+//
+// engine used when config is reset. override with -DAHRS_DEFAULT=...
+//
+#ifndef AHRS_DEFAULT
+#define AHRS_DEFAULT            ahrs_type_madgwick
+#endif
+
+//
+// with 75Hz mag samples this is about 0.7 sec time constant on heading
+//
+#define AHRS_MAG_GAIN           0.02f
+
+typedef struct
+{
+  ahrs_type_t       type;
+  float             mag_gain;
+  union
+  {
+    madgwick_t      madgwick;
+    mahony_t        mahony;
+    complementary_t complementary;
+  };
+} ahrs_t;
+
+extern const char* ahrs_type_name(ahrs_type_t type);
+
+extern void ahrs_init(ahrs_t* ahrs, ahrs_type_t type, float sample_freq);
+extern void ahrs_seed(ahrs_t* ahrs, const float a[3], const float m[3]);
+extern void ahrs_update_imu(ahrs_t* ahrs, const float g[3], const float a[3]);
+extern void ahrs_update_mag(ahrs_t* ahrs, const float m[3]);
+extern void ahrs_get_quaternion(ahrs_t* ahrs, float q[4]);
+extern void ahrs_get_roll_pitch_yaw(ahrs_t* ahrs, int16_t data[3], float md);
+extern float ahrs_get_accel_weight(ahrs_t* ahrs);
+
+#endif /* !__AHRS_DEF_H__ */
@@ -0,0 +1,196 @@
+#include <math.h>
+#include "app_common.h"
+#include "math_helper.h"
+#include "ahrs_common.h"
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// private utilities
+//
+////////////////////////////////////////////////////////////////////////////////
+static inline void
+ahrs_quat_normalize(float q[4])
+{
+  float recipNorm = math_rsqrtf(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+
+  q[0] *= recipNorm;
+  q[1] *= recipNorm;
+  q[2] *= recipNorm;
+  q[3] *= recipNorm;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// public interfaces
+//
+////////////////////////////////////////////////////////////////////////////////
+
+//
+// TRIAD style seed from one accel and one mag vector in body frame.
+//
+// up is the accel direction, west is up x mag and north is west x up.
+// these three are the rows of body to earth rotation which is then
+// turned into the quaternion. without a usable mag vector, body x is
+// used instead and heading starts at whatever the nose points to.
+//
+void
+ahrs_quat_from_vectors(float q[4], const float a[3], const float m[3])
+{
+  float u[3], w[3], n[3], r[3][3];
+  float mx = m[0], my = m[1], mz = m[2];
+  float norm, t, s;
+
+  norm = sqrtf(a[0] * a[0] + a[1] * a[1] + a[2] * a[2]);
+  if(norm == 0.0f)
+  {
+    return;
+  }
+  u[0] = a[0] / norm;
+  u[1] = a[1] / norm;
+  u[2] = a[2] / norm;
+
+  for(int i = 0; i < 3; i++)
+  {
+    w[0] = u[1] * mz - u[2] * my;
+    w[1] = u[2] * mx - u[0] * mz;
+    w[2] = u[0] * my - u[1] * mx;
+
+    norm = sqrtf(w[0] * w[0] + w[1] * w[1] + w[2] * w[2]);
+    if(norm > 1e-3f * sqrtf(mx * mx + my * my + mz * mz))
+    {
+      break;
+    }
+
+    // no mag or mag along up. fall back to body x then body y
+    mx = (i == 0) ? 1.0f : 0.0f;
+    my = (i == 0) ? 0.0f : 1.0f;
+    mz = 0.0f;
+  }
+  w[0] /= norm;
+  w[1] /= norm;
+  w[2] /= norm;
+
+  n[0] = w[1] * u[2] - w[2] * u[1];
+  n[1] = w[2] * u[0] - w[0] * u[2];
+  n[2] = w[0] * u[1] - w[1] * u[0];
+
+  for(int i = 0; i < 3; i++)
+  {
+    r[0][i] = n[i];
+    r[1][i] = w[i];
+    r[2][i] = u[i];
+  }
+
+  t = r[0][0] + r[1][1] + r[2][2];
+  if(t > 0.0f)
+  {
+    s    = 2.0f * sqrtf(t + 1.0f);
+    q[0] = 0.25f * s;
+    q[1] = (r[2][1] - r[1][2]) / s;
+    q[2] = (r[0][2] - r[2][0]) / s;
+    q[3] = (r[1][0] - r[0][1]) / s;
+  }
+  else if(r[0][0] > r[1][1] && r[0][0] > r[2][2])
+  {
+    s    = 2.0f * sqrtf(1.0f + r[0][0] - r[1][1] - r[2][2]);
+    q[0] = (r[2][1] - r[1][2]) / s;
+    q[1] = 0.25f * s;
+    q[2] = (r[0][1] + r[1][0]) / s;
+    q[3] = (r[0][2] + r[2][0]) / s;
+  }
+  else if(r[1][1] > r[2][2])
+  {
+    s    = 2.0f * sqrtf(1.0f + r[1][1] - r[0][0] - r[2][2]);
+    q[0] = (r[0][2] - r[2][0]) / s;
+    q[1] = (r[0][1] + r[1][0]) / s;
+    q[2] = 0.25f * s;
+    q[3] = (r[1][2] + r[2][1]) / s;
+  }
+  else
+  {
+    s    = 2.0f * sqrtf(1.0f + r[2][2] - r[0][0] - r[1][1]);
+    q[0] = (r[1][0] - r[0][1]) / s;
+    q[1] = (r[0][2] + r[2][0]) / s;
+    q[2] = (r[1][2] + r[2][1]) / s;
+    q[3] = 0.25f * s;
+  }
+
+  if(q[0] < 0.0f)
+  {
+    q[0] = -q[0]; q[1] = -q[1]; q[2] = -q[2]; q[3] = -q[3];
+  }
+}
+
+//
+// heading only correction from a fresh magnetometer sample.
+//
+// the measurement is rotated into earth frame and the angle of its
+// horizontal part from north is the heading error. the estimate is then
+// rotated about earth z by a fraction of that error, which cannot disturb
+// roll/pitch.
+//
+void
+ahrs_quat_heading_correct(float q[4], const float m[3], float gain)
+{
+  float hx, hy;
+  float err, s, c;
+  float q0 = q[0], q1 = q[1], q2 = q[2], q3 = q[3];
+
+  // earth frame horizontal components of R(q) * m
+  hx = (1.0f - 2.0f * (q2 * q2 + q3 * q3)) * m[0] +
+       2.0f * (q1 * q2 - q0 * q3) * m[1] +
+       2.0f * (q1 * q3 + q0 * q2) * m[2];
+  hy = 2.0f * (q1 * q2 + q0 * q3) * m[0] +
+       (1.0f - 2.0f * (q1 * q1 + q3 * q3)) * m[1] +
+       2.0f * (q2 * q3 - q0 * q1) * m[2];
+
+  if((hx == 0.0f) && (hy == 0.0f))
+  {
+    return;
+  }
+
+  // rotate by -gain * err about earth z. q = qz * q
+  err = math_atan2f(hy, hx);
+  s   = math_sinf(-0.5f * gain * err);
+  c   = math_cosf(-0.5f * gain * err);
+
+  q[0] = c * q0 - s * q3;
+  q[1] = c * q1 - s * q2;
+  q[2] = c * q2 + s * q1;
+  q[3] = c * q3 + s * q0;
+
+  ahrs_quat_normalize(q);
+}
+
+//
+// euler angles in decidegree, md is magnetic declination in decidegree
+//
+void
+ahrs_quat_to_roll_pitch_yaw(const float q[4], int16_t data[3], float md)
+{
+  float roll, pitch, yaw;
+
+#if 0   //ned
+  roll  = math_atan2f(q[0]*q[1] + q[2]*q[3], 0.5f - q[1]*q[1] - q[2]*q[2]);
+  pitch = math_asinf(-2.0f * (q[1]*q[3] - q[0]*q[2]));
+  yaw   = math_atan2f(q[1]*q[2] + q[0]*q[3], 0.5f - q[2]*q[2] - q[3]*q[3]);
+
+#else   //nwu
+  roll  =  math_atan2f(2.0f*(q[2]*q[3] + q[0]*q[1]), 2.0f*(sq(q[0]) + sq(q[3])) - 1.0f);
+  pitch =  math_asinf(2.0f*(q[1]*q[3] - q[0]*q[2]));
+  yaw   = -math_atan2f(2.0f*(q[1]*q[2] + q[0]*q[3]), 2.0f*(sq(q[0]) + sq(q[1])) - 1.0f);
+#endif
+
+  roll  = roll * 57.29578f;
+  pitch = pitch * 57.29578f;
+  yaw   = yaw * 57.29578f + md/10.0f;
+
+  if (yaw < 0.0f)
+  {
+    yaw += 360.0f;
+  }
+
+  data[0] = (int16_t)(roll * 10);
+  data[1] = (int16_t)(pitch * 10);
+  data[2] = (int16_t)(yaw * 10);
+}
@@ -0,0 +1,41 @@
+#ifndef __AHRS_COMMON_DEF_H__
+#define __AHRS_COMMON_DEF_H__
+
+#include <math.h>
+#include "app_common.h"
+
+//
+// helpers shared by every AHRS engine.
+// quaternion is w, x, y, z and rotates body frame to earth frame (NWU)
+//
+
+//
+// accel is trusted fully within GATE_LO of 1G, not at all beyond GATE_HI
+// and linearly in between. accel input is expected in G
+//
+#define AHRS_ACC_GATE_LO      0.1f
+#define AHRS_ACC_GATE_HI      0.3f
+
+static inline float
+ahrs_accel_weight(float norm)
+{
+  float dev = fabsf(norm - 1.0f);
+
+  if(dev <= AHRS_ACC_GATE_LO)
+  {
+    return 1.0f;
+  }
+
+  if(dev >= AHRS_ACC_GATE_HI)
+  {
+    return 0.0f;
+  }
+
+  return (AHRS_ACC_GATE_HI - dev) / (AHRS_ACC_GATE_HI - AHRS_ACC_GATE_LO);
+}
+
+extern void ahrs_quat_from_vectors(float q[4], const float a[3], const float m[3]);
+extern void ahrs_quat_heading_correct(float q[4], const float m[3], float gain);
+extern void ahrs_quat_to_roll_pitch_yaw(const float q[4], int16_t data[3], float md);
+
+#endif /* !__AHRS_COMMON_DEF_H__ */
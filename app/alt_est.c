@@ -0,0 +1,94 @@
+#include <string.h>
+#include "app_common.h"
+#include "alt_est.h"
+
+#define ALT_EST_GRAVITY         9.80665f
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// private utilities
+//
+////////////////////////////////////////////////////////////////////////////////
+static inline float
+alt_est_hist_get(const alt_est_t* est, uint32_t delay)
+{
+  if(delay >= ALT_EST_HIST_LEN)
+  {
+    delay = ALT_EST_HIST_LEN - 1;
+  }
+  return est->hist[(est->hist_head + ALT_EST_HIST_LEN - delay) % ALT_EST_HIST_LEN];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// public interfaces
+//
+////////////////////////////////////////////////////////////////////////////////
+
+//
+// gains put all three poles at -1/tau
+//
+void
+alt_est_init(alt_est_t* est, float tau, float alt)
+{
+  memset(est, 0, sizeof(alt_est_t));
+
+  est->k1 = 3.0f / tau;
+  est->k2 = 3.0f / (tau * tau);
+  est->k3 = 1.0f / (tau * tau * tau);
+
+  est->alt = alt;
+  for(int i = 0; i < ALT_EST_HIST_LEN; i++)
+  {
+    est->hist[i] = alt;
+  }
+}
+
+//
+// q is body to earth. accel in G, body frame.
+// only the third row of the rotation is needed for earth z
+//
+void
+alt_est_predict(alt_est_t* est, const float q[4], const float accel[3], float dt)
+{
+  float   az;
+
+  az = 2.0f * (q[1] * q[3] - q[0] * q[2]) * accel[0] +
+       2.0f * (q[2] * q[3] + q[0] * q[1]) * accel[1] +
+       (1.0f - 2.0f * (q[1] * q[1] + q[2] * q[2])) * accel[2];
+
+  az = (az - 1.0f) * ALT_EST_GRAVITY - est->acc_bias;
+
+  est->alt += (est->vel + 0.5f * az * dt) * dt;
+  est->vel += az * dt;
+
+  est->hist_head = (est->hist_head + 1) % ALT_EST_HIST_LEN;
+  est->hist[est->hist_head] = est->alt;
+}
+
+//
+// baro_alt was sampled delay msec ago. dt is the time since the last
+// baro correction
+//
+void
+alt_est_correct(alt_est_t* est, float baro_alt, uint32_t delay, float dt)
+{
+  float   err = baro_alt - alt_est_hist_get(est, delay),
+          d_alt;
+
+  d_alt = est->k1 * err * dt;
+
+  est->alt      += d_alt;
+  est->vel      += est->k2 * err * dt;
+  est->acc_bias -= est->k3 * err * dt;
+  est->baro_err  = err;
+
+  //
+  // keep the history consistent with the corrected estimate so the next
+  // innovation does not count this correction again
+  //
+  for(int i = 0; i < ALT_EST_HIST_LEN; i++)
+  {
+    est->hist[i] += d_alt;
+  }
+}
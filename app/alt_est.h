@@ -0,0 +1,41 @@
+#ifndef __ALT_EST_DEF_H__
+#define __ALT_EST_DEF_H__
+
+#include "app_common.h"
+
+//
+// vertical estimator. third order complementary filter.
+//
+// earth frame vertical acceleration is integrated at IMU rate into
+// velocity and altitude. baro altitude pulls the three states back
+// with gains from a single time constant, the third one being an
+// accel offset so a mis-leveled or biased accel does not show up as
+// climb rate.
+//
+// baro is compared against the estimate at the time the pressure was
+// actually sampled, kept in a short history of one entry per predict.
+// predict runs on every 1KHz IMU sample, so an entry is 1ms
+//
+// altitude in meter, up positive. velocity in m/s
+//
+#define ALT_EST_HIST_LEN          32        // msec. must cover baro delay
+
+typedef struct
+{
+  float       alt;
+  float       vel;
+  float       acc_bias;     // m/s^2, earth z
+
+  float       k1, k2, k3;
+
+  float       hist[ALT_EST_HIST_LEN];
+  uint8_t     hist_head;
+
+  float       baro_err;     // last baro innovation. m
+} alt_est_t;
+
+extern void alt_est_init(alt_est_t* est, float tau, float alt);
+extern void alt_est_predict(alt_est_t* est, const float q[4], const float accel[3], float dt);
+extern void alt_est_correct(alt_est_t* est, float baro_alt, uint32_t delay, float dt);
+
+#endif /* !__ALT_EST_DEF_H__ */
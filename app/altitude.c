@@ -0,0 +1,121 @@
+#include <string.h>
+#include "altitude.h"
+#include "imu.h"
+#include "accelgyro.h"
+#include "baro.h"
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// vertical estimator glue. integrates accel on every IMU sample and
+// corrects with every fresh baro altitude.
+//
+// baro.c stamps each altitude with the time it describes, conversion
+// midpoint less pre-filter delay, and the estimate of that time is
+// what it is compared against. the delay is counted from the sample
+// being processed, one alt_est history entry per sample
+//
+////////////////////////////////////////////////////////////////////////////////
+#define ALTITUDE_TAU              2.0f      // sec
+
+#if ACCELGYRO_SAMPLE_FREQ != 1000
+#error alt_est history is one entry per msec
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// module privates
+//
+////////////////////////////////////////////////////////////////////////////////
+static alt_est_t        _est;
+static bool             _running;
+static uint32_t         _baro_seen;
+static uint32_t         _baro_msec;
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// private utilities
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+// runs per IMU sample, after imu.c updated the AHRS with it
+//
+static void
+altitude_sample_callback(void)
+{
+  float   q[4];
+  int32_t delay;
+
+  if(!_running)
+  {
+    //
+    // baroSampleCount stays 0 until ground calibration is done
+    //
+    if(imu_is_ready() && baroSampleCount != 0)
+    {
+      alt_est_init(&_est, ALTITUDE_TAU, baroAltitude / 100.0f);
+      _baro_seen  = baroSampleCount;
+      _baro_msec  = accel_gyro_msec;
+      _running    = true;
+    }
+    return;
+  }
+
+  ahrs_get_quaternion(&imu_get()->ahrs, q);
+  alt_est_predict(&_est, q, accel_body, 1.0f / ACCELGYRO_SAMPLE_FREQ);
+
+  if(_baro_seen != baroSampleCount)
+  {
+    // stamped a little after this sample when the FIFO was read late
+    delay = (int32_t)(accel_gyro_msec - baroSampleMsec);
+
+    alt_est_correct(&_est, baroAltitude / 100.0f, delay > 0 ? (uint32_t)delay : 0,
+        (accel_gyro_msec - _baro_msec) / 1000.0f);
+
+    _baro_seen = baroSampleCount;
+    _baro_msec = accel_gyro_msec;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// public interfaces
+//
+////////////////////////////////////////////////////////////////////////////////
+void
+altitude_init(void)
+{
+  _running = false;
+  memset(&_est, 0, sizeof(_est));
+
+  accelgyro_add_sample_callback(altitude_sample_callback);
+}
+
+bool
+altitude_is_running(void)
+{
+  return _running;
+}
+
+//
+// meter above the baro ground reference
+//
+float
+altitude_get(void)
+{
+  return _est.alt;
+}
+
+//
+// m/s, up positive
+//
+float
+altitude_get_climb(void)
+{
+  return _est.vel;
+}
+
+alt_est_t*
+altitude_get_est(void)
+{
+  return &_est;
+}
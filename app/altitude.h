@@ -0,0 +1,13 @@
+#ifndef __ALTITUDE_DEF_H__
+#define __ALTITUDE_DEF_H__
+
+#include "app_common.h"
+#include "alt_est.h"
+
+extern void altitude_init(void);
+extern bool altitude_is_running(void);
+extern float altitude_get(void);
+extern float altitude_get_climb(void);
+extern alt_est_t* altitude_get_est(void);
+
+#endif /* !__ALTITUDE_DEF_H__ */
@@ -6,16 +6,60 @@
 #include "mainloop_timer.h"
 #include "blinky.h"
 #include "motor.h"
+#include "spi_bus.h"
 #include "accelgyro.h"
 #include "magneto.h"
 #include "micros.h"
 #include "imu.h"
+#include "ins.h"
+#include "altitude.h"
 #include "rx.h"
 #include "baro.h"
 #include "gps.h"
 #include "flight.h"
 #include "config.h"
+#include "cycle_counter.h"
 
+//
+// devices come up through their own timer driven state machines and
+// overlap. this only watches for the milestones.
+//
+#define APP_BOOT_POLL_INTERVAL      10        // msec
+
+static SoftTimerElem      _boot_timer;
+
+app_boot_stat_t           app_boot_stat;
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// private utilities
+//
+////////////////////////////////////////////////////////////////////////////////
+static void
+app_boot_timer_callback(SoftTimerElem* te)
+{
+  if(app_boot_stat.sensors_ready == 0 &&
+     imu_is_ready() && baroSampleCount != 0)
+  {
+    app_boot_stat.sensors_ready = __msec;
+  }
+
+  if(app_boot_stat.armable == 0 && flight_is_arming_ready())
+  {
+    app_boot_stat.armable = __msec;
+  }
+
+  if(app_boot_stat.sensors_ready == 0 || app_boot_stat.armable == 0)
+  {
+    mainloop_timer_schedule(&_boot_timer, APP_BOOT_POLL_INTERVAL);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// public interfaces
+//
+////////////////////////////////////////////////////////////////////////////////
 void
 app_init_f(void)
 {
@@ -29,6 +73,7 @@ app_init(void)
   config_init();
   blinky_init();
   micros_init();
+  cycle_counter_init();
 }
 
 void
@@ -36,6 +81,15 @@ app_start(void)
 {
   motor_init();
 
+  spi_bus_init();
+
+  //
+  // none of these block. GPS first so the baud probe starts right away,
+  // MPU6000 and MS5611 reset waits run in parallel after
+  //
+  rx_init();
+  gps_init();
+
   accelgyro_init(sensor_align_cw_180, sensor_align_cw_180);
   accelgyro_start();
 
@@ -45,13 +99,16 @@ app_start(void)
   baro_init();
   baro_start();
 
-  rx_init();
-  gps_init();
-
   imu_init();
+  ins_init();
+  altitude_init();
 
   flight_init();
 
+  soft_timer_init_elem(&_boot_timer);
+  _boot_timer.cb = app_boot_timer_callback;
+  mainloop_timer_schedule(&_boot_timer, APP_BOOT_POLL_INTERVAL);
+
   __disable_irq();
   shell_init();
   __enable_irq();
@@ -1,6 +1,19 @@
 #ifndef __APP_DEF_H__
 #define __APP_DEF_H__
 
+#include "app_common.h"
+
+//
+// msec from reset. 0 until reached
+//
+typedef struct
+{
+  uint32_t    sensors_ready;    // IMU aligned and baro calibrated
+  uint32_t    armable;          // arming checks pass
+} app_boot_stat_t;
+
+extern app_boot_stat_t    app_boot_stat;
+
 extern void app_init_f(void);
 extern void app_init(void);
 extern void app_start(void);
@@ -2,13 +2,38 @@
 #include "baro.h"
 #include "ms5611.h"
 #include "mainloop_timer.h"
+#include "micros.h"
+#include "math_helper.h"
 
-#define BARO_PRESSURE_SAMPLE_TIME         10
-#define BARO_TEMPERATURE_SAMPLE_TIME      10
-#define BARO_CALIBRATE_SAMPLE_COUNT       50*3      // 1 sample per 20ms. 3 sec
+//
+// conversions run back to back. the result of one is read and the next
+// one started in the same tick, so the ADC is never idle. temperature
+// moves over seconds and is only converted once every
+// BARO_TEMPERATURE_DECIMATION pressure conversions, at a lower OSR.
+//
+// with 4096/1024 that is 10 pressure samples per 103ms, about 97Hz,
+// against 50Hz when pressure and temperature alternated.
+//
+#define BARO_PRESSURE_OSR                 CMD_ADC_4096
+#define BARO_TEMPERATURE_OSR              CMD_ADC_1024
+#define BARO_TEMPERATURE_DECIMATION       10
+
+//
+// pre-filter. median of the last 3 pressures rejects single sample
+// spikes at the cost of one sample period. a first order low pass
+// follows if BARO_LPF_CUTOFF is non zero. each sample carries the
+// midpoint of its conversion, moved back by the low pass group delay,
+// so consumers can compensate the total latency.
+//
+#define BARO_MEDIAN_FILTER                1
+#define BARO_LPF_CUTOFF                   0         // Hz. 0 off
+
+#define BARO_CALIBRATE_SAMPLE_COUNT       90*3      // ~90 samples per sec. 3 sec
 
 typedef enum
 {
+  baro_op_state_resetting,
+  baro_op_state_idle,
   baro_op_state_reading_pressure,
   baro_op_state_reading_temperature,
 } baro_op_state_t;
@@ -21,6 +46,15 @@ typedef enum
 static ms5611_t           _ms5611;
 static baro_op_state_t    _baro_state;
 static SoftTimerElem      _sample_timer;
+static bool               _start_pending;
+static uint32_t           _conv_usec;           // start of the conversion in progress
+static uint8_t            _press_count;         // pressure conversions since temperature
+
+static int32_t            _med_press[3];
+static uint32_t           _med_usec[3];
+static uint8_t            _med_count;
+static float              _lpf_press;
+static bool               _lpf_valid;
 static bool               _cal_in_prog;
 static uint32_t           _cal_sample_count;
 
@@ -34,6 +68,8 @@ int32_t     baroTemperature;                    // divide by 100
 float       baroGroundPressure = 101325.0f;     // in pascal
 float       baroGroundAltitude = 0.0f;          // cm
 int32_t     baroAltitude = 0;                   // cm
+uint32_t    baroSampleCount = 0;
+uint32_t    baroSampleMsec  = 0;
 
 ////////////////////////////////////////////////////////////////////////////////
 //
@@ -70,10 +106,77 @@ baro_calibrate(void)
   }
 }
 
+//
+// oldest first. returns the index of the middle value
+//
+static inline int
+baro_median3(const int32_t v[3])
+{
+  if((v[0] <= v[1] && v[1] <= v[2]) || (v[2] <= v[1] && v[1] <= v[0]))
+  {
+    return 1;
+  }
+  if((v[1] <= v[0] && v[0] <= v[2]) || (v[2] <= v[0] && v[0] <= v[1]))
+  {
+    return 0;
+  }
+  return 2;
+}
+
+//
+// usec is the midpoint of the pressure conversion
+//
 static void
-baro_update(void)
+baro_update(uint32_t usec)
 {
-  ms5611_calc(&_ms5611, &baroPressure, &baroTemperature);
+  int32_t   press;
+  uint32_t  delay = 0;
+
+  ms5611_calc(&_ms5611, &press, &baroTemperature);
+
+#if BARO_MEDIAN_FILTER == 1
+  _med_press[0] = _med_press[1];
+  _med_press[1] = _med_press[2];
+  _med_press[2] = press;
+  _med_usec[0]  = _med_usec[1];
+  _med_usec[1]  = _med_usec[2];
+  _med_usec[2]  = usec;
+
+  if(_med_count < 3)
+  {
+    _med_count++;
+  }
+  else
+  {
+    int   m = baro_median3(_med_press);
+
+    press = _med_press[m];
+    usec  = _med_usec[m];
+  }
+#endif
+
+#if BARO_LPF_CUTOFF != 0
+  {
+    const float   dt    = (BARO_TEMPERATURE_DECIMATION * ms5611_conv_time(BARO_PRESSURE_OSR) +
+                           ms5611_conv_time(BARO_TEMPERATURE_OSR)) /
+                          (BARO_TEMPERATURE_DECIMATION * 1000000.0f),
+                  tau   = 1.0f / (2.0f * M_PIf * BARO_LPF_CUTOFF),
+                  alpha = dt / (tau + dt);
+
+    if(!_lpf_valid)
+    {
+      _lpf_press = press;
+      _lpf_valid = true;
+    }
+    _lpf_press += alpha * (press - _lpf_press);
+
+    press = (int32_t)_lpf_press;
+    delay = (uint32_t)((1.0f - alpha) / alpha * dt * 1000000.0f);
+  }
+#endif
+
+  baroPressure    = press;
+  baroSampleMsec  = __msec - (micros_get() - usec + delay) / 1000;
 
   if(_cal_in_prog)
   {
@@ -82,6 +185,7 @@ baro_update(void)
   else
   {
     baroAltitude = pressureToAltitude(baroPressure) - baroGroundAltitude;
+    baroSampleCount++;
   }
 }
 
@@ -90,29 +194,84 @@ baro_update(void)
 // baro sampling
 //
 ////////////////////////////////////////////////////////////////////////////////
+static void
+baro_conversion_start(baro_op_state_t state)
+{
+  uint8_t   osr;
+
+  _baro_state = state;
+  if(state == baro_op_state_reading_pressure)
+  {
+    osr = BARO_PRESSURE_OSR;
+    ms5611_start_read_pressure(&_ms5611, osr);
+  }
+  else
+  {
+    osr = BARO_TEMPERATURE_OSR;
+    ms5611_start_read_temp(&_ms5611, osr);
+  }
+  _conv_usec = micros_get();
+
+  mainloop_timer_schedule(&_sample_timer, (ms5611_conv_time(osr) + 999) / 1000);
+}
+
+static void
+baro_sampling_start(void)
+{
+  //
+  // temperature first so the first pressure has its compensation
+  //
+  _press_count  = 0;
+  _med_count    = 0;
+  _lpf_valid    = false;
+  baro_conversion_start(baro_op_state_reading_temperature);
+
+  _cal_in_prog = true;
+  _cal_sample_count = 0;
+}
+
 static void
 baro_sample_timeout(SoftTimerElem* te)
 {
+  uint32_t  usec;
+
   switch(_baro_state)
   {
+  case baro_op_state_resetting:
+    ms5611_read_prom(&_ms5611);
+
+    _baro_state = baro_op_state_idle;
+    if(_start_pending)
+    {
+      _start_pending = false;
+      baro_sampling_start();
+    }
+    break;
+
+  case baro_op_state_idle:
+    break;
+
   case baro_op_state_reading_pressure:
     ms5611_read_pressure(&_ms5611);
+    usec = _conv_usec + ms5611_conv_time(BARO_PRESSURE_OSR) / 2;
 
-    _baro_state = baro_op_state_reading_temperature;
+    _press_count++;
+    if(_press_count >= BARO_TEMPERATURE_DECIMATION)
+    {
+      _press_count = 0;
+      baro_conversion_start(baro_op_state_reading_temperature);
+    }
+    else
+    {
+      baro_conversion_start(baro_op_state_reading_pressure);
+    }
 
-    mainloop_timer_schedule(&_sample_timer, BARO_TEMPERATURE_SAMPLE_TIME);
-    ms5611_start_read_temp(&_ms5611);
+    baro_update(usec);
     break;
 
   case baro_op_state_reading_temperature:
     ms5611_read_temp(&_ms5611);
-
-    _baro_state = baro_op_state_reading_pressure;
-    mainloop_timer_schedule(&_sample_timer, BARO_PRESSURE_SAMPLE_TIME);
-
-    ms5611_start_read_pressure(&_ms5611);
-
-    baro_update();
+    baro_conversion_start(baro_op_state_reading_pressure);
     break;
   }
 }
@@ -122,30 +281,40 @@ baro_sample_timeout(SoftTimerElem* te)
 // public interfaces
 //
 ////////////////////////////////////////////////////////////////////////////////
+//
+// the reset wait runs on the sample timer, nothing blocks
+//
 void
 baro_init(void)
 {
-  _baro_state = baro_op_state_reading_pressure;
-  ms5611_init(&_ms5611);
-
   soft_timer_init_elem(&_sample_timer);
   _sample_timer.cb    = baro_sample_timeout;
+
+  _start_pending = false;
+  _baro_state    = baro_op_state_resetting;
+
+  ms5611_init(&_ms5611);
+  mainloop_timer_schedule(&_sample_timer, MS5611_RESET_TIME);
 }
 
 void
 baro_start(void)
 {
-  _baro_state = baro_op_state_reading_pressure;
-
-  mainloop_timer_schedule(&_sample_timer, BARO_PRESSURE_SAMPLE_TIME);
-  ms5611_start_read_pressure(&_ms5611);
-
-  _cal_in_prog = true;
-  _cal_sample_count = 0;
+  if(_baro_state == baro_op_state_resetting)
+  {
+    _start_pending = true;
+    return;
+  }
+  baro_sampling_start();
 }
 
 void
 baro_stop(void)
 {
-  mainloop_timer_cancel(&_sample_timer);
+  _start_pending = false;
+  if(_baro_state != baro_op_state_resetting)
+  {
+    _baro_state = baro_op_state_idle;
+    mainloop_timer_cancel(&_sample_timer);
+  }
 }
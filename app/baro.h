@@ -12,5 +12,7 @@ extern int32_t     baroTemperature;
 extern float       baroGroundPressure;
 extern float       baroGroundAltitude;
 extern int32_t     baroAltitude;
+extern uint32_t    baroSampleCount;     // bumped on every new altitude after calibration
+extern uint32_t    baroSampleMsec;      // __msec the current pressure describes
 
 #endif /* !__BARO_DEF_H__ */
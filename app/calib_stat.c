@@ -0,0 +1,131 @@
+#include <math.h>
+#include "calib_stat.h"
+
+//
+// deviation check needs a settled mean first
+//
+#define CALIB_STAT_DEV_MIN_N        16
+
+//
+// samples per batch mean. several times the correlation length of the
+// sensor low pass
+//
+#define CALIB_STAT_BATCH            16
+
+//
+// two sided 95%, squared
+//
+#define CALIB_STAT_Z2               (1.96f * 1.96f)
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// private utilities
+//
+////////////////////////////////////////////////////////////////////////////////
+static void
+calib_stat_batch_push(calib_stat_t* c, const float x[3])
+{
+  float   m[3];
+
+  for(int i = 0; i < 3; i++)
+  {
+    c->batch_sum[i] += x[i];
+  }
+
+  if(++c->batch_n < CALIB_STAT_BATCH)
+  {
+    return;
+  }
+
+  for(int i = 0; i < 3; i++)
+  {
+    m[i] = c->batch_sum[i] / CALIB_STAT_BATCH;
+    c->batch_sum[i] = 0.0f;
+  }
+  c->batch_n = 0;
+
+  welford3_push(&c->batch, m);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// public interfaces
+//
+////////////////////////////////////////////////////////////////////////////////
+void
+calib_stat_init(calib_stat_t* c, float tol, float max_std, float max_dev,
+    uint32_t min_n, uint32_t max_n)
+{
+  c->tol      = tol;
+  c->max_std  = max_std;
+  c->max_dev  = max_dev;
+  c->min_n    = min_n;
+  c->max_n    = max_n;
+
+  calib_stat_reset(c);
+}
+
+void
+calib_stat_reset(calib_stat_t* c)
+{
+  welford3_reset(&c->w);
+  welford3_reset(&c->batch);
+
+  for(int i = 0; i < 3; i++)
+  {
+    c->batch_sum[i] = 0.0f;
+  }
+  c->batch_n = 0;
+}
+
+calib_stat_result_t
+calib_stat_push(calib_stat_t* c, const int16_t raw[3])
+{
+  const float   x[3] = { raw[0], raw[1], raw[2] };
+  bool          converged = true;
+  float         var;
+
+  if(c->w.n >= CALIB_STAT_DEV_MIN_N)
+  {
+    for(int i = 0; i < 3; i++)
+    {
+      if(fabsf(x[i] - c->w.mean[i]) > c->max_dev)
+      {
+        return calib_stat_motion;
+      }
+    }
+  }
+
+  welford3_push(&c->w, x);
+  calib_stat_batch_push(c, x);
+
+  if(c->w.n < c->min_n)
+  {
+    return calib_stat_running;
+  }
+
+  //
+  // half width = 1.96 * std / sqrt(n) with std and n of the batch
+  // means. compared squared
+  //
+  for(int i = 0; i < 3; i++)
+  {
+    var = welford3_var(&c->w, i);
+
+    if(var > c->max_std * c->max_std)
+    {
+      return calib_stat_motion;
+    }
+
+    if(CALIB_STAT_Z2 * welford3_var(&c->batch, i) > c->tol * c->tol * c->batch.n)
+    {
+      converged = false;
+    }
+  }
+
+  if(converged || c->w.n >= c->max_n)
+  {
+    return calib_stat_done;
+  }
+  return calib_stat_running;
+}
@@ -0,0 +1,85 @@
+#ifndef __CALIB_STAT_DEF_H__
+#define __CALIB_STAT_DEF_H__
+
+#include "app_common.h"
+
+//
+// running mean/variance of a 3 axis sensor held still.
+//
+// Welford update keeps the mean and the sum of squared deviations
+// instead of raw sums, so precision does not degrade as samples pile up.
+//
+// sampling stops as soon as the 95% confidence half width of the mean
+// is below tol on every axis. a sample far from the running mean or too
+// much spread means the board is being moved.
+//
+// sensor noise is low passed so neighbouring samples are correlated and
+// the sample variance over n understates the error of the mean. the
+// confidence is taken from the spread of means over short batches
+// instead, which carries that correlation.
+//
+typedef struct
+{
+  uint32_t    n;
+  float       mean[3];
+  float       m2[3];
+} welford3_t;
+
+typedef enum
+{
+  calib_stat_running = 0,
+  calib_stat_done,
+  calib_stat_motion,
+} calib_stat_result_t;
+
+typedef struct
+{
+  welford3_t  w;
+  welford3_t  batch;        // of batch means
+  float       batch_sum[3];
+  uint32_t    batch_n;
+
+  float       tol;          // confidence half width to stop at
+  float       max_std;      // more spread than this is motion
+  float       max_dev;      // a sample farther than this from the mean is motion
+  uint32_t    min_n;
+  uint32_t    max_n;        // done anyway at this count
+} calib_stat_t;
+
+static inline void
+welford3_reset(welford3_t* w)
+{
+  w->n = 0;
+  for(int i = 0; i < 3; i++)
+  {
+    w->mean[i] = 0.0f;
+    w->m2[i]   = 0.0f;
+  }
+}
+
+static inline void
+welford3_push(welford3_t* w, const float x[3])
+{
+  float   d;
+
+  w->n++;
+  for(int i = 0; i < 3; i++)
+  {
+    d           = x[i] - w->mean[i];
+    w->mean[i] += d / w->n;
+    w->m2[i]   += d * (x[i] - w->mean[i]);
+  }
+}
+
+static inline float
+welford3_var(const welford3_t* w, int axis)
+{
+  return w->n > 1 ? w->m2[axis] / (w->n - 1) : 0.0f;
+}
+
+extern void calib_stat_init(calib_stat_t* c, float tol, float max_std, float max_dev,
+    uint32_t min_n, uint32_t max_n);
+extern void calib_stat_reset(calib_stat_t* c);
+extern calib_stat_result_t calib_stat_push(calib_stat_t* c, const int16_t raw[3]);
+
+#endif /* !__CALIB_STAT_DEF_H__ */
@@ -0,0 +1,95 @@
+#include <math.h>
+#include "app_common.h"
+#include "math_helper.h"
+#include "ahrs_common.h"
+#include "complementary.h"
+
+#define Q0    cf->q[0]
+#define Q1    cf->q[1]
+#define Q2    cf->q[2]
+#define Q3    cf->q[3]
+
+//
+// gyro integration blended with accel tilt at a fixed time constant.
+//
+// this is the cheapest of the engines. no bias estimate and accel is not
+// normalised. the gate works on |a|^2 and inside the gate |a| is within
+// 10% of 1G, which only changes the blend rate by as much.
+//
+#define COMPLEMENTARY_TAU     1.0f      // sec
+
+#define COMPLEMENTARY_GATE_LO2  ((1.0f - AHRS_ACC_GATE_LO) * (1.0f - AHRS_ACC_GATE_LO))
+#define COMPLEMENTARY_GATE_HI2  ((1.0f + AHRS_ACC_GATE_LO) * (1.0f + AHRS_ACC_GATE_LO))
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// public interfaces
+//
+////////////////////////////////////////////////////////////////////////////////
+void
+complementary_init(complementary_t* cf, float sample_freq)
+{
+  cf->invSampleFreq = 1.0f / sample_freq;
+  cf->k             = 1.0f / COMPLEMENTARY_TAU;
+  cf->accWeight     = 1.0f;
+
+  Q0    = 1.0f;
+  Q1    = 0.0f;
+  Q2    = 0.0f;
+  Q3    = 0.0f;
+}
+
+void
+complementary_updateIMU(complementary_t* cf,
+                        float gx, float gy, float gz,
+                        float ax, float ay, float az)
+{
+  float n2, recipNorm;
+  float vx, vy, vz;
+  float qa, qb, qc;
+
+  // Convert gyroscope degrees/sec to radians/sec
+  gx *= 0.0174533f;
+  gy *= 0.0174533f;
+  gz *= 0.0174533f;
+
+  n2 = ax * ax + ay * ay + az * az;
+
+  if(n2 > COMPLEMENTARY_GATE_LO2 && n2 < COMPLEMENTARY_GATE_HI2)
+  {
+    cf->accWeight = 1.0f;
+
+    // Estimated direction of gravity
+    vx = 2.0f * (Q1 * Q3 - Q0 * Q2);
+    vy = 2.0f * (Q0 * Q1 + Q2 * Q3);
+    vz = Q0 * Q0 - Q1 * Q1 - Q2 * Q2 + Q3 * Q3;
+
+    // turn towards measured gravity
+    gx += cf->k * (ay * vz - az * vy);
+    gy += cf->k * (az * vx - ax * vz);
+    gz += cf->k * (ax * vy - ay * vx);
+  }
+  else
+  {
+    cf->accWeight = 0.0f;
+  }
+
+  // Integrate rate of change of quaternion
+  gx *= (0.5f * cf->invSampleFreq);
+  gy *= (0.5f * cf->invSampleFreq);
+  gz *= (0.5f * cf->invSampleFreq);
+  qa = Q0;
+  qb = Q1;
+  qc = Q2;
+  Q0 += (-qb * gx - qc * gy - Q3 * gz);
+  Q1 += (qa * gx + qc * gz - Q3 * gy);
+  Q2 += (qa * gy - qb * gz + Q3 * gx);
+  Q3 += (qa * gz + qb * gy - qc * gx);
+
+  // Normalise quaternion
+  recipNorm = math_rsqrtf(Q0 * Q0 + Q1 * Q1 + Q2 * Q2 + Q3 * Q3);
+  Q0 *= recipNorm;
+  Q1 *= recipNorm;
+  Q2 *= recipNorm;
+  Q3 *= recipNorm;
+}
@@ -0,0 +1,17 @@
+#ifndef __COMPLEMENTARY_DEF_H__
+#define __COMPLEMENTARY_DEF_H__
+
+typedef struct
+{
+  float invSampleFreq;
+  float k;            // accel blend in rad/s per unit error. 1/time constant
+  float accWeight;    // accel trust of the last update. 0..1
+  float q[4];
+} complementary_t;
+
+extern void complementary_init(complementary_t* cf, float sample_freq);
+extern void complementary_updateIMU(complementary_t* cf,
+                                    float gx, float gy, float gz,
+                                    float ax, float ay, float az);
+
+#endif //!__COMPLEMENTARY_DEF_H__
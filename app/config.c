@@ -3,11 +3,14 @@
 #include "stm32f4xx_hal.h"
 #include "stm32f4xx_hal_flash.h"
 #include "config.h"
+#include "pwm.h"
+#include "ahrs.h"
+#include "mem_section.h"
 
 #define CONFIG_START_ADDR         0x080E0000
 #define CONFIG_END_ADDR           (0x080E0000 + 128*1024)
 
-config_internal_t    _config =
+CCM_DATA config_internal_t    _config =
 {
   .cfg = 
   {
@@ -19,6 +22,7 @@ config_internal_t    _config =
     .mag_scale[0]       = 1.0f,
     .mag_scale[1]       = 1.0f,
     .mag_scale[2]       = 1.0f,
+    .mag_soft           = { 1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f },
     .accel_gain[0]      = 4096,
     .accel_gain[1]      = 4096,
     .accel_gain[2]      = 4096,
@@ -28,27 +32,70 @@ config_internal_t    _config =
     .gyro_offset[0]     = 0,
     .gyro_offset[1]     = 0,
     .gyro_offset[2]     = 0,
+    .gyro_offset_temp   = 250,
 
     .mag_decl           = 0,
-
-    .roll_kX[0]         = 1.0f,
-    .roll_kX[1]         = 1.0f,
-    .roll_kX[2]         = 1.0f,
-    .pitch_kX[0]        = 1.0f,
-    .pitch_kX[1]        = 1.0f,
-    .pitch_kX[2]        = 1.0f,
-    .yaw_kX[0]          = 1.0f,
-    .yaw_kX[1]          = 1.0f,
-    .yaw_kX[2]          = 1.0f,
+    .board_align        = { 0, 0, 0 },
+    .ahrs_type          = AHRS_DEFAULT,
+
+    .roll_kX[PID_KP]    = 1.0f,
+    .roll_kX[PID_KI]    = 0.5f,
+    .roll_kX[PID_KD]    = 0.005f,
+    .roll_kX[PID_KFF]   = 0.0f,
+    .pitch_kX[PID_KP]   = 1.0f,
+    .pitch_kX[PID_KI]   = 0.5f,
+    .pitch_kX[PID_KD]   = 0.005f,
+    .pitch_kX[PID_KFF]  = 0.0f,
+    .yaw_kX[PID_KP]     = 2.0f,
+    .yaw_kX[PID_KI]     = 1.0f,
+    .yaw_kX[PID_KD]     = 0.0f,
+    .yaw_kX[PID_KFF]    = 0.0f,
+    .angle_kp[0]        = 4.0f,
+    .angle_kp[1]        = 4.0f,
 
     .roll_max           = 200,        // 20 degree
     .pitch_max          = 200,        // 20 degree
     .yaw_rate_max       = 100,        // 10 degree per sec
+    .angle_rate_max     = 2000,       // 200 degree per sec
+
+    .pid_i_limit        = 200,
+    .pid_out_limit      = 500,
+    .dterm_lpf_type     = filter_type_pt1,
+    .dterm_lpf_hz       = 100,
+    .iterm_relax        = 40,         // 40 degree per sec
+    .angle_loop_div     = 2,          // 500Hz angle loop
 
+    .motor_protocol     = pwm_protocol_pwm,
     .motor_min          = 1000,
     .motor_max          = 2000,
 
     .min_flight_throttle  = 1150,
+
+    .mixer              =
+    {
+      .num_motors       = 4,
+      .coeff            =
+      {
+        //  throttle  roll    pitch   yaw     quad X
+        {   1.0f,    -1.0f,  -1.0f,   1.0f  },
+        {   1.0f,    -1.0f,   1.0f,  -1.0f  },
+        {   1.0f,     1.0f,  -1.0f,  -1.0f  },
+        {   1.0f,     1.0f,   1.0f,   1.0f  },
+      },
+    },
+
+    .gyro_filter[0]     = { .type = filter_type_pt1,  .hz = 120, .cutoff = 0 },
+    .gyro_filter[1]     = { .type = filter_type_none, .hz = 0,   .cutoff = 0 },
+    .gyro_filter[2]     = { .type = filter_type_none, .hz = 0,   .cutoff = 0 },
+
+    .dyn_notch_peaks    = 1,
+    .dyn_notch_min_hz   = 80,
+    .dyn_notch_max_hz   = 230,
+    .dyn_notch_q        = 350,
+
+    .gps_profile        = gps_profile_legacy,
+    .gps_rate_hz        = 10,
+    .gps_aid            = { .valid = false },
     
     .rx_cmd_ndx[RX_CMD_ROLL]        = 0,
     .rx_cmd_ndx[RX_CMD_PITCH]       = 1,
@@ -126,6 +173,11 @@ is_flash_config_valid(void)
     return false;
   }
 
+  if(flash_cfg->cfg.version != CONFIG_VERSION)
+  {
+    return false;
+  }
+
   crc = calcCRC(0, (const void*)flash_cfg, sizeof(config_t));
 
   if(flash_cfg->crc != crc)
@@ -4,8 +4,12 @@
 #include "app_common.h"
 #include "rx.h"
 #include "motor.h"
+#include "pid.h"
+#include "mixer.h"
+#include "gyro_tcomp.h"
+#include "gps.h"
 
-#define CONFIG_VERSION          1
+#define CONFIG_VERSION          12
 #define CONFIG_MAGIC            0x63149654
 
 typedef struct
@@ -17,23 +21,51 @@ typedef struct
   // calibration parameters
   int16_t     mag_offset[3];
   float       mag_scale[3];
+  float       mag_soft[6];      // soft iron. xx yy zz xy xz yz
   int16_t     accel_gain[3];
   int16_t     accel_offset[3];
   int16_t     gyro_offset[3];
+  int16_t     gyro_offset_temp; // gyro temperature at which gyro_offset was taken. decidegree
+  gyro_tcomp_table_t  gyro_tc;  // gyro bias against temperature
   int16_t     mag_decl;
+  int16_t     board_align[3];   // board roll/pitch/yaw on airframe in decidegree
+  uint8_t     ahrs_type;        // ahrs_type_t
 
-  float       roll_kX[3];     // KP/KI/KD for roll
-  float       pitch_kX[3];    // KP/KI/KD for pitch
-  float       yaw_kX[3];      // KP/KI/KD for yaw
+  float       roll_kX[PID_K_NUM];     // KP/KI/KD/KFF for roll rate
+  float       pitch_kX[PID_K_NUM];    // KP/KI/KD/KFF for pitch rate
+  float       yaw_kX[PID_K_NUM];      // KP/KI/KD/KFF for yaw rate
+  float       angle_kp[2];            // roll/pitch angle loop P. dps per degree
 
   int16_t     roll_max;       // max roll angle in decidegree
   int16_t     pitch_max;      // max pitch angle in decidegree
   int16_t     yaw_rate_max;   // max yaw rate in decidegree per sec
+  int16_t     angle_rate_max; // max roll/pitch rate from angle loop in decidegree per sec
 
+  uint16_t    pid_i_limit;    // I term limit in motor unit
+  uint16_t    pid_out_limit;  // PID output limit in motor unit
+  uint8_t     dterm_lpf_type; // filter_type_t for D term
+  uint16_t    dterm_lpf_hz;   // D term low pass cutoff. 0 disables
+  uint16_t    iterm_relax;    // setpoint deviation in dps that stops I accumulation. 0 disables
+  uint8_t     angle_loop_div; // angle loop runs every N rate loop
+
+  uint8_t     motor_protocol; // pwm_protocol_t. applied on reboot
   uint16_t    motor_min;
   uint16_t    motor_max;
   uint16_t    min_flight_throttle;
 
+  mixer_config_t  mixer;      // motor mixing table
+
+  filter_config_t gyro_filter[FILTER_CHAIN_MAX];   // gyro filter stages in order
+
+  uint8_t     dyn_notch_peaks;    // number of tracked peaks per axis. 0 disables
+  uint16_t    dyn_notch_min_hz;
+  uint16_t    dyn_notch_max_hz;
+  uint16_t    dyn_notch_q;        // notch Q * 100
+
+  uint8_t     gps_profile;    // gps_profile_t
+  uint8_t     gps_rate_hz;    // navigation rate of gps_profile_pvt
+  gps_aid_t   gps_aid;        // last good fix. kept by the next save
+
   uint8_t     rx_cmd_ndx[RX_MAX_CHANNELS];
   uint8_t     motor_ndx[MOTOR_MAX_NUM];
 } config_t;
@@ -0,0 +1,24 @@
+#ifndef __CYCLE_COUNTER_DEF_H__
+#define __CYCLE_COUNTER_DEF_H__
+
+#include "app_common.h"
+
+//
+// DWT cycle counter for measuring code cost.
+// 168 cycles per micro second
+//
+static inline void
+cycle_counter_init(void)
+{
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+static inline uint32_t
+cycle_counter_get(void)
+{
+  return DWT->CYCCNT;
+}
+
+#endif /* !__CYCLE_COUNTER_DEF_H__ */
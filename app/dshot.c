@@ -0,0 +1,271 @@
+#include "stm32f4xx_hal.h"
+#include "main.h"
+#include "tim.h"
+#include "dshot.h"
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// DShot output through timer DMA burst.
+//
+// the two outputs of each timer are written by one DMA stream driven by
+// the timer update event. DMAR burst writes both CCRs every bit period so
+// a whole timer worth of motors is sent by a single stream.
+//
+// PA3(PWM3) is TIM9_CH2 in PWM mode but TIM9 has no DMA request.
+// it is remapped to TIM2_CH4 which pairs with TIM2_CH3 on PA2.
+//
+// TIM2_UP    : DMA1 Stream1 Channel3
+// TIM3_UP    : DMA1 Stream2 Channel5
+// TIM5_UP    : DMA1 Stream0 Channel6
+//
+////////////////////////////////////////////////////////////////////////////////
+#define DSHOT_CHNLS_PER_TIMER         2
+#define DSHOT_DMA_LENGTH              (DSHOT_FRAME_SLOTS * DSHOT_CHNLS_PER_TIMER)
+#define DSHOT_NUM_CHNLS               6
+
+typedef struct
+{
+  TIM_HandleTypeDef*    htim;
+  uint32_t              tim_chnl[DSHOT_CHNLS_PER_TIMER];
+  uint32_t              burst_base;
+  DMA_Stream_TypeDef*   dma_stream;
+  uint32_t              dma_chnl;
+  DMA_HandleTypeDef     hdma;
+  uint32_t              buffer[DSHOT_DMA_LENGTH];
+} dshot_timer_t;
+
+typedef struct
+{
+  uint8_t               timer;
+  uint8_t               slot;
+  GPIO_TypeDef*         port;
+  uint16_t              pin;
+  uint8_t               af;
+} dshot_channel_t;
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// module privates
+//
+////////////////////////////////////////////////////////////////////////////////
+extern TIM_HandleTypeDef htim2;
+extern TIM_HandleTypeDef htim3;
+extern TIM_HandleTypeDef htim5;
+extern TIM_HandleTypeDef htim9;
+
+static dshot_timer_t    _dshot_timers[] =
+{
+  {
+    .htim       = &htim2,
+    .tim_chnl   = { TIM_CHANNEL_3, TIM_CHANNEL_4 },
+    .burst_base = TIM_DMABASE_CCR3,
+    .dma_stream = DMA1_Stream1,
+    .dma_chnl   = DMA_CHANNEL_3,
+  },
+  {
+    .htim       = &htim3,
+    .tim_chnl   = { TIM_CHANNEL_3, TIM_CHANNEL_4 },
+    .burst_base = TIM_DMABASE_CCR3,
+    .dma_stream = DMA1_Stream2,
+    .dma_chnl   = DMA_CHANNEL_5,
+  },
+  {
+    .htim       = &htim5,
+    .tim_chnl   = { TIM_CHANNEL_1, TIM_CHANNEL_2 },
+    .burst_base = TIM_DMABASE_CCR1,
+    .dma_stream = DMA1_Stream0,
+    .dma_chnl   = DMA_CHANNEL_6,
+  },
+};
+
+//
+// same order as _pwm_chnls in pwm.c
+//
+static const dshot_channel_t  _dshot_chnls[DSHOT_NUM_CHNLS] =
+{
+  { 1, 0, PWM1_GPIO_Port, PWM1_Pin, GPIO_AF2_TIM3 },    // TIM3_CH3
+  { 1, 1, PWM2_GPIO_Port, PWM2_Pin, GPIO_AF2_TIM3 },    // TIM3_CH4
+  { 0, 1, PWM3_GPIO_Port, PWM3_Pin, GPIO_AF1_TIM2 },    // TIM2_CH4. remapped from TIM9_CH2
+  { 0, 0, PWM4_GPIO_Port, PWM4_Pin, GPIO_AF1_TIM2 },    // TIM2_CH3
+  { 2, 1, PWM5_GPIO_Port, PWM5_Pin, GPIO_AF2_TIM5 },    // TIM5_CH2
+  { 2, 0, PWM6_GPIO_Port, PWM6_Pin, GPIO_AF2_TIM5 },    // TIM5_CH1
+};
+
+static uint16_t     _dshot_value[DSHOT_NUM_CHNLS];
+static uint32_t     _dshot_bit0;
+static uint32_t     _dshot_bit1;
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// private utilities
+//
+////////////////////////////////////////////////////////////////////////////////
+static void
+dshot_timer_init(dshot_timer_t* t, uint32_t period)
+{
+  TIM_OC_InitTypeDef    oc;
+
+  HAL_TIM_Base_Stop(t->htim);
+
+  t->htim->Init.Prescaler   = 0;
+  t->htim->Init.Period      = period - 1;
+  HAL_TIM_Base_Init(t->htim);
+  HAL_TIM_PWM_Init(t->htim);
+
+  oc.OCMode       = TIM_OCMODE_PWM1;
+  oc.Pulse        = 0;
+  oc.OCPolarity   = TIM_OCPOLARITY_HIGH;
+  oc.OCFastMode   = TIM_OCFAST_DISABLE;
+
+  for(int i = 0; i < DSHOT_CHNLS_PER_TIMER; i++)
+  {
+    // also sets CCR preload so a new bit takes effect on the next update
+    HAL_TIM_PWM_ConfigChannel(t->htim, &oc, t->tim_chnl[i]);
+  }
+
+  t->hdma.Instance                  = t->dma_stream;
+  t->hdma.Init.Channel              = t->dma_chnl;
+  t->hdma.Init.Direction            = DMA_MEMORY_TO_PERIPH;
+  t->hdma.Init.PeriphInc            = DMA_PINC_DISABLE;
+  t->hdma.Init.MemInc               = DMA_MINC_ENABLE;
+  t->hdma.Init.PeriphDataAlignment  = DMA_PDATAALIGN_WORD;
+  t->hdma.Init.MemDataAlignment     = DMA_MDATAALIGN_WORD;
+  t->hdma.Init.Mode                 = DMA_NORMAL;
+  t->hdma.Init.Priority             = DMA_PRIORITY_VERY_HIGH;
+  t->hdma.Init.FIFOMode             = DMA_FIFOMODE_DISABLE;
+  HAL_DMA_Init(&t->hdma);
+
+  t->dma_stream->PAR    = (uint32_t)&t->htim->Instance->DMAR;
+  t->htim->Instance->DCR = t->burst_base | TIM_DMABURSTLENGTH_2TRANSFERS;
+
+  for(int i = 0; i < DSHOT_CHNLS_PER_TIMER; i++)
+  {
+    TIM_CCxChannelCmd(t->htim->Instance, t->tim_chnl[i], TIM_CCx_ENABLE);
+  }
+}
+
+static inline bool
+dshot_dma_busy(void)
+{
+  for(int i = 0; i < NARRAY(_dshot_timers); i++)
+  {
+    if(_dshot_timers[i].dma_stream->CR & DMA_SxCR_EN)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+static inline void
+dshot_dma_arm(dshot_timer_t* t)
+{
+  DMA_HandleTypeDef*  hdma = &t->hdma;
+
+  t->htim->Instance->DIER &= ~TIM_DIER_UDE;
+
+  __HAL_DMA_CLEAR_FLAG(hdma,
+      __HAL_DMA_GET_TC_FLAG_INDEX(hdma) |
+      __HAL_DMA_GET_HT_FLAG_INDEX(hdma) |
+      __HAL_DMA_GET_TE_FLAG_INDEX(hdma) |
+      __HAL_DMA_GET_DME_FLAG_INDEX(hdma) |
+      __HAL_DMA_GET_FE_FLAG_INDEX(hdma));
+
+  t->dma_stream->M0AR = (uint32_t)t->buffer;
+  t->dma_stream->NDTR = DSHOT_DMA_LENGTH;
+  t->dma_stream->CR  |= DMA_SxCR_EN;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// public interfaces
+//
+////////////////////////////////////////////////////////////////////////////////
+void
+dshot_start(dshot_rate_t rate)
+{
+  static const uint32_t   bitrates[] = { 150000, 300000, 600000 };
+  GPIO_InitTypeDef        gpio;
+  uint32_t                period;
+
+  period      = DSHOT_TIMER_CLOCK / bitrates[rate];
+  _dshot_bit1 = period * 3 / 4;
+  _dshot_bit0 = period * 3 / 8;
+
+  __HAL_RCC_DMA1_CLK_ENABLE();
+
+  HAL_TIM_PWM_Stop(&htim9, TIM_CHANNEL_2);
+  HAL_TIM_Base_Stop(&htim9);
+
+  for(int i = 0; i < NARRAY(_dshot_timers); i++)
+  {
+    dshot_timer_init(&_dshot_timers[i], period);
+  }
+
+  gpio.Mode   = GPIO_MODE_AF_PP;
+  gpio.Pull   = GPIO_PULLDOWN;
+  gpio.Speed  = GPIO_SPEED_FREQ_HIGH;
+
+  for(int i = 0; i < DSHOT_NUM_CHNLS; i++)
+  {
+    gpio.Pin        = _dshot_chnls[i].pin;
+    gpio.Alternate  = _dshot_chnls[i].af;
+    HAL_GPIO_Init(_dshot_chnls[i].port, &gpio);
+
+    _dshot_value[i] = DSHOT_THROTTLE_STOP;
+  }
+
+  for(int i = 0; i < NARRAY(_dshot_timers); i++)
+  {
+    __HAL_TIM_SET_COUNTER(_dshot_timers[i].htim, 0);
+    HAL_TIM_Base_Start(_dshot_timers[i].htim);
+  }
+}
+
+void
+dshot_set(uint8_t chnl, uint16_t value)
+{
+  _dshot_value[chnl] = value > DSHOT_THROTTLE_MAX ? DSHOT_THROTTLE_MAX : value;
+}
+
+//
+// encode every channel and send all of them in one go.
+// a frame takes 30us at DShot600 and 120us at DShot150 so with a 1KHz
+// caller the previous burst is long done. if not, this round is dropped
+// rather than corrupting the frame on the wire.
+//
+void
+dshot_fire(void)
+{
+  const dshot_channel_t*  c;
+  dshot_timer_t*          t;
+
+  if(dshot_dma_busy())
+  {
+    return;
+  }
+
+  for(int i = 0; i < DSHOT_NUM_CHNLS; i++)
+  {
+    c = &_dshot_chnls[i];
+    t = &_dshot_timers[c->timer];
+
+    dshot_frame_to_pulses(dshot_encode_frame(_dshot_value[i], false),
+        &t->buffer[c->slot], DSHOT_CHNLS_PER_TIMER, _dshot_bit0, _dshot_bit1);
+  }
+
+  for(int i = 0; i < NARRAY(_dshot_timers); i++)
+  {
+    dshot_dma_arm(&_dshot_timers[i]);
+  }
+
+  //
+  // line the timers up and let the update events start pulling
+  //
+  for(int i = 0; i < NARRAY(_dshot_timers); i++)
+  {
+    t = &_dshot_timers[i];
+    __HAL_TIM_SET_COUNTER(t->htim, 0);
+    t->htim->Instance->DIER |= TIM_DIER_UDE;
+  }
+}
@@ -0,0 +1,92 @@
+#ifndef __DSHOT_DEF_H__
+#define __DSHOT_DEF_H__
+
+#include "app_common.h"
+
+//
+// DShot frame
+//
+// bit 15-5 : throttle value. 0 stop, 1-47 commands, 48-2047 throttle
+// bit 4    : telemetry request
+// bit 3-0  : CRC. xor of the three nibbles above
+//
+// sent MSB first. each bit is one timer period and the
+// high time of the period tells 1 from 0
+//
+#define DSHOT_FRAME_BITS              16
+#define DSHOT_FRAME_SLOTS             (DSHOT_FRAME_BITS + 2)    // two trailing zero periods to end low
+
+#define DSHOT_THROTTLE_STOP           0
+#define DSHOT_THROTTLE_MIN            48
+#define DSHOT_THROTTLE_MAX            2047
+
+//
+// pulse width in motor unit that maps to DShot range
+//
+#define DSHOT_PULSE_MIN               1000
+#define DSHOT_PULSE_MAX               2000
+
+#define DSHOT_TIMER_CLOCK             84000000      // APB1 timer clock
+
+typedef enum
+{
+  dshot_150 = 0,
+  dshot_300,
+  dshot_600,
+} dshot_rate_t;
+
+static inline uint16_t
+dshot_encode_frame(uint16_t value, bool telemetry)
+{
+  uint16_t    v = (value << 1) | (telemetry ? 1 : 0);
+  uint16_t    crc;
+
+  crc = (v ^ (v >> 4) ^ (v >> 8)) & 0x0f;
+
+  return (v << 4) | crc;
+}
+
+//
+// frame to per period compare values.
+// stride lets several channels of one timer be interleaved for burst DMA
+//
+static inline void
+dshot_frame_to_pulses(uint16_t frame, uint32_t* buf, int stride, uint32_t bit0, uint32_t bit1)
+{
+  for(int i = 0; i < DSHOT_FRAME_BITS; i++)
+  {
+    buf[i * stride] = (frame & 0x8000) ? bit1 : bit0;
+    frame <<= 1;
+  }
+
+  buf[DSHOT_FRAME_BITS * stride]        = 0;
+  buf[(DSHOT_FRAME_BITS + 1) * stride]  = 0;
+}
+
+//
+// motor pulse width in usec to DShot throttle.
+// anything at or below DSHOT_PULSE_MIN stops the motor
+//
+static inline uint16_t
+dshot_throttle_from_pulse(uint16_t pulse)
+{
+  if(pulse <= DSHOT_PULSE_MIN)
+  {
+    return DSHOT_THROTTLE_STOP;
+  }
+
+  if(pulse >= DSHOT_PULSE_MAX)
+  {
+    return DSHOT_THROTTLE_MAX;
+  }
+
+  return DSHOT_THROTTLE_MIN +
+    (uint32_t)(pulse - DSHOT_PULSE_MIN) * (DSHOT_THROTTLE_MAX - DSHOT_THROTTLE_MIN) /
+    (DSHOT_PULSE_MAX - DSHOT_PULSE_MIN);
+}
+
+extern void dshot_start(dshot_rate_t rate);
+extern void dshot_set(uint8_t chnl, uint16_t value);
+extern void dshot_fire(void);
+
+#endif /* !__DSHOT_DEF_H__ */
@@ -0,0 +1,452 @@
+#include <math.h>
+#include <string.h>
+#include "dyn_notch.h"
+#include "math_helper.h"
+#include "cycle_counter.h"
+#include "mem_section.h"
+
+//
+// FFT based gyro noise tracker.
+//
+// decimated gyro samples are kept in a ring per axis.
+// analysis runs one axis at a time, one small step per gyro sample,
+// so that no single loop iteration pays for the whole FFT.
+//
+// 64 point real FFT is done as 32 point complex FFT on even/odd packed
+// samples followed by a split step.
+//
+#define DYN_NOTCH_CPLX_SIZE         (DYN_NOTCH_FFT_SIZE / 2)
+#define DYN_NOTCH_CPLX_STAGES       5         // log2(DYN_NOTCH_CPLX_SIZE)
+#define DYN_NOTCH_PEAK_THRESHOLD    2.0f      // peak power over mean power in range
+#define DYN_NOTCH_SMOOTHING         0.5f      // center frequency tracking gain
+
+typedef enum
+{
+  dyn_notch_step_window = 0,
+  dyn_notch_step_bitrev,
+  dyn_notch_step_stage,
+  dyn_notch_step_split = dyn_notch_step_stage + DYN_NOTCH_CPLX_STAGES,
+  dyn_notch_step_peaks,
+  dyn_notch_step_tune,
+} dyn_notch_step_t;
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// module privates
+//
+////////////////////////////////////////////////////////////////////////////////
+static CCM_BSS float  _ring[3][DYN_NOTCH_FFT_SIZE];
+static uint8_t    _ring_ndx;
+static float      _decim_acc[3];
+static uint8_t    _decim_count;
+
+static CCM_BSS float  _fft[DYN_NOTCH_FFT_SIZE];         // re/im interleaved, 32 complex
+static CCM_BSS float  _power[DYN_NOTCH_FFT_BINS];
+static CCM_BSS float  _window[DYN_NOTCH_FFT_SIZE];
+static CCM_BSS float  _cos64[DYN_NOTCH_CPLX_SIZE];      // W64^k = cos - j sin
+static CCM_BSS float  _sin64[DYN_NOTCH_CPLX_SIZE];
+
+static uint8_t    _axis;
+static uint8_t    _step;
+
+static CCM_BSS filter_t _notch[3][DYN_NOTCH_MAX_PEAKS];
+
+static float      _sample_hz;         // gyro rate
+static float      _fft_hz;            // decimated rate
+static uint8_t    _num_peaks;
+static uint8_t    _min_bin,
+                  _max_bin;
+static float      _min_hz,
+                  _max_hz;
+static float      _q;
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// visibles
+//
+////////////////////////////////////////////////////////////////////////////////
+float               dyn_notch_center[3][DYN_NOTCH_MAX_PEAKS];
+dyn_notch_stat_t    dyn_notch_stat;
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// FFT steps
+//
+////////////////////////////////////////////////////////////////////////////////
+static void
+dyn_notch_do_window(void)
+{
+  const float*  r = _ring[_axis];
+
+  for(int n = 0; n < DYN_NOTCH_FFT_SIZE; n++)
+  {
+    _fft[n] = r[(_ring_ndx + n) & (DYN_NOTCH_FFT_SIZE - 1)] * _window[n];
+  }
+}
+
+static void
+dyn_notch_do_bitrev(void)
+{
+  int   j = 0;
+  float t;
+
+  for(int i = 0; i < DYN_NOTCH_CPLX_SIZE - 1; i++)
+  {
+    if(i < j)
+    {
+      t = _fft[2*i];      _fft[2*i]     = _fft[2*j];      _fft[2*j]     = t;
+      t = _fft[2*i+1];    _fft[2*i+1]   = _fft[2*j+1];    _fft[2*j+1]   = t;
+    }
+
+    int m = DYN_NOTCH_CPLX_SIZE >> 1;
+    while(m >= 1 && j >= m)
+    {
+      j -= m;
+      m >>= 1;
+    }
+    j += m;
+  }
+}
+
+//
+// one radix-2 DIT stage of the 32 point complex FFT
+//
+static void
+dyn_notch_do_stage(int stage)
+{
+  const int half  = 1 << stage;
+  const int len   = half << 1;
+  const int tstep = DYN_NOTCH_FFT_SIZE / len;     // W32^j == W64^(2j)
+
+  for(int j = 0; j < half; j++)
+  {
+    const float wr =  _cos64[j * tstep];
+    const float wi = -_sin64[j * tstep];
+
+    for(int k = j; k < DYN_NOTCH_CPLX_SIZE; k += len)
+    {
+      float* a = &_fft[2 * k];
+      float* b = &_fft[2 * (k + half)];
+      float  tr = b[0] * wr - b[1] * wi;
+      float  ti = b[0] * wi + b[1] * wr;
+
+      b[0] = a[0] - tr;
+      b[1] = a[1] - ti;
+      a[0] += tr;
+      a[1] += ti;
+    }
+  }
+}
+
+//
+// unpack 32 point complex result into 33 real FFT power bins
+//
+static void
+dyn_notch_do_split(void)
+{
+  for(int k = _min_bin - 1; k <= _max_bin + 1; k++)
+  {
+    const int   nk  = (DYN_NOTCH_CPLX_SIZE - k) & (DYN_NOTCH_CPLX_SIZE - 1);
+    const float ar  = _fft[2 * (k & (DYN_NOTCH_CPLX_SIZE - 1))];
+    const float ai  = _fft[2 * (k & (DYN_NOTCH_CPLX_SIZE - 1)) + 1];
+    const float br  = _fft[2 * nk];
+    const float bi  = _fft[2 * nk + 1];
+    const float c   = k < DYN_NOTCH_CPLX_SIZE ?  _cos64[k] : -1.0f;
+    const float s   = k < DYN_NOTCH_CPLX_SIZE ?  _sin64[k] :  0.0f;
+
+    const float er  = 0.5f * (ar + br);
+    const float ei  = 0.5f * (ai - bi);
+    const float or_ = 0.5f * (ai + bi);
+    const float oi  = -0.5f * (ar - br);
+
+    const float xr  = er + c * or_ + s * oi;
+    const float xi  = ei + c * oi  - s * or_;
+
+    _power[k] = xr * xr + xi * xi;
+  }
+}
+
+static void
+dyn_notch_do_peaks(void)
+{
+  uint8_t   peak_bin[DYN_NOTCH_MAX_PEAKS];
+  float     peak_freq[DYN_NOTCH_MAX_PEAKS];
+  int       found = 0;
+  float     mean = 0.0f;
+
+  for(int k = _min_bin; k <= _max_bin; k++)
+  {
+    mean += _power[k];
+  }
+  mean /= (_max_bin - _min_bin + 1);
+
+  //
+  // strongest local maxima first
+  //
+  for(int p = 0; p < _num_peaks; p++)
+  {
+    int     best = -1;
+    float   best_power = mean * DYN_NOTCH_PEAK_THRESHOLD;
+
+    for(int k = _min_bin; k <= _max_bin; k++)
+    {
+      bool taken = false;
+
+      for(int i = 0; i < found; i++)
+      {
+        if(peak_bin[i] == k)
+        {
+          taken = true;
+        }
+      }
+
+      if(!taken &&
+         _power[k] > best_power &&
+         _power[k] > _power[k - 1] &&
+         _power[k] >= _power[k + 1])
+      {
+        best        = k;
+        best_power  = _power[k];
+      }
+    }
+
+    if(best < 0)
+    {
+      break;
+    }
+    peak_bin[found++] = best;
+  }
+
+  //
+  // parabolic interpolation around each peak
+  //
+  for(int i = 0; i < found; i++)
+  {
+    const int   k   = peak_bin[i];
+    const float y0  = _power[k - 1],
+                y1  = _power[k],
+                y2  = _power[k + 1];
+    const float den = y0 - 2.0f * y1 + y2;
+    float       d   = 0.0f;
+
+    if(den != 0.0f)
+    {
+      d = 0.5f * (y0 - y2) / den;
+    }
+
+    peak_freq[i] = (k + d) * _fft_hz / DYN_NOTCH_FFT_SIZE;
+    clamp(&peak_freq[i], _min_hz, _max_hz);
+  }
+
+  //
+  // sort by frequency so that each notch keeps following the same peak
+  //
+  for(int i = 1; i < found; i++)
+  {
+    for(int j = i; j > 0 && peak_freq[j - 1] > peak_freq[j]; j--)
+    {
+      float t = peak_freq[j];
+      peak_freq[j] = peak_freq[j - 1];
+      peak_freq[j - 1] = t;
+    }
+  }
+
+  for(int i = 0; i < found; i++)
+  {
+    float* c = &dyn_notch_center[_axis][i];
+
+    *c += DYN_NOTCH_SMOOTHING * (peak_freq[i] - *c);
+  }
+}
+
+static void
+dyn_notch_do_tune(void)
+{
+  for(int p = 0; p < _num_peaks; p++)
+  {
+    filter_coeff_init(&_notch[_axis][p].c, filter_type_notch,
+        dyn_notch_center[_axis][p], _q, _sample_hz);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// public interfaces
+//
+////////////////////////////////////////////////////////////////////////////////
+void
+dyn_notch_init(float sample_hz)
+{
+  _sample_hz  = sample_hz;
+  _fft_hz     = sample_hz / DYN_NOTCH_DECIMATION;
+
+  for(int n = 0; n < DYN_NOTCH_FFT_SIZE; n++)
+  {
+    _window[n] = 0.5f - 0.5f * cosf(2.0f * M_PIf * n / (DYN_NOTCH_FFT_SIZE - 1));
+  }
+
+  for(int k = 0; k < DYN_NOTCH_CPLX_SIZE; k++)
+  {
+    _cos64[k] = cosf(2.0f * M_PIf * k / DYN_NOTCH_FFT_SIZE);
+    _sin64[k] = sinf(2.0f * M_PIf * k / DYN_NOTCH_FFT_SIZE);
+  }
+
+  memset(_ring, 0, sizeof(_ring));
+  _ring_ndx     = 0;
+  _decim_count  = 0;
+  _decim_acc[0] = _decim_acc[1] = _decim_acc[2] = 0.0f;
+
+  _axis = 0;
+  _step = dyn_notch_step_window;
+
+  memset(&dyn_notch_stat, 0, sizeof(dyn_notch_stat));
+
+  _num_peaks = 0;
+}
+
+void
+dyn_notch_config(uint8_t num_peaks, uint16_t min_hz, uint16_t max_hz, float q)
+{
+  const float bin_hz = _fft_hz / DYN_NOTCH_FFT_SIZE;
+
+  if(num_peaks > DYN_NOTCH_MAX_PEAKS)
+  {
+    num_peaks = DYN_NOTCH_MAX_PEAKS;
+  }
+
+  _min_hz = min_hz;
+  _max_hz = max_hz;
+  clamp(&_max_hz, 2 * bin_hz, _fft_hz / 2.0f - 2 * bin_hz);
+  clamp(&_min_hz, 2 * bin_hz, _max_hz);
+
+  //
+  // need one extra bin on each side for peak detection
+  //
+  _min_bin  = (uint8_t)(_min_hz / bin_hz);
+  _max_bin  = (uint8_t)(_max_hz / bin_hz + 0.5f);
+  if(_min_bin < 1)
+  {
+    _min_bin = 1;
+  }
+  if(_max_bin > DYN_NOTCH_FFT_BINS - 2)
+  {
+    _max_bin = DYN_NOTCH_FFT_BINS - 2;
+  }
+
+  _q = q < DYN_NOTCH_Q_MIN ? DYN_NOTCH_Q_MIN : q;
+
+  //
+  // spread the notches over the range to begin with
+  //
+  for(int a = 0; a < 3; a++)
+  {
+    for(int p = 0; p < DYN_NOTCH_MAX_PEAKS; p++)
+    {
+      dyn_notch_center[a][p] = _min_hz + (_max_hz - _min_hz) * (p + 1) / (num_peaks + 1);
+      filter_init(&_notch[a][p], filter_type_notch, dyn_notch_center[a][p], _q, _sample_hz);
+    }
+  }
+
+  _axis       = 0;
+  _step       = dyn_notch_step_window;
+  _num_peaks  = num_peaks;
+}
+
+//
+// feed un-notched gyro. called every gyro sample
+//
+void
+dyn_notch_push(const float v[3])
+{
+  if(_num_peaks == 0)
+  {
+    return;
+  }
+
+  _decim_acc[0] += v[0];
+  _decim_acc[1] += v[1];
+  _decim_acc[2] += v[2];
+
+  _decim_count++;
+  if(_decim_count < DYN_NOTCH_DECIMATION)
+  {
+    return;
+  }
+
+  for(int i = 0; i < 3; i++)
+  {
+    _ring[i][_ring_ndx] = _decim_acc[i] * (1.0f / DYN_NOTCH_DECIMATION);
+    _decim_acc[i] = 0.0f;
+  }
+  _decim_count = 0;
+  _ring_ndx = (_ring_ndx + 1) & (DYN_NOTCH_FFT_SIZE - 1);
+}
+
+//
+// do one slice of analysis work
+//
+void
+dyn_notch_update(void)
+{
+  uint32_t    start;
+
+  if(_num_peaks == 0)
+  {
+    return;
+  }
+
+  start = cycle_counter_get();
+
+  switch(_step)
+  {
+  case dyn_notch_step_window:
+    dyn_notch_do_window();
+    break;
+
+  case dyn_notch_step_bitrev:
+    dyn_notch_do_bitrev();
+    break;
+
+  case dyn_notch_step_split:
+    dyn_notch_do_split();
+    break;
+
+  case dyn_notch_step_peaks:
+    dyn_notch_do_peaks();
+    break;
+
+  case dyn_notch_step_tune:
+    dyn_notch_do_tune();
+    break;
+
+  default:
+    dyn_notch_do_stage(_step - dyn_notch_step_stage);
+    break;
+  }
+
+  _step++;
+  if(_step > dyn_notch_step_tune)
+  {
+    _step = dyn_notch_step_window;
+    _axis = (_axis + 1) % 3;
+    dyn_notch_stat.update_count++;
+  }
+
+  dyn_notch_stat.slice_cycles = cycle_counter_get() - start;
+  if(dyn_notch_stat.slice_cycles > dyn_notch_stat.slice_cycles_max)
+  {
+    dyn_notch_stat.slice_cycles_max = dyn_notch_stat.slice_cycles;
+  }
+}
+
+void
+dyn_notch_apply(float v[3])
+{
+  for(int a = 0; a < 3; a++)
+  {
+    for(int p = 0; p < _num_peaks; p++)
+    {
+      v[a] = filter_apply(&_notch[a][p], v[a]);
+    }
+  }
+}
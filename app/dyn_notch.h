@@ -0,0 +1,37 @@
+#ifndef __DYN_NOTCH_DEF_H__
+#define __DYN_NOTCH_DEF_H__
+
+#include "app_common.h"
+#include "filter.h"
+
+//
+// gyro is decimated before FFT.
+// with 1KHz gyro, FFT runs at 500Hz sample rate. 64 point gives 7.8Hz per bin
+//
+#define DYN_NOTCH_FFT_SIZE          64
+#define DYN_NOTCH_FFT_BINS          (DYN_NOTCH_FFT_SIZE / 2 + 1)
+#define DYN_NOTCH_DECIMATION        2
+#define DYN_NOTCH_MAX_PEAKS         3
+
+//
+// a lower Q is a notch wider than the range it tracks. Q 0 divides by zero
+//
+#define DYN_NOTCH_Q_MIN             1.0f
+
+typedef struct
+{
+  uint32_t    slice_cycles;       // cycles spent in the last slice
+  uint32_t    slice_cycles_max;   // worst slice since last reset
+  uint32_t    update_count;       // number of completed per axis analysis
+} dyn_notch_stat_t;
+
+extern float              dyn_notch_center[3][DYN_NOTCH_MAX_PEAKS];
+extern dyn_notch_stat_t   dyn_notch_stat;
+
+extern void dyn_notch_init(float sample_hz);
+extern void dyn_notch_config(uint8_t num_peaks, uint16_t min_hz, uint16_t max_hz, float q);
+extern void dyn_notch_push(const float v[3]);
+extern void dyn_notch_update(void);
+extern void dyn_notch_apply(float v[3]);
+
+#endif /* !__DYN_NOTCH_DEF_H__ */
@@ -6,6 +6,7 @@
 #define DISPATCH_EVENT_RC_RX                10
 
 #define DISPATCH_EVENT_UBLOX_RX             12
-#define DISPATCH_EVENT_UBLOX_TX             13
+
+#define DISPATCH_EVENT_SPI_DONE             14
 
 #endif //!__EVENT_LIST_DEF_H__
@@ -0,0 +1,250 @@
+#include <math.h>
+#include "filter.h"
+#include "math_helper.h"
+#include "mem_section.h"
+
+//
+// PT2 is two cascaded PT1. cutoff of each stage is raised so that
+// the -3dB point of the pair lands on the requested cutoff.
+// 1 / sqrt(2^(1/2) - 1)
+//
+#define FILTER_PT2_CUTOFF_CORRECTION      1.553773974f
+
+static const char* _filter_type_names[filter_type_max] =
+{
+  "none",
+  "pt1",
+  "pt2",
+  "biquad",
+  "notch",
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// coefficients
+//
+////////////////////////////////////////////////////////////////////////////////
+static inline float
+filter_pt1_gain(float hz, float sample_hz)
+{
+  const float rc = 1.0f / (2.0f * M_PIf * hz);
+  const float dt = 1.0f / sample_hz;
+
+  return dt / (rc + dt);
+}
+
+const char*
+filter_type_name(filter_type_t type)
+{
+  if(type >= filter_type_max)
+  {
+    return "invalid";
+  }
+  return _filter_type_names[type];
+}
+
+float
+filter_notch_q(float center_hz, float cutoff_hz)
+{
+  return center_hz * cutoff_hz / (center_hz * center_hz - cutoff_hz * cutoff_hz);
+}
+
+void
+filter_coeff_init(filter_coeff_t* c, filter_type_t type, float hz, float q, float sample_hz)
+{
+  float   omega,
+          sn,
+          cs,
+          alpha,
+          a0;
+
+  c->b0 = 1.0f;
+  c->b1 = c->b2 = c->a1 = c->a2 = 0.0f;
+
+  //
+  // keep cutoff below nyquist
+  //
+  if(hz > sample_hz * 0.48f)
+  {
+    hz = sample_hz * 0.48f;
+  }
+
+  switch(type)
+  {
+  case filter_type_pt1:
+    c->b0 = filter_pt1_gain(hz, sample_hz);
+    break;
+
+  case filter_type_pt2:
+    c->b0 = filter_pt1_gain(hz * FILTER_PT2_CUTOFF_CORRECTION, sample_hz);
+    break;
+
+  case filter_type_biquad_lpf:
+  case filter_type_notch:
+    omega = 2.0f * M_PIf * hz / sample_hz;
+    sn    = sinf(omega);
+    cs    = cosf(omega);
+    alpha = sn / (2.0f * q);
+    a0    = 1.0f + alpha;
+
+    if(type == filter_type_biquad_lpf)
+    {
+      c->b0 = (1.0f - cs) * 0.5f / a0;
+      c->b1 = (1.0f - cs) / a0;
+      c->b2 = c->b0;
+    }
+    else
+    {
+      c->b0 = 1.0f / a0;
+      c->b1 = -2.0f * cs / a0;
+      c->b2 = c->b0;
+    }
+    c->a1 = -2.0f * cs / a0;
+    c->a2 = (1.0f - alpha) / a0;
+    break;
+
+  default:
+    break;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// single channel
+//
+////////////////////////////////////////////////////////////////////////////////
+void
+filter_init(filter_t* f, filter_type_t type, float hz, float q, float sample_hz)
+{
+  f->type = hz > 0.0f ? type : filter_type_none;
+  filter_coeff_init(&f->c, f->type, hz, q, sample_hz);
+  filter_reset(f);
+}
+
+void
+filter_reset(filter_t* f)
+{
+  f->s1 = f->s2 = 0.0f;
+}
+
+FAST_CODE float
+filter_apply(filter_t* f, float x)
+{
+  float y;
+
+  switch(f->type)
+  {
+  case filter_type_pt1:
+    f->s1 += f->c.b0 * (x - f->s1);
+    return f->s1;
+
+  case filter_type_pt2:
+    f->s1 += f->c.b0 * (x - f->s1);
+    f->s2 += f->c.b0 * (f->s1 - f->s2);
+    return f->s2;
+
+  case filter_type_biquad_lpf:
+  case filter_type_notch:
+    y     = f->c.b0 * x + f->s1;
+    f->s1 = f->c.b1 * x - f->c.a1 * y + f->s2;
+    f->s2 = f->c.b2 * x - f->c.a2 * y;
+    return y;
+
+  default:
+    return x;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// 3 axis
+//
+////////////////////////////////////////////////////////////////////////////////
+void
+filter3_init(filter3_t* f, filter_type_t type, float hz, float q, float sample_hz)
+{
+  f->type = hz > 0.0f ? type : filter_type_none;
+  filter_coeff_init(&f->c, f->type, hz, q, sample_hz);
+  filter3_reset(f);
+}
+
+void
+filter3_init_from_config(filter3_t* f, const filter_config_t* cfg, float sample_hz)
+{
+  float q = FILTER_BIQUAD_Q;
+
+  if(cfg->type == filter_type_notch)
+  {
+    if(cfg->cutoff == 0 || cfg->cutoff >= cfg->hz)
+    {
+      filter3_init(f, filter_type_none, 0, q, sample_hz);
+      return;
+    }
+    q = filter_notch_q(cfg->hz, cfg->cutoff);
+  }
+
+  filter3_init(f, cfg->type, cfg->hz, q, sample_hz);
+}
+
+//
+// retune without touching the state. for tracking filters
+//
+void
+filter3_update(filter3_t* f, float hz, float q, float sample_hz)
+{
+  filter_coeff_init(&f->c, f->type, hz, q, sample_hz);
+}
+
+void
+filter3_reset(filter3_t* f)
+{
+  for(int i = 0; i < 3; i++)
+  {
+    f->s1[i] = f->s2[i] = 0.0f;
+  }
+}
+
+FAST_CODE void
+filter3_apply(filter3_t* f, float v[3])
+{
+  const float b0 = f->c.b0,
+              b1 = f->c.b1,
+              b2 = f->c.b2,
+              a1 = f->c.a1,
+              a2 = f->c.a2;
+  float       y;
+
+  switch(f->type)
+  {
+  case filter_type_pt1:
+    for(int i = 0; i < 3; i++)
+    {
+      f->s1[i] += b0 * (v[i] - f->s1[i]);
+      v[i] = f->s1[i];
+    }
+    break;
+
+  case filter_type_pt2:
+    for(int i = 0; i < 3; i++)
+    {
+      f->s1[i] += b0 * (v[i] - f->s1[i]);
+      f->s2[i] += b0 * (f->s1[i] - f->s2[i]);
+      v[i] = f->s2[i];
+    }
+    break;
+
+  case filter_type_biquad_lpf:
+  case filter_type_notch:
+    for(int i = 0; i < 3; i++)
+    {
+      y        = b0 * v[i] + f->s1[i];
+      f->s1[i] = b1 * v[i] - a1 * y + f->s2[i];
+      f->s2[i] = b2 * v[i] - a2 * y;
+      v[i]     = y;
+    }
+    break;
+
+  default:
+    break;
+  }
+}
@@ -0,0 +1,79 @@
+#ifndef __FILTER_DEF_H__
+#define __FILTER_DEF_H__
+
+#include "app_common.h"
+
+#define FILTER_CHAIN_MAX          3
+
+#define FILTER_BIQUAD_Q           0.70710678f     // 1/sqrt(2). butterworth
+
+typedef enum
+{
+  filter_type_none = 0,
+  filter_type_pt1,
+  filter_type_pt2,
+  filter_type_biquad_lpf,
+  filter_type_notch,
+  filter_type_max,
+} filter_type_t;
+
+//
+// precomputed coefficients.
+// PT1/PT2 only use b0 as gain
+// biquads are run in direct form 2 transposed
+//
+typedef struct
+{
+  float     b0, b1, b2;
+  float     a1, a2;
+} filter_coeff_t;
+
+//
+// single channel filter stage
+//
+typedef struct
+{
+  filter_type_t   type;
+  filter_coeff_t  c;
+  float           s1, s2;
+} filter_t;
+
+//
+// 3 axis filter stage.
+// one set of coefficients for all axes and state laid out per axis
+// so that a stage is applied to x/y/z in one go
+//
+typedef struct
+{
+  filter_type_t   type;
+  filter_coeff_t  c;
+  float           s1[3];
+  float           s2[3];
+} filter3_t;
+
+//
+// filter stage configuration as stored in config
+//
+typedef struct
+{
+  uint8_t     type;         // filter_type_t
+  uint16_t    hz;           // cutoff or notch center
+  uint16_t    cutoff;       // notch lower cutoff. unused for others
+} filter_config_t;
+
+extern const char* filter_type_name(filter_type_t type);
+
+extern float filter_notch_q(float center_hz, float cutoff_hz);
+extern void filter_coeff_init(filter_coeff_t* c, filter_type_t type, float hz, float q, float sample_hz);
+
+extern void filter_init(filter_t* f, filter_type_t type, float hz, float q, float sample_hz);
+extern void filter_reset(filter_t* f);
+extern float filter_apply(filter_t* f, float x);
+
+extern void filter3_init(filter3_t* f, filter_type_t type, float hz, float q, float sample_hz);
+extern void filter3_init_from_config(filter3_t* f, const filter_config_t* cfg, float sample_hz);
+extern void filter3_update(filter3_t* f, float hz, float q, float sample_hz);
+extern void filter3_reset(filter3_t* f);
+extern void filter3_apply(filter3_t* f, float v[3]);
+
+#endif /* !__FILTER_DEF_H__ */
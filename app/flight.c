@@ -2,23 +2,41 @@
 #include "pid.h"
 #include "mainloop_timer.h"
 #include "imu.h"
+#include "accelgyro.h"
 #include "rx.h"
 #include "motor.h"
+#include "mixer.h"
 #include "config.h"
 #include "math_helper.h"
 #include "blinky.h"
+#include "micros.h"
+#include "mem_section.h"
+
+//
+// real loop interval is measured with micros.
+// anything outside of this is either the very first run or a stall
+//
+#define FLIGHT_LOOP_DT_MIN        0.0002f
+#define FLIGHT_LOOP_DT_MAX        0.01f
+#define FLIGHT_LOOP_DT_NOMINAL    0.001f
+#define FLIGHT_LOOP_FREQ          1000
+
+#define FLIGHT_ARMING_COS_TILT    0.98480775f     // cos(10 degree)
 
 ////////////////////////////////////////////////////////////////////////////////
 //
 // module privates
 //
 ////////////////////////////////////////////////////////////////////////////////
-static pid_control_t      _pidc_roll,
-                          _pidc_pitch,
-                          _pidc_yaw;
+static CCM_BSS pid_control_t  _pidc_roll,
+                              _pidc_pitch,
+                              _pidc_yaw;
 
 static SoftTimerElem      _loop_timer;
 
+static uint32_t           _last_run_usec;
+static uint8_t            _angle_loop_count;
+
 ////////////////////////////////////////////////////////////////////////////////
 //
 // visibles. module output
@@ -26,7 +44,8 @@ static SoftTimerElem      _loop_timer;
 ////////////////////////////////////////////////////////////////////////////////
 float                     pid_out[3];
 float                     pid_target[3];        // RP - deci degree. Y - dps
-uint16_t                  pid_motor[4];
+float                     pid_rate_target[3];   // RPY - dps
+uint16_t                  pid_motor[MOTOR_MAX_NUM];
 flight_state_t            flight_state;
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -34,28 +53,40 @@ flight_state_t            flight_state;
 // utilities
 //
 ////////////////////////////////////////////////////////////////////////////////
+static inline uint8_t
+flight_num_motors(void)
+{
+  return GCFG->mixer.num_motors < MOTOR_MAX_NUM ? GCFG->mixer.num_motors : MOTOR_MAX_NUM;
+}
+
+//
+// outputs past the mixer motor count are held at motor_min so nothing is
+// left running at its last value when the mixer table shrinks
+//
 static inline void
-flight_control_set_motor(uint16_t m1, uint16_t m2, uint16_t m3, uint16_t m4)
+flight_control_set_motor(const float* m)
 {
-  pid_motor[0] = m1;
-  pid_motor[1] = m2;
-  pid_motor[2] = m3;
-  pid_motor[3] = m4;
-
-  motor_set(motor_1, pid_motor[0]);
-  motor_set(motor_2, pid_motor[1]);
-  motor_set(motor_3, pid_motor[2]);
-  motor_set(motor_4, pid_motor[3]);
+  const uint8_t   n = flight_num_motors();
+
+  for(int i = 0; i < MOTOR_MAX_NUM; i++)
+  {
+    pid_motor[i] = i < n ? (uint16_t)m[i] : GCFG->motor_min;
+    motor_set(i, pid_motor[i]);
+  }
+
+  motor_update();
 }
 
 static inline void
 flight_control_set_motor_to_min(void)
 {
-  flight_control_set_motor(
-      GCFG->motor_min,
-      GCFG->motor_min,
-      GCFG->motor_min,
-      GCFG->motor_min);
+  float   m[MOTOR_MAX_NUM];
+
+  for(int i = 0; i < MOTOR_MAX_NUM; i++)
+  {
+    m[i] = GCFG->motor_min;
+  }
+  flight_control_set_motor(m);
 }
 
 static inline bool
@@ -80,14 +111,34 @@ flight_is_rx_cmd_arming_position(void)
   return false;
 }
 
-static inline bool
+//
+// up vector in body frame. third row of body to earth DCM.
+// x : sin(pitch), y : sin(roll)cos(pitch), z : cos(tilt)
+//
+static inline void
+flight_get_body_up(const float q[4], float u[3])
+{
+  u[0] = 2.0f * (q[1] * q[3] - q[0] * q[2]);
+  u[1] = 2.0f * (q[2] * q[3] + q[0] * q[1]);
+  u[2] = q[0] * q[0] - q[1] * q[1] - q[2] * q[2] + q[3] * q[3];
+}
+
+bool
 flight_is_arming_ready(void)
 {
-  // roll/pitch should be within +- 10 degree
-  if(attitude[0] < -100 ||
-     attitude[0] >  100 ||
-     attitude[1] < -100 ||
-     attitude[1] >  100)
+  float   q[4],
+          u[3];
+
+  if(!imu_is_ready())
+  {
+    return false;
+  }
+
+  ahrs_get_quaternion(&imu_get()->ahrs, q);
+  flight_get_body_up(q, u);
+
+  // tilt should be within 10 degree
+  if(u[2] < FLIGHT_ARMING_COS_TILT)
   {
     return false;
   }
@@ -100,9 +151,16 @@ flight_reset(void)
 {
   flight_control_set_motor_to_min();
 
-  pid_control_init(&_pidc_roll);
-  pid_control_init(&_pidc_pitch);
-  pid_control_init(&_pidc_yaw);
+  pid_control_init(&_pidc_roll,  GCFG->pid_i_limit, GCFG->pid_out_limit, GCFG->iterm_relax);
+  pid_control_init(&_pidc_pitch, GCFG->pid_i_limit, GCFG->pid_out_limit, GCFG->iterm_relax);
+  pid_control_init(&_pidc_yaw,   GCFG->pid_i_limit, GCFG->pid_out_limit, GCFG->iterm_relax);
+
+  flight_filter_config();
+
+  pid_rate_target[0] = pid_rate_target[1] = pid_rate_target[2] = 0.0f;
+
+  _angle_loop_count = 0;
+  _last_run_usec    = micros_get();
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -119,62 +177,166 @@ flight_control_update_command_target(void)
   // pitch  1000-2000 ->  +- pitch_max
   pid_target[1] = lerp(rx_cmd_get(RX_CMD_PITCH), RX_CMD_MIN, RX_CMD_MAX, -GCFG->pitch_max, GCFG->pitch_max);
 
-  // yaw    1000-2000 ->  +- yaw_rate_max
-  pid_target[2] = lerp(rx_cmd_get(RX_CMD_YAW), RX_CMD_MIN, RX_CMD_MAX, -GCFG->yaw_rate_max, GCFG->yaw_rate_max);
+  // yaw    1000-2000 ->  +- yaw_rate_max. decidegree/s -> dps
+  pid_target[2] = lerp(rx_cmd_get(RX_CMD_YAW), RX_CMD_MIN, RX_CMD_MAX, -GCFG->yaw_rate_max, GCFG->yaw_rate_max) / 10.0f;
+}
+
+//
+// body rates in the same sense as roll/pitch/yaw targets.
+// see imu.c for the frame
+//
+// roll   : + right bank. gyro_body[0] as is
+// pitch  : + nose up. gyro_body[1] is + nose down in NWU
+// yaw    : gyro_body[2] as is. no angle loop on yaw
+//
+static inline void
+flight_control_get_rates(float rates[3])
+{
+  rates[0] =  gyro_body[0];
+  rates[1] = -gyro_body[1];
+  rates[2] =  gyro_body[2];
+}
+
+//
+// tilt error straight from the quaternion without going through euler.
+//
+// u  : measured up vector in body frame
+// ut : up vector of the target roll/pitch in body frame.
+//      heading does not change it so yaw stays a pure rate command
+//
+// error quaternion is the shortest rotation taking u to ut
+//   qe = [1 + u.ut, ut x u] / |.|
+// and 2 * vector part of qe is the rotation vector in body axes.
+// it equals the angle error for small errors and keeps growing up to
+// 180 degree, so nothing odd happens around +-90 pitch.
+//
+// err[0] : + right bank needed, err[1] : + nose up needed. radian
+//
+static inline void
+flight_control_tilt_error(const float q[4], float roll, float pitch, float err[2])
+{
+  float   u[3],
+          ut[3],
+          v[3],
+          w,
+          n;
+
+  flight_get_body_up(q, u);
+
+  ut[0] = math_sinf(pitch);
+  ut[1] = math_sinf(roll) * math_cosf(pitch);
+  ut[2] = math_cosf(roll) * math_cosf(pitch);
+
+  v[0] = ut[1] * u[2] - ut[2] * u[1];
+  v[1] = ut[2] * u[0] - ut[0] * u[2];
+  v[2] = ut[0] * u[1] - ut[1] * u[0];
+  w    = 1.0f + u[0] * ut[0] + u[1] * ut[1] + u[2] * ut[2];
+
+  n = w * w + v[0] * v[0] + v[1] * v[1] + v[2] * v[2];
+  if(n < F_EPSILON)
+  {
+    // upside down from the target. any axis will do
+    err[0] = M_PIf;
+    err[1] = 0.0f;
+    return;
+  }
+
+  n = 2.0f * math_rsqrtf(n);
+  err[0] =  v[0] * n;
+  err[1] = -v[1] * n;     // NWU y is + nose down
 }
 
-/*
-   motor order
-
-      M4          M2
-     <----\    / --->
-           \  /
-            \/
-            /\
-           /  \
-      M3  /    \  M1
-    ---->/      \<---
-*/
+//
+// outer loop. angle error -> rate setpoint in dps
+//
+static void
+flight_control_angle_loop(void)
+{
+  const float rate_max = GCFG->angle_rate_max / 10.0f;
+  float       q[4],
+              err[2];
+
+  flight_control_update_command_target();
+
+  ahrs_get_quaternion(&imu_get()->ahrs, q);
+
+  // decidegree -> radian
+  flight_control_tilt_error(q, pid_target[0] * RAD / 10.0f, pid_target[1] * RAD / 10.0f, err);
+
+  for(int i = 0; i < 2; i++)
+  {
+    pid_rate_target[i] = GCFG->angle_kp[i] * err[i] / RAD;
+    clamp(&pid_rate_target[i], -rate_max, rate_max);
+  }
+
+  pid_rate_target[2] = pid_target[2];
+}
+
+//
+// motor layout and coefficients are in GCFG->mixer. see mixer.c
+//
 static void
 flight_control_update_motor_out(void)
 {
-  float   m[4];
-  float   throttle  = rx_cmd_get(RX_CMD_THROTTLE),
-          roll      = pid_out[0],
-          pitch     = pid_out[1],
-          yaw       = pid_out[2];
+  float   m[MIXER_MAX_MOTORS];
+  float   throttle  = rx_cmd_get(RX_CMD_THROTTLE);
 
   if(throttle >= GCFG->min_flight_throttle)
   {
-    m[0] = throttle - roll - pitch + yaw; 
-    m[1] = throttle - roll + pitch - yaw; 
-    m[2] = throttle + roll - pitch - yaw; 
-    m[3] = throttle + roll + pitch + yaw; 
-
-    for(int i = 0; i < 4; i++)
-    {
-      clamp(&m[i], GCFG->motor_min, GCFG->motor_max);
-    }
+    mixer_run(&GCFG->mixer, GCFG->motor_min, GCFG->motor_max, throttle, pid_out, m);
   }
   else
   {
-    m[0] = m[1] = m[2] = m[3] = throttle;
+    for(int i = 0; i < MIXER_MAX_MOTORS; i++)
+    {
+      m[i] = throttle;
+    }
   }
 
-  flight_control_set_motor((uint16_t)m[0],
-      (uint16_t)m[1],
-      (uint16_t)m[2],
-      (uint16_t)m[3]);
+  flight_control_set_motor(m);
+}
+
+static inline float
+flight_control_get_dt(void)
+{
+  uint32_t  now = micros_get();
+  float     dt  = (now - _last_run_usec) * 1e-6f;
+
+  _last_run_usec = now;
+
+  if(dt < FLIGHT_LOOP_DT_MIN || dt > FLIGHT_LOOP_DT_MAX)
+  {
+    dt = FLIGHT_LOOP_DT_NOMINAL;
+  }
+  return dt;
 }
 
+//
+// cascaded controller.
+// angle loop runs decimated and feeds the rate loop that runs every time
+//
 static void
 flight_control_run(void)
 {
-  flight_control_update_command_target();
+  float   dt = flight_control_get_dt();
+  float   rates[3];
+
+  if(_angle_loop_count == 0)
+  {
+    flight_control_angle_loop();
+  }
+
+  _angle_loop_count++;
+  if(_angle_loop_count >= GCFG->angle_loop_div)
+  {
+    _angle_loop_count = 0;
+  }
+
+  flight_control_get_rates(rates);
 
-  pid_out[0] = pid_control_run(&_pidc_roll,   pid_target[0], attitude[0],   1, GCFG->roll_kX);
-  pid_out[1] = pid_control_run(&_pidc_pitch,  pid_target[1], attitude[1],   1, GCFG->pitch_kX);
-  pid_out[2] = pid_control_run(&_pidc_yaw,    pid_target[2], gyro_body[2],  1, GCFG->yaw_kX);
+  pid_out[0] = pid_control_run(&_pidc_roll,   pid_rate_target[0], rates[0], dt, GCFG->roll_kX);
+  pid_out[1] = pid_control_run(&_pidc_pitch,  pid_rate_target[1], rates[1], dt, GCFG->pitch_kX);
+  pid_out[2] = pid_control_run(&_pidc_yaw,    pid_rate_target[2], rates[2], dt, GCFG->yaw_kX);
 
   flight_control_update_motor_out();
 }
@@ -258,6 +420,8 @@ flight_loop_timer_callback(SoftTimerElem* te)
     break;
 
   default:
+    // digital ESCs need a steady frame stream even when idle
+    motor_update();
     break;
   }
 
@@ -282,6 +446,14 @@ flight_init(void)
   mainloop_timer_schedule(&_loop_timer, 1);
 }
 
+void
+flight_filter_config(void)
+{
+  pid_control_set_dterm_filter(&_pidc_roll,  GCFG->dterm_lpf_type, GCFG->dterm_lpf_hz, FLIGHT_LOOP_FREQ);
+  pid_control_set_dterm_filter(&_pidc_pitch, GCFG->dterm_lpf_type, GCFG->dterm_lpf_hz, FLIGHT_LOOP_FREQ);
+  pid_control_set_dterm_filter(&_pidc_yaw,   GCFG->dterm_lpf_type, GCFG->dterm_lpf_hz, FLIGHT_LOOP_FREQ);
+}
+
 void
 flight_arm(void)
 {
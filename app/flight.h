@@ -2,6 +2,7 @@
 #define __FLIGHT_DEF_H__
 
 #include "app_common.h"
+#include "motor.h"
 
 typedef enum
 {
@@ -14,10 +15,13 @@ typedef enum
 extern void flight_init(void);
 extern void flight_arm(void);
 extern void flight_disarm(void);
+extern bool flight_is_arming_ready(void);
+extern void flight_filter_config(void);
 
 extern float pid_out[3];
 extern float pid_target[3];
-extern uint16_t pid_motor[4];
+extern float pid_rate_target[3];
+extern uint16_t pid_motor[MOTOR_MAX_NUM];
 extern flight_state_t flight_state;
 
 #endif /* !__FLIGHT_DEF_H__ */
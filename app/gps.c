@@ -1,10 +1,67 @@
 #include "gps.h"
 #include "ublox.h"
+#include "config.h"
+#include "mainloop_timer.h"
+
+#define GPS_AID_INTERVAL          1000          // msec
+#define GPS_AID_MAX_EPH           500           // cm. worst fix worth keeping
 
 gps_data_t        gps_data;
 
+static SoftTimerElem    _aid_timer;
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// private utilities
+//
+////////////////////////////////////////////////////////////////////////////////
+
+//
+// keeps the last good fix in GCFG in RAM. it only reaches flash with the
+// next shell save, never on its own: a config_save() here would also store
+// the boot gyro offset, the learned gyro_tc and any unsaved shell tuning,
+// and the sector erase stalls the main loop, DShot and the MPU FIFO with it
+//
+static void
+gps_aid_timer_callback(SoftTimerElem* te)
+{
+  gps_aid_t*    aid = &GCFG->gps_aid;
+
+  mainloop_timer_schedule(&_aid_timer, GPS_AID_INTERVAL);
+
+  if(gps_data.fix_type == GPS_FIX_3D && gps_data.flags.valid_time &&
+     gps_data.eph <= GPS_AID_MAX_EPH)
+  {
+    aid->llh    = gps_data.llh;
+    aid->acc    = gps_data.eph;
+    aid->time   = gps_data.time;
+    aid->valid  = true;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// public interfaces
+//
+////////////////////////////////////////////////////////////////////////////////
+const char*
+gps_profile_name(gps_profile_t profile)
+{
+  static const char*  names[gps_profile_max] =
+  {
+    [gps_profile_legacy]  = "legacy",
+    [gps_profile_pvt]     = "pvt",
+  };
+
+  return profile < gps_profile_max ? names[profile] : "unknown";
+}
+
 void
 gps_init(void)
 {
+  soft_timer_init_elem(&_aid_timer);
+  _aid_timer.cb = gps_aid_timer_callback;
+  mainloop_timer_schedule(&_aid_timer, GPS_AID_INTERVAL);
+
   ublox_init();
 }
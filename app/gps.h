@@ -21,6 +21,18 @@ typedef struct
   int32_t     alt;    // in cm
 } gps_location_t;
 
+//
+// last good fix, kept in config and given back to the receiver at boot
+// so it does not start cold. flash only gets it with a shell save
+//
+typedef struct
+{
+  gps_location_t      llh;
+  uint32_t            acc;      // horizontal accuracy (cm)
+  date_time_t         time;     // UTC of the fix
+  uint8_t             valid;
+} gps_aid_t;
+
 typedef enum
 {
   GPS_NO_FIX      = 0,
@@ -38,6 +50,19 @@ typedef enum
   SBAS_NONE
 } gps_sbad_mode_t;
 
+//
+// message set the receiver is configured for
+//
+typedef enum
+{
+  gps_profile_legacy = 0,     // POSLLH/STATUS/SOL/VELNED/TIMEUTC at 5Hz. any uBlox
+  gps_profile_pvt,            // NAV-PVT only at gps_rate_hz. M8 and later
+  gps_profile_max,
+} gps_profile_t;
+
+#define GPS_PVT_RATE_MIN      1       // Hz
+#define GPS_PVT_RATE_MAX      18
+
 typedef enum 
 {
   gps_state_configuring_baud,
@@ -77,10 +102,17 @@ typedef struct
   uint32_t    rx_msgs;
   uint32_t    rx_crc_err;
   uint32_t    rx_unsync;
+
+  uint32_t    nav_seq;        // bumped when an epoch of position/velocity is complete
+  uint32_t    nav_msec;       // __msec when nav_seq was bumped
+  uint32_t    nav_usec;       // micros_get() at the start of the frame completing the epoch
+
+  bool        aid_sent;       // cached fix was replayed to the receiver
 } gps_data_t;
 
 extern gps_data_t     gps_data;
 
 extern void gps_init(void);
+extern const char* gps_profile_name(gps_profile_t profile);
 
 #endif /* !__GPS_DEF_H__ */
@@ -0,0 +1,129 @@
+#include <string.h>
+#include "gyro_tcomp.h"
+
+//
+// a bin becomes a moving average after this many windows so it keeps
+// following slow aging
+//
+#define GYRO_TCOMP_AVG_MAX        32
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// private utilities
+//
+////////////////////////////////////////////////////////////////////////////////
+static inline float
+gyro_tcomp_pos(float temp)
+{
+  float   p = (temp - GYRO_TCOMP_T_MIN) / GYRO_TCOMP_T_STEP;
+
+  if(p < 0.0f)
+  {
+    return 0.0f;
+  }
+  if(p > GYRO_TCOMP_BINS - 1)
+  {
+    return GYRO_TCOMP_BINS - 1;
+  }
+  return p;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// public interfaces
+//
+////////////////////////////////////////////////////////////////////////////////
+void
+gyro_tcomp_clear(gyro_tcomp_table_t* t)
+{
+  memset(t, 0, sizeof(gyro_tcomp_table_t));
+}
+
+//
+// bias averaged over a still window at temp. goes to the nearest bin
+//
+void
+gyro_tcomp_learn(gyro_tcomp_table_t* t, float temp, const float bias[3])
+{
+  int     b = (int)(gyro_tcomp_pos(temp) + 0.5f);
+  float   w;
+
+  if(t->count[b] < GYRO_TCOMP_AVG_MAX)
+  {
+    t->count[b]++;
+  }
+  w = 1.0f / t->count[b];
+
+  for(int i = 0; i < 3; i++)
+  {
+    t->bias[b][i] += (bias[i] - t->bias[b][i]) * w;
+  }
+  t->temp[b] += (temp - t->temp[b]) * w;
+}
+
+//
+// false if nothing is learned yet
+//
+bool
+gyro_tcomp_lookup(const gyro_tcomp_table_t* t, float temp, float bias[3])
+{
+  float   f;
+  int     lo = -1,
+          hi = -1;
+
+  for(int b = 0; b < GYRO_TCOMP_BINS; b++)
+  {
+    if(t->count[b] == 0)
+    {
+      continue;
+    }
+
+    if(t->temp[b] <= temp)
+    {
+      lo = b;
+    }
+    else if(hi < 0)
+    {
+      hi = b;
+    }
+  }
+
+  if(lo < 0 && hi < 0)
+  {
+    return false;
+  }
+
+  if(lo < 0 || hi < 0)
+  {
+    memcpy(bias, t->bias[lo < 0 ? hi : lo], sizeof(float) * 3);
+    return true;
+  }
+
+  f = (temp - t->temp[lo]) / (t->temp[hi] - t->temp[lo]);
+  for(int i = 0; i < 3; i++)
+  {
+    bias[i] = t->bias[lo][i] + (t->bias[hi][i] - t->bias[lo][i]) * f;
+  }
+  return true;
+}
+
+//
+// bias change from ref_temp to temp. zero without a table
+//
+void
+gyro_tcomp_delta(const gyro_tcomp_table_t* t, float temp, float ref_temp, float d[3])
+{
+  float   b[3],
+          r[3];
+
+  if(!gyro_tcomp_lookup(t, temp, b) || !gyro_tcomp_lookup(t, ref_temp, r))
+  {
+    d[0] = d[1] = d[2] = 0.0f;
+    return;
+  }
+
+  for(int i = 0; i < 3; i++)
+  {
+    d[i] = b[i] - r[i];
+  }
+}
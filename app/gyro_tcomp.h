@@ -0,0 +1,35 @@
+#ifndef __GYRO_TCOMP_DEF_H__
+#define __GYRO_TCOMP_DEF_H__
+
+#include "app_common.h"
+
+//
+// gyro bias against temperature.
+//
+// one bias per 5 degree bin from 0 to 80 degree, in raw LSB, learned
+// from still windows. each bin also keeps the mean temperature of what
+// went into it and lookups interpolate between those, so the bin width
+// does not quantize the curve. the table is held flat past the last
+// learned bin on either side.
+//
+// the table corrects the offset captured at calibration temperature,
+// so only the shape of the curve matters, not the turn on bias of the
+// session it was learned in.
+//
+#define GYRO_TCOMP_BINS           16
+#define GYRO_TCOMP_T_MIN          0.0f
+#define GYRO_TCOMP_T_STEP         5.0f
+
+typedef struct
+{
+  float       bias[GYRO_TCOMP_BINS][3];
+  float       temp[GYRO_TCOMP_BINS];
+  uint8_t     count[GYRO_TCOMP_BINS];     // still windows averaged. 0 is empty
+} gyro_tcomp_table_t;
+
+extern void gyro_tcomp_clear(gyro_tcomp_table_t* t);
+extern void gyro_tcomp_learn(gyro_tcomp_table_t* t, float temp, const float bias[3]);
+extern bool gyro_tcomp_lookup(const gyro_tcomp_table_t* t, float temp, float bias[3]);
+extern void gyro_tcomp_delta(const gyro_tcomp_table_t* t, float temp, float ref_temp, float d[3]);
+
+#endif /* !__GYRO_TCOMP_DEF_H__ */
@@ -87,3 +87,17 @@ hmc5883_read(hmc5883Mag* mag, int16_t m[3])
   m[2] = (int16_t)(data[3] | ((int16_t)(data[2] << 8)));
   m[1] = (int16_t)(data[5] | ((int16_t)(data[4] << 8)));
 }
+
+//
+// status register bit 0. set when all six output registers are updated
+// and cleared as soon as any of them is read
+//
+bool
+hmc5883_data_ready(hmc5883Mag* mag)
+{
+  uint8_t   status;
+
+  hmc5883_read_reg(mag, HMC5883_REGISTER_MAG_SR_REG_Mg, &status, 1);
+
+  return (status & 0x01) ? true : false;
+}
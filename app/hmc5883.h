@@ -43,5 +43,6 @@ typedef struct hmc5883Mag_s
 extern void hmc5883_init(hmc5883Mag* mag, uint8_t address, hmc5883MagGain gain);
 extern void hmc5883_set_mag_gain(hmc5883Mag* mag, hmc5883MagGain gain);
 extern void hmc5883_read(hmc5883Mag* mag, int16_t m[3]);
+extern bool hmc5883_data_ready(hmc5883Mag* mag);
 
 #endif //!__HMC5883_DEF_H__
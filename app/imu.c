@@ -5,25 +5,27 @@
 #include "imu.h"
 #include "accelgyro.h"
 #include "magneto.h"
-#include "mainloop_timer.h"
 
 #include "math_helper.h"
 #include "config.h"
+#include "mem_section.h"
 
-#define IMU_SAMPLE_FREQ       1000
+#define IMU_SAMPLE_FREQ       ACCELGYRO_SAMPLE_FREQ
+
+//
+// accel is averaged for IMU_ALIGN_SAMPLES before the filter is seeded.
+// mag is averaged over the same window. if mag never shows up within
+// IMU_ALIGN_TIMEOUT, seeding goes ahead without it
+//
+#define IMU_ALIGN_SAMPLES     100
+#define IMU_ALIGN_TIMEOUT     500
 
 ////////////////////////////////////////////////////////////////////////////////
 //
 // module privates
 //
 ////////////////////////////////////////////////////////////////////////////////
-static imu_t            _imu;
-static SoftTimerElem    _sample_timer;
-int16_t                 attitude[3];
-
-int16_t                 accel_body[3],
-                        mag_body[3];
-float                   gyro_body[3];
+static CCM_BSS imu_t    _imu;
 
 /*
   
@@ -62,56 +64,77 @@ float                   gyro_body[3];
    and accel/mag coordinates and
    gyro directions should be adjusted
    according to the required coordinate system.
+
+   chip alignment, the remap to NWU and board alignment
+   are all folded into one matrix per sensor. see sensor_xform.c
   
 */
-static void imu_body_aling(imu_t* imu)
+
+//
+// average the first samples and seed the quaternion from them.
+// this replaces converging from identity by gradient descent
+//
+static void
+imu_align(imu_t* imu)
 {
-  /*
-  accel_body[0]  = accel_value[1];
-  accel_body[1]  = accel_value[0];
-  accel_body[2]  = accel_value[2];
-
-  gyro_body[0]   = -gyro_dps[1];
-  gyro_body[1]   = -gyro_dps[0];
-  gyro_body[2]   = -gyro_dps[2];
-
-  mag_body[0]    = mag_value[1];
-  mag_body[1]    = mag_value[0];
-  mag_body[2]    = mag_value[2];
-  */
-  accel_body[0]  = accel_value[1];
-  accel_body[1]  =-accel_value[0];
-  accel_body[2]  = accel_value[2];
-
-  gyro_body[0]   = gyro_dps[1];
-  gyro_body[1]   =-gyro_dps[0];
-  gyro_body[2]   = gyro_dps[2];
-
-  mag_body[0]    = mag_value[1];
-  mag_body[1]    =-mag_value[0];
-  mag_body[2]    = mag_value[2];
+  for(int i = 0; i < 3; i++)
+  {
+    imu->align_accel[i] += accel_body[i];
+  }
+  imu->align_count++;
+
+  if(imu->mag_seen != mag_sample_count)
+  {
+    imu->mag_seen = mag_sample_count;
+    for(int i = 0; i < 3; i++)
+    {
+      imu->align_mag[i] += mag_body[i];
+    }
+    imu->align_mag_count++;
+  }
+
+  if(imu->align_count < IMU_ALIGN_SAMPLES ||
+     (imu->align_mag_count == 0 && imu->align_count < IMU_ALIGN_TIMEOUT))
+  {
+    return;
+  }
+
+  // averaging is only for noise. the direction is what counts
+  ahrs_seed(&imu->ahrs, imu->align_accel, imu->align_mag);
+
+  imu->ready      = true;
+  imu->ready_time = __msec;
 }
 
+//
+// gyro+accel once per gyro sample, driven by accelgyro as each FIFO
+// frame comes out of the chain. a batch of frames is integrated frame by
+// frame and nothing is integrated twice when no frame arrived.
+// magnetometer comes in at 75Hz and only corrects heading, once per
+// fresh sample
+//
 static void
 imu_run(imu_t* imu)
 {
-  imu_body_aling(imu);
-
-  madgwick_update(&imu->filter,
-      gyro_body[0],    gyro_body[1],    gyro_body[2],
-      accel_body[0],   accel_body[1],   accel_body[2],
-      mag_body[0],     mag_body[1],     mag_body[2]);
-
-  madgwick_get_roll_pitch_yaw(&imu->filter,
-      attitude, GCFG->mag_decl);
+  if(!imu->ready)
+  {
+    imu_align(imu);
+    return;
+  }
+
+  ahrs_update_imu(&imu->ahrs, gyro_body, accel_body);
+
+  if(imu->mag_seen != mag_sample_count)
+  {
+    imu->mag_seen = mag_sample_count;
+    ahrs_update_mag(&imu->ahrs, mag_body);
+  }
 }
 
 static void
-imu_sample_timer_callback(SoftTimerElem* te)
+imu_sample_callback(void)
 {
   imu_run(&_imu);
-
-  mainloop_timer_schedule(&_sample_timer, 1);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -122,14 +145,9 @@ imu_sample_timer_callback(SoftTimerElem* te)
 void
 imu_init(void)
 {
-  memset(&_imu, 0, sizeof(_imu));
-
-  madgwick_init(&_imu.filter, IMU_SAMPLE_FREQ);
+  imu_reset();
 
-  soft_timer_init_elem(&_sample_timer);
-  _sample_timer.cb = imu_sample_timer_callback;
-
-  mainloop_timer_schedule(&_sample_timer, 1);
+  accelgyro_add_sample_callback(imu_sample_callback);
 }
 
 imu_t*
@@ -137,3 +155,33 @@ imu_get(void)
 {
   return &_imu;
 }
+
+//
+// euler angles in decidegree. flight control works on the quaternion
+// directly so this is only for display and telemetry
+//
+void
+imu_get_attitude(int16_t att[3])
+{
+  ahrs_get_roll_pitch_yaw(&_imu.ahrs, att, GCFG->mag_decl);
+}
+
+bool
+imu_is_ready(void)
+{
+  return _imu.ready;
+}
+
+//
+// restart with the configured AHRS engine. attitude is not ready until
+// the boot alignment runs again
+//
+void
+imu_reset(void)
+{
+  memset(&_imu, 0, sizeof(_imu));
+
+  _imu.mag_seen = mag_sample_count;
+
+  ahrs_init(&_imu.ahrs, GCFG->ahrs_type, IMU_SAMPLE_FREQ);
+}
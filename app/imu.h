@@ -2,26 +2,34 @@
 #define __IMU_DEF_H__
 
 #include "app_common.h"
-#include "madgwick.h"
+#include "ahrs.h"
 
 typedef struct
 {
   //
   // AHRS filter
   //
-  madgwick_t    filter;
+  ahrs_t        ahrs;
+  uint32_t      mag_seen;     // last mag_sample_count fused
+  //
+  // boot alignment
+  //
+  bool          ready;
+  uint16_t      align_count;
+  uint16_t      align_mag_count;
+  float         align_accel[3];
+  float         align_mag[3];
+  uint32_t      ready_time;   // msec at which the filter was seeded
   //
   // orientation
   //
   int16_t   orient[3];    // in degrees * 10
 } imu_t;
 
-extern int16_t           attitude[3];
-extern int16_t           accel_body[3],
-                         mag_body[3];
-extern float             gyro_body[3];
-
 extern void imu_init(void);
 extern imu_t* imu_get(void);
+extern void imu_get_attitude(int16_t att[3]);
+extern bool imu_is_ready(void);
+extern void imu_reset(void);
 
 #endif /* !__IMU_DEF_H__ */
@@ -0,0 +1,262 @@
+#include <math.h>
+#include <string.h>
+#include "ins.h"
+#include "imu.h"
+#include "accelgyro.h"
+#include "magneto.h"
+#include "baro.h"
+#include "gps.h"
+#include "config.h"
+#include "math_helper.h"
+#include "cycle_counter.h"
+#include "mem_section.h"
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// INS glue. predicts on every IMU sample and feeds the EKF every fresh
+//
+//  - magnetometer sample as heading (75Hz)
+//  - baro altitude as up position (~97Hz)
+//  - GPS epoch as north/west position and all three velocities (5-18Hz)
+//
+// GPS and baro are late by the time they arrive. the EKF forms their
+// innovation against its own past estimate, see ins_ekf.c. the EKF clock
+// is the IMU sample time, so delays are counted from the sample too
+//
+////////////////////////////////////////////////////////////////////////////////
+#define INS_GPS_DELAY           100       // msec. uBlox solution to start of VELNED/PVT
+
+#define INS_GPS_MIN_SATS        6
+#define INS_GPS_MAX_EPH         500       // cm. worse than this is not used
+#define INS_GPS_RESET_REJECTS   25        // epochs of rejected position. 5 sec at 5Hz
+
+#define INS_GPS_VEL_VAR         sq(0.3f)
+#define INS_BARO_VAR            sq(0.5f)
+#define INS_MAG_VAR             sq(0.0873f)   // 5 degree
+
+#define INS_EARTH_RADIUS        6371000.0f
+#define INS_DEG7_TO_RAD         (1.0e-7f * 0.0174533f)
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// module privates
+//
+////////////////////////////////////////////////////////////////////////////////
+static CCM_BSS ins_ekf_t  _ekf;
+
+static bool             _running;
+static bool             _home_set;
+static int32_t          _home_lat,
+                        _home_lon;
+static float            _home_coslat;
+
+static uint32_t         _mag_seen,
+                        _baro_seen,
+                        _gps_seen;
+static uint16_t         _gps_rejects;
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// visibles
+//
+////////////////////////////////////////////////////////////////////////////////
+ins_stat_t              ins_stat;
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// private utilities
+//
+////////////////////////////////////////////////////////////////////////////////
+static void
+ins_start(void)
+{
+  float   q[4],
+          p[3] = { 0.0f, 0.0f, baroAltitude / 100.0f };
+
+  ahrs_get_quaternion(&imu_get()->ahrs, q);
+  ins_ekf_init(&_ekf, q, p, accel_gyro_msec);
+
+  _mag_seen   = mag_sample_count;
+  _baro_seen  = baroSampleCount;
+  _gps_seen   = gps_data.nav_seq;
+  _running    = true;
+}
+
+//
+// age in msec of a measurement against the sample being processed.
+// one stamped a little after it is not in the future, the FIFO was
+// only read before it arrived
+//
+static inline uint32_t
+ins_delay(int32_t age)
+{
+  return age > 0 ? (uint32_t)age : 0;
+}
+
+static void
+ins_gps_to_local(float pos[2])
+{
+  pos[0] =  (gps_data.llh.lat - _home_lat) * INS_DEG7_TO_RAD * INS_EARTH_RADIUS;
+  pos[1] = -(gps_data.llh.lon - _home_lon) * INS_DEG7_TO_RAD * INS_EARTH_RADIUS * _home_coslat;
+}
+
+static void
+ins_fuse_gps(void)
+{
+  float     pos[2],
+            vel[3],
+            pvar;
+  uint32_t  delay;
+  bool      accepted;
+
+  if(gps_data.fix_type != GPS_FIX_3D ||
+     gps_data.num_sat < INS_GPS_MIN_SATS ||
+     gps_data.eph > INS_GPS_MAX_EPH)
+  {
+    return;
+  }
+
+  // NED cm/s to NWU m/s
+  vel[0] =  gps_data.vel_ned[0] / 100.0f;
+  vel[1] = -gps_data.vel_ned[1] / 100.0f;
+  vel[2] = -gps_data.vel_ned[2] / 100.0f;
+
+  pvar = sq(gps_data.eph / 100.0f);
+
+  if(!_home_set)
+  {
+    _home_lat     = gps_data.llh.lat;
+    _home_lon     = gps_data.llh.lon;
+    _home_coslat  = cosf(_home_lat * INS_DEG7_TO_RAD);
+    _home_set     = true;
+
+    for(int i = 0; i < 2; i++)
+    {
+      ins_ekf_reset_pos(&_ekf, i, 0.0f, pvar);
+      ins_ekf_reset_vel(&_ekf, i, vel[i], INS_GPS_VEL_VAR);
+    }
+    return;
+  }
+
+  ins_gps_to_local(pos);
+
+  delay = ins_delay((int32_t)(accel_gyro_usec - gps_data.nav_usec) / 1000) + INS_GPS_DELAY;
+
+  accepted  = ins_ekf_fuse_pos(&_ekf, 0, pos[0], pvar, delay);
+  accepted |= ins_ekf_fuse_pos(&_ekf, 1, pos[1], pvar, delay);
+
+  for(int i = 0; i < 3; i++)
+  {
+    ins_ekf_fuse_vel(&_ekf, i, vel[i], INS_GPS_VEL_VAR, delay);
+  }
+
+  //
+  // a long GPS outage leaves the estimate far outside the gate.
+  // give up on it and jump to GPS
+  //
+  _gps_rejects = accepted ? 0 : _gps_rejects + 1;
+  if(_gps_rejects >= INS_GPS_RESET_REJECTS)
+  {
+    for(int i = 0; i < 2; i++)
+    {
+      ins_ekf_reset_pos(&_ekf, i, pos[i], pvar);
+      ins_ekf_reset_vel(&_ekf, i, vel[i], INS_GPS_VEL_VAR);
+    }
+    _gps_rejects = 0;
+    ins_stat.gps_resets++;
+  }
+}
+
+//
+// runs per IMU sample, after imu.c updated the AHRS with it
+//
+static void
+ins_sample_callback(void)
+{
+  uint32_t  start;
+
+  if(!_running)
+  {
+    if(imu_is_ready())
+    {
+      ins_start();
+    }
+    return;
+  }
+
+  start = cycle_counter_get();
+  ins_ekf_predict(&_ekf, gyro_body, accel_body, 1.0f / ACCELGYRO_SAMPLE_FREQ, accel_gyro_msec);
+  ins_stat.predict_cycles = cycle_counter_get() - start;
+  if(ins_stat.predict_cycles > ins_stat.predict_cycles_max)
+  {
+    ins_stat.predict_cycles_max = ins_stat.predict_cycles;
+  }
+
+  //
+  // at most one measurement kind per step to spread the load
+  //
+  start = cycle_counter_get();
+  if(_gps_seen != gps_data.nav_seq)
+  {
+    _gps_seen = gps_data.nav_seq;
+    ins_fuse_gps();
+    ins_stat.gps_count++;
+  }
+  else if(_baro_seen != baroSampleCount)
+  {
+    _baro_seen = baroSampleCount;
+    ins_ekf_fuse_pos(&_ekf, 2, baroAltitude / 100.0f, INS_BARO_VAR,
+        ins_delay((int32_t)(accel_gyro_msec - baroSampleMsec)));
+    ins_stat.baro_count++;
+  }
+  else if(_mag_seen != mag_sample_count)
+  {
+    _mag_seen = mag_sample_count;
+    ins_ekf_fuse_heading(&_ekf, mag_body, GCFG->mag_decl * (0.0174533f / 10.0f), INS_MAG_VAR);
+    ins_stat.mag_count++;
+  }
+  else
+  {
+    return;
+  }
+
+  ins_stat.fuse_cycles = cycle_counter_get() - start;
+  if(ins_stat.fuse_cycles > ins_stat.fuse_cycles_max)
+  {
+    ins_stat.fuse_cycles_max = ins_stat.fuse_cycles;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// public interfaces
+//
+////////////////////////////////////////////////////////////////////////////////
+void
+ins_init(void)
+{
+  _running  = false;
+  _home_set = false;
+
+  memset(&ins_stat, 0, sizeof(ins_stat));
+
+  accelgyro_add_sample_callback(ins_sample_callback);
+}
+
+bool
+ins_is_running(void)
+{
+  return _running;
+}
+
+bool
+ins_has_home(void)
+{
+  return _home_set;
+}
+
+ins_ekf_t*
+ins_get(void)
+{
+  return &_ekf;
+}
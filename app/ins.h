@@ -0,0 +1,26 @@
+#ifndef __INS_DEF_H__
+#define __INS_DEF_H__
+
+#include "app_common.h"
+#include "ins_ekf.h"
+
+typedef struct
+{
+  uint32_t    predict_cycles;       // cycles of the last IMU step
+  uint32_t    predict_cycles_max;
+  uint32_t    fuse_cycles;          // cycles of the last measurement step
+  uint32_t    fuse_cycles_max;
+  uint32_t    gps_count;
+  uint32_t    baro_count;
+  uint32_t    mag_count;
+  uint32_t    gps_resets;
+} ins_stat_t;
+
+extern ins_stat_t   ins_stat;
+
+extern void ins_init(void);
+extern bool ins_is_running(void);
+extern bool ins_has_home(void);
+extern ins_ekf_t* ins_get(void);
+
+#endif /* !__INS_DEF_H__ */
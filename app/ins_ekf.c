@@ -0,0 +1,614 @@
+#include <math.h>
+#include <string.h>
+#include "app_common.h"
+#include "math_helper.h"
+#include "ins_ekf.h"
+#include "mem_section.h"
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// error state EKF.
+//
+// continuous error dynamics with R body to earth, fe specific force in
+// earth frame
+//
+//    d(att)    = -R d(gbias)
+//    d(vel)    = -[fe]x d(att) - R d(abias)
+//    d(pos)    = d(vel)
+//    d(gbias)  = d(abias) = 0
+//
+// F = I + A*dt has only five non zero off diagonal 3x3 blocks, and every
+// measurement here sees a single 3 state group. both are exploited by
+// hand below instead of going through generic matrix code.
+//
+// P is kept as the upper triangle of 5x5 blocks of 3x3 (135 floats).
+//
+////////////////////////////////////////////////////////////////////////////////
+
+//
+// process noise. spectral densities
+//
+#define INS_EKF_GYRO_NOISE        1.0e-3f     // rad/s/sqrt(Hz)
+#define INS_EKF_ACCEL_NOISE       0.1f        // m/s^2/sqrt(Hz)
+#define INS_EKF_GBIAS_WALK        2.0e-5f     // rad/s^2/sqrt(Hz)
+#define INS_EKF_ABIAS_WALK        5.0e-4f     // m/s^3/sqrt(Hz)
+
+//
+// innovation gate. squared number of sigmas
+//
+#define INS_EKF_GATE              25.0f
+
+#define D2R                       0.0174533f
+
+//
+// block index of group pair. lower half points to the transposed block
+//
+static const uint8_t  _blk[INS_EKF_NUM_GROUPS][INS_EKF_NUM_GROUPS] =
+{
+  {  0,  1,  2,  3,  4 },
+  {  1,  5,  6,  7,  8 },
+  {  2,  6,  9, 10, 11 },
+  {  3,  7, 10, 12, 13 },
+  {  4,  8, 11, 13, 14 },
+};
+
+//
+// F*P scratch. full 5x5 blocks
+//
+static CCM_BSS float  _G[INS_EKF_NUM_GROUPS][INS_EKF_NUM_GROUPS][9];
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// 3x3 helpers. row major
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// o -= s * a * b
+static inline void
+m3_sub_mul(float* o, float s, const float* a, const float* b)
+{
+  for(int r = 0; r < 3; r++)
+  {
+    for(int c = 0; c < 3; c++)
+    {
+      o[r * 3 + c] -= s * (a[r * 3 + 0] * b[0 * 3 + c] +
+                           a[r * 3 + 1] * b[1 * 3 + c] +
+                           a[r * 3 + 2] * b[2 * 3 + c]);
+    }
+  }
+}
+
+// o -= s * a * b^T
+static inline void
+m3_sub_mul_bt(float* o, float s, const float* a, const float* b)
+{
+  for(int r = 0; r < 3; r++)
+  {
+    for(int c = 0; c < 3; c++)
+    {
+      o[r * 3 + c] -= s * (a[r * 3 + 0] * b[c * 3 + 0] +
+                           a[r * 3 + 1] * b[c * 3 + 1] +
+                           a[r * 3 + 2] * b[c * 3 + 2]);
+    }
+  }
+}
+
+// o -= s * [f]x * b. cross product on every column
+static inline void
+m3_sub_cross_cols(float* o, float s, const float f[3], const float* b)
+{
+  for(int c = 0; c < 3; c++)
+  {
+    o[0 * 3 + c] -= s * (f[1] * b[2 * 3 + c] - f[2] * b[1 * 3 + c]);
+    o[1 * 3 + c] -= s * (f[2] * b[0 * 3 + c] - f[0] * b[2 * 3 + c]);
+    o[2 * 3 + c] -= s * (f[0] * b[1 * 3 + c] - f[1] * b[0 * 3 + c]);
+  }
+}
+
+// o -= s * b * [f]x^T. cross product on every row
+static inline void
+m3_sub_cross_rows(float* o, float s, const float f[3], const float* b)
+{
+  for(int r = 0; r < 3; r++)
+  {
+    o[r * 3 + 0] -= s * (f[1] * b[r * 3 + 2] - f[2] * b[r * 3 + 1]);
+    o[r * 3 + 1] -= s * (f[2] * b[r * 3 + 0] - f[0] * b[r * 3 + 2]);
+    o[r * 3 + 2] -= s * (f[0] * b[r * 3 + 1] - f[1] * b[r * 3 + 0]);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// covariance access
+//
+////////////////////////////////////////////////////////////////////////////////
+static inline void
+ins_ekf_get_block(const ins_ekf_t* ekf, int i, int j, float* b)
+{
+  const float* s = ekf->P[_blk[i][j]];
+
+  if(i <= j)
+  {
+    memcpy(b, s, sizeof(float) * 9);
+    return;
+  }
+
+  for(int r = 0; r < 3; r++)
+  {
+    for(int c = 0; c < 3; c++)
+    {
+      b[r * 3 + c] = s[c * 3 + r];
+    }
+  }
+}
+
+static inline float*
+ins_ekf_p_ptr(ins_ekf_t* ekf, int r, int c)
+{
+  int   i = r / 3,
+        j = c / 3;
+
+  if(i <= j)
+  {
+    return &ekf->P[_blk[i][j]][(r % 3) * 3 + (c % 3)];
+  }
+  return &ekf->P[_blk[j][i]][(c % 3) * 3 + (r % 3)];
+}
+
+static inline void
+ins_ekf_rotation(const float q[4], float R[9])
+{
+  R[0] = 1.0f - 2.0f * (q[2] * q[2] + q[3] * q[3]);
+  R[1] = 2.0f * (q[1] * q[2] - q[0] * q[3]);
+  R[2] = 2.0f * (q[1] * q[3] + q[0] * q[2]);
+  R[3] = 2.0f * (q[1] * q[2] + q[0] * q[3]);
+  R[4] = 1.0f - 2.0f * (q[1] * q[1] + q[3] * q[3]);
+  R[5] = 2.0f * (q[2] * q[3] - q[0] * q[1]);
+  R[6] = 2.0f * (q[1] * q[3] - q[0] * q[2]);
+  R[7] = 2.0f * (q[2] * q[3] + q[0] * q[1]);
+  R[8] = 1.0f - 2.0f * (q[1] * q[1] + q[2] * q[2]);
+}
+
+static inline void
+ins_ekf_quat_normalize(float q[4])
+{
+  float recipNorm = math_rsqrtf(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+
+  q[0] *= recipNorm;
+  q[1] *= recipNorm;
+  q[2] *= recipNorm;
+  q[3] *= recipNorm;
+}
+
+//
+// P = F * P * F^T + Q
+//
+static void
+ins_ekf_predict_cov(ins_ekf_t* ekf, const float R[9], const float fe[3], float dt)
+{
+  float   B[INS_EKF_NUM_GROUPS][9];
+  float*  o;
+
+  //
+  // G = F * P, one block column at a time
+  //
+  for(int j = 0; j < INS_EKF_NUM_GROUPS; j++)
+  {
+    for(int k = 0; k < INS_EKF_NUM_GROUPS; k++)
+    {
+      ins_ekf_get_block(ekf, k, j, B[k]);
+    }
+
+    memcpy(_G[0][j], B[0], sizeof(float) * 9);
+    m3_sub_mul(_G[0][j], dt, R, B[3]);
+
+    memcpy(_G[1][j], B[1], sizeof(float) * 9);
+    m3_sub_cross_cols(_G[1][j], dt, fe, B[0]);
+    m3_sub_mul(_G[1][j], dt, R, B[4]);
+
+    for(int e = 0; e < 9; e++)
+    {
+      _G[2][j][e] = B[2][e] + dt * B[1][e];
+    }
+
+    memcpy(_G[3][j], B[3], sizeof(float) * 9);
+    memcpy(_G[4][j], B[4], sizeof(float) * 9);
+  }
+
+  //
+  // P = G * F^T, upper blocks only
+  //
+  for(int i = 0; i < INS_EKF_NUM_GROUPS; i++)
+  {
+    for(int j = i; j < INS_EKF_NUM_GROUPS; j++)
+    {
+      o = ekf->P[_blk[i][j]];
+
+      switch(j)
+      {
+      case 0:
+        memcpy(o, _G[i][0], sizeof(float) * 9);
+        m3_sub_mul_bt(o, dt, _G[i][3], R);
+        break;
+
+      case 1:
+        memcpy(o, _G[i][1], sizeof(float) * 9);
+        m3_sub_cross_rows(o, dt, fe, _G[i][0]);
+        m3_sub_mul_bt(o, dt, _G[i][4], R);
+        break;
+
+      case 2:
+        for(int e = 0; e < 9; e++)
+        {
+          o[e] = _G[i][2][e] + dt * _G[i][1][e];
+        }
+        break;
+
+      default:
+        memcpy(o, _G[i][j], sizeof(float) * 9);
+        break;
+      }
+    }
+  }
+
+  //
+  // process noise and keep diagonal blocks symmetric
+  //
+  for(int i = 0; i < INS_EKF_NUM_GROUPS; i++)
+  {
+    static const float  noise[INS_EKF_NUM_GROUPS] =
+    {
+      INS_EKF_GYRO_NOISE * INS_EKF_GYRO_NOISE,
+      INS_EKF_ACCEL_NOISE * INS_EKF_ACCEL_NOISE,
+      0.0f,
+      INS_EKF_GBIAS_WALK * INS_EKF_GBIAS_WALK,
+      INS_EKF_ABIAS_WALK * INS_EKF_ABIAS_WALK,
+    };
+
+    o = ekf->P[_blk[i][i]];
+
+    o[1] = o[3] = 0.5f * (o[1] + o[3]);
+    o[2] = o[6] = 0.5f * (o[2] + o[6]);
+    o[5] = o[7] = 0.5f * (o[5] + o[7]);
+
+    o[0] += noise[i] * dt;
+    o[4] += noise[i] * dt;
+    o[8] += noise[i] * dt;
+  }
+}
+
+//
+// apply error state to nominal state. the error state is then zero again
+//
+static void
+ins_ekf_inject(ins_ekf_t* ekf, const float dx[INS_EKF_NUM_STATES])
+{
+  const float*  da = &dx[INS_EKF_ATT];
+  float         q[4];
+
+  // q = [1, da/2] * q
+  q[0] = ekf->q[0] - 0.5f * (da[0] * ekf->q[1] + da[1] * ekf->q[2] + da[2] * ekf->q[3]);
+  q[1] = ekf->q[1] + 0.5f * (da[0] * ekf->q[0] + da[1] * ekf->q[3] - da[2] * ekf->q[2]);
+  q[2] = ekf->q[2] + 0.5f * (da[1] * ekf->q[0] - da[0] * ekf->q[3] + da[2] * ekf->q[1]);
+  q[3] = ekf->q[3] + 0.5f * (da[2] * ekf->q[0] + da[0] * ekf->q[2] - da[1] * ekf->q[1]);
+  ins_ekf_quat_normalize(q);
+  memcpy(ekf->q, q, sizeof(q));
+
+  for(int i = 0; i < 3; i++)
+  {
+    ekf->v[i]   += dx[INS_EKF_VEL + i];
+    ekf->p[i]   += dx[INS_EKF_POS + i];
+    ekf->bg[i]  += dx[INS_EKF_GBIAS + i];
+    ekf->ba[i]  += dx[INS_EKF_ABIAS + i];
+  }
+
+  //
+  // history moves with the estimate so a later delayed measurement
+  // does not correct the same error twice
+  //
+  for(int h = 0; h < ekf->hist_count; h++)
+  {
+    for(int i = 0; i < 3; i++)
+    {
+      ekf->hist[h].v[i] += dx[INS_EKF_VEL + i];
+      ekf->hist[h].p[i] += dx[INS_EKF_POS + i];
+    }
+  }
+}
+
+//
+// measurement that only sees one group of three states through h.
+// with c = P(:,g) * h
+//
+//    s  = h' * P(g,g) * h + var
+//    K  = c / s
+//    P -= c * c' / s
+//
+// position, velocity and baro are unit h. heading has all three
+// attitude entries non zero
+//
+static bool
+ins_ekf_fuse_group(ins_ekf_t* ekf, int g, const float h[3], float innov, float var)
+{
+  float   c[INS_EKF_NUM_STATES];
+  float   dx[INS_EKF_NUM_STATES];
+  float   s, inv;
+  float*  o;
+
+  for(int i = 0; i < INS_EKF_NUM_STATES; i++)
+  {
+    c[i] = *ins_ekf_p_ptr(ekf, i, g * 3 + 0) * h[0] +
+           *ins_ekf_p_ptr(ekf, i, g * 3 + 1) * h[1] +
+           *ins_ekf_p_ptr(ekf, i, g * 3 + 2) * h[2];
+  }
+
+  s = c[g * 3 + 0] * h[0] + c[g * 3 + 1] * h[1] + c[g * 3 + 2] * h[2] + var;
+  if(s <= 0.0f || innov * innov > INS_EKF_GATE * s)
+  {
+    ekf->reject_count++;
+    return false;
+  }
+  inv = 1.0f / s;
+
+  for(int i = 0; i < INS_EKF_NUM_GROUPS; i++)
+  {
+    for(int j = i; j < INS_EKF_NUM_GROUPS; j++)
+    {
+      const float*  ci = &c[i * 3];
+      const float*  cj = &c[j * 3];
+
+      o = ekf->P[_blk[i][j]];
+
+      for(int r = 0; r < 3; r++)
+      {
+        float   a = ci[r] * inv;
+
+        o[r * 3 + 0] -= a * cj[0];
+        o[r * 3 + 1] -= a * cj[1];
+        o[r * 3 + 2] -= a * cj[2];
+      }
+    }
+  }
+
+  for(int i = 0; i < INS_EKF_NUM_STATES; i++)
+  {
+    dx[i] = c[i] * inv * innov;
+  }
+  ins_ekf_inject(ekf, dx);
+
+  ekf->fuse_count++;
+  return true;
+}
+
+static inline bool
+ins_ekf_fuse_state(ins_ekf_t* ekf, int k, float innov, float var)
+{
+  float   h[3] = { 0.0f, 0.0f, 0.0f };
+
+  h[k % 3] = 1.0f;
+  return ins_ekf_fuse_group(ekf, k / 3, h, innov, var);
+}
+
+static void
+ins_ekf_reset_state(ins_ekf_t* ekf, int k, float var)
+{
+  for(int i = 0; i < INS_EKF_NUM_STATES; i++)
+  {
+    *ins_ekf_p_ptr(ekf, i, k) = 0.0f;
+    *ins_ekf_p_ptr(ekf, k, i) = 0.0f;
+  }
+  *ins_ekf_p_ptr(ekf, k, k) = var;
+}
+
+static const ins_ekf_hist_t*
+ins_ekf_hist_lookup(const ins_ekf_t* ekf, uint32_t delay)
+{
+  uint32_t              t = ekf->msec - delay;
+  const ins_ekf_hist_t* h = NULL;
+  int                   ndx = ekf->hist_head;
+
+  // newest to oldest
+  for(int i = 0; i < ekf->hist_count; i++)
+  {
+    ndx = (ndx == 0) ? INS_EKF_HIST_LEN - 1 : ndx - 1;
+    h   = &ekf->hist[ndx];
+
+    if((int32_t)(t - h->msec) >= 0)
+    {
+      break;
+    }
+  }
+  return h;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// public interfaces
+//
+////////////////////////////////////////////////////////////////////////////////
+void
+ins_ekf_init(ins_ekf_t* ekf, const float q[4], const float p[3], uint32_t msec)
+{
+  static const float  var[INS_EKF_NUM_STATES] =
+  {
+    sq(2.0f * D2R),   sq(2.0f * D2R),   sq(10.0f * D2R),
+    1.0f,             1.0f,             1.0f,
+    100.0f,           100.0f,           1.0f,
+    sq(0.5f * D2R),   sq(0.5f * D2R),   sq(0.5f * D2R),
+    sq(0.2f),         sq(0.2f),         sq(0.2f),
+  };
+
+  memset(ekf, 0, sizeof(ins_ekf_t));
+
+  memcpy(ekf->q, q, sizeof(float) * 4);
+  memcpy(ekf->p, p, sizeof(float) * 3);
+  ekf->msec = msec;
+
+  for(int i = 0; i < INS_EKF_NUM_STATES; i++)
+  {
+    *ins_ekf_p_ptr(ekf, i, i) = var[i];
+  }
+}
+
+//
+// gyro in dps, accel in G. body frame
+//
+void
+ins_ekf_predict(ins_ekf_t* ekf, const float gyro[3], const float accel[3],
+    float dt, uint32_t msec)
+{
+  float   R[9], w[3], f[3], fe[3], acc[3];
+  float*  q = ekf->q;
+  float   qd[4];
+  ins_ekf_hist_t* h;
+
+  for(int i = 0; i < 3; i++)
+  {
+    w[i] = gyro[i] * D2R - ekf->bg[i];
+    f[i] = accel[i] * INS_EKF_GRAVITY - ekf->ba[i];
+  }
+
+  ins_ekf_rotation(q, R);
+
+  for(int i = 0; i < 3; i++)
+  {
+    fe[i]  = R[i * 3 + 0] * f[0] + R[i * 3 + 1] * f[1] + R[i * 3 + 2] * f[2];
+    acc[i] = fe[i];
+  }
+  acc[2] -= INS_EKF_GRAVITY;
+
+  for(int i = 0; i < 3; i++)
+  {
+    ekf->p[i] += (ekf->v[i] + 0.5f * acc[i] * dt) * dt;
+    ekf->v[i] += acc[i] * dt;
+  }
+
+  qd[0] = 0.5f * (-q[1] * w[0] - q[2] * w[1] - q[3] * w[2]);
+  qd[1] = 0.5f * ( q[0] * w[0] + q[2] * w[2] - q[3] * w[1]);
+  qd[2] = 0.5f * ( q[0] * w[1] - q[1] * w[2] + q[3] * w[0]);
+  qd[3] = 0.5f * ( q[0] * w[2] + q[1] * w[1] - q[2] * w[0]);
+  for(int i = 0; i < 4; i++)
+  {
+    q[i] += qd[i] * dt;
+  }
+  ins_ekf_quat_normalize(q);
+
+  ins_ekf_predict_cov(ekf, R, fe, dt);
+
+  ekf->msec = msec;
+
+  if(ekf->hist_count == 0 ||
+     (msec - ekf->hist[(ekf->hist_head + INS_EKF_HIST_LEN - 1) % INS_EKF_HIST_LEN].msec) >= INS_EKF_HIST_INTERVAL)
+  {
+    h = &ekf->hist[ekf->hist_head];
+    h->msec = msec;
+    memcpy(h->p, ekf->p, sizeof(float) * 3);
+    memcpy(h->v, ekf->v, sizeof(float) * 3);
+
+    ekf->hist_head = (ekf->hist_head + 1) % INS_EKF_HIST_LEN;
+    if(ekf->hist_count < INS_EKF_HIST_LEN)
+    {
+      ekf->hist_count++;
+    }
+  }
+}
+
+//
+// delay is how old the measurement is in msec. the innovation is formed
+// against the estimate at that time and the correction goes to now
+//
+bool
+ins_ekf_fuse_pos(ins_ekf_t* ekf, int axis, float z, float var, uint32_t delay)
+{
+  const ins_ekf_hist_t* h = delay ? ins_ekf_hist_lookup(ekf, delay) : NULL;
+  float                 x = h ? h->p[axis] : ekf->p[axis];
+
+  return ins_ekf_fuse_state(ekf, INS_EKF_POS + axis, z - x, var);
+}
+
+bool
+ins_ekf_fuse_vel(ins_ekf_t* ekf, int axis, float z, float var, uint32_t delay)
+{
+  const ins_ekf_hist_t* h = delay ? ins_ekf_hist_lookup(ekf, delay) : NULL;
+  float                 x = h ? h->v[axis] : ekf->v[axis];
+
+  return ins_ekf_fuse_state(ekf, INS_EKF_VEL + axis, z - x, var);
+}
+
+//
+// magnetometer as a heading measurement. decl is declination in rad,
+// east positive.
+//
+// with field h in earth frame the heading error is atan2(hy, hx) and
+// an attitude error d moves it by
+//
+//    -dz + hz * (dx * hx + dy * hy) / (hx^2 + hy^2)
+//
+// the tilt part is not small with a steep field so it is kept in h
+//
+bool
+ins_ekf_fuse_heading(ins_ekf_t* ekf, const float m[3], float decl, float var)
+{
+  float   R[9], hx, hy, hz, hh, err, h[3];
+
+  ins_ekf_rotation(ekf->q, R);
+
+  hx = R[0] * m[0] + R[1] * m[1] + R[2] * m[2];
+  hy = R[3] * m[0] + R[4] * m[1] + R[5] * m[2];
+  hz = R[6] * m[0] + R[7] * m[1] + R[8] * m[2];
+
+  hh = hx * hx + hy * hy;
+  if(hh == 0.0f)
+  {
+    return false;
+  }
+
+  h[0] = -hz * hx / hh;
+  h[1] = -hz * hy / hh;
+  h[2] = 1.0f;
+
+  // magnetic north is at -decl in NWU
+  err = math_atan2f(hy, hx) + decl;
+  if(err > M_PI)
+  {
+    err -= 2.0f * M_PI;
+  }
+  else if(err < -M_PI)
+  {
+    err += 2.0f * M_PI;
+  }
+
+  return ins_ekf_fuse_group(ekf, INS_EKF_ATT / 3, h, -err, var);
+}
+
+void
+ins_ekf_reset_pos(ins_ekf_t* ekf, int axis, float z, float var)
+{
+  float   d = z - ekf->p[axis];
+
+  ekf->p[axis] = z;
+  for(int h = 0; h < ekf->hist_count; h++)
+  {
+    ekf->hist[h].p[axis] += d;
+  }
+  ins_ekf_reset_state(ekf, INS_EKF_POS + axis, var);
+}
+
+void
+ins_ekf_reset_vel(ins_ekf_t* ekf, int axis, float z, float var)
+{
+  float   d = z - ekf->v[axis];
+
+  ekf->v[axis] = z;
+  for(int h = 0; h < ekf->hist_count; h++)
+  {
+    ekf->hist[h].v[axis] += d;
+  }
+  ins_ekf_reset_state(ekf, INS_EKF_VEL + axis, var);
+}
+
+float
+ins_ekf_get_var(ins_ekf_t* ekf, int k)
+{
+  return *ins_ekf_p_ptr(ekf, k, k);
+}
@@ -0,0 +1,75 @@
+#ifndef __INS_EKF_DEF_H__
+#define __INS_EKF_DEF_H__
+
+#include "app_common.h"
+
+//
+// error state EKF for the full INS.
+//
+// nominal state  : attitude quaternion (body to earth), velocity,
+//                  position, gyro bias, accel bias
+// error state    : 15 entries in five 3 vector groups below.
+//                  attitude error is a small rotation in earth frame
+//
+// earth frame is NWU like the rest of the firmware.
+// position in meter from home, velocity in m/s, biases in rad/s and m/s^2
+//
+#define INS_EKF_ATT             0
+#define INS_EKF_VEL             3
+#define INS_EKF_POS             6
+#define INS_EKF_GBIAS           9
+#define INS_EKF_ABIAS           12
+#define INS_EKF_NUM_STATES      15
+
+#define INS_EKF_NUM_GROUPS      5
+#define INS_EKF_NUM_BLOCKS      15    // upper triangle of 5x5 blocks
+
+//
+// past position/velocity to form innovations of delayed measurements
+//
+#define INS_EKF_HIST_LEN        32
+#define INS_EKF_HIST_INTERVAL   10    // msec. 320ms window
+
+#define INS_EKF_GRAVITY         9.80665f
+
+typedef struct
+{
+  uint32_t    msec;
+  float       p[3];
+  float       v[3];
+} ins_ekf_hist_t;
+
+typedef struct
+{
+  float           q[4];
+  float           v[3];
+  float           p[3];
+  float           bg[3];
+  float           ba[3];
+
+  //
+  // covariance. only the upper triangle of 3x3 blocks is kept.
+  // diagonal blocks are stored full
+  //
+  float           P[INS_EKF_NUM_BLOCKS][9];
+
+  ins_ekf_hist_t  hist[INS_EKF_HIST_LEN];
+  uint8_t         hist_head;
+  uint8_t         hist_count;
+  uint32_t        msec;
+
+  uint32_t        fuse_count;
+  uint32_t        reject_count;
+} ins_ekf_t;
+
+extern void ins_ekf_init(ins_ekf_t* ekf, const float q[4], const float p[3], uint32_t msec);
+extern void ins_ekf_predict(ins_ekf_t* ekf, const float gyro[3], const float accel[3],
+    float dt, uint32_t msec);
+extern bool ins_ekf_fuse_pos(ins_ekf_t* ekf, int axis, float z, float var, uint32_t delay);
+extern bool ins_ekf_fuse_vel(ins_ekf_t* ekf, int axis, float z, float var, uint32_t delay);
+extern bool ins_ekf_fuse_heading(ins_ekf_t* ekf, const float m[3], float decl, float var);
+extern void ins_ekf_reset_pos(ins_ekf_t* ekf, int axis, float z, float var);
+extern void ins_ekf_reset_vel(ins_ekf_t* ekf, int axis, float z, float var);
+extern float ins_ekf_get_var(ins_ekf_t* ekf, int k);
+
+#endif /* !__INS_EKF_DEF_H__ */
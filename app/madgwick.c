@@ -1,13 +1,39 @@
 #include <math.h>
 #include "app_common.h"
 #include "math_helper.h"
+#include "ahrs_common.h"
 #include "madgwick.h"
+#include "mem_section.h"
+
+#define Q0    madgwick->q[0]
+#define Q1    madgwick->q[1]
+#define Q2    madgwick->q[2]
+#define Q3    madgwick->q[3]
+
+//
+// beta starts high to mop up what is left after the initial alignment
+// and decays to the in flight value with MADGWICK_BETA_TAU time constant.
+//
+#define MADGWICK_BETA_INIT  2.0f
+#define MADGWICK_BETA       0.1f
+#define MADGWICK_BETA_TAU   0.5f
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// private utilities
+//
+////////////////////////////////////////////////////////////////////////////////
+static inline void
+madgwick_beta_step(madgwick_t* madgwick)
+{
+  madgwick->beta -= (madgwick->beta - madgwick->betaFinal) * madgwick->betaDecay;
+}
 
-#define Q0    madgwick->q0
-#define Q1    madgwick->q1
-#define Q2    madgwick->q2
-#define Q3    madgwick->q3
-
+////////////////////////////////////////////////////////////////////////////////
+//
+// public interfaces
+//
+////////////////////////////////////////////////////////////////////////////////
 void
 madgwick_init(madgwick_t* madgwick, float sample_freq)
 {
@@ -15,21 +41,28 @@ madgwick_init(madgwick_t* madgwick, float sample_freq)
 
   madgwick->invSampleFreq = 1.0f/sample_freq;
 
-  madgwick->beta  = 0.25f;
+  madgwick->beta      = MADGWICK_BETA_INIT;
+  madgwick->betaFinal = MADGWICK_BETA;
+  madgwick->betaDecay = madgwick->invSampleFreq / MADGWICK_BETA_TAU;
+  madgwick->accWeight = 1.0f;
 
-  madgwick->q0    = 1.0f;
-  madgwick->q1    = 0.0f;
-  madgwick->q2    = 0.0f;
-  madgwick->q3    = 0.0f;
+  Q0    = 1.0f;
+  Q1    = 0.0f;
+  Q2    = 0.0f;
+  Q3    = 0.0f;
 }
 
+//
+// 9 DOF update. not called, ahrs.c corrects heading with
+// ahrs_update_mag() instead. kept in flash
+//
 void
 madgwick_update(madgwick_t* madgwick,
                 float gx, float gy, float gz,
 								float ax, float ay, float az,
 								float mx, float my, float mz)
 {
-	float recipNorm;
+	float recipNorm, gain;
 	float s0, s1, s2, s3;
 	float qDot1, qDot2, qDot3, qDot4;
 	float hx, hy;
@@ -56,13 +89,15 @@ madgwick_update(madgwick_t* madgwick,
 	// Compute feedback only if accelerometer measurement valid (avoids NaN in accelerometer normalisation)
   if(!((ax == 0.0f) && (ay == 0.0f) && (az == 0.0f))) {
 		// Normalise accelerometer measurement
-		recipNorm = invSqrt(ax * ax + ay * ay + az * az);
+		recipNorm = math_rsqrtf(ax * ax + ay * ay + az * az);
+		madgwick->accWeight = ahrs_accel_weight((ax * ax + ay * ay + az * az) * recipNorm);
+		gain = madgwick->beta * madgwick->accWeight;
 		ax *= recipNorm;
 		ay *= recipNorm;
 		az *= recipNorm;
 
 		// Normalise magnetometer measurement
-		recipNorm = invSqrt(mx * mx + my * my + mz * mz);
+		recipNorm = math_rsqrtf(mx * mx + my * my + mz * mz);
 		mx *= recipNorm;
 		my *= recipNorm;
 		mz *= recipNorm;
@@ -102,17 +137,17 @@ madgwick_update(madgwick_t* madgwick,
 		s1 = _2q3 * (2.0f * q1q3 - _2q0q2 - ax) + _2q0 * (2.0f * q0q1 + _2q2q3 - ay) - 4.0f * Q1 * (1 - 2.0f * q1q1 - 2.0f * q2q2 - az) + _2bz * Q3 * (_2bx * (0.5f - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx) + (_2bx * Q2 + _2bz * Q0) * (_2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my) + (_2bx * Q3 - _4bz * Q1) * (_2bx * (q0q2 + q1q3) + _2bz * (0.5f - q1q1 - q2q2) - mz);
 		s2 = -_2q0 * (2.0f * q1q3 - _2q0q2 - ax) + _2q3 * (2.0f * q0q1 + _2q2q3 - ay) - 4.0f * Q2 * (1 - 2.0f * q1q1 - 2.0f * q2q2 - az) + (-_4bx * Q2 - _2bz * Q0) * (_2bx * (0.5f - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx) + (_2bx * Q1 + _2bz * Q3) * (_2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my) + (_2bx * Q0 - _4bz * Q2) * (_2bx * (q0q2 + q1q3) + _2bz * (0.5f - q1q1 - q2q2) - mz);
 		s3 = _2q1 * (2.0f * q1q3 - _2q0q2 - ax) + _2q2 * (2.0f * q0q1 + _2q2q3 - ay) + (-_4bx * Q3 + _2bz * Q1) * (_2bx * (0.5f - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx) + (-_2bx * Q0 + _2bz * Q2) * (_2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my) + _2bx * Q1 * (_2bx * (q0q2 + q1q3) + _2bz * (0.5f - q1q1 - q2q2) - mz);
-		recipNorm = invSqrt(s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3); // normalise step magnitude
+		recipNorm = math_rsqrtf(s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3); // normalise step magnitude
 		s0 *= recipNorm;
 		s1 *= recipNorm;
 		s2 *= recipNorm;
 		s3 *= recipNorm;
 
 		// Apply feedback step
-		qDot1 -= madgwick->beta * s0;
-		qDot2 -= madgwick->beta * s1;
-		qDot3 -= madgwick->beta * s2;
-		qDot4 -= madgwick->beta * s3;
+		qDot1 -= gain * s0;
+		qDot2 -= gain * s1;
+		qDot3 -= gain * s2;
+		qDot4 -= gain * s3;
 	}
 
 	// Integrate rate of change of quaternion to yield quaternion
@@ -122,19 +157,21 @@ madgwick_update(madgwick_t* madgwick,
 	Q3 += qDot4 * madgwick->invSampleFreq;
 
 	// Normalise quaternion
-	recipNorm = invSqrt(Q0 * Q0 + Q1 * Q1 + Q2 * Q2 + Q3 * Q3);
+	recipNorm = math_rsqrtf(Q0 * Q0 + Q1 * Q1 + Q2 * Q2 + Q3 * Q3);
 	Q0 *= recipNorm;
 	Q1 *= recipNorm;
 	Q2 *= recipNorm;
 	Q3 *= recipNorm;
+
+	madgwick_beta_step(madgwick);
 }
 
-void
+FAST_CODE void
 madgwick_updateIMU(madgwick_t* madgwick, 
                    float gx, float gy, float gz,
                    float ax, float ay, float az)
 {
-  float recipNorm;
+  float recipNorm, gain;
   float s0, s1, s2, s3;
   float qDot1, qDot2, qDot3, qDot4;
   float _2q0, _2q1, _2q2, _2q3, _4q0, _4q1, _4q2 ,_8q1, _8q2, q0q0, q1q1, q2q2, q3q3;
@@ -154,7 +191,9 @@ madgwick_updateIMU(madgwick_t* madgwick,
   if(!((ax == 0.0f) && (ay == 0.0f) && (az == 0.0f))) 
   {
     // Normalise accelerometer measurement
-    recipNorm = invSqrt(ax * ax + ay * ay + az * az);
+    recipNorm = math_rsqrtf(ax * ax + ay * ay + az * az);
+    madgwick->accWeight = ahrs_accel_weight((ax * ax + ay * ay + az * az) * recipNorm);
+    gain = madgwick->beta * madgwick->accWeight;
     ax *= recipNorm;
     ay *= recipNorm;
     az *= recipNorm;
@@ -179,17 +218,17 @@ madgwick_updateIMU(madgwick_t* madgwick,
     s1 = _4q1 * q3q3 - _2q3 * ax + 4.0f * q0q0 * Q1 - _2q0 * ay - _4q1 + _8q1 * q1q1 + _8q1 * q2q2 + _4q1 * az;
     s2 = 4.0f * q0q0 * Q2 + _2q0 * ax + _4q2 * q3q3 - _2q3 * ay - _4q2 + _8q2 * q1q1 + _8q2 * q2q2 + _4q2 * az;
     s3 = 4.0f * q1q1 * Q3 - _2q1 * ax + 4.0f * q2q2 * Q3 - _2q2 * ay;
-    recipNorm = invSqrt(s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3); // normalise step magnitude
+    recipNorm = math_rsqrtf(s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3); // normalise step magnitude
     s0 *= recipNorm;
     s1 *= recipNorm;
     s2 *= recipNorm;
     s3 *= recipNorm;
 
     // Apply feedback step
-    qDot1 -= madgwick->beta * s0;
-    qDot2 -= madgwick->beta * s1;
-    qDot3 -= madgwick->beta * s2;
-    qDot4 -= madgwick->beta * s3;
+    qDot1 -= gain * s0;
+    qDot2 -= gain * s1;
+    qDot3 -= gain * s2;
+    qDot4 -= gain * s3;
   }
 
   // Integrate rate of change of quaternion to yield quaternion
@@ -199,41 +238,13 @@ madgwick_updateIMU(madgwick_t* madgwick,
   Q3 += qDot4 * madgwick->invSampleFreq;
 
   // Normalise quaternion
-  recipNorm = invSqrt(Q0 * Q0 + Q1 * Q1 + Q2 * Q2 + Q3 * Q3);
+  recipNorm = math_rsqrtf(Q0 * Q0 + Q1 * Q1 + Q2 * Q2 + Q3 * Q3);
   Q0 *= recipNorm;
   Q1 *= recipNorm;
   Q2 *= recipNorm;
   Q3 *= recipNorm;
-}
-
-void
-madgwick_get_roll_pitch_yaw(madgwick_t* madgwick, int16_t data[3], float md)
-{
-  float roll, pitch, yaw;
-
-#if 0   //ned
-  roll  = atan2f(Q0*Q1 + Q2*Q3, 0.5f - Q1*Q1 - Q2*Q2);
-  pitch = asinf(-2.0f * (Q1*Q3 - Q0*Q2));
-  yaw   = atan2f(Q1*Q2 + Q0*Q3, 0.5f - Q2*Q2 - Q3*Q3);
-
-#else   //nwu
-  roll  =  atan2f(2.0f*(Q2*Q3 + Q0*Q1), 2.0f*(sq(Q0) + sq(Q3)) - 1.0f);
-  pitch =  asinf(2.0f*(Q1*Q3 - Q0*Q2));
-  yaw   = -atan2f(2.0f*(Q1*Q2 + Q0*Q3), 2.0f*(sq(Q0) + sq(Q1)) - 1.0f);
-#endif
-
-  roll  = roll * 57.29578f;
-  pitch = pitch * 57.29578f;
-  yaw   = yaw * 57.29578f + md/10.0f;
-
-  if (yaw < 0.0f)
-  {
-    yaw += 360.0f;
-  }
 
-  data[0] = (int16_t)(roll * 10);
-  data[1] = (int16_t)(pitch * 10);
-  data[2] = (int16_t)(yaw * 10);
+  madgwick_beta_step(madgwick);
 }
 
 void
@@ -5,8 +5,11 @@ typedef struct
 {
   float sampleFreq;
   float invSampleFreq;
-  float beta;
-  float q0, q1, q2, q3;
+  float beta;         // current gain. decays from boot value to betaFinal
+  float betaFinal;
+  float betaDecay;    // fraction of the remaining gap removed per sample
+  float accWeight;    // accel trust of the last update. 0..1
+  float q[4];
 } madgwick_t;
 
 extern void madgwick_init(madgwick_t* madgwick, float sample_freq);
@@ -17,7 +20,6 @@ extern void madgwick_update(madgwick_t* madgwick,
                             float gx, float gy, float gz,
                             float ax, float ay, float az,
 								            float mx, float my, float mz);
-extern void madgwick_get_roll_pitch_yaw(madgwick_t* madgwick, int16_t data[3], float mg);
 extern void madgwick_get_quaternion(madgwick_t* madgwick, float data[4]);
 
 #endif //!__MADGWICK_DEF_H__
@@ -0,0 +1,381 @@
+#include <math.h>
+#include <string.h>
+#include "mag_ellipsoid.h"
+
+//
+// raw counts are scaled down before they are squared and multiplied
+// so the fourth order sums stay well inside float precision
+//
+#define MAG_ELLIPSOID_SCALE           512.0f
+#define MAG_ELLIPSOID_JACOBI_SWEEPS   8
+
+#define N                             MAG_ELLIPSOID_NUM_PARAMS
+
+//
+// cholesky factor. kept off the stack
+//
+static float    _U[N * (N + 1) / 2];
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// private utilities
+//
+////////////////////////////////////////////////////////////////////////////////
+static inline int
+pidx(int i, int j)
+{
+  return i * N - i * (i - 1) / 2 + (j - i);
+}
+
+static inline uint8_t
+mag_ellipsoid_bin(const mag_ellipsoid_t* e, const int16_t m[3])
+{
+  float   d[3];
+  int     a = 0;
+
+  for(int i = 0; i < 3; i++)
+  {
+    d[i] = m[i] - (e->min[i] + e->max[i]) / 2.0f;
+    if(fabsf(d[i]) > fabsf(d[a]))
+    {
+      a = i;
+    }
+  }
+
+  return (a * 2 + (d[a] < 0.0f)) * 4 +
+         (d[(a + 1) % 3] < 0.0f) * 2 +
+         (d[(a + 2) % 3] < 0.0f);
+}
+
+//
+// U' * U = DtD
+//
+static bool
+mag_ellipsoid_cholesky(const float* A)
+{
+  float   s;
+
+  for(int i = 0; i < N; i++)
+  {
+    for(int j = i; j < N; j++)
+    {
+      s = A[pidx(i, j)];
+      for(int k = 0; k < i; k++)
+      {
+        s -= _U[pidx(k, i)] * _U[pidx(k, j)];
+      }
+
+      if(i == j)
+      {
+        if(s <= 0.0f)
+        {
+          return false;
+        }
+        _U[pidx(i, i)] = sqrtf(s);
+      }
+      else
+      {
+        _U[pidx(i, j)] = s / _U[pidx(i, i)];
+      }
+    }
+  }
+  return true;
+}
+
+static void
+mag_ellipsoid_chol_solve(const float b[N], float x[N])
+{
+  float   y[N];
+
+  for(int i = 0; i < N; i++)
+  {
+    y[i] = b[i];
+    for(int k = 0; k < i; k++)
+    {
+      y[i] -= _U[pidx(k, i)] * y[k];
+    }
+    y[i] /= _U[pidx(i, i)];
+  }
+
+  for(int i = N - 1; i >= 0; i--)
+  {
+    x[i] = y[i];
+    for(int k = i + 1; k < N; k++)
+    {
+      x[i] -= _U[pidx(i, k)] * x[k];
+    }
+    x[i] /= _U[pidx(i, i)];
+  }
+}
+
+//
+// symmetric 3x3 eigen decomposition. a = v * diag(l) * v'
+//
+static void
+mag_ellipsoid_eigen(float a[3][3], float v[3][3], float l[3])
+{
+  static const uint8_t  pairs[3][2] = { { 0, 1 }, { 0, 2 }, { 1, 2 } };
+  float   theta, t, c, s, tmp;
+
+  memset(v, 0, sizeof(float) * 9);
+  v[0][0] = v[1][1] = v[2][2] = 1.0f;
+
+  for(int sweep = 0; sweep < MAG_ELLIPSOID_JACOBI_SWEEPS; sweep++)
+  {
+    for(int n = 0; n < 3; n++)
+    {
+      const int p = pairs[n][0],
+                q = pairs[n][1];
+
+      if(fabsf(a[p][q]) < 1.0e-12f)
+      {
+        continue;
+      }
+
+      theta = (a[q][q] - a[p][p]) / (2.0f * a[p][q]);
+      t     = 1.0f / (fabsf(theta) + sqrtf(theta * theta + 1.0f));
+      if(theta < 0.0f)
+      {
+        t = -t;
+      }
+      c = 1.0f / sqrtf(t * t + 1.0f);
+      s = t * c;
+
+      // a = J' * a * J
+      for(int k = 0; k < 3; k++)
+      {
+        tmp     = a[k][p];
+        a[k][p] = c * tmp - s * a[k][q];
+        a[k][q] = s * tmp + c * a[k][q];
+      }
+      for(int k = 0; k < 3; k++)
+      {
+        tmp     = a[p][k];
+        a[p][k] = c * tmp - s * a[q][k];
+        a[q][k] = s * tmp + c * a[q][k];
+      }
+
+      // v = v * J
+      for(int k = 0; k < 3; k++)
+      {
+        tmp     = v[k][p];
+        v[k][p] = c * tmp - s * v[k][q];
+        v[k][q] = s * tmp + c * v[k][q];
+      }
+    }
+  }
+
+  l[0] = a[0][0];
+  l[1] = a[1][1];
+  l[2] = a[2][2];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// public interfaces
+//
+////////////////////////////////////////////////////////////////////////////////
+void
+mag_ellipsoid_reset(mag_ellipsoid_t* e)
+{
+  memset(e, 0, sizeof(mag_ellipsoid_t));
+
+  for(int i = 0; i < 3; i++)
+  {
+    e->min[i] =  32767;
+    e->max[i] = -32768;
+  }
+}
+
+void
+mag_ellipsoid_push(mag_ellipsoid_t* e, const int16_t m[3])
+{
+  const float   x = m[0] / MAG_ELLIPSOID_SCALE,
+                y = m[1] / MAG_ELLIPSOID_SCALE,
+                z = m[2] / MAG_ELLIPSOID_SCALE;
+  float         d[N];
+  int           k = 0;
+
+  d[0] = x * x;
+  d[1] = y * y;
+  d[2] = z * z;
+  d[3] = 2.0f * x * y;
+  d[4] = 2.0f * x * z;
+  d[5] = 2.0f * y * z;
+  d[6] = 2.0f * x;
+  d[7] = 2.0f * y;
+  d[8] = 2.0f * z;
+
+  for(int i = 0; i < N; i++)
+  {
+    for(int j = i; j < N; j++)
+    {
+      e->DtD[k++] += d[i] * d[j];
+    }
+    e->Dt1[i] += d[i];
+  }
+  e->count++;
+
+  for(int i = 0; i < 3; i++)
+  {
+    if(m[i] < e->min[i])
+    {
+      e->min[i] = m[i];
+    }
+    if(m[i] > e->max[i])
+    {
+      e->max[i] = m[i];
+    }
+  }
+
+  e->bins |= (1UL << mag_ellipsoid_bin(e, m));
+}
+
+//
+// number of visited direction bins out of MAG_ELLIPSOID_NUM_BINS
+//
+uint8_t
+mag_ellipsoid_coverage(const mag_ellipsoid_t* e)
+{
+  uint32_t  b = e->bins;
+  uint8_t   n = 0;
+
+  while(b)
+  {
+    b &= b - 1;
+    n++;
+  }
+  return n;
+}
+
+//
+// with A the quadric matrix, g the linear part and center c = -inv(A) * g
+//
+//    (x - c)' * A * (x - c) = 1 + c' * A * c = k
+//
+// M = A / k is the ellipsoid shape. soft iron is sqrt(M) scaled to det 1
+// and radius is det(M)^(-1/6).
+//
+// the algebraic residual of the fit comes out of the same sums
+//
+//    sum (v' * d - 1)^2 = v' * DtD * v - 2 * v' * Dt1 + n
+//
+// and v' * d - 1 = k * (r^2 / R^2 - 1), about 2k times the relative
+// radius error of a sample
+//
+bool
+mag_ellipsoid_solve(const mag_ellipsoid_t* e, mag_ellipsoid_result_t* r)
+{
+  float   v[N],
+          A[3][3],
+          inv[3][3],
+          V[3][3],
+          l[3],
+          c[3],
+          det, k, res, radius;
+
+  if(e->count < MAG_ELLIPSOID_MIN_SAMPLES)
+  {
+    return false;
+  }
+
+  if(!mag_ellipsoid_cholesky(e->DtD))
+  {
+    return false;
+  }
+  mag_ellipsoid_chol_solve(e->Dt1, v);
+
+  A[0][0] = v[0];
+  A[1][1] = v[1];
+  A[2][2] = v[2];
+  A[0][1] = A[1][0] = v[3];
+  A[0][2] = A[2][0] = v[4];
+  A[1][2] = A[2][1] = v[5];
+
+  inv[0][0] = A[1][1] * A[2][2] - A[1][2] * A[2][1];
+  inv[0][1] = A[0][2] * A[2][1] - A[0][1] * A[2][2];
+  inv[0][2] = A[0][1] * A[1][2] - A[0][2] * A[1][1];
+  inv[1][1] = A[0][0] * A[2][2] - A[0][2] * A[2][0];
+  inv[1][2] = A[0][2] * A[1][0] - A[0][0] * A[1][2];
+  inv[2][2] = A[0][0] * A[1][1] - A[0][1] * A[1][0];
+  inv[1][0] = inv[0][1];
+  inv[2][0] = inv[0][2];
+  inv[2][1] = inv[1][2];
+
+  det = A[0][0] * inv[0][0] + A[0][1] * inv[1][0] + A[0][2] * inv[2][0];
+  if(det <= 0.0f)
+  {
+    return false;
+  }
+
+  for(int i = 0; i < 3; i++)
+  {
+    c[i] = -(inv[i][0] * v[6] + inv[i][1] * v[7] + inv[i][2] * v[8]) / det;
+  }
+
+  k = 1.0f;
+  for(int i = 0; i < 3; i++)
+  {
+    k += c[i] * (A[i][0] * c[0] + A[i][1] * c[1] + A[i][2] * c[2]);
+  }
+  if(k <= 0.0f)
+  {
+    return false;
+  }
+
+  //
+  // residual before A is destroyed by the eigen decomposition
+  //
+  res = (float)e->count;
+  for(int i = 0; i < N; i++)
+  {
+    float   s = 0.0f;
+
+    for(int j = 0; j < N; j++)
+    {
+      s += e->DtD[i <= j ? pidx(i, j) : pidx(j, i)] * v[j];
+    }
+    res += v[i] * (s - 2.0f * e->Dt1[i]);
+  }
+  if(res < 0.0f)
+  {
+    res = 0.0f;
+  }
+
+  for(int i = 0; i < 3; i++)
+  {
+    for(int j = 0; j < 3; j++)
+    {
+      A[i][j] /= k;
+    }
+  }
+
+  mag_ellipsoid_eigen(A, V, l);
+  if(l[0] <= 0.0f || l[1] <= 0.0f || l[2] <= 0.0f)
+  {
+    return false;
+  }
+
+  radius = powf(l[0] * l[1] * l[2], -1.0f / 6.0f);
+
+  for(int i = 0; i < 3; i++)
+  {
+    l[i] = sqrtf(l[i]) * radius;
+  }
+
+  for(int i = 0; i < 3; i++)
+  {
+    for(int j = 0; j < 3; j++)
+    {
+      r->soft[i][j] = V[i][0] * l[0] * V[j][0] +
+                      V[i][1] * l[1] * V[j][1] +
+                      V[i][2] * l[2] * V[j][2];
+    }
+    r->offset[i] = c[i] * MAG_ELLIPSOID_SCALE;
+  }
+
+  r->radius     = radius * MAG_ELLIPSOID_SCALE;
+  r->fit_error  = sqrtf(res / e->count) / (2.0f * k);
+
+  return true;
+}
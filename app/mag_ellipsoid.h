@@ -0,0 +1,52 @@
+#ifndef __MAG_ELLIPSOID_DEF_H__
+#define __MAG_ELLIPSOID_DEF_H__
+
+#include "app_common.h"
+
+//
+// magnetometer ellipsoid fit.
+//
+// samples are fitted to the quadric
+//
+//    a x^2 + b y^2 + c z^2 + 2d xy + 2e xz + 2f yz + 2g x + 2h y + 2i z = 1
+//
+// by linear least squares. only the normal equations are accumulated
+// so memory does not grow with the number of samples.
+//
+// the solution gives hard iron offset and a symmetric soft iron matrix
+// W with det(W) = 1, so that W * (raw - offset) lies on a sphere of
+// about the original radius in raw counts.
+//
+// coverage is tracked in 24 direction bins, four quadrants on each face
+// of a cube around a provisional min/max center.
+//
+#define MAG_ELLIPSOID_NUM_PARAMS      9
+#define MAG_ELLIPSOID_NUM_BINS        24
+#define MAG_ELLIPSOID_MIN_SAMPLES     100
+#define MAG_ELLIPSOID_MIN_BINS        18
+
+typedef struct
+{
+  float       DtD[MAG_ELLIPSOID_NUM_PARAMS * (MAG_ELLIPSOID_NUM_PARAMS + 1) / 2];   // upper, row packed
+  float       Dt1[MAG_ELLIPSOID_NUM_PARAMS];
+  uint32_t    count;
+
+  int16_t     min[3],
+              max[3];
+  uint32_t    bins;             // bit mask of visited direction bins
+} mag_ellipsoid_t;
+
+typedef struct
+{
+  float       offset[3];        // raw counts
+  float       soft[3][3];       // symmetric, det 1
+  float       radius;           // raw counts
+  float       fit_error;        // rms relative radius error
+} mag_ellipsoid_result_t;
+
+extern void mag_ellipsoid_reset(mag_ellipsoid_t* e);
+extern void mag_ellipsoid_push(mag_ellipsoid_t* e, const int16_t m[3]);
+extern uint8_t mag_ellipsoid_coverage(const mag_ellipsoid_t* e);
+extern bool mag_ellipsoid_solve(const mag_ellipsoid_t* e, mag_ellipsoid_result_t* r);
+
+#endif /* !__MAG_ELLIPSOID_DEF_H__ */
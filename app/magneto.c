@@ -1,12 +1,19 @@
 #include <math.h>
+#include <string.h>
 #include "magneto.h"
 #include "hmc5883.h"
 #include "mainloop_timer.h"
-#include "sensor_calib.h"
+#include "mag_ellipsoid.h"
 #include "config.h"
+#include "sensor_xform.h"
 
-#define SAMPLE_INTERVAL   100
-#define MAGNETOMETER_CALIBRATE_SAMPLE_COUNT           (10*60)     // 10 samples for 60 seconds
+//
+// HMC5883 runs continuous at 75Hz, 13.3ms per sample.
+// poll a bit early and check data ready so every output is picked up once
+//
+#define SAMPLE_INTERVAL   13
+#define SAMPLE_RETRY      1
+#define MAGNETOMETER_CALIBRATE_SAMPLE_COUNT           (75*60)     // 75 samples for 60 seconds
 
 ////////////////////////////////////////////////////////////////////////////////
 //
@@ -24,6 +31,7 @@ static void mag_calib_update(int16_t mx, int16_t my, int16_t mz);
 static hmc5883Mag       _mag;
 static SoftTimerElem    _sample_timer;
 static sensor_align_t   _align;
+static sensor_xform_t   _xform;
 
 ////////////////////////////////////////////////////////////////////////////////
 //
@@ -31,7 +39,9 @@ static sensor_align_t   _align;
 //
 ////////////////////////////////////////////////////////////////////////////////
 int16_t                 mag_raw[3];
-int16_t                 mag_value[3];
+float                   mag_body[3];
+uint32_t                mag_sample_count;     // bumped on every fresh sample
+magneto_cal_stat_t      magneto_cal_stat;
 
 ////////////////////////////////////////////////////////////////////////////////
 //
@@ -41,7 +51,7 @@ int16_t                 mag_value[3];
 static bool             _mag_calib_in_prog;
 #ifndef MAGNETO_CAL_SCALE
 static int16_t          _mag_prev[3];
-static sensor_calib_t   _cal_state;
+static mag_ellipsoid_t  _cal_state;
 #else
 static int16_t          _mag_min[3],
                         _mag_max[3];
@@ -59,19 +69,16 @@ static void*                        _cb_arg;
 static void
 mag_sample_timer_callback(SoftTimerElem* te)
 {
-  hmc5883_read(&_mag, mag_raw);
+  if(!hmc5883_data_ready(&_mag))
+  {
+    mainloop_timer_schedule(&_sample_timer, SAMPLE_RETRY);
+    return;
+  }
 
-#ifndef MAGNETO_CAL_SCALE
-  mag_value[0] = mag_raw[0] - GCFG->mag_offset[0];
-  mag_value[1] = mag_raw[1] - GCFG->mag_offset[1];
-  mag_value[2] = mag_raw[2] - GCFG->mag_offset[2];
-#else
-  mag_value[0] = (mag_raw[0] - GCFG->mag_offset[0]) * GCFG->mag_scale[0];
-  mag_value[1] = (mag_raw[1] - GCFG->mag_offset[1]) * GCFG->mag_scale[1];
-  mag_value[2] = (mag_raw[2] - GCFG->mag_offset[2]) * GCFG->mag_scale[2];
-#endif
+  hmc5883_read(&_mag, mag_raw);
 
-  sensor_align_values(mag_value, _align);
+  sensor_xform_apply(&_xform, mag_raw, mag_body);
+  mag_sample_count++;
 
   mainloop_timer_schedule(&_sample_timer, SAMPLE_INTERVAL);
 
@@ -88,12 +95,42 @@ magneto_init(sensor_align_t align)
 
   hmc5883_init(&_mag, HMC5883_ADDRESS_MAG, HMC5883_MAGGAIN_1_3);
 
+  magneto_xform_config();
+
   soft_timer_init_elem(&_sample_timer);
   _sample_timer.cb = mag_sample_timer_callback;
 
   _mag_calib_in_prog = false;
 }
 
+//
+// rebuild raw to body transform from calibration and board alignment
+//
+void
+magneto_xform_config(void)
+{
+  float   offset[3];
+#ifndef MAGNETO_CAL_SCALE
+  const float*  w = GCFG->mag_soft;
+  float         soft[3][3] =
+  {
+    { w[0], w[3], w[4] },
+    { w[3], w[1], w[5] },
+    { w[4], w[5], w[2] },
+  };
+#endif
+
+  for(int i = 0; i < 3; i++)
+  {
+    offset[i] = GCFG->mag_offset[i];
+  }
+#ifndef MAGNETO_CAL_SCALE
+  sensor_xform_build_cal(&_xform, _align, GCFG->board_align, offset, soft);
+#else
+  sensor_xform_build(&_xform, _align, GCFG->board_align, offset, GCFG->mag_scale);
+#endif
+}
+
 void
 magneto_start(void)
 {
@@ -117,7 +154,9 @@ mag_calib_update(int16_t mx, int16_t my, int16_t mz)
 #ifndef MAGNETO_CAL_SCALE
   float     diffMag = 0;
   float     avgMag = 0;
-  int32_t   mag_data[3];
+  int16_t   mag_data[3];
+  mag_ellipsoid_result_t  r;
+  bool      success;
 
   _mag_cal_sample_count++;
 
@@ -132,27 +171,47 @@ mag_calib_update(int16_t mx, int16_t my, int16_t mz)
 
   // sqrtf(diffMag / avgMag) is a rough approximation of tangent of angle between magADC and _mag_prev. tan(8 deg) = 0.14
   if ((avgMag > 0.01f) && ((diffMag / avgMag) > (0.14f * 0.14f))) {
-    sensorCalibrationPushSampleForOffsetCalculation(&_cal_state, mag_data);
+    mag_ellipsoid_push(&_cal_state, mag_data);
 
     for (int axis = 0; axis < 3; axis++) {
       _mag_prev[axis] = mag_data[axis];
     }
+
+    magneto_cal_stat.samples  = _cal_state.count;
+    magneto_cal_stat.coverage = mag_ellipsoid_coverage(&_cal_state);
   }
 
   if(_mag_cal_sample_count > MAGNETOMETER_CALIBRATE_SAMPLE_COUNT)
   {
-    float     magZerof[3];
-
-    sensorCalibrationSolveForOffset(&_cal_state, magZerof);
-
-    for (int axis = 0; axis < 3; axis++)
+    //
+    // too little of the sphere seen or a degenerate fit keeps
+    // the old calibration
+    //
+    success = magneto_cal_stat.coverage >= MAG_ELLIPSOID_MIN_BINS &&
+              mag_ellipsoid_solve(&_cal_state, &r);
+
+    if(success)
     {
-      GCFG->mag_offset[axis] = lrintf(magZerof[axis]);
+      for (int axis = 0; axis < 3; axis++)
+      {
+        GCFG->mag_offset[axis] = lrintf(r.offset[axis]);
+      }
+
+      GCFG->mag_soft[0] = r.soft[0][0];
+      GCFG->mag_soft[1] = r.soft[1][1];
+      GCFG->mag_soft[2] = r.soft[2][2];
+      GCFG->mag_soft[3] = r.soft[0][1];
+      GCFG->mag_soft[4] = r.soft[0][2];
+      GCFG->mag_soft[5] = r.soft[1][2];
+
+      magneto_cal_stat.radius     = r.radius;
+      magneto_cal_stat.fit_error  = r.fit_error;
     }
 
     _mag_calib_in_prog = false;
+    magneto_xform_config();
 
-    _cb(GCFG->mag_offset, _cb_arg);
+    _cb(success, GCFG->mag_offset, _cb_arg);
   }
 #else
   int16_t   m[3];
@@ -191,8 +250,9 @@ mag_calib_update(int16_t mx, int16_t my, int16_t mz)
     }
     
     _mag_calib_in_prog = false;
+    magneto_xform_config();
 
-    _cb(GCFG->mag_offset, _cb_arg);
+    _cb(true, GCFG->mag_offset, _cb_arg);
   }
 #endif
 }
@@ -213,12 +273,14 @@ magneto_calibrate(magneto_calibrate_callback cb, void* cb_arg)
   _mag_prev[1] = 
   _mag_prev[2] =  0;
 
-  sensorCalibrationResetState(&_cal_state);
+  mag_ellipsoid_reset(&_cal_state);
 #else
   _mag_min[0] = _mag_min[1] = _mag_min[2] = 32764;
   _mag_max[0] = _mag_max[1] = _mag_max[2] =-32763;
 #endif
 
+  memset(&magneto_cal_stat, 0, sizeof(magneto_cal_stat));
+
   _mag_calib_in_prog = true;
   _mag_cal_sample_count = 0;
 
@@ -5,13 +5,28 @@
 #include "sensor_align.h"
 
 extern int16_t mag_raw[3];
-extern int16_t mag_value[3];
+extern float mag_body[3];      // body frame NWU. see imu.c
+extern uint32_t mag_sample_count;
 
 extern void magneto_init(sensor_align_t align);
 extern void magneto_start(void);
 extern void magneto_stop(void);
+extern void magneto_xform_config(void);
 
-typedef void (*magneto_calibrate_callback)(int16_t offset[3], void* cb_arg);
+//
+// progress and result of the last calibration
+//
+typedef struct
+{
+  uint32_t    samples;        // samples taken into the fit
+  uint8_t     coverage;       // direction bins visited out of MAG_ELLIPSOID_NUM_BINS
+  float       radius;         // field strength in raw counts
+  float       fit_error;      // rms relative radius error after correction
+} magneto_cal_stat_t;
+
+extern magneto_cal_stat_t   magneto_cal_stat;
+
+typedef void (*magneto_calibrate_callback)(bool success, int16_t offset[3], void* cb_arg);
 extern bool magneto_calibrate(magneto_calibrate_callback cb, void* cb_arg);
 
 #endif /* __MAGNETO_DEF_H__ */
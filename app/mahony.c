@@ -0,0 +1,128 @@
+#include <math.h>
+#include "app_common.h"
+#include "math_helper.h"
+#include "ahrs_common.h"
+#include "mahony.h"
+
+#define Q0    mahony->q[0]
+#define Q1    mahony->q[1]
+#define Q2    mahony->q[2]
+#define Q3    mahony->q[3]
+
+//
+// PI feedback on the cross product between measured and estimated gravity.
+// P pulls the attitude in with 1/Kp time constant, I settles on the gyro
+// bias so yaw drift from bias is also taken out while level.
+//
+#define MAHONY_KP         0.5f
+#define MAHONY_KI         0.05f
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// public interfaces
+//
+////////////////////////////////////////////////////////////////////////////////
+void
+mahony_init(mahony_t* mahony, float sample_freq)
+{
+  mahony->invSampleFreq = 1.0f / sample_freq;
+
+  mahony->twoKp = 2.0f * MAHONY_KP;
+  mahony->twoKi = 2.0f * MAHONY_KI;
+
+  mahony->integralFB[0] = 0.0f;
+  mahony->integralFB[1] = 0.0f;
+  mahony->integralFB[2] = 0.0f;
+
+  mahony->accWeight = 1.0f;
+
+  Q0    = 1.0f;
+  Q1    = 0.0f;
+  Q2    = 0.0f;
+  Q3    = 0.0f;
+}
+
+void
+mahony_updateIMU(mahony_t* mahony,
+                 float gx, float gy, float gz,
+                 float ax, float ay, float az)
+{
+  float recipNorm, w;
+  float halfvx, halfvy, halfvz;
+  float halfex, halfey, halfez;
+  float qa, qb, qc;
+
+  // Convert gyroscope degrees/sec to radians/sec
+  gx *= 0.0174533f;
+  gy *= 0.0174533f;
+  gz *= 0.0174533f;
+
+  // Compute feedback only if accelerometer measurement valid (avoids NaN in accelerometer normalisation)
+  if(!((ax == 0.0f) && (ay == 0.0f) && (az == 0.0f)))
+  {
+    // Normalise accelerometer measurement
+    recipNorm = math_rsqrtf(ax * ax + ay * ay + az * az);
+    w = ahrs_accel_weight((ax * ax + ay * ay + az * az) * recipNorm);
+    mahony->accWeight = w;
+
+    ax *= recipNorm;
+    ay *= recipNorm;
+    az *= recipNorm;
+
+    // Estimated direction of gravity, half of it
+    halfvx = Q1 * Q3 - Q0 * Q2;
+    halfvy = Q0 * Q1 + Q2 * Q3;
+    halfvz = Q0 * Q0 - 0.5f + Q3 * Q3;
+
+    // Error is sum of cross product between estimated and measured direction of gravity
+    // scaled down when accel is away from 1G
+    halfex = (ay * halfvz - az * halfvy) * w;
+    halfey = (az * halfvx - ax * halfvz) * w;
+    halfez = (ax * halfvy - ay * halfvx) * w;
+
+    // Integral feedback. bias estimate only moves when accel is trusted
+    mahony->integralFB[0] += mahony->twoKi * halfex * mahony->invSampleFreq;
+    mahony->integralFB[1] += mahony->twoKi * halfey * mahony->invSampleFreq;
+    mahony->integralFB[2] += mahony->twoKi * halfez * mahony->invSampleFreq;
+
+    // Apply proportional feedback
+    gx += mahony->twoKp * halfex;
+    gy += mahony->twoKp * halfey;
+    gz += mahony->twoKp * halfez;
+  }
+
+  gx += mahony->integralFB[0];
+  gy += mahony->integralFB[1];
+  gz += mahony->integralFB[2];
+
+  // Integrate rate of change of quaternion
+  gx *= (0.5f * mahony->invSampleFreq);
+  gy *= (0.5f * mahony->invSampleFreq);
+  gz *= (0.5f * mahony->invSampleFreq);
+  qa = Q0;
+  qb = Q1;
+  qc = Q2;
+  Q0 += (-qb * gx - qc * gy - Q3 * gz);
+  Q1 += (qa * gx + qc * gz - Q3 * gy);
+  Q2 += (qa * gy - qb * gz + Q3 * gx);
+  Q3 += (qa * gz + qb * gy - qc * gx);
+
+  // Normalise quaternion
+  recipNorm = math_rsqrtf(Q0 * Q0 + Q1 * Q1 + Q2 * Q2 + Q3 * Q3);
+  Q0 *= recipNorm;
+  Q1 *= recipNorm;
+  Q2 *= recipNorm;
+  Q3 *= recipNorm;
+}
+
+//
+// gyro bias in dps as seen by the integral term
+//
+void
+mahony_get_gyro_bias(mahony_t* mahony, float bias[3])
+{
+  for(int i = 0; i < 3; i++)
+  {
+    bias[i] = -mahony->integralFB[i] * 57.29578f;
+  }
+}
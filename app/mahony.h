@@ -0,0 +1,20 @@
+#ifndef __MAHONY_DEF_H__
+#define __MAHONY_DEF_H__
+
+typedef struct
+{
+  float invSampleFreq;
+  float twoKp;        // 2 * proportional gain
+  float twoKi;        // 2 * integral gain
+  float integralFB[3];  // integral feedback in rad/s. negative of gyro bias
+  float accWeight;    // accel trust of the last update. 0..1
+  float q[4];
+} mahony_t;
+
+extern void mahony_init(mahony_t* mahony, float sample_freq);
+extern void mahony_updateIMU(mahony_t* mahony,
+                             float gx, float gy, float gz,
+                             float ax, float ay, float az);
+extern void mahony_get_gyro_bias(mahony_t* mahony, float bias[3]);
+
+#endif //!__MAHONY_DEF_H__
@@ -2,6 +2,7 @@
 #include "mainloop_timer.h"
 #include "event_dispatcher.h"
 #include "event_list.h"
+#include "mem_section.h"
 
 ////////////////////////////////////////////////////////////////////////////////
 //
@@ -15,7 +16,7 @@ static void mainloop_timer_1ms_handler(uint32_t event);
 // module privates
 //
 ////////////////////////////////////////////////////////////////////////////////
-static SoftTimer      _mainloop_timer;
+static CCM_BSS SoftTimer  _mainloop_timer;
 
 ////////////////////////////////////////////////////////////////////////////////
 //
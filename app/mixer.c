@@ -0,0 +1,187 @@
+#include <string.h>
+#include "mixer.h"
+#include "math_helper.h"
+#include "mem_section.h"
+
+typedef struct
+{
+  const char*     name;
+  uint8_t         num_motors;
+  const float     (*coeff)[MIXER_AXIS_NUM];
+} mixer_preset_def_t;
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// presets. top view, front up
+//
+////////////////////////////////////////////////////////////////////////////////
+/*
+      M4          M2
+     <----\    / --->
+           \  /
+            \/
+            /\
+           /  \
+      M3  /    \  M1
+    ---->/      \<---
+*/
+static const float _mixer_quad_x[4][MIXER_AXIS_NUM] =
+{
+  //  throttle    roll      pitch       yaw
+  {   1.0f,      -1.0f,    -1.0f,       1.0f  },    // rear right
+  {   1.0f,      -1.0f,     1.0f,      -1.0f  },    // front right
+  {   1.0f,       1.0f,    -1.0f,      -1.0f  },    // rear left
+  {   1.0f,       1.0f,     1.0f,       1.0f  },    // front left
+};
+
+/*
+          M4    M2
+      M6            M5
+          M3    M1
+*/
+static const float _mixer_hex_x[6][MIXER_AXIS_NUM] =
+{
+  //  throttle    roll      pitch       yaw
+  {   1.0f,      -0.5f,    -0.866025f, -1.0f  },    // rear right
+  {   1.0f,      -0.5f,     0.866025f, -1.0f  },    // front right
+  {   1.0f,       0.5f,    -0.866025f,  1.0f  },    // rear left
+  {   1.0f,       0.5f,     0.866025f,  1.0f  },    // front left
+  {   1.0f,      -1.0f,     0.0f,       1.0f  },    // right
+  {   1.0f,       1.0f,     0.0f,      -1.0f  },    // left
+};
+
+/*
+   clockwise from front right. M1 at 22.5 degree, 45 degree apart
+*/
+static const float _mixer_octo_x[8][MIXER_AXIS_NUM] =
+{
+  //  throttle    roll      pitch       yaw
+  {   1.0f,      -0.382683f, 0.923880f, -1.0f  },
+  {   1.0f,      -0.923880f, 0.382683f,  1.0f  },
+  {   1.0f,      -0.923880f,-0.382683f, -1.0f  },
+  {   1.0f,      -0.382683f,-0.923880f,  1.0f  },
+  {   1.0f,       0.382683f,-0.923880f, -1.0f  },
+  {   1.0f,       0.923880f,-0.382683f,  1.0f  },
+  {   1.0f,       0.923880f, 0.382683f, -1.0f  },
+  {   1.0f,       0.382683f, 0.923880f,  1.0f  },
+};
+
+static const mixer_preset_def_t   _mixer_presets[mixer_preset_max] =
+{
+  { "quad_x",   4,    _mixer_quad_x },
+  { "hex_x",    6,    _mixer_hex_x  },
+  { "octo_x",   8,    _mixer_octo_x },
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// visibles
+//
+////////////////////////////////////////////////////////////////////////////////
+mixer_stat_t    mixer_stat;
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// public interfaces
+//
+////////////////////////////////////////////////////////////////////////////////
+const char*
+mixer_preset_name(mixer_preset_t preset)
+{
+  if(preset >= mixer_preset_max)
+  {
+    return "invalid";
+  }
+  return _mixer_presets[preset].name;
+}
+
+uint8_t
+mixer_preset_motors(mixer_preset_t preset)
+{
+  if(preset >= mixer_preset_max)
+  {
+    return 0;
+  }
+  return _mixer_presets[preset].num_motors;
+}
+
+void
+mixer_load_preset(mixer_config_t* mix, mixer_preset_t preset)
+{
+  const mixer_preset_def_t*   p = &_mixer_presets[preset];
+
+  memset(mix, 0, sizeof(mixer_config_t));
+
+  mix->num_motors = p->num_motors;
+  memcpy(mix->coeff, p->coeff, sizeof(float) * MIXER_AXIS_NUM * p->num_motors);
+}
+
+//
+// out = coeff * [throttle roll pitch yaw]
+//
+// desaturation
+// 1) if the spread of roll/pitch/yaw demand across motors is wider than
+//    the output range, all three are scaled down together so the ratio
+//    between axes is kept.
+// 2) throttle is then shifted up or down until every motor fits.
+//    attitude correction wins over collective thrust.
+//
+// this assumes the throttle column is the same for every motor, which is
+// true for all the presets. out[] is clamped at the end anyway.
+//
+FAST_CODE void
+mixer_run(const mixer_config_t* mix, float out_min, float out_max,
+    float throttle, const float axis[3], float* out)
+{
+  const uint8_t   n     = mix->num_motors;
+  const float     span  = out_max - out_min;
+  float           a[MIXER_MAX_MOTORS];
+  float           lo    = 0.0f,
+                  hi    = 0.0f,
+                  scale;
+
+  for(int i = 0; i < n; i++)
+  {
+    const float* c = mix->coeff[i];
+
+    a[i] = c[MIXER_ROLL] * axis[0] + c[MIXER_PITCH] * axis[1] + c[MIXER_YAW] * axis[2];
+
+    if(i == 0 || a[i] < lo)
+    {
+      lo = a[i];
+    }
+    if(i == 0 || a[i] > hi)
+    {
+      hi = a[i];
+    }
+  }
+
+  if(hi - lo > span)
+  {
+    scale = span / (hi - lo);
+    for(int i = 0; i < n; i++)
+    {
+      a[i] *= scale;
+    }
+    lo *= scale;
+    hi *= scale;
+    mixer_stat.desat_count++;
+  }
+
+  if(throttle + hi > out_max)
+  {
+    throttle = out_max - hi;
+    mixer_stat.shift_count++;
+  }
+  else if(throttle + lo < out_min)
+  {
+    throttle = out_min - lo;
+    mixer_stat.shift_count++;
+  }
+
+  for(int i = 0; i < n; i++)
+  {
+    out[i] = mix->coeff[i][MIXER_THROTTLE] * throttle + a[i];
+    clamp(&out[i], out_min, out_max);
+  }
+}
@@ -0,0 +1,55 @@
+#ifndef __MIXER_DEF_H__
+#define __MIXER_DEF_H__
+
+#include "app_common.h"
+
+//
+// table can hold an octo. how many of them can be driven
+// is limited by MOTOR_MAX_NUM outputs on the board
+//
+#define MIXER_MAX_MOTORS          8
+
+//
+// column index in a mixer row
+//
+#define MIXER_THROTTLE            0
+#define MIXER_ROLL                1
+#define MIXER_PITCH               2
+#define MIXER_YAW                 3
+#define MIXER_AXIS_NUM            4
+
+typedef enum
+{
+  mixer_preset_quad_x = 0,
+  mixer_preset_hex_x,
+  mixer_preset_octo_x,
+  mixer_preset_max,
+} mixer_preset_t;
+
+//
+// motor[i] = sum(coeff[i][j] * input[j]) for throttle/roll/pitch/yaw.
+// roll is + right bank, pitch + nose up. yaw is + counter clockwise seen
+// from above, the NWU gyro_body[2] sense flight.c feeds it in
+//
+typedef struct
+{
+  uint8_t     num_motors;
+  float       coeff[MIXER_MAX_MOTORS][MIXER_AXIS_NUM];
+} mixer_config_t;
+
+typedef struct
+{
+  uint32_t    desat_count;      // runs where roll/pitch/yaw had to be scaled down
+  uint32_t    shift_count;      // runs where throttle was moved to fit
+} mixer_stat_t;
+
+extern mixer_stat_t   mixer_stat;
+
+extern const char* mixer_preset_name(mixer_preset_t preset);
+extern uint8_t mixer_preset_motors(mixer_preset_t preset);
+extern void mixer_load_preset(mixer_config_t* mix, mixer_preset_t preset);
+
+extern void mixer_run(const mixer_config_t* mix, float out_min, float out_max,
+    float throttle, const float axis[3], float* out);
+
+#endif /* !__MIXER_DEF_H__ */
@@ -5,12 +5,13 @@
 void
 motor_init(void)
 {
-  pwm_start();
+  pwm_start(GCFG->motor_protocol);
 
   for(int i = 0; i < MOTOR_MAX_NUM; i++)
   {
     motor_set(i, GCFG->motor_min);
   }
+  motor_update();
 }
 
 void
@@ -18,3 +19,9 @@ motor_set(motor_ndx_t ndx, uint16_t v)
 {
   pwm_set_duty(GCFG->motor_ndx[ndx], v);
 }
+
+void
+motor_update(void)
+{
+  pwm_update();
+}
@@ -17,5 +17,6 @@ typedef enum
 
 extern void motor_init(void);
 extern void motor_set(motor_ndx_t ndx, uint16_t v);
+extern void motor_update(void);
 
 #endif /* !__MOTOR_DEF_H__ */
@@ -1,8 +1,9 @@
 #include "stm32f4xx_hal.h"
-#include "spi.h"
 #include "gpio.h"
 #include "app_common.h"
+#include "spi_bus.h"
 #include "mpu6000.h"
+#include "micros.h"
 
 #define BIT_H_RESET                 0x80
 #define MPU_CLK_SEL_PLLGYROX        0x01
@@ -12,7 +13,34 @@
 #define BIT_ACC                     2
 #define BIT_TEMP                    1
 
-static SPI_HandleTypeDef* hspi = &hspi1;
+#define BIT_FIFO_EN                 0x40
+#define BIT_FIFO_RESET              0x04
+#define BIT_TEMP_FIFO_EN            0x80
+#define BIT_XYZG_FIFO_EN            0x70
+#define BIT_ACCEL_FIFO_EN           0x08
+
+#define MPU6000_SAMPLE_PERIOD       1000      // usec. SMPLRT_DIV 0 with DLPF on
+
+//
+// APB2 84MHz. registers are good for 1MHz, sensor, interrupt and FIFO
+// reads for 20MHz
+//
+static const spi_device_t _mpu6000_dev =
+{
+  .bus            = spi_bus_1,
+  .cs_port        = MPU6000_SS_GPIO_Port,
+  .cs_pin         = MPU6000_SS_Pin,
+  .slow_prescaler = SPI_BAUDRATEPRESCALER_128,    // 656KHz
+  .fast_prescaler = SPI_BAUDRATEPRESCALER_8,      // 10.5MHz
+  .polarity       = SPI_POLARITY_HIGH,
+  .phase          = SPI_PHASE_2EDGE,
+};
+
+//
+// register address in front, then the frames. in place transfer
+//
+static uint8_t            _fifo_buffer[1 + MPU6000_FIFO_MAX_FRAMES * MPU6000_FIFO_FRAME_SIZE];
+static mpu6000_sample_t   _fifo_samples[MPU6000_FIFO_MAX_FRAMES];
 
 ////////////////////////////////////////////////////////////////////////////////
 //
@@ -27,49 +55,31 @@ mpu6000_write_reg(MPU6000_t* mpu, uint8_t reg, uint8_t data)
   buffer[0] = reg;
   buffer[1] = data;
 
-  HAL_GPIO_WritePin(MPU6000_SS_GPIO_Port, MPU6000_SS_Pin, GPIO_PIN_RESET);
-  HAL_SPI_Transmit(hspi, buffer, 2, 1000);
-  HAL_GPIO_WritePin(MPU6000_SS_GPIO_Port, MPU6000_SS_Pin, GPIO_PIN_SET);
-}
-
-static inline void
-mpu6000_write_reg16(MPU6000_t* mpu, uint8_t reg, uint16_t data)
-{
-  uint8_t buffer[3];
-
-  buffer[0] = reg;
-  buffer[1] = (data >> 8 ) & 0xff;
-  buffer[2] = data & 0xff;
-
-  HAL_GPIO_WritePin(MPU6000_SS_GPIO_Port, MPU6000_SS_Pin, GPIO_PIN_RESET);
-  HAL_SPI_Transmit(hspi, buffer, 3, 1000);
-  HAL_GPIO_WritePin(MPU6000_SS_GPIO_Port, MPU6000_SS_Pin, GPIO_PIN_SET);
+  spi_bus_xfer(&_mpu6000_dev, false, buffer, NULL, 2);
 }
 
 static inline uint8_t
 mpu6000_read_reg(MPU6000_t* mpu, uint8_t reg)
 {
-  uint8_t    ret;
+  uint8_t    buffer[2];
 
-  reg |= 0x80;
+  buffer[0] = reg | 0x80;
+  buffer[1] = 0;
 
-  HAL_GPIO_WritePin(MPU6000_SS_GPIO_Port, MPU6000_SS_Pin, GPIO_PIN_RESET);
-  HAL_SPI_Transmit(hspi, &reg, 1, 1000);
-  HAL_SPI_Receive(hspi, &ret, 1, 1000);
-  HAL_GPIO_WritePin(MPU6000_SS_GPIO_Port, MPU6000_SS_Pin, GPIO_PIN_SET);
+  spi_bus_xfer(&_mpu6000_dev, false, buffer, buffer, 2);
 
-  return ret;
+  return buffer[1];
 }
 
+//
+// sensor data. len is without the address byte
+//
 static inline void
-mpu6000_read_data(MPU6000_t* mpu, uint8_t reg, uint8_t* data, uint8_t len)
+mpu6000_read_data(MPU6000_t* mpu, uint8_t reg, uint8_t* buffer, uint16_t len)
 {
-  reg |= 0x80;
+  buffer[0] = reg | 0x80;
 
-  HAL_GPIO_WritePin(MPU6000_SS_GPIO_Port, MPU6000_SS_Pin, GPIO_PIN_RESET);
-  HAL_SPI_Transmit(hspi, &reg, 1, 1000);
-  HAL_SPI_Receive(hspi, data, len, 1000);
-  HAL_GPIO_WritePin(MPU6000_SS_GPIO_Port, MPU6000_SS_Pin, GPIO_PIN_SET);
+  spi_bus_xfer(&_mpu6000_dev, true, buffer, buffer, len + 1);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -77,73 +87,231 @@ mpu6000_read_data(MPU6000_t* mpu, uint8_t reg, uint8_t* data, uint8_t len)
 // public interfaces
 //
 ////////////////////////////////////////////////////////////////////////////////
-void
-mpu6000_init(MPU6000_t* mpu)
+//
+// bring-up is a list of register writes, each followed by a wait.
+// the caller does the waiting so nothing blocks here.
+// returns msec to wait before the next step, -1 once done
+//
+int
+mpu6000_init_step(MPU6000_t* mpu, int step)
+{
+  static const struct
+  {
+    uint8_t   reg;
+    uint8_t   val;
+    uint8_t   wait;
+  } steps[] =
+  {
+    // bus device reset
+    { MPU6000_PWR_MGMT_1,         BIT_H_RESET,                    150 },
+    { MPU6000_SIGNAL_PATH_RESET,  BIT_GYRO | BIT_ACC | BIT_TEMP,  150 },
+
+    // Clock Source PPL with Z axis gyro reference
+    { MPU6000_PWR_MGMT_1,         MPU_CLK_SEL_PLLGYROZ,           1 },
+
+    // Disable Primary I2C Interface
+    { MPU6000_USER_CTRL,          BIT_I2C_IF_DIS,                 1 },
+    { MPU6000_PWR_MGMT_2,         0x00,                           1 },
+
+    //
+    // accel rate is always 1K Hz
+    // gyro rate is set to 1K Hz with DPLF is enabled
+    // target LPF
+    // for accel : 184Hz
+    // for gyro  : 188Hz
+    //
+    // EXT SYNC disabled
+    //
+    { MPU6000_SMPLRT_DIV,         0,                              0 },
+    { MPU6000_CONFIG,             (0x0 << 3 | 0x1),               1 },
+
+    // accelerometer range
+    // +- 8G scale
+    { MPU6000_ACCEL_CONFIG,       (0x02 << 3),                    1 },
+
+    // gyro range
+    // +- 1000 degrees per sec
+    { MPU6000_GYRO_CONFIG,        (0x02 << 3),                    1 },
+  };
+
+  if(step >= NARRAY(steps))
+  {
+    return -1;
+  }
+
+  mpu6000_write_reg(mpu, steps[step].reg, steps[step].val);
+  return steps[step].wait;
+}
+
+//
+// 14 bytes of accel, temperature and gyro. same layout in FIFO
+//
+static inline void
+mpu6000_decode(const uint8_t* data, int16_t a[3], int16_t g[3])
+{
+  a[0] = (int16_t)(data[0] << 8 | data[1]);
+  a[1] = (int16_t)(data[2] << 8 | data[3]);
+  a[2] = (int16_t)(data[4] << 8 | data[5]);
+
+  g[0] = (int16_t)(data[8] << 8 | data[9]);
+  g[1] = (int16_t)(data[10] << 8 | data[11]);
+  g[2] = (int16_t)(data[12] << 8 | data[13]);
+}
+
+static inline void
+mpu6000_decode_temp(MPU6000_t* mpu, const uint8_t* data)
 {
-  // bus device reset
-  mpu6000_write_reg(mpu, MPU6000_PWR_MGMT_1, BIT_H_RESET);
-  HAL_Delay(150);
-
-  mpu6000_write_reg(mpu, MPU6000_SIGNAL_PATH_RESET, BIT_GYRO | BIT_ACC | BIT_TEMP);
-  HAL_Delay(150);
-
-  // Clock Source PPL with Z axis gyro reference
-  mpu6000_write_reg(mpu, MPU6000_PWR_MGMT_1, MPU_CLK_SEL_PLLGYROZ);
-  HAL_Delay(1);
-
-  // Disable Primary I2C Interface
-  mpu6000_write_reg(mpu, MPU6000_USER_CTRL, BIT_I2C_IF_DIS);
-  HAL_Delay(1);
-
-  mpu6000_write_reg(mpu, MPU6000_PWR_MGMT_2, 0x00);
-  HAL_Delay(1);
-
-  //
-  // accel rate is always 1K Hz
-  // gyro rate is set to 1K Hz with DPLF is enabled
-  // target LPF
-  // for accel : 184Hz
-  // for gyro  : 188Hz
-  //
-  // EXT SYNC disabled
-  //
-  mpu6000_write_reg(mpu, MPU6000_SMPLRT_DIV, 0);
-  mpu6000_write_reg(mpu, MPU6000_CONFIG, (0x0 << 3 | 0x1));
-  HAL_Delay(1);
-
-  // accelerometer range
-  // +- 8G scale
-  mpu6000_write_reg(mpu, MPU6000_ACCEL_CONFIG, (0x02 << 3));
-  HAL_Delay(1);
-
-  // gyro range
-  // +- 1000 degrees per sec
-  mpu6000_write_reg(mpu, MPU6000_GYRO_CONFIG, (0x02 << 3));
-  HAL_Delay(1);
+  int16_t temp = (data[6] << 8 | data[7]);
+
+  mpu->Temperature = (float)((float)temp / (float)340.0 + (float)36.53);
+}
+
+static void
+mpu6000_fifo_reset(MPU6000_t* mpu)
+{
+  mpu6000_write_reg(mpu, MPU6000_USER_CTRL, BIT_I2C_IF_DIS | BIT_FIFO_RESET);
+  mpu6000_write_reg(mpu, MPU6000_USER_CTRL, BIT_I2C_IF_DIS | BIT_FIFO_EN);
+}
+
+//
+// FIFO read stage 2. frames are in, oldest first
+//
+static void
+mpu6000_fifo_data_done(spi_txn_t* txn)
+{
+  MPU6000_t*  mpu = (MPU6000_t*)txn->cb_arg;
+  int         n   = (txn->len - 1) / MPU6000_FIFO_FRAME_SIZE;
+
+  if(txn->state != spi_txn_state_done)
+  {
+    n = 0;
+  }
+
+  for(int i = 0; i < n; i++)
+  {
+    mpu6000_decode(&_fifo_buffer[1 + i * MPU6000_FIFO_FRAME_SIZE], _fifo_samples[i].a, _fifo_samples[i].g);
+    _fifo_samples[i].usec = mpu->fifo_usec - (mpu->fifo_pending - 1 - i) * MPU6000_SAMPLE_PERIOD;
+  }
+  if(n > 0)
+  {
+    mpu6000_decode_temp(mpu, &_fifo_buffer[1 + (n - 1) * MPU6000_FIFO_FRAME_SIZE]);
+  }
+
+  mpu->fifo_cb(mpu, _fifo_samples, n);
+}
+
+//
+// FIFO read stage 1. count is in, queue the burst for the frames
+//
+// 1024 is not a multiple of 14 so once the FIFO fills up and drops old
+// bytes the frame boundary is lost. it is reset then, which costs the
+// pending samples, and only happens if nobody read for 70ms.
+//
+static void
+mpu6000_fifo_count_done(spi_txn_t* txn)
+{
+  MPU6000_t*  mpu = (MPU6000_t*)txn->cb_arg;
+  uint16_t    count;
+  int         n;
+
+  if(txn->state != spi_txn_state_done)
+  {
+    mpu->fifo_cb(mpu, _fifo_samples, 0);
+    return;
+  }
+
+  count = (mpu->fifo_count[1] << 8) | mpu->fifo_count[2];
+
+  if(count > MPU6000_FIFO_SIZE - MPU6000_FIFO_FRAME_SIZE)
+  {
+    mpu->fifo_overflow++;
+    mpu6000_fifo_reset(mpu);
+    mpu->fifo_cb(mpu, _fifo_samples, 0);
+    return;
+  }
+
+  n = mpu->fifo_pending = count / MPU6000_FIFO_FRAME_SIZE;
+  if(n > mpu->fifo_frames_max)
+  {
+    mpu->fifo_frames_max = n;
+  }
+  if(n > MPU6000_FIFO_MAX_FRAMES)
+  {
+    n = MPU6000_FIFO_MAX_FRAMES;
+  }
+  if(n == 0)
+  {
+    mpu->fifo_cb(mpu, _fifo_samples, 0);
+    return;
+  }
+
+  _fifo_buffer[0] = MPU6000_FIFO_R_W | 0x80;
+
+  txn->fast = true;
+  txn->tx   = _fifo_buffer;
+  txn->rx   = _fifo_buffer;
+  txn->len  = 1 + n * MPU6000_FIFO_FRAME_SIZE;
+  txn->cb   = mpu6000_fifo_data_done;
+  spi_bus_submit(txn);
 }
 
 void
 mpu6000_read_all(MPU6000_t* mpu, int16_t a[3], int16_t g[3])
 {
-  uint8_t data[14];
-  int16_t temp;
+  uint8_t data[1 + 14];
 
   /* Read full raw data, 14bytes */
   mpu6000_read_data(mpu, MPU6000_ACCEL_XOUT_H, data, 14);
 
-  /* Format accelerometer data */
-  a[0] = (int16_t)(data[0] << 8 | data[1]);
-  a[1] = (int16_t)(data[2] << 8 | data[3]);
-  a[2] = (int16_t)(data[4] << 8 | data[5]);
+  mpu6000_decode(&data[1], a, g);
+  mpu6000_decode_temp(mpu, &data[1]);
+}
 
-  /* Format temperature */
-  temp = (data[6] << 8 | data[7]);
-  mpu->Temperature = (float)((float)((int16_t)temp) / (float)340.0 + (float)36.53);
+void
+mpu6000_fifo_start(MPU6000_t* mpu)
+{
+  mpu->fifo_overflow    = 0;
+  mpu->fifo_frames_max  = 0;
+  mpu->fifo_txn.state   = spi_txn_state_idle;
 
-  /* Format gyroscope data */
-  g[0] = (int16_t)(data[8] << 8 | data[9]);
-  g[1] = (int16_t)(data[10] << 8 | data[11]);
-  g[2] = (int16_t)(data[12] << 8 | data[13]);
+  mpu6000_write_reg(mpu, MPU6000_FIFO_EN, BIT_TEMP_FIFO_EN | BIT_XYZG_FIFO_EN | BIT_ACCEL_FIFO_EN);
+  mpu6000_fifo_reset(mpu);
+}
+
+//
+// queue the count read. the frames follow in a second transfer queued
+// from its completion and cb gets the pending frames, up to
+// MPU6000_FIFO_MAX_FRAMES, from the main loop. what is left over comes
+// with the next read.
+//
+// the newest pending frame is taken as sampled when the read was queued
+// and earlier ones a sample period apart.
+//
+// false if the previous read is still in progress
+//
+bool
+mpu6000_fifo_read_start(MPU6000_t* mpu, mpu6000_fifo_callback cb)
+{
+  spi_txn_t*  txn = &mpu->fifo_txn;
+
+  if(txn->state == spi_txn_state_queued || txn->state == spi_txn_state_busy)
+  {
+    return false;
+  }
+
+  mpu->fifo_count[0]  = MPU6000_FIFO_COUNTH | 0x80;
+  mpu->fifo_cb        = cb;
+  mpu->fifo_usec      = micros_get();
+
+  txn->dev    = &_mpu6000_dev;
+  txn->fast   = true;
+  txn->tx     = mpu->fifo_count;
+  txn->rx     = mpu->fifo_count;
+  txn->len    = 3;
+  txn->cb     = mpu6000_fifo_count_done;
+  txn->cb_arg = mpu;
+
+  return spi_bus_submit(txn);
 }
 
 uint8_t
@@ -2,6 +2,7 @@
 #define __MPU_6000_DEF_H__
 
 #include "app_common.h"
+#include "spi_bus.h"
 
 /* MPU6000 registers */
 #define MPU6000_AUX_VDDIO             0x01
@@ -22,6 +23,7 @@
 #define MPU6000_GYRO_CONFIG           0x1B
 #define MPU6000_ACCEL_CONFIG          0x1C
 #define MPU6000_MOTION_THRESH         0x1F
+#define MPU6000_FIFO_EN               0x23
 #define MPU6000_INT_PIN_CFG           0x37
 #define MPU6000_INT_ENABLE            0x38
 #define MPU6000_INT_STATUS            0x3A
@@ -62,13 +64,43 @@
 #define MPU6000_ACCE_SENS_8         ((float) 4096)
 #define MPU6000_ACCE_SENS_16        ((float) 2048)
 
-typedef struct 
+//
+// FIFO holds accel, temperature and gyro in the same order as the data
+// registers. 1024 bytes is 73 frames, 73ms at 1KHz
+//
+#define MPU6000_FIFO_FRAME_SIZE     14
+#define MPU6000_FIFO_SIZE           1024
+#define MPU6000_FIFO_MAX_FRAMES     16      // per read
+
+typedef struct
+{
+  int16_t     a[3];
+  int16_t     g[3];
+  uint32_t    usec;             // sample time, back dated from the read at sample rate
+} mpu6000_sample_t;
+
+struct __mpu6000;
+typedef void (*mpu6000_fifo_callback)(struct __mpu6000* mpu, const mpu6000_sample_t* s, int n);
+
+typedef struct __mpu6000
 {
   float       Temperature;      /*!< Temperature in degrees */
+
+  uint32_t    fifo_overflow;    // FIFO filled up and was reset
+  uint16_t    fifo_frames_max;  // most frames pending at one read
+
+  // FIFO read in progress
+  spi_txn_t             fifo_txn;
+  uint8_t               fifo_count[3];
+  uint16_t              fifo_pending;
+  uint32_t              fifo_usec;
+  mpu6000_fifo_callback fifo_cb;
 } MPU6000_t;
 
-extern void mpu6000_init(MPU6000_t* mpu);
+extern int mpu6000_init_step(MPU6000_t* mpu, int step);
 extern void mpu6000_read_all(MPU6000_t* mpu, int16_t a[3], int16_t g[3]);
+extern void mpu6000_fifo_start(MPU6000_t* mpu);
+extern bool mpu6000_fifo_read_start(MPU6000_t* mpu, mpu6000_fifo_callback cb);
 extern uint8_t mpu6000_test(MPU6000_t* mpu, uint8_t reg);
 
 #endif //!__MPU_6000_DEF_H__
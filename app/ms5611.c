@@ -4,9 +4,13 @@
 
 #define I2C_DEFAULT_TIMEOUT               1000
 
-static const uint8_t ms56xx_osr = CMD_ADC_4096;
 static I2C_HandleTypeDef*   hi2c = &hi2c1;
 
+//
+// maximum conversion time in usec by OSR, 256 to 4096
+//
+static const uint16_t       _conv_time[] = { 600, 1170, 2280, 4540, 9040 };
+
 ////////////////////////////////////////////////////////////////////////////////
 //
 // private read/write
@@ -41,16 +45,22 @@ ms5611_read_adc(ms5611_t* dev)
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-// private utilities
+// public services
 //
 ////////////////////////////////////////////////////////////////////////////////
-static void
-ms5611_device_init(ms5611_t* dev)
+//
+// issues the reset only. PROM is readable MS5611_RESET_TIME later
+//
+void
+ms5611_init(ms5611_t* dev)
 {
+  dev->dev_addr = MS5611_I2C_ADDR;
   ms5611_write_reg(dev, CMD_RESET, 1);
-  
-  HAL_Delay(5);
+}
 
+void
+ms5611_read_prom(ms5611_t* dev)
+{
   // read all coefficients
   for (int i = 0; i < PROM_NB; i++)
   {
@@ -61,22 +71,10 @@ ms5611_device_init(ms5611_t* dev)
   }
 }
 
-////////////////////////////////////////////////////////////////////////////////
-//
-// public services
-//
-////////////////////////////////////////////////////////////////////////////////
-void
-ms5611_init(ms5611_t* dev)
-{
-  dev->dev_addr = MS5611_I2C_ADDR;
-  ms5611_device_init(dev);
-}
-
 void
-ms5611_start_read_pressure(ms5611_t* dev)
+ms5611_start_read_pressure(ms5611_t* dev, uint8_t osr)
 {
-  ms5611_write_reg(dev, CMD_ADC_CONV + CMD_ADC_D1 + ms56xx_osr, 1);
+  ms5611_write_reg(dev, CMD_ADC_CONV + CMD_ADC_D1 + osr, 1);
 }
 
 void
@@ -86,9 +84,9 @@ ms5611_read_pressure(ms5611_t* dev)
 }
 
 void
-ms5611_start_read_temp(ms5611_t* dev)
+ms5611_start_read_temp(ms5611_t* dev, uint8_t osr)
 {
-  ms5611_write_reg(dev, CMD_ADC_CONV + CMD_ADC_D2 + ms56xx_osr, 1);
+  ms5611_write_reg(dev, CMD_ADC_CONV + CMD_ADC_D2 + osr, 1);
 }
 
 void
@@ -97,6 +95,15 @@ ms5611_read_temp(ms5611_t* dev)
   dev->ut   = ms5611_read_adc(dev);
 }
 
+//
+// osr is one of CMD_ADC_256 .. CMD_ADC_4096
+//
+uint16_t
+ms5611_conv_time(uint8_t osr)
+{
+  return _conv_time[osr >> 1];
+}
+
 void
 ms5611_calc(ms5611_t* dev, int32_t* pressure, int32_t* temperature)
 {
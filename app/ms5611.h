@@ -18,6 +18,8 @@
 #define CMD_PROM_RD             0xA0 // Prom read command
 #define PROM_NB                 8
 
+#define MS5611_RESET_TIME       5    // msec. 2.8 max
+
 typedef struct
 {
   uint32_t    ut;               // temperature
@@ -28,10 +30,12 @@ typedef struct
 } ms5611_t;
 
 extern void ms5611_init(ms5611_t* dev);
-extern void ms5611_start_read_pressure(ms5611_t* dev);
+extern void ms5611_read_prom(ms5611_t* dev);
+extern void ms5611_start_read_pressure(ms5611_t* dev, uint8_t osr);
 extern void ms5611_read_pressure(ms5611_t* dev);
-extern void ms5611_start_read_temp(ms5611_t* dev);
+extern void ms5611_start_read_temp(ms5611_t* dev, uint8_t osr);
 extern void ms5611_read_temp(ms5611_t* dev);
+extern uint16_t ms5611_conv_time(uint8_t osr);
 extern void ms5611_calc(ms5611_t* dev, int32_t* pressure, int32_t* temperature);
 
 #endif /* !__MS5611_DEF_H__ */
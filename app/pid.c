@@ -1,33 +1,126 @@
+#include <math.h>
 #include "pid.h"
+#include "math_helper.h"
+#include "mem_section.h"
+
+//
+// time constant of the setpoint tracker used for I term relax.
+// about 15Hz
+//
+#define PID_I_RELAX_RC        (1.0f / (2.0f * M_PIf * 15.0f))
+
+static inline float
+pid_pt1(float state, float input, float rc, float dt)
+{
+  return state + (dt / (rc + dt)) * (input - state);
+}
 
 void
-pid_control_init(pid_control_t* pidc)
+pid_control_init(pid_control_t* pidc, float i_limit, float out_limit, float i_relax)
 {
+  pidc->i_limit   = i_limit;
+  pidc->out_limit = out_limit;
+  pidc->i_relax   = i_relax;
+
+  filter_init(&pidc->dterm_filter, filter_type_none, 0, FILTER_BIQUAD_Q, 1000);
+
   pid_control_reset(pidc);
 }
 
+void
+pid_control_set_dterm_filter(pid_control_t* pidc, filter_type_t type, float hz, float sample_hz)
+{
+  filter_init(&pidc->dterm_filter, type, hz, FILTER_BIQUAD_Q, sample_hz);
+}
+
 void
 pid_control_reset(pid_control_t* pidc)
 {
-  pidc->prev_error      = 0.0f;
   pidc->integral        = 0.0f;
+  pidc->prev_feed       = 0.0f;
+  pidc->target_lpf      = 0.0f;
+  pidc->first_run       = true;
+
+  filter_reset(&pidc->dterm_filter);
 }
 
-float
-pid_control_run(pid_control_t* pidc, const float target, const float feed, const float dt, const float k[3])
+//
+// one PID step.
+//
+// - P on error
+// - I on error with clamping, relax while setpoint is moving fast and
+//   conditional integration while the output is saturated
+// - D on measurement through the D term filter. no setpoint kick
+// - FF directly from the setpoint
+//
+FAST_CODE float
+pid_control_run(pid_control_t* pidc, const float target, const float feed, const float dt, const float k[PID_K_NUM])
 {
   float error = target - feed;
   float p,
-        i,
-        d;
+        i_prev,
+        i_delta,
+        d,
+        ff,
+        out;
+
+  if(pidc->first_run)
+  {
+    pidc->prev_feed   = feed;
+    pidc->target_lpf  = target;
+    pidc->first_run   = false;
+  }
+
+  p = k[PID_KP] * error;
+
+  //
+  // I term relax.
+  // stick is moving. let P/FF do the job and keep I from winding up
+  //
+  i_delta = k[PID_KI] * error * dt;
+  if(pidc->i_relax > 0.0f)
+  {
+    float dev;
+
+    pidc->target_lpf = pid_pt1(pidc->target_lpf, target, PID_I_RELAX_RC, dt);
+    dev = fabsf(target - pidc->target_lpf);
+
+    if(dev >= pidc->i_relax)
+    {
+      i_delta = 0.0f;
+    }
+    else
+    {
+      i_delta *= (1.0f - dev / pidc->i_relax);
+    }
+  }
+  i_prev = pidc->integral;
+  pidc->integral += i_delta;
+  clamp(&pidc->integral, -pidc->i_limit, pidc->i_limit);
+
+  //
+  // D on measurement
+  //
+  d = -(feed - pidc->prev_feed) / dt;
+  pidc->prev_feed = feed;
+
+  d = k[PID_KD] * filter_apply(&pidc->dterm_filter, d);
+
+  ff = k[PID_KFF] * target;
 
-  p = k[0] * error;
+  out = p + pidc->integral + d + ff;
 
-  pidc->integral = pidc->integral + error * dt;
-  i = k[1] * pidc->integral;
+  //
+  // conditional integration.
+  // don't keep integrating into the direction we are already saturated
+  //
+  if((out > pidc->out_limit && i_delta > 0.0f) ||
+     (out < -pidc->out_limit && i_delta < 0.0f))
+  {
+    pidc->integral = i_prev;
+  }
 
-  d = k[2] * (error - pidc->prev_error);
-  pidc->prev_error = error;
+  clamp(&out, -pidc->out_limit, pidc->out_limit);
 
-  return p + i + d;
+  return out;
 }
@@ -2,15 +2,40 @@
 #define __PIF_DEF_H__
 
 #include "app_common.h"
+#include "filter.h"
+
+//
+// gain index in k[] passed to pid_control_run()
+//
+#define PID_KP        0
+#define PID_KI        1
+#define PID_KD        2
+#define PID_KFF       3
+#define PID_K_NUM     4
 
 typedef struct
 {
-  float       prev_error;
-  float       integral;
+  //
+  // state
+  //
+  float       integral;         // accumulated I term in output unit
+  float       prev_feed;        // previous measurement for D on measurement
+  float       target_lpf;       // slow setpoint for I term relax
+  bool        first_run;
+
+  //
+  // parameters
+  //
+  float       i_limit;          // I term clamp in output unit
+  float       out_limit;        // output clamp
+  float       i_relax;          // setpoint deviation at which I stops accumulating. 0 disables
+
+  filter_t    dterm_filter;
 } pid_control_t;
 
-extern void pid_control_init(pid_control_t* pidc);
+extern void pid_control_init(pid_control_t* pidc, float i_limit, float out_limit, float i_relax);
+extern void pid_control_set_dterm_filter(pid_control_t* pidc, filter_type_t type, float hz, float sample_hz);
 extern void pid_control_reset(pid_control_t* pidc);
-extern float pid_control_run(pid_control_t* pidc, const float input, const float target, const float dt, const float k[3]);
+extern float pid_control_run(pid_control_t* pidc, const float target, const float feed, const float dt, const float k[PID_K_NUM]);
 
 #endif /* !__PIF_DEF_H__ */
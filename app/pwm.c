@@ -1,6 +1,7 @@
 #include "stm32f4xx_hal.h"
 #include "tim.h"
 #include "pwm.h"
+#include "dshot.h"
 
 ////////////////////////////////////////////////////////////////////////////////
 //
@@ -13,6 +14,21 @@ typedef struct
   uint32_t            tim_chnl;
 } pwm_channel_t;
 
+//
+// one pulse mode timing.
+// all timers are brought to the same 84MHz tick. TIM9 sits on APB2 at 168MHz
+//
+#define PWM_ONESHOT_TICKS_PER_USEC        84
+#define PWM_ONESHOT_START_DELAY           1       // ticks before the longest pulse starts
+
+//
+// OneShot125 : 125-250us, 1/8 of standard PWM
+// Multishot  : 5-25us
+//
+#define PWM_ONESHOT125_MAX_USEC           250
+#define PWM_MULTISHOT_MIN_USEC            5
+#define PWM_MULTISHOT_MAX_USEC            25
+
 ////////////////////////////////////////////////////////////////////////////////
 //
 // module privates
@@ -41,14 +57,198 @@ static pwm_channel_t    _pwm_chnls[] =
   {   &htim5,   TIM_CHANNEL_1   },
 };
 
+static const char* _pwm_protocol_names[pwm_protocol_max] =
+{
+  "pwm",
+  "dshot150",
+  "dshot300",
+  "dshot600",
+  "oneshot125",
+  "multishot",
+};
+
+static pwm_protocol_t   _pwm_protocol = pwm_protocol_pwm;
+static uint16_t         _pwm_oneshot_arr;
+static uint16_t         _pwm_oneshot_ticks[NARRAY(_pwm_chnls)];
+
+static inline bool
+pwm_is_dshot(void)
+{
+  return _pwm_protocol >= pwm_protocol_dshot150 && _pwm_protocol <= pwm_protocol_dshot600;
+}
+
+static inline bool
+pwm_is_oneshot(void)
+{
+  return _pwm_protocol == pwm_protocol_oneshot125 || _pwm_protocol == pwm_protocol_multishot;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// one pulse mode
+//
+// each timer runs in one pulse mode with PWM2 so the output is low while the
+// counter is stopped, goes high at CCR and drops when the counter hits ARR
+// and stops itself. ARR is shared by a timer's channels, so pulses of a timer
+// end together and start ARR - CCR + 1 ticks earlier.
+//
+// pwm_update() loads CCRs and starts every counter back to back, so all
+// motors get their pulse right after the mixer has run.
+//
+////////////////////////////////////////////////////////////////////////////////
+static uint16_t
+pwm_oneshot_ticks_from_pulse(uint16_t pulse)
+{
+  uint32_t    ticks;
+
+  if(pulse < PWM_OUT_MIN_DUTY_CYCLE)
+  {
+    pulse = PWM_OUT_MIN_DUTY_CYCLE;
+  }
+  else if(pulse > PWM_OUT_MAX_DUTY_CYCLE)
+  {
+    pulse = PWM_OUT_MAX_DUTY_CYCLE;
+  }
+
+  if(_pwm_protocol == pwm_protocol_oneshot125)
+  {
+    ticks = (uint32_t)pulse * PWM_ONESHOT_TICKS_PER_USEC / 8;
+  }
+  else
+  {
+    // 1000-2000 to 5-25us. below 1000 stays at the minimum pulse
+    ticks = pulse > 1000 ? (uint32_t)(pulse - 1000) * PWM_ONESHOT_TICKS_PER_USEC / 50 : 0;
+    ticks += PWM_MULTISHOT_MIN_USEC * PWM_ONESHOT_TICKS_PER_USEC;
+  }
+  return (uint16_t)ticks;
+}
+
+static void
+pwm_oneshot_disable_preload(TIM_HandleTypeDef* htim, uint32_t chnl)
+{
+  switch(chnl)
+  {
+  case TIM_CHANNEL_1:
+    htim->Instance->CCMR1 &= ~TIM_CCMR1_OC1PE;
+    break;
+  case TIM_CHANNEL_2:
+    htim->Instance->CCMR1 &= ~TIM_CCMR1_OC2PE;
+    break;
+  case TIM_CHANNEL_3:
+    htim->Instance->CCMR2 &= ~TIM_CCMR2_OC3PE;
+    break;
+  case TIM_CHANNEL_4:
+    htim->Instance->CCMR2 &= ~TIM_CCMR2_OC4PE;
+    break;
+  }
+}
+
+static void
+pwm_oneshot_start(void)
+{
+  TIM_OC_InitTypeDef    oc;
+  TIM_HandleTypeDef*    htim;
+  uint16_t              max_usec;
+
+  max_usec = _pwm_protocol == pwm_protocol_oneshot125 ?
+    PWM_ONESHOT125_MAX_USEC : PWM_MULTISHOT_MAX_USEC;
+
+  _pwm_oneshot_arr = max_usec * PWM_ONESHOT_TICKS_PER_USEC + PWM_ONESHOT_START_DELAY;
+
+  for(int i = 0; i < NARRAY(_pwm_timers); i++)
+  {
+    htim = _pwm_timers[i];
+
+    HAL_TIM_Base_Stop(htim);
+
+    htim->Init.Prescaler  = htim->Instance == TIM9 ? 1 : 0;
+    htim->Init.Period     = _pwm_oneshot_arr;
+    HAL_TIM_Base_Init(htim);
+
+    htim->Instance->CR1 |= TIM_CR1_OPM;
+    __HAL_TIM_SET_COUNTER(htim, 0);
+  }
+
+  oc.OCMode       = TIM_OCMODE_PWM2;
+  oc.Pulse        = _pwm_oneshot_arr + 1;     // never reached. output stays low
+  oc.OCPolarity   = TIM_OCPOLARITY_HIGH;
+  oc.OCFastMode   = TIM_OCFAST_DISABLE;
+
+  for(int i = 0; i < NARRAY(_pwm_chnls); i++)
+  {
+    htim = _pwm_chnls[i].htim;
+
+    HAL_TIM_PWM_ConfigChannel(htim, &oc, _pwm_chnls[i].tim_chnl);
+
+    // counter is stopped between pulses. CCR has to take effect right away
+    pwm_oneshot_disable_preload(htim, _pwm_chnls[i].tim_chnl);
+    TIM_CCxChannelCmd(htim->Instance, _pwm_chnls[i].tim_chnl, TIM_CCx_ENABLE);
+
+    _pwm_oneshot_ticks[i] = pwm_oneshot_ticks_from_pulse(PWM_OUT_MIN_DUTY_CYCLE);
+  }
+}
+
+static void
+pwm_oneshot_fire(void)
+{
+  //
+  // previous pulse still on the wire. skip rather than cut it short
+  //
+  for(int i = 0; i < NARRAY(_pwm_timers); i++)
+  {
+    if(_pwm_timers[i]->Instance->CR1 & TIM_CR1_CEN)
+    {
+      return;
+    }
+  }
+
+  for(int i = 0; i < NARRAY(_pwm_chnls); i++)
+  {
+    __HAL_TIM_SET_COMPARE(_pwm_chnls[i].htim, _pwm_chnls[i].tim_chnl,
+        _pwm_oneshot_arr + 1 - _pwm_oneshot_ticks[i]);
+  }
+
+  __disable_irq();
+  for(int i = 0; i < NARRAY(_pwm_timers); i++)
+  {
+    _pwm_timers[i]->Instance->CNT  = 0;
+    _pwm_timers[i]->Instance->CR1 |= TIM_CR1_CEN;
+  }
+  __enable_irq();
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 //
 // public interfaces
 //
 ////////////////////////////////////////////////////////////////////////////////
+const char*
+pwm_protocol_name(pwm_protocol_t proto)
+{
+  if(proto >= pwm_protocol_max)
+  {
+    return "invalid";
+  }
+  return _pwm_protocol_names[proto];
+}
+
 void
-pwm_start(void)
+pwm_start(pwm_protocol_t proto)
 {
+  _pwm_protocol = proto < pwm_protocol_max ? proto : pwm_protocol_pwm;
+
+  if(pwm_is_dshot())
+  {
+    dshot_start((dshot_rate_t)(_pwm_protocol - pwm_protocol_dshot150));
+    return;
+  }
+
+  if(pwm_is_oneshot())
+  {
+    pwm_oneshot_start();
+    return;
+  }
+
   for(int i = 0; i < sizeof(_pwm_chnls)/sizeof(pwm_channel_t); i++)
   {
     __HAL_TIM_SET_COMPARE(_pwm_chnls[i].htim, _pwm_chnls[i].tim_chnl, PWM_OUT_MIN_DUTY_CYCLE);
@@ -80,10 +280,44 @@ pwm_stop(void)
   }
 }
 
+//
+// duty is pulse width in usec regardless of protocol.
+// for DShot and one pulse modes it is only latched here
+// and goes out on pwm_update()
+//
 void
 pwm_set_duty(pwm_channel_enum_t chnl, uint16_t duty)
 {
   pwm_channel_t*  c = &_pwm_chnls[chnl];
 
+  if(pwm_is_dshot())
+  {
+    dshot_set(chnl, dshot_throttle_from_pulse(duty));
+    return;
+  }
+
+  if(pwm_is_oneshot())
+  {
+    _pwm_oneshot_ticks[chnl] = pwm_oneshot_ticks_from_pulse(duty);
+    return;
+  }
+
   __HAL_TIM_SET_COMPARE(c->htim, c->tim_chnl, duty);
 }
+
+//
+// push latched outputs to ESCs.
+// analog PWM free runs so there is nothing to do
+//
+void
+pwm_update(void)
+{
+  if(pwm_is_dshot())
+  {
+    dshot_fire();
+  }
+  else if(pwm_is_oneshot())
+  {
+    pwm_oneshot_fire();
+  }
+}
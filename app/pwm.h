@@ -16,8 +16,22 @@ typedef enum
   pwm_channel_5,
 } pwm_channel_enum_t;
 
-extern void pwm_start(void);
+typedef enum
+{
+  pwm_protocol_pwm = 0,
+  pwm_protocol_dshot150,
+  pwm_protocol_dshot300,
+  pwm_protocol_dshot600,
+  pwm_protocol_oneshot125,
+  pwm_protocol_multishot,
+  pwm_protocol_max,
+} pwm_protocol_t;
+
+extern const char* pwm_protocol_name(pwm_protocol_t proto);
+
+extern void pwm_start(pwm_protocol_t proto);
 extern void pwm_stop(void);
 extern void pwm_set_duty(pwm_channel_enum_t chnl, uint16_t duty);
+extern void pwm_update(void);
 
 #endif /* !__PWM_DEF_H__ */
@@ -0,0 +1,140 @@
+#include <math.h>
+#include <string.h>
+#include "sensor_xform.h"
+#include "math_helper.h"
+
+//
+// aligned sensor frame to madgwick NWU body frame.
+//
+//   body x =  aligned y
+//   body y = -aligned x
+//   body z =  aligned z
+//
+static const float _sensor_nwu_remap[3][3] =
+{
+  {  0.0f,  1.0f,  0.0f },
+  { -1.0f,  0.0f,  0.0f },
+  {  0.0f,  0.0f,  1.0f },
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// private utilities
+//
+////////////////////////////////////////////////////////////////////////////////
+static void
+sensor_xform_mul(const float a[3][3], const float b[3][3], float r[3][3])
+{
+  float t[3][3];
+
+  for(int i = 0; i < 3; i++)
+  {
+    for(int j = 0; j < 3; j++)
+    {
+      t[i][j] = a[i][0] * b[0][j] + a[i][1] * b[1][j] + a[i][2] * b[2][j];
+    }
+  }
+  memcpy(r, t, sizeof(t));
+}
+
+//
+// sensor_align_values() is linear so its matrix is just
+// where it sends each unit vector
+//
+static void
+sensor_xform_align_matrix(sensor_align_t align, float m[3][3])
+{
+  int16_t   e[3];
+
+  for(int j = 0; j < 3; j++)
+  {
+    e[0] = e[1] = e[2] = 0;
+    e[j] = 1;
+
+    sensor_align_values(e, align);
+
+    for(int i = 0; i < 3; i++)
+    {
+      m[i][j] = e[i];
+    }
+  }
+}
+
+//
+// board orientation on the airframe in decidegree, same sense as attitude.
+// roll + right bank, pitch + nose up, yaw + clockwise.
+//
+// body = R * board with R = Rz(yaw) Ry(pitch) Rx(roll) in NWU.
+// NWU pitch and yaw turn the other way so they are negated
+//
+static void
+sensor_xform_board_matrix(const int16_t board_align[3], float m[3][3])
+{
+  const float   r  =  board_align[0] * RAD / 10.0f,
+                p  = -board_align[1] * RAD / 10.0f,
+                y  = -board_align[2] * RAD / 10.0f;
+  const float   cr = cosf(r), sr = sinf(r),
+                cp = cosf(p), sp = sinf(p),
+                cy = cosf(y), sy = sinf(y);
+
+  m[0][0] = cy * cp;
+  m[0][1] = cy * sp * sr - sy * cr;
+  m[0][2] = cy * sp * cr + sy * sr;
+
+  m[1][0] = sy * cp;
+  m[1][1] = sy * sp * sr + cy * cr;
+  m[1][2] = sy * sp * cr - cy * sr;
+
+  m[2][0] = -sp;
+  m[2][1] = cp * sr;
+  m[2][2] = cp * cr;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// public interfaces
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+// cal is applied to raw - offset before anything else
+//
+void
+sensor_xform_build_cal(sensor_xform_t* x,
+    sensor_align_t align,
+    const int16_t board_align[3],
+    const float offset[3],
+    const float cal[3][3])
+{
+  float   a[3][3],
+          b[3][3];
+
+  sensor_xform_align_matrix(align, a);
+  sensor_xform_board_matrix(board_align, b);
+
+  // M = B * N * A * cal
+  sensor_xform_mul(_sensor_nwu_remap, a, x->m);
+  sensor_xform_mul(b, x->m, x->m);
+  sensor_xform_mul(x->m, cal, x->m);
+
+  for(int i = 0; i < 3; i++)
+  {
+    x->c[i] = -(x->m[i][0] * offset[0] + x->m[i][1] * offset[1] + x->m[i][2] * offset[2]);
+  }
+}
+
+void
+sensor_xform_build(sensor_xform_t* x,
+    sensor_align_t align,
+    const int16_t board_align[3],
+    const float offset[3],
+    const float scale[3])
+{
+  float   cal[3][3] =
+  {
+    { scale[0], 0.0f,     0.0f     },
+    { 0.0f,     scale[1], 0.0f     },
+    { 0.0f,     0.0f,     scale[2] },
+  };
+
+  sensor_xform_build_cal(x, align, board_align, offset, cal);
+}
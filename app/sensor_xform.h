@@ -0,0 +1,45 @@
+#ifndef __SENSOR_XFORM_DEF_H__
+#define __SENSOR_XFORM_DEF_H__
+
+#include "app_common.h"
+#include "sensor_align.h"
+
+//
+// raw sensor to body frame in one go
+//
+//   body = M * raw + c
+//
+// M folds per axis scale (or a full soft iron matrix), chip alignment on the board, NWU remap and
+// board alignment on the airframe. c = -M * offset.
+// built only when configuration changes.
+//
+typedef struct
+{
+  float     m[3][3];
+  float     c[3];
+} sensor_xform_t;
+
+extern void sensor_xform_build(sensor_xform_t* x,
+    sensor_align_t align,
+    const int16_t board_align[3],
+    const float offset[3],
+    const float scale[3]);
+extern void sensor_xform_build_cal(sensor_xform_t* x,
+    sensor_align_t align,
+    const int16_t board_align[3],
+    const float offset[3],
+    const float cal[3][3]);
+
+static inline void
+sensor_xform_apply(const sensor_xform_t* x, const int16_t raw[3], float out[3])
+{
+  const float   r0 = raw[0],
+                r1 = raw[1],
+                r2 = raw[2];
+
+  out[0] = x->m[0][0] * r0 + x->m[0][1] * r1 + x->m[0][2] * r2 + x->c[0];
+  out[1] = x->m[1][0] * r0 + x->m[1][1] * r1 + x->m[1][2] * r2 + x->c[1];
+  out[2] = x->m[2][0] * r0 + x->m[2][1] * r1 + x->m[2][2] * r2 + x->c[2];
+}
+
+#endif /* !__SENSOR_XFORM_DEF_H__ */
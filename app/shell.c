@@ -11,16 +11,31 @@
 #include "shell_if_usb.h"
 #include "pwm.h"
 #include "mpu6000.h"
+#include "spi_bus.h"
 #include "accelgyro.h"
 #include "magneto.h"
+#include "mag_ellipsoid.h"
 #include "micros.h"
 #include "imu.h"
+#include "ins.h"
+#include "altitude.h"
+#include "ahrs_common.h"
 #include "rx.h"
 #include "baro.h"
 #include "gps.h"
+#include "ublox.h"
 #include "config.h"
 #include "flight.h"
 #include "motor.h"
+#include "filter.h"
+#include "dyn_notch.h"
+#include "mixer.h"
+#include "math_helper.h"
+#include "cycle_counter.h"
+#include "pid.h"
+#include "soft_timer.h"
+#include "mem_section.h"
+#include "app.h"
 
 ////////////////////////////////////////////////////////////////////////////////
 //
@@ -29,7 +44,7 @@
 ////////////////////////////////////////////////////////////////////////////////
 
 #define SHELL_MAX_COLUMNS_PER_LINE      128
-#define SHELL_COMMAND_MAX_ARGS          4
+#define SHELL_COMMAND_MAX_ARGS          6
 
 #define VERSION       "STM32F4 Shell V0.3a"
 
@@ -50,13 +65,16 @@ typedef struct
 static void shell_command_help(ShellIntf* intf, int argc, const char** argv);
 static void shell_command_version(ShellIntf* intf, int argc, const char** argv);
 static void shell_command_uptime(ShellIntf* intf, int argc, const char** argv);
+static void shell_command_boot(ShellIntf* intf, int argc, const char** argv);
 static void shell_command_pwm(ShellIntf* intf, int argc, const char** argv);
 static void shell_command_mpu(ShellIntf* intf, int argc, const char** argv);
 static void shell_command_mpu_raw(ShellIntf* intf, int argc, const char** argv);
+static void shell_command_spi(ShellIntf* intf, int argc, const char** argv);
 static void shell_command_micros(ShellIntf* intf, int argc, const char** argv);
 static void shell_command_mag_raw(ShellIntf* intf, int argc, const char** argv);
 static void shell_command_mag_cal(ShellIntf* intf, int argc, const char** argv);
 static void shell_command_gyro_cal(ShellIntf* intf, int argc, const char** argv);
+static void shell_command_gyro_tc(ShellIntf* intf, int argc, const char** argv);
 static void shell_command_accel_cal(ShellIntf* intf, int argc, const char** argv);
 static void shell_command_mag(ShellIntf* intf, int argc, const char** argv);
 static void shell_command_gyro(ShellIntf* intf, int argc, const char** argv);
@@ -71,6 +89,15 @@ static void shell_command_gps(ShellIntf* intf, int argc, const char** argv);
 static void shell_command_flight(ShellIntf* intf, int argc, const char** argv);
 static void shell_command_pid(ShellIntf* intf, int argc, const char** argv);
 static void shell_command_motor(ShellIntf* intf, int argc, const char** argv);
+static void shell_command_filter(ShellIntf* intf, int argc, const char** argv);
+static void shell_command_dyn_notch(ShellIntf* intf, int argc, const char** argv);
+static void shell_command_mixer(ShellIntf* intf, int argc, const char** argv);
+static void shell_command_ahrs(ShellIntf* intf, int argc, const char** argv);
+static void shell_command_ins(ShellIntf* intf, int argc, const char** argv);
+static void shell_command_alt(ShellIntf* intf, int argc, const char** argv);
+static void shell_command_math(ShellIntf* intf, int argc, const char** argv);
+static void shell_command_mem(ShellIntf* intf, int argc, const char** argv);
+static void shell_command_board(ShellIntf* intf, int argc, const char** argv);
 static void shell_command_arm_disarm(ShellIntf* intf, int argc, const char** argv);
 static void shell_command_save(ShellIntf* intf, int argc, const char** argv);
 
@@ -133,6 +160,11 @@ static ShellCommand     _commands[] =
     "show system uptime",
     shell_command_uptime,
   },
+  {
+    "boot",
+    "show bring-up timing",
+    shell_command_boot,
+  },
   {
     "pwm",
     "set pwm out duty cycle",
@@ -148,6 +180,11 @@ static ShellCommand     _commands[] =
     "read raw MPU values",
     shell_command_mpu_raw,
   },
+  {
+    "spi",
+    "show SPI bus statistics",
+    shell_command_spi,
+  },
   {
     "micros",
     "read current micros",
@@ -168,6 +205,11 @@ static ShellCommand     _commands[] =
     "calibrate gyro",
     shell_command_gyro_cal,
   },
+  {
+    "gyro_tc",
+    "show/clear gyro temperature compensation",
+    shell_command_gyro_tc,
+  },
   {
     "accel_cal",
     "calibrate accelerometer",
@@ -220,7 +262,7 @@ static ShellCommand     _commands[] =
   },
   {
     "gps",
-    "show gps status",
+    "show gps status or set message profile",
     shell_command_gps,
   },
   {
@@ -238,6 +280,51 @@ static ShellCommand     _commands[] =
     "show/config motor index",
     shell_command_motor,
   },
+  {
+    "filter",
+    "show/config gyro and D term filters",
+    shell_command_filter,
+  },
+  {
+    "dnotch",
+    "show/config dynamic notch",
+    shell_command_dyn_notch,
+  },
+  {
+    "mixer",
+    "show/config motor mixer",
+    shell_command_mixer,
+  },
+  {
+    "ahrs",
+    "show/select AHRS engine",
+    shell_command_ahrs,
+  },
+  {
+    "ins",
+    "show INS state",
+    shell_command_ins,
+  },
+  {
+    "alt",
+    "show baro/accel altitude",
+    shell_command_alt,
+  },
+  {
+    "math",
+    "benchmark fast math against libm",
+    shell_command_math,
+  },
+  {
+    "mem",
+    "show memory placement or benchmark the control loop",
+    shell_command_mem,
+  },
+  {
+    "board",
+    "show/config board alignment",
+    shell_command_board,
+  },
   {
     "arm",
     "arm flight controller",
@@ -299,6 +386,30 @@ shell_command_uptime(ShellIntf* intf, int argc, const char** argv)
   shell_printf(intf, "System Uptime: %lu\r\n", __uptime);
 }
 
+static void
+shell_command_boot(ShellIntf* intf, int argc, const char** argv)
+{
+  shell_printf(intf, "\r\n");
+
+  if(app_boot_stat.sensors_ready != 0)
+  {
+    shell_printf(intf, "Sensors Ready : %lu ms\r\n", app_boot_stat.sensors_ready);
+  }
+  else
+  {
+    shell_printf(intf, "Sensors Ready : not yet\r\n");
+  }
+
+  if(app_boot_stat.armable != 0)
+  {
+    shell_printf(intf, "Armable       : %lu ms\r\n", app_boot_stat.armable);
+  }
+  else
+  {
+    shell_printf(intf, "Armable       : not yet\r\n");
+  }
+}
+
 static void
 shell_command_pwm(ShellIntf* intf, int argc, const char** argv)
 {
@@ -362,9 +473,12 @@ shell_command_mpu(ShellIntf* intf, int argc, const char** argv)
 static void
 shell_command_mpu_raw(ShellIntf* intf, int argc, const char** argv)
 {
-  uint16_t  sample_rate;
+  uint16_t  sample_rate,
+            frames_max;
+  uint32_t  overflow;
 
   sample_rate = accelgyro_sample_rate();
+  accelgyro_fifo_stat(&overflow, &frames_max);
 
   shell_printf(intf, "\r\n");
   shell_printf(intf, "AX : %d\r\n", accel_raw[0]);
@@ -376,6 +490,23 @@ shell_command_mpu_raw(ShellIntf* intf, int argc, const char** argv)
   shell_printf(intf, "GZ : %d\r\n", gyro_raw[2]);
   shell_printf(intf, "\r\n");
   shell_printf(intf, "Sample Rate : %u\r\n", sample_rate);
+  shell_printf(intf, "FIFO        : max %u frames pending, %lu overflows\r\n", frames_max, overflow);
+}
+
+static void
+shell_command_spi(ShellIntf* intf, int argc, const char** argv)
+{
+  static const char*  names[spi_bus_max] = { "SPI1", "SPI3" };
+
+  shell_printf(intf, "\r\n");
+  for(int i = 0; i < spi_bus_max; i++)
+  {
+    shell_printf(intf, "%s : %lu transfers, %lu errors, queue max %u\r\n",
+        names[i],
+        spi_bus_stat[i].txn_count,
+        spi_bus_stat[i].error_count,
+        spi_bus_stat[i].queue_max);
+  }
 }
 
 static void
@@ -409,21 +540,21 @@ static void
 shell_command_mag(ShellIntf* intf, int argc, const char** argv)
 {
   shell_printf(intf, "\r\n");
-  shell_printf(intf, "MX : %d\r\n", mag_value[0]);
-  shell_printf(intf, "MY : %d\r\n", mag_value[1]);
-  shell_printf(intf, "MZ : %d\r\n", mag_value[2]);
-  shell_printf(intf, "MXN: %d\r\n", mag_body[0]);
-  shell_printf(intf, "MYN: %d\r\n", mag_body[1]);
-  shell_printf(intf, "MZN: %d\r\n", mag_body[2]);
+  shell_printf(intf, "MX : %d\r\n", mag_raw[0]);
+  shell_printf(intf, "MY : %d\r\n", mag_raw[1]);
+  shell_printf(intf, "MZ : %d\r\n", mag_raw[2]);
+  shell_printf(intf, "MXN: %.1f\r\n", mag_body[0]);
+  shell_printf(intf, "MYN: %.1f\r\n", mag_body[1]);
+  shell_printf(intf, "MZN: %.1f\r\n", mag_body[2]);
 }
 
 static void
 shell_command_gyro(ShellIntf* intf, int argc, const char** argv)
 {
   shell_printf(intf, "\r\n");
-  shell_printf(intf, "GX : %d\r\n", gyro_value[0]);
-  shell_printf(intf, "GY : %d\r\n", gyro_value[1]);
-  shell_printf(intf, "GZ : %d\r\n", gyro_value[2]);
+  shell_printf(intf, "GX : %d\r\n", gyro_raw[0]);
+  shell_printf(intf, "GY : %d\r\n", gyro_raw[1]);
+  shell_printf(intf, "GZ : %d\r\n", gyro_raw[2]);
   shell_printf(intf, "GXN: %.2f\r\n", gyro_body[0]);
   shell_printf(intf, "GYN: %.2f\r\n", gyro_body[1]);
   shell_printf(intf, "GZN: %.2f\r\n", gyro_body[2]);
@@ -433,17 +564,21 @@ static void
 shell_command_accel(ShellIntf* intf, int argc, const char** argv)
 {
   shell_printf(intf, "\r\n");
-  shell_printf(intf, "AX : %d\r\n", accel_value[0]);
-  shell_printf(intf, "AY : %d\r\n", accel_value[1]);
-  shell_printf(intf, "AZ : %d\r\n", accel_value[2]);
-  shell_printf(intf, "AXN: %d\r\n", accel_body[0]);
-  shell_printf(intf, "AYN: %d\r\n", accel_body[1]);
-  shell_printf(intf, "AZN: %d\r\n", accel_body[2]);
+  shell_printf(intf, "AX : %d\r\n", accel_raw[0]);
+  shell_printf(intf, "AY : %d\r\n", accel_raw[1]);
+  shell_printf(intf, "AZ : %d\r\n", accel_raw[2]);
+  shell_printf(intf, "AXN: %.3f\r\n", accel_body[0]);
+  shell_printf(intf, "AYN: %.3f\r\n", accel_body[1]);
+  shell_printf(intf, "AZN: %.3f\r\n", accel_body[2]);
 }
 
 static void
 shell_command_attitude(ShellIntf* intf, int argc, const char** argv)
 {
+  int16_t   attitude[3];
+
+  imu_get_attitude(attitude);
+
   shell_printf(intf, "\r\n");
 #if 0
   shell_printf(intf, "Roll  : %d\r\n", attitude[0]);
@@ -454,6 +589,7 @@ shell_command_attitude(ShellIntf* intf, int argc, const char** argv)
   shell_printf(intf, "Pitch : %.1f\r\n", attitude[1] / 10.f);
   shell_printf(intf, "Yaw   : %.1f\r\n", attitude[2] / 10.f);
 #endif
+  shell_printf(intf, "Ready : %s, %lu ms\r\n", imu_is_ready() ? "yes" : "no", imu_get()->ready_time);
 }
 
 static void
@@ -471,6 +607,9 @@ shell_command_cal_show(ShellIntf* intf, int argc, const char** argv)
   shell_printf(intf, "GX Offset  : %d\r\n", GCFG->gyro_offset[0]);
   shell_printf(intf, "GY Offset  : %d\r\n", GCFG->gyro_offset[1]);
   shell_printf(intf, "GZ Offset  : %d\r\n", GCFG->gyro_offset[2]);
+  shell_printf(intf, "G Boot Cal : %s\r\n",
+      accelgyro_gyro_boot_cal_state() == accelgyro_gyro_boot_cal_done ? "done" :
+      accelgyro_gyro_boot_cal_state() == accelgyro_gyro_boot_cal_failed ? "failed" : "running");
 
   shell_printf(intf, "MX Offset  : %d\r\n", GCFG->mag_offset[0]);
   shell_printf(intf, "MY Offset  : %d\r\n", GCFG->mag_offset[1]);
@@ -480,6 +619,10 @@ shell_command_cal_show(ShellIntf* intf, int argc, const char** argv)
   shell_printf(intf, "MX Scale   : %.2f\r\n", GCFG->mag_scale[0]);
   shell_printf(intf, "MY Scale   : %.2f\r\n", GCFG->mag_scale[1]);
   shell_printf(intf, "MZ Scale   : %.2f\r\n", GCFG->mag_scale[2]);
+#else
+  shell_printf(intf, "M Soft Iron: %.4f %.4f %.4f %.4f %.4f %.4f\r\n",
+      GCFG->mag_soft[0], GCFG->mag_soft[1], GCFG->mag_soft[2],
+      GCFG->mag_soft[3], GCFG->mag_soft[4], GCFG->mag_soft[5]);
 #endif
 }
 
@@ -556,6 +699,7 @@ shell_command_baro(ShellIntf* intf, int argc, const char** argv)
   shell_printf(intf, "Baro Ground Pressure  : %.2f\r\n", baroGroundPressure);
   shell_printf(intf, "Baro Ground Altitude  : %.2f\r\n", baroGroundAltitude);
   shell_printf(intf, "Baro Altitude         : %ld\r\n", baroAltitude);
+  shell_printf(intf, "Baro Sample Age       : %lu ms\r\n", __msec - baroSampleMsec);
 }
 
 static void
@@ -589,14 +733,65 @@ shell_command_gps(ShellIntf* intf, int argc, const char** argv)
     "FIX 2D",
     "FIX 3D",
   };
+  const ublox_cfg_t*    cfg = ublox_get_cfg();
 
   shell_printf(intf, "\r\n");
+
+  if(argc >= 3 && argc <= 4 && strcmp(argv[1], "profile") == 0)
+  {
+    if(flight_state != flight_state_disarmed)
+    {
+      shell_printf(intf, "disarm first\r\n");
+      return;
+    }
+
+    for(int i = 0; i < gps_profile_max; i++)
+    {
+      if(strcmp(argv[2], gps_profile_name(i)) != 0)
+      {
+        continue;
+      }
+
+      if(argc == 4)
+      {
+        int   hz = atoi(argv[3]);
+
+        if(i != gps_profile_pvt || hz < GPS_PVT_RATE_MIN || hz > GPS_PVT_RATE_MAX)
+        {
+          break;
+        }
+        GCFG->gps_rate_hz = hz;
+      }
+
+      GCFG->gps_profile = i;
+      ublox_reconfigure();
+      shell_printf(intf, "GPS profile set to %s, %u Hz for pvt. reconfiguring\r\n",
+          gps_profile_name(i), GCFG->gps_rate_hz);
+      return;
+    }
+
+    shell_printf(intf, "Invalid Command\r\n");
+    shell_printf(intf, "gps profile [legacy|pvt] [pvt rate %d-%d Hz]\r\n", GPS_PVT_RATE_MIN, GPS_PVT_RATE_MAX);
+    return;
+  }
+
   shell_printf(intf, "RX Status     : %s\r\n", gps_data.flags.rx_receiving ? "OK" : "NOK");
   shell_printf(intf, "GPS State     : %s\r\n", gps_state[gps_data.state]);
   shell_printf(intf, "RX Bytes      : %ld\r\n", gps_data.rx_bytes);
   shell_printf(intf, "RX Msgs       : %ld\r\n", gps_data.rx_msgs);
   shell_printf(intf, "CRC Err       : %ld\r\n", gps_data.rx_crc_err);
   shell_printf(intf, "Unsync Err    : %ld\r\n", gps_data.rx_unsync);
+  shell_printf(intf, "Profile       : %s, %u Hz for pvt\r\n", gps_profile_name(GCFG->gps_profile), GCFG->gps_rate_hz);
+  shell_printf(intf, "Epoch         : %lu, %lu us ago\r\n", gps_data.nav_seq, micros_get() - gps_data.nav_usec);
+  shell_printf(intf, "Baud          : %lu, found at %lu\r\n", cfg->baud, cfg->detected_baud);
+  shell_printf(intf, "Config        : ready in %lu ms, %lu retries, %lu NAKs, %lu mismatches, %lu restarts\r\n",
+      cfg->ready_msec, cfg->retries, cfg->naks, cfg->mismatches, cfg->restarts);
+  shell_printf(intf, "Aid           : %s, %.04f %.04f acc %lu cm, %u-%02u-%02u %02u:%02u, %s\r\n",
+      GCFG->gps_aid.valid ? "valid" : "none",
+      GCFG->gps_aid.llh.lat/1e+7f, GCFG->gps_aid.llh.lon/1e+7f, GCFG->gps_aid.acc,
+      GCFG->gps_aid.time.year, GCFG->gps_aid.time.month, GCFG->gps_aid.time.day,
+      GCFG->gps_aid.time.hours, GCFG->gps_aid.time.minutes,
+      gps_data.aid_sent ? "sent" : "not sent");
   shell_printf(intf, "\r\n");
   shell_printf(intf, "Latitude      : %.04f\r\n", gps_data.llh.lat/1e+7f);
   shell_printf(intf, "Longitude     : %.04f\r\n", gps_data.llh.lon/1e+7f);
@@ -645,11 +840,15 @@ shell_command_flight(ShellIntf* intf, int argc, const char** argv)
   shell_printf(intf, "Target Pitch    : %.2f\r\n", pid_target[1]);
   shell_printf(intf, "Target Yaw      : %.2f\r\n", pid_target[2]);
   shell_printf(intf, "\r\n");
+  shell_printf(intf, "Rate Roll       : %.2f\r\n", pid_rate_target[0]);
+  shell_printf(intf, "Rate Pitch      : %.2f\r\n", pid_rate_target[1]);
+  shell_printf(intf, "Rate Yaw        : %.2f\r\n", pid_rate_target[2]);
+  shell_printf(intf, "\r\n");
   shell_printf(intf, "Out Roll        : %.2f\r\n", pid_out[0]);
   shell_printf(intf, "Out Pitch       : %.2f\r\n", pid_out[1]);
   shell_printf(intf, "Out Yaw         : %.2f\r\n", pid_out[2]);
   shell_printf(intf, "\r\n");
-  for(int i = 0; i < 4; i++)
+  for(int i = 0; i < GCFG->mixer.num_motors && i < MOTOR_MAX_NUM; i++)
   {
     shell_printf(intf, "Motor-%d        : %u\r\n", i + 1, pid_motor[i]);
   }
@@ -660,7 +859,6 @@ shell_command_flight(ShellIntf* intf, int argc, const char** argv)
 static void
 shell_command_pid(ShellIntf* intf, int argc, const char** argv)
 {
-  float     p, i, d;
   float     *t;
 
   shell_printf(intf, "\r\n");
@@ -668,28 +866,81 @@ shell_command_pid(ShellIntf* intf, int argc, const char** argv)
   if(argc == 1)
   {
     // show
-    shell_printf(intf, "PID Roll Kp   : %.2f\r\n", GCFG->roll_kX[0]);
-    shell_printf(intf, "PID Roll Ki   : %.2f\r\n", GCFG->roll_kX[1]);
-    shell_printf(intf, "PID Roll Kd   : %.2f\r\n", GCFG->roll_kX[2]);
+    shell_printf(intf, "PID Roll Kp   : %.3f\r\n", GCFG->roll_kX[PID_KP]);
+    shell_printf(intf, "PID Roll Ki   : %.3f\r\n", GCFG->roll_kX[PID_KI]);
+    shell_printf(intf, "PID Roll Kd   : %.3f\r\n", GCFG->roll_kX[PID_KD]);
+    shell_printf(intf, "PID Roll Kff  : %.3f\r\n", GCFG->roll_kX[PID_KFF]);
+
+    shell_printf(intf, "PID Pitch Kp  : %.3f\r\n", GCFG->pitch_kX[PID_KP]);
+    shell_printf(intf, "PID Pitch Ki  : %.3f\r\n", GCFG->pitch_kX[PID_KI]);
+    shell_printf(intf, "PID Pitch Kd  : %.3f\r\n", GCFG->pitch_kX[PID_KD]);
+    shell_printf(intf, "PID Pitch Kff : %.3f\r\n", GCFG->pitch_kX[PID_KFF]);
+
+    shell_printf(intf, "PID Yaw Kp    : %.3f\r\n", GCFG->yaw_kX[PID_KP]);
+    shell_printf(intf, "PID Yaw Ki    : %.3f\r\n", GCFG->yaw_kX[PID_KI]);
+    shell_printf(intf, "PID Yaw Kd    : %.3f\r\n", GCFG->yaw_kX[PID_KD]);
+    shell_printf(intf, "PID Yaw Kff   : %.3f\r\n", GCFG->yaw_kX[PID_KFF]);
+
+    shell_printf(intf, "Angle Roll Kp : %.2f\r\n", GCFG->angle_kp[0]);
+    shell_printf(intf, "Angle Pitch Kp: %.2f\r\n", GCFG->angle_kp[1]);
+    shell_printf(intf, "Angle Rate Max: %d\r\n", GCFG->angle_rate_max);
+    shell_printf(intf, "Angle Loop Div: %u\r\n", GCFG->angle_loop_div);
+
+    shell_printf(intf, "I Limit       : %u\r\n", GCFG->pid_i_limit);
+    shell_printf(intf, "Out Limit     : %u\r\n", GCFG->pid_out_limit);
+    shell_printf(intf, "I Relax       : %u\r\n", GCFG->iterm_relax);
+    return;
+  }
 
-    shell_printf(intf, "PID Pitch Kp  : %.2f\r\n", GCFG->pitch_kX[0]);
-    shell_printf(intf, "PID Pitch Ki  : %.2f\r\n", GCFG->pitch_kX[1]);
-    shell_printf(intf, "PID Pitch Kd  : %.2f\r\n", GCFG->pitch_kX[2]);
+  if(argc == 4 && strcmp(argv[1], "angle") == 0)
+  {
+    GCFG->angle_kp[0] = atof(argv[2]);
+    GCFG->angle_kp[1] = atof(argv[3]);
 
-    shell_printf(intf, "PID Yaw Kp    : %.2f\r\n", GCFG->yaw_kX[0]);
-    shell_printf(intf, "PID Yaw Ki    : %.2f\r\n", GCFG->yaw_kX[1]);
-    shell_printf(intf, "PID Yaw Kd    : %.2f\r\n", GCFG->yaw_kX[2]);
+    shell_printf(intf, "Set angle P to %.2f %.2f\r\n", GCFG->angle_kp[0], GCFG->angle_kp[1]);
     return;
   }
 
-  if(argc != 5)
+  //
+  // D term filter is set with "filter dterm"
+  //
+  if(argc == 5 && strcmp(argv[1], "opt") == 0)
+  {
+    GCFG->pid_i_limit   = atoi(argv[2]);
+    GCFG->pid_out_limit = atoi(argv[3]);
+    GCFG->iterm_relax   = atoi(argv[4]);
+
+    shell_printf(intf, "Set PID options to %u %u %u\r\n",
+        GCFG->pid_i_limit,
+        GCFG->pid_out_limit,
+        GCFG->iterm_relax);
+    //
+    // controllers pick these up in flight_reset()
+    //
+    shell_printf(intf, "takes effect on next arm\r\n");
+    return;
+  }
+
+  if(argc == 3 && strcmp(argv[1], "div") == 0)
   {
-    goto invalid_command;
+    int   div = atoi(argv[2]);
+
+    if(div < 1 || div > UINT8_MAX)
+    {
+      shell_printf(intf, "invalid divider %s\r\n", argv[2]);
+      return;
+    }
+
+    GCFG->angle_loop_div = div;
+
+    shell_printf(intf, "Set angle loop divider to %u\r\n", GCFG->angle_loop_div);
+    return;
   }
 
-  p = atof(argv[2]);
-  i = atof(argv[3]);
-  d = atof(argv[4]);
+  if(argc != 5 && argc != 6)
+  {
+    goto invalid_command;
+  }
 
   if(strcmp(argv[1], "roll") == 0)
   {
@@ -697,27 +948,32 @@ shell_command_pid(ShellIntf* intf, int argc, const char** argv)
   }
   else if(strcmp(argv[1], "pitch") == 0)
   {
-    t = GCFG->pitch_kX;;
+    t = GCFG->pitch_kX;
   }
   else if(strcmp(argv[1], "yaw") == 0)
   {
-    t = GCFG->yaw_kX;;
+    t = GCFG->yaw_kX;
   }
   else
   {
     goto invalid_command;
   }
 
-  t[0] = p;
-  t[1] = i;
-  t[2] = d;
+  t[PID_KP]   = atof(argv[2]);
+  t[PID_KI]   = atof(argv[3]);
+  t[PID_KD]   = atof(argv[4]);
+  t[PID_KFF]  = argc == 6 ? atof(argv[5]) : 0.0f;
 
-  shell_printf(intf, "Set PID for %s to %.2f %.2f %.2f\r\n", argv[1], p, i, d);
+  shell_printf(intf, "Set PID for %s to %.3f %.3f %.3f %.3f\r\n", argv[1],
+      t[PID_KP], t[PID_KI], t[PID_KD], t[PID_KFF]);
   return;
 
 invalid_command:
   shell_printf(intf, "Invalid Command\r\n");
-  shell_printf(intf, "pid [roll|pitch|yaw] <p> <i> <d>\r\n");
+  shell_printf(intf, "pid [roll|pitch|yaw] <p> <i> <d> [ff]\r\n");
+  shell_printf(intf, "pid angle <roll p> <pitch p>\r\n");
+  shell_printf(intf, "pid opt <i limit> <out limit> <i relax>\r\n");
+  shell_printf(intf, "pid div <angle loop divider>\r\n");
 }
 
 static void
@@ -729,6 +985,7 @@ shell_command_motor(ShellIntf* intf, int argc, const char** argv)
 
   if(argc == 1)
   {
+    shell_printf(intf, "%-10s : %s\r\n", "protocol", pwm_protocol_name(GCFG->motor_protocol));
     for(int i = 0; i < MOTOR_MAX_NUM; i++)
     {
       shell_printf(intf, "%-10s : %u\r\n", motor_names[i], GCFG->motor_ndx[i]);
@@ -741,6 +998,20 @@ shell_command_motor(ShellIntf* intf, int argc, const char** argv)
     goto invalid_command;
   }
 
+  if(strcmp(argv[1], "proto") == 0)
+  {
+    for(int i = 0; i < pwm_protocol_max; i++)
+    {
+      if(strcmp(argv[2], pwm_protocol_name(i)) == 0)
+      {
+        GCFG->motor_protocol = i;
+        shell_printf(intf, "Set protocol to %s. save and reboot to apply\r\n", argv[2]);
+        return;
+      }
+    }
+    goto invalid_command;
+  }
+
   for(int i = 0; i < MOTOR_MAX_NUM; i++)
   {
     if(strcmp(motor_names[i], argv[1]) == 0)
@@ -768,6 +1039,627 @@ shell_command_motor(ShellIntf* intf, int argc, const char** argv)
 invalid_command:
   shell_printf(intf, "Invalid Command\r\n");
   shell_printf(intf, "motor [motor-name] <ndx 0-5>\r\n");
+  shell_printf(intf, "motor proto <pwm|dshot150|dshot300|dshot600|oneshot125|multishot>\r\n");
+}
+
+static bool
+shell_parse_filter_type(const char* name, filter_type_t* type)
+{
+  for(int i = 0; i < filter_type_max; i++)
+  {
+    if(strcmp(filter_type_name(i), name) == 0)
+    {
+      *type = i;
+      return true;
+    }
+  }
+  return false;
+}
+
+static void
+shell_command_filter(ShellIntf* intf, int argc, const char** argv)
+{
+  filter_type_t     type;
+  uint8_t           stage;
+
+  shell_printf(intf, "\r\n");
+
+  if(argc == 1)
+  {
+    for(int i = 0; i < FILTER_CHAIN_MAX; i++)
+    {
+      shell_printf(intf, "Gyro Stage %d  : %-6s %u %u\r\n", i,
+          filter_type_name(GCFG->gyro_filter[i].type),
+          GCFG->gyro_filter[i].hz,
+          GCFG->gyro_filter[i].cutoff);
+    }
+    shell_printf(intf, "D Term        : %-6s %u\r\n",
+        filter_type_name(GCFG->dterm_lpf_type),
+        GCFG->dterm_lpf_hz);
+    return;
+  }
+
+  //
+  // changing a stage starts it over from zero state. a step into the rate loop
+  //
+  if(flight_state != flight_state_disarmed)
+  {
+    shell_printf(intf, "disarm first\r\n");
+    return;
+  }
+
+  if((argc == 5 || argc == 6) && strcmp(argv[1], "gyro") == 0)
+  {
+    stage = atoi(argv[2]);
+    if(stage >= FILTER_CHAIN_MAX || shell_parse_filter_type(argv[3], &type) == false)
+    {
+      goto invalid_command;
+    }
+
+    GCFG->gyro_filter[stage].type   = type;
+    GCFG->gyro_filter[stage].hz     = atoi(argv[4]);
+    GCFG->gyro_filter[stage].cutoff = argc == 6 ? atoi(argv[5]) : 0;
+
+    accelgyro_filter_config();
+
+    shell_printf(intf, "Set gyro stage %u to %s %u %u\r\n", stage,
+        filter_type_name(type),
+        GCFG->gyro_filter[stage].hz,
+        GCFG->gyro_filter[stage].cutoff);
+    return;
+  }
+
+  if(argc == 4 && strcmp(argv[1], "dterm") == 0)
+  {
+    if(shell_parse_filter_type(argv[2], &type) == false || type == filter_type_notch)
+    {
+      goto invalid_command;
+    }
+
+    GCFG->dterm_lpf_type  = type;
+    GCFG->dterm_lpf_hz    = atoi(argv[3]);
+
+    flight_filter_config();
+
+    shell_printf(intf, "Set D term filter to %s %u\r\n",
+        filter_type_name(type),
+        GCFG->dterm_lpf_hz);
+    return;
+  }
+
+invalid_command:
+  shell_printf(intf, "Invalid Command\r\n");
+  shell_printf(intf, "filter gyro <stage> [none|pt1|pt2|biquad|notch] <hz> [notch cutoff]\r\n");
+  shell_printf(intf, "filter dterm [none|pt1|pt2|biquad] <hz>\r\n");
+}
+
+static void
+shell_command_dyn_notch(ShellIntf* intf, int argc, const char** argv)
+{
+  int   peaks, min_hz, max_hz, q;
+
+  shell_printf(intf, "\r\n");
+
+  if(argc == 1)
+  {
+    shell_printf(intf, "Peaks         : %u\r\n", GCFG->dyn_notch_peaks);
+    shell_printf(intf, "Range         : %u - %u Hz\r\n", GCFG->dyn_notch_min_hz, GCFG->dyn_notch_max_hz);
+    shell_printf(intf, "Q             : %.2f\r\n", GCFG->dyn_notch_q / 100.0f);
+    for(int i = 0; i < 3; i++)
+    {
+      shell_printf(intf, "Axis %d Center : %.1f %.1f %.1f\r\n", i,
+          dyn_notch_center[i][0],
+          dyn_notch_center[i][1],
+          dyn_notch_center[i][2]);
+    }
+    shell_printf(intf, "Slice Cycles  : %lu\r\n", dyn_notch_stat.slice_cycles);
+    shell_printf(intf, "Slice Max     : %lu\r\n", dyn_notch_stat.slice_cycles_max);
+    shell_printf(intf, "Updates       : %lu\r\n", dyn_notch_stat.update_count);
+    return;
+  }
+
+  if(argc != 5)
+  {
+    shell_printf(intf, "Invalid Command\r\n");
+    shell_printf(intf, "dnotch <peaks 0-%d> <min hz> <max hz> <q * 100>\r\n", DYN_NOTCH_MAX_PEAKS);
+    return;
+  }
+
+  //
+  // reconfiguring starts every gyro filter over from zero state
+  //
+  if(flight_state != flight_state_disarmed)
+  {
+    shell_printf(intf, "disarm first\r\n");
+    return;
+  }
+
+  peaks   = atoi(argv[1]);
+  min_hz  = atoi(argv[2]);
+  max_hz  = atoi(argv[3]);
+  q       = atoi(argv[4]);
+
+  if(peaks < 0 || peaks > DYN_NOTCH_MAX_PEAKS)
+  {
+    shell_printf(intf, "invalid peaks %s\r\n", argv[1]);
+    return;
+  }
+  if(min_hz < 1 || min_hz >= max_hz || max_hz > UINT16_MAX)
+  {
+    shell_printf(intf, "invalid range %s - %s\r\n", argv[2], argv[3]);
+    return;
+  }
+  if(q < DYN_NOTCH_Q_MIN * 100 || q > UINT16_MAX)
+  {
+    shell_printf(intf, "invalid q %s\r\n", argv[4]);
+    return;
+  }
+
+  GCFG->dyn_notch_peaks   = peaks;
+  GCFG->dyn_notch_min_hz  = min_hz;
+  GCFG->dyn_notch_max_hz  = max_hz;
+  GCFG->dyn_notch_q       = q;
+
+  accelgyro_filter_config();
+  dyn_notch_stat.slice_cycles_max = 0;
+
+  shell_printf(intf, "Set dynamic notch to %u peaks %u - %u Hz Q %.2f\r\n",
+      GCFG->dyn_notch_peaks,
+      GCFG->dyn_notch_min_hz,
+      GCFG->dyn_notch_max_hz,
+      GCFG->dyn_notch_q / 100.0f);
+}
+
+static void
+shell_command_mixer(ShellIntf* intf, int argc, const char** argv)
+{
+  mixer_config_t*   mix = &GCFG->mixer;
+  int               ndx;
+
+  shell_printf(intf, "\r\n");
+
+  if(argc == 1)
+  {
+    shell_printf(intf, "Motors  : %u\r\n", mix->num_motors);
+    shell_printf(intf, "          Thr     Roll    Pitch   Yaw\r\n");
+    for(int i = 0; i < mix->num_motors; i++)
+    {
+      shell_printf(intf, "Motor-%d : %6.3f  %6.3f  %6.3f  %6.3f\r\n", i + 1,
+          mix->coeff[i][MIXER_THROTTLE],
+          mix->coeff[i][MIXER_ROLL],
+          mix->coeff[i][MIXER_PITCH],
+          mix->coeff[i][MIXER_YAW]);
+    }
+    shell_printf(intf, "Desat   : %lu\r\n", mixer_stat.desat_count);
+    shell_printf(intf, "Shift   : %lu\r\n", mixer_stat.shift_count);
+    return;
+  }
+
+  if(flight_state != flight_state_disarmed)
+  {
+    shell_printf(intf, "disarm first\r\n");
+    return;
+  }
+
+  if(argc == 3 && strcmp(argv[1], "preset") == 0)
+  {
+    for(int i = 0; i < mixer_preset_max; i++)
+    {
+      if(strcmp(argv[2], mixer_preset_name(i)) == 0)
+      {
+        if(mixer_preset_motors(i) > MOTOR_MAX_NUM)
+        {
+          shell_printf(intf, "%s needs %u outputs. only %u available\r\n",
+              argv[2], mixer_preset_motors(i), MOTOR_MAX_NUM);
+          return;
+        }
+        mixer_load_preset(mix, i);
+        shell_printf(intf, "Loaded %s\r\n", argv[2]);
+        return;
+      }
+    }
+    goto invalid_command;
+  }
+
+  if(argc == 3 && strcmp(argv[1], "num") == 0)
+  {
+    ndx = atoi(argv[2]);
+    if(ndx < 1 || ndx > MOTOR_MAX_NUM)
+    {
+      goto invalid_command;
+    }
+    mix->num_motors = ndx;
+    shell_printf(intf, "Set number of motors to %d\r\n", ndx);
+    return;
+  }
+
+  if(argc == 6)
+  {
+    ndx = atoi(argv[1]) - 1;
+    if(ndx < 0 || ndx >= mix->num_motors)
+    {
+      goto invalid_command;
+    }
+
+    for(int i = 0; i < MIXER_AXIS_NUM; i++)
+    {
+      mix->coeff[ndx][i] = atof(argv[2 + i]);
+    }
+    shell_printf(intf, "Set Motor-%d mix\r\n", ndx + 1);
+    return;
+  }
+
+invalid_command:
+  shell_printf(intf, "Invalid Command\r\n");
+  shell_printf(intf, "mixer preset <quad_x|hex_x|octo_x>\r\n");
+  shell_printf(intf, "mixer num <1-%d>\r\n", MOTOR_MAX_NUM);
+  shell_printf(intf, "mixer <motor 1-N> <throttle> <roll> <pitch> <yaw>\r\n");
+}
+
+static void
+shell_command_ins(ShellIntf* intf, int argc, const char** argv)
+{
+  ins_ekf_t*  ekf = ins_get();
+  int16_t     att[3];
+
+  shell_printf(intf, "\r\n");
+
+  if(argc == 2 && strcmp(argv[1], "reset") == 0)
+  {
+    ins_stat.predict_cycles_max = 0;
+    ins_stat.fuse_cycles_max    = 0;
+    return;
+  }
+
+  if(!ins_is_running())
+  {
+    shell_printf(intf, "INS not running\r\n");
+    return;
+  }
+
+  ahrs_quat_to_roll_pitch_yaw(ekf->q, att, GCFG->mag_decl);
+
+  shell_printf(intf, "Home          : %s\r\n", ins_has_home() ? "yes" : "no");
+  shell_printf(intf, "Attitude      : %.1f %.1f %.1f\r\n", att[0] / 10.0f, att[1] / 10.0f, att[2] / 10.0f);
+  shell_printf(intf, "Position NWU  : %.2f %.2f %.2f\r\n", ekf->p[0], ekf->p[1], ekf->p[2]);
+  shell_printf(intf, "Velocity NWU  : %.2f %.2f %.2f\r\n", ekf->v[0], ekf->v[1], ekf->v[2]);
+  shell_printf(intf, "Gyro Bias     : %.3f %.3f %.3f\r\n",
+      ekf->bg[0] * 57.29578f, ekf->bg[1] * 57.29578f, ekf->bg[2] * 57.29578f);
+  shell_printf(intf, "Accel Bias    : %.3f %.3f %.3f\r\n", ekf->ba[0], ekf->ba[1], ekf->ba[2]);
+  shell_printf(intf, "Pos Sigma     : %.2f %.2f %.2f\r\n",
+      sqrtf(ins_ekf_get_var(ekf, INS_EKF_POS + 0)),
+      sqrtf(ins_ekf_get_var(ekf, INS_EKF_POS + 1)),
+      sqrtf(ins_ekf_get_var(ekf, INS_EKF_POS + 2)));
+  shell_printf(intf, "Fused/Rejected: %lu/%lu\r\n", ekf->fuse_count, ekf->reject_count);
+  shell_printf(intf, "GPS/Baro/Mag  : %lu/%lu/%lu, GPS resets %lu\r\n",
+      ins_stat.gps_count, ins_stat.baro_count, ins_stat.mag_count, ins_stat.gps_resets);
+  shell_printf(intf, "Predict Cycles: %lu, max %lu\r\n", ins_stat.predict_cycles, ins_stat.predict_cycles_max);
+  shell_printf(intf, "Fuse Cycles   : %lu, max %lu\r\n", ins_stat.fuse_cycles, ins_stat.fuse_cycles_max);
+}
+
+static void
+shell_command_alt(ShellIntf* intf, int argc, const char** argv)
+{
+  alt_est_t*  est = altitude_get_est();
+
+  shell_printf(intf, "\r\n");
+
+  if(!altitude_is_running())
+  {
+    shell_printf(intf, "altitude estimator not running\r\n");
+    return;
+  }
+
+  shell_printf(intf, "Altitude  : %.2f m, baro %.2f m\r\n", est->alt, baroAltitude / 100.0f);
+  shell_printf(intf, "Climb     : %.2f m/s\r\n", est->vel);
+  shell_printf(intf, "Acc Bias  : %.3f m/s^2\r\n", est->acc_bias);
+  shell_printf(intf, "Baro Innov: %.2f m\r\n", est->baro_err);
+}
+
+#define SHELL_AHRS_BENCH_LOOP     256
+
+//
+// cycles per update of every engine on the current sensor values.
+// runs on private instances so the live attitude is not touched
+//
+static void
+shell_command_ahrs_bench(ShellIntf* intf)
+{
+  static ahrs_t   ahrs;
+  uint32_t        start;
+
+  for(int t = 0; t < ahrs_type_max; t++)
+  {
+    ahrs_init(&ahrs, t, 1000);
+
+    start = cycle_counter_get();
+    for(int i = 0; i < SHELL_AHRS_BENCH_LOOP; i++)
+    {
+      ahrs_update_imu(&ahrs, gyro_body, accel_body);
+    }
+    shell_printf(intf, "%-14s : %lu cycles\r\n", ahrs_type_name(t),
+        (cycle_counter_get() - start) / SHELL_AHRS_BENCH_LOOP);
+  }
+
+  start = cycle_counter_get();
+  for(int i = 0; i < SHELL_AHRS_BENCH_LOOP; i++)
+  {
+    ahrs_update_mag(&ahrs, mag_body);
+  }
+  shell_printf(intf, "%-14s : %lu cycles\r\n", "mag heading",
+      (cycle_counter_get() - start) / SHELL_AHRS_BENCH_LOOP);
+}
+
+static void
+shell_command_ahrs(ShellIntf* intf, int argc, const char** argv)
+{
+  ahrs_t*   ahrs = &imu_get()->ahrs;
+  float     bias[3];
+
+  shell_printf(intf, "\r\n");
+
+  if(argc == 1)
+  {
+    shell_printf(intf, "Engine      : %s\r\n", ahrs_type_name(ahrs->type));
+    shell_printf(intf, "Ready       : %s\r\n", imu_is_ready() ? "yes" : "no");
+    shell_printf(intf, "Acc Weight  : %.2f\r\n", ahrs_get_accel_weight(ahrs));
+    shell_printf(intf, "Mag Gain    : %.3f\r\n", ahrs->mag_gain);
+
+    if(ahrs->type == ahrs_type_madgwick)
+    {
+      shell_printf(intf, "Beta        : %.3f\r\n", ahrs->madgwick.beta);
+    }
+    else if(ahrs->type == ahrs_type_mahony)
+    {
+      mahony_get_gyro_bias(&ahrs->mahony, bias);
+      shell_printf(intf, "Gyro Bias   : %.3f %.3f %.3f\r\n", bias[0], bias[1], bias[2]);
+    }
+    return;
+  }
+
+  if(argc == 2 && strcmp(argv[1], "bench") == 0)
+  {
+    shell_command_ahrs_bench(intf);
+    return;
+  }
+
+  if(argc == 2)
+  {
+    if(flight_state != flight_state_disarmed)
+    {
+      shell_printf(intf, "disarm first\r\n");
+      return;
+    }
+
+    for(int i = 0; i < ahrs_type_max; i++)
+    {
+      if(strcmp(argv[1], ahrs_type_name(i)) == 0)
+      {
+        GCFG->ahrs_type = i;
+        imu_reset();
+        shell_printf(intf, "AHRS engine set to %s\r\n", ahrs_type_name(i));
+        return;
+      }
+    }
+  }
+
+  shell_printf(intf, "Invalid Command\r\n");
+  shell_printf(intf, "ahrs [madgwick|mahony|complementary|bench]\r\n");
+}
+
+#define SHELL_MATH_BENCH_LOOP     256
+
+#define SHELL_MATH_BENCH(name, expr)                                          \
+{                                                                             \
+  volatile float  sink = 0.0f;                                                \
+  uint32_t        start = cycle_counter_get();                                \
+  for(int i = 0; i < SHELL_MATH_BENCH_LOOP; i++)                              \
+  {                                                                           \
+    float v = -0.99f + i * (1.98f / SHELL_MATH_BENCH_LOOP);                   \
+    sink += (expr);                                                           \
+  }                                                                           \
+  shell_printf(intf, "%-12s : %lu cycles\r\n", name,                          \
+      (cycle_counter_get() - start) / SHELL_MATH_BENCH_LOOP);                 \
+  (void)sink;                                                                 \
+}
+
+static void
+shell_command_math(ShellIntf* intf, int argc, const char** argv)
+{
+  shell_printf(intf, "\r\n");
+  shell_printf(intf, "MATH_FAST_APPROX %d. loop overhead included\r\n", MATH_FAST_APPROX);
+
+  SHELL_MATH_BENCH("none",        v);
+  SHELL_MATH_BENCH("atan2f",      atan2f(v, 0.3f));
+  SHELL_MATH_BENCH("fast_atan2f", fast_atan2f(v, 0.3f));
+  SHELL_MATH_BENCH("asinf",       asinf(v));
+  SHELL_MATH_BENCH("fast_asinf",  fast_asinf(v));
+  SHELL_MATH_BENCH("sinf",        sinf(v * 3.0f));
+  SHELL_MATH_BENCH("fast_sinf",   fast_sinf(v * 3.0f));
+  SHELL_MATH_BENCH("1/sqrtf",     1.0f / sqrtf(v + 1.0f));
+  SHELL_MATH_BENCH("fast_rsqrtf", fast_rsqrtf(v + 1.0f));
+}
+
+#define SHELL_MEM_BENCH_LOOP      256
+#define SHELL_MEM_BENCH_TIMERS    8
+
+static void
+shell_mem_bench_timer_cb(SoftTimerElem* te)
+{
+  soft_timer_add((SoftTimer*)te->priv, te, 4);
+}
+
+static void
+shell_mem_print(ShellIntf* intf, const char* name, uint32_t* s, uint32_t* e)
+{
+  shell_printf(intf, "%-8s : 0x%08lx - 0x%08lx, %6lu bytes\r\n", name,
+      (uint32_t)s, (uint32_t)e, (uint32_t)e - (uint32_t)s);
+}
+
+//
+// cycles per call of the control loop stages on the current sensor values.
+// runs on private instances so the live state is not touched. compare a
+// "make MEM_PLACEMENT=0" build with the default one
+//
+static void
+shell_command_mem_bench(ShellIntf* intf)
+{
+  static CCM_BSS ahrs_t         ahrs;
+  static CCM_BSS filter3_t      filters[FILTER_CHAIN_MAX];
+  static CCM_BSS pid_control_t  pidc[3];
+  static CCM_BSS SoftTimer      timer;
+  static CCM_BSS SoftTimerElem  timers[SHELL_MEM_BENCH_TIMERS];
+  float                         v[3];
+  float                         out[MOTOR_MAX_NUM];
+  volatile float                sink = 0.0f;
+  uint32_t                      start,
+                                total = 0,
+                                cycles;
+
+  ahrs_init(&ahrs, ahrs_type_madgwick, ACCELGYRO_SAMPLE_FREQ);
+  for(int i = 0; i < FILTER_CHAIN_MAX; i++)
+  {
+    filter3_init_from_config(&filters[i], &GCFG->gyro_filter[i], ACCELGYRO_SAMPLE_FREQ);
+  }
+  for(int i = 0; i < 3; i++)
+  {
+    pid_control_init(&pidc[i], GCFG->pid_i_limit, GCFG->pid_out_limit, GCFG->iterm_relax);
+    pid_control_set_dterm_filter(&pidc[i], GCFG->dterm_lpf_type, GCFG->dterm_lpf_hz,
+        ACCELGYRO_SAMPLE_FREQ);
+  }
+
+  soft_timer_init(&timer, 1);
+  for(int i = 0; i < SHELL_MEM_BENCH_TIMERS; i++)
+  {
+    soft_timer_init_elem(&timers[i]);
+    timers[i].cb    = shell_mem_bench_timer_cb;
+    timers[i].priv  = &timer;
+    soft_timer_add(&timer, &timers[i], 1 + i % 4);
+  }
+
+  shell_printf(intf, "MEM_PLACEMENT %d. loop overhead included\r\n", MEM_PLACEMENT);
+
+  start = cycle_counter_get();
+  for(int i = 0; i < SHELL_MEM_BENCH_LOOP; i++)
+  {
+    ahrs_update_imu(&ahrs, gyro_body, accel_body);
+  }
+  cycles = (cycle_counter_get() - start) / SHELL_MEM_BENCH_LOOP;
+  total += cycles;
+  shell_printf(intf, "%-8s : %lu cycles\r\n", "ahrs", cycles);
+
+  start = cycle_counter_get();
+  for(int i = 0; i < SHELL_MEM_BENCH_LOOP; i++)
+  {
+    v[0] = gyro_body[0];
+    v[1] = gyro_body[1];
+    v[2] = gyro_body[2];
+    for(int j = 0; j < FILTER_CHAIN_MAX; j++)
+    {
+      filter3_apply(&filters[j], v);
+    }
+  }
+  cycles = (cycle_counter_get() - start) / SHELL_MEM_BENCH_LOOP;
+  total += cycles;
+  shell_printf(intf, "%-8s : %lu cycles\r\n", "filter", cycles);
+
+  start = cycle_counter_get();
+  for(int i = 0; i < SHELL_MEM_BENCH_LOOP; i++)
+  {
+    v[0] = pid_control_run(&pidc[0], 10.0f, gyro_body[0], 0.001f, GCFG->roll_kX);
+    v[1] = pid_control_run(&pidc[1], 10.0f, gyro_body[1], 0.001f, GCFG->pitch_kX);
+    v[2] = pid_control_run(&pidc[2], 10.0f, gyro_body[2], 0.001f, GCFG->yaw_kX);
+  }
+  cycles = (cycle_counter_get() - start) / SHELL_MEM_BENCH_LOOP;
+  total += cycles;
+  shell_printf(intf, "%-8s : %lu cycles\r\n", "pid", cycles);
+
+  start = cycle_counter_get();
+  for(int i = 0; i < SHELL_MEM_BENCH_LOOP; i++)
+  {
+    mixer_run(&GCFG->mixer, GCFG->motor_min, GCFG->motor_max, 0.5f, v, out);
+    sink += out[0];
+  }
+  cycles = (cycle_counter_get() - start) / SHELL_MEM_BENCH_LOOP;
+  total += cycles;
+  shell_printf(intf, "%-8s : %lu cycles\r\n", "mixer", cycles);
+
+  start = cycle_counter_get();
+  for(int i = 0; i < SHELL_MEM_BENCH_LOOP; i++)
+  {
+    soft_timer_drive(&timer);
+  }
+  cycles = (cycle_counter_get() - start) / SHELL_MEM_BENCH_LOOP;
+  total += cycles;
+  shell_printf(intf, "%-8s : %lu cycles\r\n", "timer", cycles);
+
+  shell_printf(intf, "%-8s : %lu cycles\r\n", "total", total);
+  (void)sink;
+}
+
+static void
+shell_command_mem(ShellIntf* intf, int argc, const char** argv)
+{
+  shell_printf(intf, "\r\n");
+
+  if(argc == 1)
+  {
+    shell_printf(intf, "MEM_PLACEMENT %d\r\n", MEM_PLACEMENT);
+    shell_mem_print(intf, "data", &_sdata, &_edata);
+    shell_mem_print(intf, "ramfunc", &_sramfunc, &_eramfunc);
+    shell_mem_print(intf, "bss", &_sbss, &_ebss);
+    shell_mem_print(intf, "ccmdata", &_sccmram, &_eccmram);
+    shell_mem_print(intf, "ccmbss", &_sccmbss, &_eccmbss);
+    shell_printf(intf, "%-8s : 0x%08lx\r\n", "stack", (uint32_t)&_estack);
+    return;
+  }
+
+  if(argc == 2 && strcmp(argv[1], "bench") == 0)
+  {
+    shell_command_mem_bench(intf);
+    return;
+  }
+
+  shell_printf(intf, "Invalid Command\r\n");
+  shell_printf(intf, "mem [bench]\r\n");
+}
+
+static void
+shell_command_board(ShellIntf* intf, int argc, const char** argv)
+{
+  shell_printf(intf, "\r\n");
+
+  if(argc == 4)
+  {
+    //
+    // the body frame turns under the AHRS and the rate loop
+    //
+    if(flight_state != flight_state_disarmed)
+    {
+      shell_printf(intf, "disarm first\r\n");
+      return;
+    }
+
+    for(int i = 0; i < 3; i++)
+    {
+      GCFG->board_align[i] = (int16_t)(atof(argv[1 + i]) * 10.0f);
+    }
+    accelgyro_xform_config();
+    magneto_xform_config();
+
+    // attitude is aligned again in the new frame
+    imu_reset();
+  }
+  else if(argc != 1)
+  {
+    shell_printf(intf, "Invalid Command\r\n");
+    shell_printf(intf, "board <roll> <pitch> <yaw> in degree\r\n");
+    return;
+  }
+
+  shell_printf(intf, "Board Roll    : %.1f\r\n", GCFG->board_align[0] / 10.0f);
+  shell_printf(intf, "Board Pitch   : %.1f\r\n", GCFG->board_align[1] / 10.0f);
+  shell_printf(intf, "Board Yaw     : %.1f\r\n", GCFG->board_align[2] / 10.0f);
 }
 
 static void
@@ -795,15 +1687,30 @@ shell_command_save(ShellIntf* intf, int argc, const char** argv)
 //
 ////////////////////////////////////////////////////////////////////////////////
 static void
-shell_command_mag_cal_callback(int16_t offsets[3], void* cb_arg)
+shell_command_mag_cal_callback(bool success, int16_t offsets[3], void* cb_arg)
 {
   ShellIntf* intf = (ShellIntf*)cb_arg;
+  const float* w  = GCFG->mag_soft;
+
+  if(!success)
+  {
+    shell_printf(intf, "\r\nMagnetometer Calibration Failed. %lu samples, coverage %d/%d\r\n",
+        magneto_cal_stat.samples, magneto_cal_stat.coverage, MAG_ELLIPSOID_NUM_BINS);
+    return;
+  }
 
   shell_printf(intf, "\r\nMagnetometer Calibration Complete\r\n");
 
   shell_printf(intf, "Offset X : %d\r\n", offsets[0]);
   shell_printf(intf, "Offset Y : %d\r\n", offsets[1]);
   shell_printf(intf, "Offset Z : %d\r\n", offsets[2]);
+  shell_printf(intf, "Soft Iron: %.4f %.4f %.4f\r\n", w[0], w[3], w[4]);
+  shell_printf(intf, "           %.4f %.4f %.4f\r\n", w[3], w[1], w[5]);
+  shell_printf(intf, "           %.4f %.4f %.4f\r\n", w[4], w[5], w[2]);
+  shell_printf(intf, "Radius   : %.1f\r\n", magneto_cal_stat.radius);
+  shell_printf(intf, "Coverage : %d/%d, %lu samples\r\n",
+      magneto_cal_stat.coverage, MAG_ELLIPSOID_NUM_BINS, magneto_cal_stat.samples);
+  shell_printf(intf, "Fit Error: %.2f %%\r\n", magneto_cal_stat.fit_error * 100.0f);
 }
 
 static void
@@ -824,10 +1731,16 @@ shell_command_mag_cal(ShellIntf* intf, int argc, const char** argv)
 //
 ////////////////////////////////////////////////////////////////////////////////
 static void
-shell_command_gyro_cal_callback(int16_t offsets[3], void* cb_arg)
+shell_command_gyro_cal_callback(bool success, int16_t offsets[3], void* cb_arg)
 {
   ShellIntf* intf = (ShellIntf*)cb_arg;
 
+  if(!success)
+  {
+    shell_printf(intf, "\r\nGyro Calibration Aborted. Board Moved\r\n");
+    return;
+  }
+
   shell_printf(intf, "\r\nGyro Calibration Complete\r\n");
 
   shell_printf(intf, "Offset X : %d\r\n", offsets[0]);
@@ -847,6 +1760,39 @@ shell_command_gyro_cal(ShellIntf* intf, int argc, const char** argv)
   }
 }
 
+static void
+shell_command_gyro_tc(ShellIntf* intf, int argc, const char** argv)
+{
+  gyro_tcomp_table_t*   t = &GCFG->gyro_tc;
+  float                 d[3];
+
+  shell_printf(intf, "\r\n");
+
+  if(argc == 2 && strcmp(argv[1], "clear") == 0)
+  {
+    gyro_tcomp_clear(t);
+    shell_printf(intf, "cleared\r\n");
+    return;
+  }
+
+  accelgyro_gyro_tc_get(d);
+
+  shell_printf(intf, "Temperature : %.1f, offset taken at %.1f\r\n",
+      accelgyro_temperature(), GCFG->gyro_offset_temp / 10.0f);
+  shell_printf(intf, "Correction  : %.3f %.3f %.3f dps\r\n", d[0], d[1], d[2]);
+
+  for(int b = 0; b < GYRO_TCOMP_BINS; b++)
+  {
+    if(t->count[b] == 0)
+    {
+      continue;
+    }
+    shell_printf(intf, "%4.0f C : %7.2f %7.2f %7.2f  (%d)\r\n",
+        GYRO_TCOMP_T_MIN + b * GYRO_TCOMP_T_STEP,
+        t->bias[b][0], t->bias[b][1], t->bias[b][2], t->count[b]);
+  }
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 //
 // accel calibration
@@ -6,6 +6,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include "soft_timer.h"
+#include "mem_section.h"
 
 /**
  * initialize a timer manager
@@ -93,7 +94,7 @@ soft_timer_del(SoftTimer* timer, SoftTimerElem* elem)
   list_del_init(&elem->next);
 }
 
-static void
+static FAST_CODE void
 timer_tick(SoftTimer* timer)
 {
   int               current;
@@ -135,7 +136,7 @@ timer_tick(SoftTimer* timer)
  *
  * @param timer timer manager context block
  */
-void
+FAST_CODE void
 soft_timer_drive(SoftTimer* timer)
 {
   timer_tick(timer);
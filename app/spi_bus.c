@@ -0,0 +1,371 @@
+#include "stm32f4xx_hal.h"
+#include "spi.h"
+#include "app_common.h"
+#include "event_dispatcher.h"
+#include "event_list.h"
+#include "spi_bus.h"
+
+//
+// SPI1   RX : DMA2 Stream0 Channel3
+//        TX : DMA2 Stream3 Channel3
+//
+// SPI3 RX is only on DMA1 Stream0/Stream2 Channel0, both used by DShot,
+// so SPI3 transfers are interrupt driven
+//
+#define SPI_BUS_SYNC_TIMEOUT          100       // msec
+
+typedef struct
+{
+  SPI_HandleTypeDef*    hspi;
+  bool                  dma;
+
+  spi_txn_t*            head;       // head is the one on the wire when busy
+  spi_txn_t*            tail;
+  spi_txn_t*            done_head;
+  spi_txn_t*            done_tail;
+  uint8_t               depth;
+
+  volatile bool         busy;
+} spi_bus_t;
+
+static spi_bus_t          _buses[spi_bus_max] =
+{
+  [spi_bus_1] = { .hspi = &hspi1, .dma = true  },
+  [spi_bus_3] = { .hspi = &hspi3, .dma = false },
+};
+
+static DMA_HandleTypeDef  _spi1_dma_rx,
+                          _spi1_dma_tx;
+
+spi_bus_stat_t            spi_bus_stat[spi_bus_max];
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// private prototypes
+//
+////////////////////////////////////////////////////////////////////////////////
+static void spi_bus_complete(spi_bus_id_t id, bool error);
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// private utilities
+//
+////////////////////////////////////////////////////////////////////////////////
+static void
+spi_bus_dma_init(DMA_HandleTypeDef* hdma, DMA_Stream_TypeDef* stream, uint32_t dir)
+{
+  hdma->Instance                  = stream;
+  hdma->Init.Channel              = DMA_CHANNEL_3;
+  hdma->Init.Direction            = dir;
+  hdma->Init.PeriphInc            = DMA_PINC_DISABLE;
+  hdma->Init.MemInc               = DMA_MINC_ENABLE;
+  hdma->Init.PeriphDataAlignment  = DMA_PDATAALIGN_BYTE;
+  hdma->Init.MemDataAlignment     = DMA_MDATAALIGN_BYTE;
+  hdma->Init.Mode                 = DMA_NORMAL;
+  hdma->Init.Priority             = DMA_PRIORITY_HIGH;
+  hdma->Init.FIFOMode             = DMA_FIFOMODE_DISABLE;
+  HAL_DMA_Init(hdma);
+}
+
+//
+// clock mode and prescaler can only change while SPE is off. the bus is
+// idle here and HAL enables SPE again when the transfer starts
+//
+static inline void
+spi_bus_configure(spi_bus_t* bus, const spi_device_t* dev, bool fast)
+{
+  SPI_HandleTypeDef*  hspi  = bus->hspi;
+  uint32_t            presc = fast ? dev->fast_prescaler : dev->slow_prescaler,
+                      cr1;
+
+  cr1 = (hspi->Instance->CR1 & ~(SPI_CR1_BR | SPI_CR1_CPOL | SPI_CR1_CPHA)) |
+        presc | dev->polarity | dev->phase;
+
+  if(cr1 == hspi->Instance->CR1)
+  {
+    return;
+  }
+
+  __HAL_SPI_DISABLE(hspi);
+  hspi->Instance->CR1 = cr1 & ~SPI_CR1_SPE;
+
+  hspi->Init.BaudRatePrescaler  = presc;
+  hspi->Init.CLKPolarity        = dev->polarity;
+  hspi->Init.CLKPhase           = dev->phase;
+}
+
+//
+// called with interrupts disabled or from the bus interrupt.
+// a transaction that fails to start completes right away with error
+//
+static void
+spi_bus_start(spi_bus_id_t id)
+{
+  spi_bus_t*          bus = &_buses[id];
+  spi_txn_t*          txn;
+  HAL_StatusTypeDef   ret;
+
+  while((txn = bus->head) != NULL)
+  {
+    bus->busy   = true;
+    txn->state  = spi_txn_state_busy;
+
+    spi_bus_configure(bus, txn->dev, txn->fast);
+    HAL_GPIO_WritePin(txn->dev->cs_port, txn->dev->cs_pin, GPIO_PIN_RESET);
+
+    if(bus->dma)
+    {
+      ret = HAL_SPI_TransmitReceive_DMA(bus->hspi, (uint8_t*)txn->tx, txn->rx, txn->len);
+    }
+    else
+    {
+      ret = HAL_SPI_TransmitReceive_IT(bus->hspi, (uint8_t*)txn->tx, txn->rx, txn->len);
+    }
+
+    if(ret == HAL_OK)
+    {
+      return;
+    }
+    spi_bus_complete(id, true);
+  }
+  bus->busy = false;
+}
+
+static void
+spi_bus_complete(spi_bus_id_t id, bool error)
+{
+  spi_bus_t*  bus = &_buses[id];
+  spi_txn_t*  txn = bus->head;
+
+  HAL_GPIO_WritePin(txn->dev->cs_port, txn->dev->cs_pin, GPIO_PIN_SET);
+
+  bus->head = txn->next;
+  if(bus->head == NULL)
+  {
+    bus->tail = NULL;
+  }
+  bus->depth--;
+
+  txn->next   = NULL;
+  txn->state  = error ? spi_txn_state_error : spi_txn_state_done;
+
+  if(bus->done_tail == NULL)
+  {
+    bus->done_head = txn;
+  }
+  else
+  {
+    bus->done_tail->next = txn;
+  }
+  bus->done_tail = txn;
+
+  spi_bus_stat[id].txn_count++;
+  if(error)
+  {
+    spi_bus_stat[id].error_count++;
+  }
+
+  event_set(1 << DISPATCH_EVENT_SPI_DONE);
+}
+
+static void
+spi_bus_done_event(uint32_t event)
+{
+  spi_txn_t   *txn,
+              *next;
+
+  for(int i = 0; i < spi_bus_max; i++)
+  {
+    __disable_irq();
+    {
+      txn = _buses[i].done_head;
+      _buses[i].done_head = _buses[i].done_tail = NULL;
+    }
+    __enable_irq();
+
+    // a callback may submit the same transaction again
+    for(; txn != NULL; txn = next)
+    {
+      next = txn->next;
+      if(txn->cb != NULL)
+      {
+        txn->cb(txn);
+      }
+    }
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// public interfaces
+//
+////////////////////////////////////////////////////////////////////////////////
+void
+spi_bus_init(void)
+{
+  __HAL_RCC_DMA2_CLK_ENABLE();
+
+  spi_bus_dma_init(&_spi1_dma_rx, DMA2_Stream0, DMA_PERIPH_TO_MEMORY);
+  spi_bus_dma_init(&_spi1_dma_tx, DMA2_Stream3, DMA_MEMORY_TO_PERIPH);
+  __HAL_LINKDMA(&hspi1, hdmarx, _spi1_dma_rx);
+  __HAL_LINKDMA(&hspi1, hdmatx, _spi1_dma_tx);
+
+  HAL_NVIC_SetPriority(DMA2_Stream0_IRQn, 0, 0);
+  HAL_NVIC_EnableIRQ(DMA2_Stream0_IRQn);
+  HAL_NVIC_SetPriority(DMA2_Stream3_IRQn, 0, 0);
+  HAL_NVIC_EnableIRQ(DMA2_Stream3_IRQn);
+  HAL_NVIC_SetPriority(SPI1_IRQn, 0, 0);
+  HAL_NVIC_EnableIRQ(SPI1_IRQn);
+  HAL_NVIC_SetPriority(SPI3_IRQn, 0, 0);
+  HAL_NVIC_EnableIRQ(SPI3_IRQn);
+
+  event_register_handler(spi_bus_done_event, DISPATCH_EVENT_SPI_DONE);
+}
+
+//
+// queue a transaction. tx and rx must both be valid and may be the same
+// buffer. they must stay valid until the callback, and not be in CCM on
+// a DMA bus.
+//
+bool
+spi_bus_submit(spi_txn_t* txn)
+{
+  spi_bus_id_t  id  = txn->dev->bus;
+  spi_bus_t*    bus = &_buses[id];
+
+  if(txn->state == spi_txn_state_queued || txn->state == spi_txn_state_busy)
+  {
+    return false;
+  }
+
+  txn->state  = spi_txn_state_queued;
+  txn->next   = NULL;
+
+  __disable_irq();
+  {
+    if(bus->tail == NULL)
+    {
+      bus->head = txn;
+    }
+    else
+    {
+      bus->tail->next = txn;
+    }
+    bus->tail = txn;
+
+    bus->depth++;
+    if(bus->depth > spi_bus_stat[id].queue_max)
+    {
+      spi_bus_stat[id].queue_max = bus->depth;
+    }
+
+    if(!bus->busy)
+    {
+      spi_bus_start(id);
+    }
+  }
+  __enable_irq();
+
+  return true;
+}
+
+//
+// blocking transfer for init and configuration. waits for the queue to
+// drain first. rx may be NULL for writes.
+// must not be called from interrupt context
+//
+bool
+spi_bus_xfer(const spi_device_t* dev, bool fast, const uint8_t* tx, uint8_t* rx, uint16_t len)
+{
+  spi_bus_t*          bus = &_buses[dev->bus];
+  HAL_StatusTypeDef   ret;
+
+  while(bus->busy)
+  {
+    ;
+  }
+
+  //
+  // submissions only come from the main loop so the bus stays ours
+  //
+  bus->busy = true;
+
+  spi_bus_configure(bus, dev, fast);
+  HAL_GPIO_WritePin(dev->cs_port, dev->cs_pin, GPIO_PIN_RESET);
+
+  if(rx == NULL)
+  {
+    ret = HAL_SPI_Transmit(bus->hspi, (uint8_t*)tx, len, SPI_BUS_SYNC_TIMEOUT);
+  }
+  else
+  {
+    ret = HAL_SPI_TransmitReceive(bus->hspi, (uint8_t*)tx, rx, len, SPI_BUS_SYNC_TIMEOUT);
+  }
+
+  HAL_GPIO_WritePin(dev->cs_port, dev->cs_pin, GPIO_PIN_SET);
+
+  bus->busy = false;
+
+  spi_bus_stat[dev->bus].txn_count++;
+  if(ret != HAL_OK)
+  {
+    spi_bus_stat[dev->bus].error_count++;
+    return false;
+  }
+  return true;
+}
+
+//
+// from HAL_SPI_TxRxCpltCallback/HAL_SPI_ErrorCallback
+//
+void
+spi_bus_irq_done(SPI_HandleTypeDef* hspi, bool error)
+{
+  for(int i = 0; i < spi_bus_max; i++)
+  {
+    spi_bus_t*  bus = &_buses[i];
+
+    if(bus->hspi != hspi)
+    {
+      continue;
+    }
+
+    if(bus->head == NULL || bus->head->state != spi_txn_state_busy)
+    {
+      return;
+    }
+
+    spi_bus_complete(i, error);
+    spi_bus_start(i);
+    return;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// interrupt handlers
+//
+////////////////////////////////////////////////////////////////////////////////
+void
+DMA2_Stream0_IRQHandler(void)
+{
+  HAL_DMA_IRQHandler(&_spi1_dma_rx);
+}
+
+void
+DMA2_Stream3_IRQHandler(void)
+{
+  HAL_DMA_IRQHandler(&_spi1_dma_tx);
+}
+
+void
+SPI1_IRQHandler(void)
+{
+  HAL_SPI_IRQHandler(&hspi1);
+}
+
+void
+SPI3_IRQHandler(void)
+{
+  HAL_SPI_IRQHandler(&hspi3);
+}
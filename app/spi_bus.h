@@ -0,0 +1,81 @@
+#ifndef __SPI_BUS_DEF_H__
+#define __SPI_BUS_DEF_H__
+
+#include "stm32f4xx_hal.h"
+#include "app_common.h"
+
+//
+// SPI bus manager.
+//
+// each bus owns its SPI handle and a queue of transactions. a device
+// descriptor carries chip select, clock mode and two clock prescalers,
+// slow for configuration and fast for data. the bus switches CR1 to
+// the device/speed of every transaction before it starts.
+//
+// transfers are full duplex and may be in place (tx == rx). SPI1 runs
+// on DMA, SPI3 on interrupt since both of its DMA RX streams are taken
+// by DShot. the next queued transaction is started from the completion
+// interrupt so the bus never idles on the main loop. completion
+// callbacks are called from the main loop through the event dispatcher.
+//
+typedef enum
+{
+  spi_bus_1 = 0,
+  spi_bus_3,
+  spi_bus_max,
+} spi_bus_id_t;
+
+typedef struct
+{
+  spi_bus_id_t    bus;
+  GPIO_TypeDef*   cs_port;
+  uint16_t        cs_pin;
+  uint32_t        slow_prescaler;   // SPI_BAUDRATEPRESCALER_x
+  uint32_t        fast_prescaler;
+  uint32_t        polarity;         // SPI_POLARITY_x
+  uint32_t        phase;            // SPI_PHASE_x
+} spi_device_t;
+
+typedef enum
+{
+  spi_txn_state_idle = 0,
+  spi_txn_state_queued,
+  spi_txn_state_busy,
+  spi_txn_state_done,
+  spi_txn_state_error,
+} spi_txn_state_t;
+
+struct __spi_txn;
+typedef void (*spi_txn_callback)(struct __spi_txn* txn);
+
+typedef struct __spi_txn
+{
+  const spi_device_t*         dev;
+  bool                        fast;
+  const uint8_t*              tx;
+  uint8_t*                    rx;
+  uint16_t                    len;
+  spi_txn_callback            cb;       // may be NULL
+  void*                       cb_arg;
+
+  volatile spi_txn_state_t    state;
+  struct __spi_txn*           next;
+} spi_txn_t;
+
+typedef struct
+{
+  uint32_t    txn_count;
+  uint32_t    error_count;
+  uint8_t     queue_max;      // deepest queue seen
+} spi_bus_stat_t;
+
+extern spi_bus_stat_t   spi_bus_stat[spi_bus_max];
+
+extern void spi_bus_init(void);
+extern bool spi_bus_submit(spi_txn_t* txn);
+extern bool spi_bus_xfer(const spi_device_t* dev, bool fast,
+    const uint8_t* tx, uint8_t* rx, uint16_t len);
+
+extern void spi_bus_irq_done(SPI_HandleTypeDef* hspi, bool error);
+
+#endif /* !__SPI_BUS_DEF_H__ */
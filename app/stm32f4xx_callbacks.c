@@ -12,6 +12,7 @@
 
 #include "ibus.h"
 #include "ublox.h"
+#include "spi_bus.h"
 
 volatile uint32_t     __uptime  = 0;
 volatile uint32_t     __msec    = 0;
@@ -55,11 +56,12 @@ void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart)
   }
 }
 
-void HAL_UART_TxCpltCallback(UART_HandleTypeDef* huart)
+void HAL_SPI_TxRxCpltCallback(SPI_HandleTypeDef* hspi)
 {
-  if(huart == &huart3)
-  {
-    ublox_tx_irq();
-    return;
-  }
+  spi_bus_irq_done(hspi, false);
+}
+
+void HAL_SPI_ErrorCallback(SPI_HandleTypeDef* hspi)
+{
+  spi_bus_irq_done(hspi, true);
 }
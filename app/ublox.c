@@ -1,12 +1,16 @@
 #include <stdlib.h>
 #include <string.h>
+#include <stddef.h>
 #include "usart.h"
 #include "circ_buffer.h"
 #include "event_dispatcher.h"
 #include "event_list.h"
 #include "ublox_priv.h"
+#include "ublox_cfg.h"
 #include "gps.h"
+#include "config.h"
 #include "mainloop_timer.h"
+#include "micros.h"
 
 #define UBX_VALID_GPS_DATE(valid) (valid & 1 << 0)
 #define UBX_VALID_GPS_TIME(valid) (valid & 1 << 1)
@@ -14,6 +18,18 @@
 
 #define UBLOX_MAX_PAYLOAD_SIZE          256
 #define UBLOX_MAX_TX_BUF_SIZE           64      
+#define UBLOX_TARGET_BAUD               115200
+#define UBLOX_CFG_TICK                  10        // msec
+#define UBLOX_LEGACY_RATE               200       // msec. 5Hz
+#define UBLOX_RX_TIMEOUT                2000      // msec
+
+//
+// the cached fix may be from another field, driven to since. the receiver
+// only uses it to pick satellites likely in view, which still works a few
+// hundred km off, while an accuracy tighter than the real error has it
+// search for the wrong ones
+//
+#define UBLOX_AID_POS_ACC_MIN           (300 * 1000 * 100UL)  // cm. 300km
 
 #define NAV_STATUS_FIX_VALID            0x01
 
@@ -27,9 +43,8 @@
 
 static void ublox_enter_critical(CircBuffer* cb);
 static void ublox_leave_critical(CircBuffer* cb);
-static void ublox_start_baud_config(void);
-static void ublox_config_baud_step(void);
-static void ublox_gps_config_step(void);
+static void ublox_start_config(void);
+static void ublox_update_state(void);
 
 static volatile uint8_t    _rx_buf[UBLOX_MAX_PAYLOAD_SIZE];
 
@@ -49,53 +64,88 @@ static uint8_t            _msg_id;
 static uint8_t            _ck_b, _ck_a;
 static uint16_t           _payload_length;
 static uint16_t           _payload_counter;
+static uint8_t*           _payload_dst;
+static uint32_t           _frame_usec;        // micros at the first preamble byte
 
 static uint8_t            _next_fix_type;
 static uint32_t           _hw_version;
 
-static uint32_t           _target_baud    = 115200;
-static uint32_t           _target_cmd     = 0;
+static ublox_cfg_t        _cfg;
+static SoftTimerElem      _cfg_timer;
+static uint8_t            _tx_buf[UBLOX_MAX_TX_BUF_SIZE];
 
-static uint8_t            _next_baud_index;
-static uint32_t           _avail_bauds[] =
-{
-  115200,
-  57600,
-  38400,
-  19200,
-  9600
-};
-static const char*        _baud_set_cmds[] =
-{
-  "$PUBX,41,1,0003,0001,115200,0*1E\r\n",
-  "$PUBX,41,1,0003,0001,57600,0*2D\r\n",
-  "$PUBX,41,1,0003,0001,38400,0*26\r\n",
-  "$PUBX,41,1,0003,0001,19200,0*23\r\n",
-  "$PUBX,41,1,0003,0001,9600,0*16\r\n"
-};
+//
+// configuration tables, one per gps_profile_t. sent in order, each waits
+// for its ACK, then every rate is polled back. each table turns off what
+// the other one turns on so switching profiles needs no receiver reset
+//
+#define UBLOX_CFG_MSG(cls, id, rate)    { CLASS_CFG, MSG_CFG_SET_RATE, 3, { cls, id, rate } }
+#define UBLOX_CFG_RATE(msec)            { CLASS_CFG, MSG_CFG_RATE, 6, { (msec) & 0xff, (msec) >> 8, 1, 0, 1, 0 } }
 
-static uint8_t          _config_step;
+//
+// CFG-NAV5. air 1G, auto 2D/3D. rest collected by resetting a GPS unit
+// to defaults and capturing the data from the U-Center binary console
+// (original MWII code)
+//
+#define UBLOX_CFG_NAV5                                                    \
+  {                                                                       \
+    CLASS_CFG, MSG_CFG_NAV_SETTINGS, 0x24,                                \
+    {                                                                     \
+      0xFF, 0xFF, UBX_DYNMODEL_AIR_1G, UBX_FIXMODE_AUTO, 0x00,            \
+      0x00, 0x00, 0x00, 0x10, 0x27, 0x00, 0x00, 0x05, 0x00, 0xFA, 0x00,   \
+      0xFA, 0x00, 0x64, 0x00, 0x2C, 0x01, 0x00, 0x3C, 0x00, 0x00, 0x00,   \
+      0x00, 0xC8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00                \
+    },                                                                    \
+  }
 
-static const uint8_t default_payload[] = {
-  // CFG-NAV5 - Set engine settings (original MWII code)
-  0xFF, 0xFF, 0x03, 0x03, 0x00,
-  // Collected by resetting a GPS unit to defaults. Changing mode to Pedistrian and
-  0x00, 0x00, 0x00, 0x10, 0x27, 0x00, 0x00, 0x05, 0x00, 0xFA, 0x00,
-  // capturing the data from the U-Center binary console.
-  0xFA, 0x00, 0x64, 0x00, 0x2C, 0x01, 0x00, 0x3C, 0x00, 0x00, 0x00,
-  0x00, 0xC8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
-};
+#define UBLOX_CFG_NMEA_OFF                                                \
+  UBLOX_CFG_MSG(MSG_CLASS_NMEA, MSG_NMEA_GGA, 0),                         \
+  UBLOX_CFG_MSG(MSG_CLASS_NMEA, MSG_NMEA_GLL, 0),                         \
+  UBLOX_CFG_MSG(MSG_CLASS_NMEA, MSG_NMEA_GSA, 0),                         \
+  UBLOX_CFG_MSG(MSG_CLASS_NMEA, MSG_NMEA_GSV, 0),                         \
+  UBLOX_CFG_MSG(MSG_CLASS_NMEA, MSG_NMEA_RMC, 0),                         \
+  UBLOX_CFG_MSG(MSG_CLASS_NMEA, MSG_NMEA_VGS, 0)
 
-// SBAS_AUTO, SBAS_EGNOS, SBAS_WAAS, SBAS_MSAS, SBAS_GAGAN, SBAS_NONE
-static const uint32_t ubloxScanMode1[] = {
-  0x00000000, 0x00000851, 0x0004E004, 0x00020200, 0x00000180, 0x00000000,
+// CFG-SBAS. disabled
+#define UBLOX_CFG_SBAS_OFF              { CLASS_CFG, MSG_CFG_SBAS, 8, { 2, 3, 3, 0, 0, 0, 0, 0 } }
+
+static const ublox_cfg_msg_t  _config_msgs_legacy[] =
+{
+  UBLOX_CFG_NAV5,
+  UBLOX_CFG_NMEA_OFF,
+
+  UBLOX_CFG_MSG(MSG_CLASS_UBX,  MSG_POSLLH,   1),
+  UBLOX_CFG_MSG(MSG_CLASS_UBX,  MSG_STATUS,   1),
+  UBLOX_CFG_MSG(MSG_CLASS_UBX,  MSG_SOL,      1),
+  UBLOX_CFG_MSG(MSG_CLASS_UBX,  MSG_VELNED,   1),
+  UBLOX_CFG_MSG(MSG_CLASS_UBX,  MSG_SVINFO,   0),
+  UBLOX_CFG_MSG(MSG_CLASS_UBX,  MSG_TIMEUTC,  10),
+  UBLOX_CFG_MSG(MSG_CLASS_UBX,  MSG_PVT,      0),
+
+  UBLOX_CFG_RATE(UBLOX_LEGACY_RATE),
+  UBLOX_CFG_SBAS_OFF,
 };
 
-static union
+//
+// NAV-PVT carries position, velocity, accuracy, fix and time of an epoch
+// in one 100 byte frame. CFG-RATE is filled in from gps_rate_hz
+//
+static ublox_cfg_msg_t        _config_msgs_pvt[] =
 {
-  ubx_message_t   msg;
-  uint8_t         bytes[58];
-} _send_buffer;
+  UBLOX_CFG_NAV5,
+  UBLOX_CFG_NMEA_OFF,
+
+  UBLOX_CFG_MSG(MSG_CLASS_UBX,  MSG_POSLLH,   0),
+  UBLOX_CFG_MSG(MSG_CLASS_UBX,  MSG_STATUS,   0),
+  UBLOX_CFG_MSG(MSG_CLASS_UBX,  MSG_SOL,      0),
+  UBLOX_CFG_MSG(MSG_CLASS_UBX,  MSG_VELNED,   0),
+  UBLOX_CFG_MSG(MSG_CLASS_UBX,  MSG_SVINFO,   0),
+  UBLOX_CFG_MSG(MSG_CLASS_UBX,  MSG_TIMEUTC,  0),
+  UBLOX_CFG_MSG(MSG_CLASS_UBX,  MSG_PVT,      1),
+
+  UBLOX_CFG_RATE(100),
+  UBLOX_CFG_SBAS_OFF,
+};
 
 static union
 {
@@ -103,13 +153,18 @@ static union
   ubx_nav_status_t status;
   ubx_nav_solution_t solution;
   ubx_nav_velned_t velned;
-  ubx_nav_pvt_t pvt;
   ubx_nav_svinfo_t svinfo;
   ubx_mon_ver_t ver;
   ubx_nav_timeutc_t timeutc;
   uint8_t bytes[UBLOX_MAX_PAYLOAD_SIZE];
 } _payload;
 
+//
+// NAV-PVT lands here straight from the parser and is decoded from here.
+// it never goes through _payload
+//
+static ubx_nav_pvt_t      _pvt;
+
 static SoftTimerElem    _rx_timeout;
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -148,6 +203,8 @@ ublox_reset_data(void)
   _payload_length   = 0;
   _payload_counter  = 0;
 
+  _payload_dst      = _payload.bytes;
+
   _next_fix_type    = GPS_NO_FIX;
   _hw_version       = 0;
 }
@@ -161,7 +218,7 @@ static void
 ublox_rx_timeout_callback(SoftTimerElem* te)
 {
   gps_data.flags.rx_receiving = false;
-  ublox_start_baud_config();
+  ublox_start_config();
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -181,21 +238,6 @@ ublox_rx_irq(void)
   HAL_UART_Receive_IT(_huart, &_rx_char, 1);
 }
 
-void
-ublox_tx_irq(void)
-{
-  if(gps_data.state == gps_state_configuring_baud)
-  {
-    ublox_config_baud_step();
-    return;
-  }
-
-  if(gps_data.state == gps_state_configuring_gps)
-  {
-    ublox_gps_config_step();
-  }
-}
-
 ////////////////////////////////////////////////////////////////////////////////
 //
 // circular buffer locking
@@ -220,12 +262,74 @@ ublox_leave_critical(CircBuffer* cb)
 // UBLOX core
 //
 ////////////////////////////////////////////////////////////////////////////////
+
+//
+// one NAV-PVT is a whole epoch. gps_data is filled from it in one go and
+// nav_seq bumped last so consumers never see a mix of two epochs
+//
+static void
+ublox_handle_pvt(void)
+{
+  const ubx_nav_pvt_t*  pvt = &_pvt;
+
+  if(_payload_length < offsetof(ubx_nav_pvt_t, flags3))
+  {
+    return;
+  }
+
+  gps_data.fix_type       = ublox_gps_fix_type(pvt->fix_status & NAV_STATUS_FIX_VALID, pvt->fix_type);
+  gps_data.llh.lon        = pvt->longitude;
+  gps_data.llh.lat        = pvt->latitude;
+  gps_data.llh.alt        = pvt->altitude_msl / 10;       // in cm
+  gps_data.vel_ned[0]     = pvt->ned_north / 10;          // to cm/s
+  gps_data.vel_ned[1]     = pvt->ned_east / 10;
+  gps_data.vel_ned[2]     = pvt->ned_down / 10;
+  gps_data.ground_speed   = pvt->speed_2d / 10;           // to cm/s
+  gps_data.ground_course  = (uint16_t)(pvt->heading_2d / 10000);   // deg * 1e5 to deg * 10
+  gps_data.num_sat        = pvt->satellites;
+  gps_data.eph            = ublox_gps_contrain_epe(pvt->horizontal_accuracy / 10);
+  gps_data.epv            = ublox_gps_contrain_epe(pvt->vertical_accuracy / 10);
+  gps_data.hdop           = ublox_gps_contrain_hdop(pvt->position_DOP);
+
+  gps_data.flags.valid_vel_ne = true;
+  gps_data.flags.valid_vel_d  = true;
+  gps_data.flags.valid_epe    = true;
+
+  if(UBX_VALID_GPS_DATE_TIME(pvt->valid))
+  {
+    gps_data.time.year    = pvt->year;
+    gps_data.time.month   = pvt->month;
+    gps_data.time.day     = pvt->day;
+    gps_data.time.hours   = pvt->hour;
+    gps_data.time.minutes = pvt->min;
+    gps_data.time.seconds = pvt->sec;
+    gps_data.time.millis  = pvt->nano > 0 ? pvt->nano / (1000*1000) : 0;
+
+    gps_data.flags.valid_time = true;
+  }
+  else
+  {
+    gps_data.flags.valid_time = false;
+  }
+
+  gps_data.nav_usec = _frame_usec;
+  gps_data.nav_msec = __msec;
+  gps_data.nav_seq++;
+}
+
 static void
 ublox_handle_msg(void)
 {
   gps_data.flags.rx_receiving = true;
   gps_data.rx_msgs++;
-  mainloop_timer_reschedule(&_rx_timeout, 2000);
+
+  if(gps_data.state != gps_state_receiving)
+  {
+    ublox_cfg_rx_ubx(&_cfg, _class, _msg_id, _payload_dst, _payload_length, __msec);
+    ublox_update_state();
+    return;
+  }
+  mainloop_timer_reschedule(&_rx_timeout, UBLOX_RX_TIMEOUT);
 
   switch(_msg_id)
   {
@@ -276,6 +380,11 @@ ublox_handle_msg(void)
 
     gps_data.flags.valid_vel_ne = true;
     gps_data.flags.valid_vel_d  = true;
+
+    // VELNED is the last of the NAV messages in an epoch
+    gps_data.nav_usec = _frame_usec;
+    gps_data.nav_msec = __msec;
+    gps_data.nav_seq++;
     break;
 
   case MSG_TIMEUTC:
@@ -298,43 +407,7 @@ ublox_handle_msg(void)
     break;
 
   case MSG_PVT:
-    _next_fix_type = ublox_gps_fix_type(
-        _payload.pvt.fix_status & NAV_STATUS_FIX_VALID, 
-        _payload.pvt.fix_type);
-    gps_data.fix_type       = _next_fix_type;
-    gps_data.llh.lon        = _payload.pvt.longitude;
-    gps_data.llh.lat        = _payload.pvt.latitude;
-    gps_data.llh.alt        = _payload.pvt.altitude_msl / 10;  //alt in cm
-    gps_data.vel_ned[0]     = _payload.pvt.ned_north / 10;  // to cm/s
-    gps_data.vel_ned[1]     = _payload.pvt.ned_east / 10;   // to cm/s
-    gps_data.vel_ned[2]     = _payload.pvt.ned_down / 10;   // to cm/s
-    gps_data.ground_speed   = _payload.pvt.speed_2d / 10;    // to cm/s
-    gps_data.ground_course  = (uint16_t) (_payload.pvt.heading_2d / 10000);     // Heading 2D deg * 100000 rescaled to deg * 10
-    gps_data.num_sat        = _payload.pvt.satellites;
-    gps_data.eph            = ublox_gps_contrain_epe(_payload.pvt.horizontal_accuracy / 10);
-    gps_data.epv            = ublox_gps_contrain_epe(_payload.pvt.vertical_accuracy / 10);
-    gps_data.hdop           = ublox_gps_contrain_hdop(_payload.pvt.position_DOP);
-
-    gps_data.flags.valid_vel_ne = true;
-    gps_data.flags.valid_vel_d  = true;
-    gps_data.flags.valid_epe    = true;
-
-    if (UBX_VALID_GPS_DATE_TIME(_payload.pvt.valid))
-    {
-      gps_data.time.year    = _payload.pvt.year;
-      gps_data.time.month   = _payload.pvt.month;
-      gps_data.time.day     = _payload.pvt.day;
-      gps_data.time.hours   = _payload.pvt.hour;
-      gps_data.time.minutes = _payload.pvt.min;
-      gps_data.time.seconds = _payload.pvt.sec;
-      gps_data.time.millis  = _payload.pvt.nano / (1000*1000);
-
-      gps_data.flags.valid_time = true;
-    }
-    else
-    {
-      gps_data.flags.valid_time = false;
-    }
+    ublox_handle_pvt();
     break;
 
   case MSG_VER:
@@ -364,6 +437,7 @@ ublox_rx(uint8_t data)
       gps_data.rx_unsync++;
       break;
     }
+    _frame_usec = micros_get();
     _rx_step++;
     break;
 
@@ -406,6 +480,14 @@ ublox_rx(uint8_t data)
     _ck_b += (_ck_a += data);
     _rx_step++;
 
+    if(_class == CLASS_NAV && _msg_id == MSG_PVT && _payload_length <= sizeof(_pvt))
+    {
+      _payload_dst = (uint8_t*)&_pvt;
+    }
+    else
+    {
+      _payload_dst = _payload.bytes;
+    }
     _payload_counter = 0;
     if(_payload_length == 0)
     {
@@ -415,7 +497,7 @@ ublox_rx(uint8_t data)
 
   case 6:   // receiving payload
     _ck_b += (_ck_a += data);
-    _payload.bytes[_payload_counter++] = data;
+    _payload_dst[_payload_counter++] = data;
     if(_payload_counter == _payload_length)
     {
       _rx_step++;
@@ -451,256 +533,142 @@ ublox_rx(uint8_t data)
 // ublox gps config
 //
 ////////////////////////////////////////////////////////////////////////////////
-static void
-ublox_start_receiving(void)
+static bool
+ublox_send(const uint8_t* data, uint16_t len)
 {
   //
-  // enable receiver
-  // and start rx timer
+  // one message at a time. if the previous one is still going out this
+  // one is not queued. config frames are resent on ACK timeout
   //
-  soft_timer_init_elem(&_rx_timeout);
-  _rx_timeout.cb    = ublox_rx_timeout_callback;
-
-  mainloop_timer_schedule(&_rx_timeout, 2000);
-
-  HAL_UART_Receive_IT(_huart, &_rx_char, 1);
-
-  gps_data.state  = gps_state_receiving;
-}
-
-static void
-ublox_update_checksum(uint8_t *data, uint8_t len, uint8_t *ck_a, uint8_t *ck_b)
-{
-  while(len--)
+  if(len > sizeof(_tx_buf) || _huart->gState != HAL_UART_STATE_READY)
   {
-    *ck_a += *data;
-    *ck_b += *ck_a;
-    data++;
+    return false;
   }
+
+  memcpy(_tx_buf, data, len);
+  return HAL_UART_Transmit_IT(_huart, _tx_buf, len) == HAL_OK;
 }
 
 static void
-ublox_send_config_msg(void)
+ublox_set_baud(uint32_t baud)
 {
-  uint8_t ck_a=0, ck_b=0;
-
-  _send_buffer.msg.header.preamble1=PREAMBLE1;
-  _send_buffer.msg.header.preamble2=PREAMBLE2;
-
-  ublox_update_checksum(&_send_buffer.bytes[2], _send_buffer.msg.header.length+4, &ck_a, &ck_b);
+  HAL_UART_DeInit(_huart);
+  _huart->Init.BaudRate = baud;
+  HAL_UART_Init(_huart);
 
-  _send_buffer.bytes[_send_buffer.msg.header.length+6] = ck_a;
-  _send_buffer.bytes[_send_buffer.msg.header.length+7] = ck_b;
+  ublox_reset_data();
 
-  HAL_UART_Transmit_IT(_huart,
-      _send_buffer.bytes,
-      _send_buffer.msg.header.length + 8);
+  circ_buffer_init(&_rx_circ, _rx_buf, UBLOX_MAX_PAYLOAD_SIZE,
+      ublox_enter_critical,
+      ublox_leave_critical);
 
-  //check ack/nack here
+  HAL_UART_Receive_IT(_huart, &_rx_char, 1);
 }
 
-static void
-ublox_config_nav5(uint8_t dyn_model, uint8_t fix_mode)
+//
+// position only. there is no RTC running while powered off, so the time
+// of the cached fix says nothing about the time now and MGA-INI-TIME_UTC
+// with any accuracy we could claim would be a guess. MGA messages are not
+// acknowledged unless asked for, a receiver without MGA ignores them.
+//
+// false while the aid still has to go out. the last config frame may
+// still be in the UART when the config is done
+//
+static bool
+ublox_send_aid(void)
 {
-  _send_buffer.msg.header.msg_class   = CLASS_CFG;
-  _send_buffer.msg.header.msg_id      = MSG_CFG_NAV_SETTINGS;
-  _send_buffer.msg.header.length      = 0x24;
-  memcpy(_send_buffer.msg.payload.bytes, default_payload, sizeof(default_payload));
-  _send_buffer.msg.payload.bytes[2]   = dyn_model;
-  _send_buffer.msg.payload.bytes[3]   = fix_mode;
-
-  ublox_send_config_msg();
-}
+  const gps_aid_t*  aid = &GCFG->gps_aid;
+  uint8_t           buf[sizeof(ubx_mga_ini_pos_llh_t) + UBLOX_CFG_FRAME_OVERHEAD];
+  uint16_t          len;
 
-static void
-ublox_config_msg(uint8_t _class, uint8_t id, uint8_t rate)
-{
-  _send_buffer.msg.header.msg_class     = CLASS_CFG;
-  _send_buffer.msg.header.msg_id        = MSG_CFG_SET_RATE;
-  _send_buffer.msg.header.length        = 3;
-  _send_buffer.msg.payload.msg._class   = _class;
-  _send_buffer.msg.payload.msg.id       = id;
-  _send_buffer.msg.payload.msg.rate     = rate;
-
-  ublox_send_config_msg();
-}
+  if(!aid->valid || gps_data.aid_sent)
+  {
+    return true;
+  }
 
-static void
-ublox_cofig_rate(uint16_t rate)
-{
-  _send_buffer.msg.header.msg_class   = CLASS_CFG;
-  _send_buffer.msg.header.msg_id      = MSG_CFG_RATE;
-  _send_buffer.msg.header.length      = 6;
-  _send_buffer.msg.payload.rate.meas  = rate;
-  _send_buffer.msg.payload.rate.nav   =1;
-  _send_buffer.msg.payload.rate.time  =1;
-
-  ublox_send_config_msg();
-}
+  len = ublox_build_mga_ini_pos(buf, &aid->llh,
+      aid->acc > UBLOX_AID_POS_ACC_MIN ? aid->acc : UBLOX_AID_POS_ACC_MIN);
 
-static void
-ublox_config_sbas(void)
-{
-  _send_buffer.msg.header.msg_class         = CLASS_CFG;
-  _send_buffer.msg.header.msg_id            = MSG_CFG_SBAS;
-  _send_buffer.msg.header.length            = 8;
-  //_send_buffer.msg.payload.sbas.mode=(gpsState.gpsConfig->sbasMode == SBAS_NONE?2:3);
-  _send_buffer.msg.payload.sbas.mode        = 2;
-  _send_buffer.msg.payload.sbas.usage       = 3;
-  _send_buffer.msg.payload.sbas.maxSBAS     = 3;
-  _send_buffer.msg.payload.sbas.scanmode2   = 0;
-  _send_buffer.msg.payload.sbas.scanmode1   = ubloxScanMode1[SBAS_NONE];
-
-  ublox_send_config_msg();
+  gps_data.aid_sent = ublox_send(buf, len);
+  return gps_data.aid_sent;
 }
 
 static void
-ublox_do_gps_config(int step)
+ublox_update_state(void)
 {
-  switch(step)
+  switch(_cfg.state)
   {
-  case 0:   // air 1G setup
-    ublox_config_nav5(UBX_DYNMODEL_AIR_1G, UBX_FIXMODE_AUTO);
-    break;
-
-  // disable MNEA
-  case 1: 
-    ublox_config_msg(MSG_CLASS_NMEA, MSG_NMEA_GGA, 0);
-    break;
-
-  case 2:
-    ublox_config_msg(MSG_CLASS_NMEA, MSG_NMEA_GLL, 0);
-    break;
-
-  case 3:
-    ublox_config_msg(MSG_CLASS_NMEA, MSG_NMEA_GSA, 0);
-    break;
-
-  case 4:
-    ublox_config_msg(MSG_CLASS_NMEA, MSG_NMEA_GSV, 0);
-    break;
-
-  case 5:
-    ublox_config_msg(MSG_CLASS_NMEA, MSG_NMEA_RMC, 0);
-    break;
-
-  case 6:
-    ublox_config_msg(MSG_CLASS_NMEA, MSG_NMEA_VGS, 0);
-    break;
-
-  // enable UBX
-  case 7:
-    ublox_config_msg(MSG_CLASS_UBX, MSG_POSLLH, 1);
-    break;
-  
-  case 8:
-    ublox_config_msg(MSG_CLASS_UBX, MSG_STATUS, 1);
-    break;
-
-  case 9:
-    ublox_config_msg(MSG_CLASS_UBX, MSG_SOL,    1);
-    break;
-
-  case 10:
-    ublox_config_msg(MSG_CLASS_UBX, MSG_VELNED, 1);
+  case ublox_cfg_state_config:
+  case ublox_cfg_state_verify:
+    gps_data.state = gps_state_configuring_gps;
     break;
 
-  case 11:
-    ublox_config_msg(MSG_CLASS_UBX, MSG_SVINFO, 0);
-    break;
-
-  case 12:
-    ublox_config_msg(MSG_CLASS_UBX, MSG_TIMEUTC,10);
-    break;
-
-  case 13:   // rate
-    ublox_cofig_rate(200);    // 5Hz
-    break;
+  case ublox_cfg_state_done:
+    if(gps_data.state != gps_state_receiving)
+    {
+      gps_data.state = gps_state_receiving;
+      mainloop_timer_reschedule(&_rx_timeout, UBLOX_RX_TIMEOUT);
+    }
 
-  case 14:   // sbas
-    ublox_config_sbas();
+    //
+    // the config tick keeps running until the aid is out
+    //
+    if(ublox_send_aid() && is_soft_timer_running(&_cfg_timer))
+    {
+      mainloop_timer_cancel(&_cfg_timer);
+    }
     break;
 
-  case 15:   // galileo
+  default:
+    gps_data.state = gps_state_configuring_baud;
     break;
   }
 }
 
 static void
-ublox_gps_config_step(void)
+ublox_cfg_timer_callback(SoftTimerElem* te)
 {
-  _config_step++;
-  if(_config_step >= 15)
-  {
-    //
-    // enable receiver
-    // and start rx timer
-    //
-    ublox_start_receiving();
-    return;
-  }
+  mainloop_timer_schedule(&_cfg_timer, UBLOX_CFG_TICK);
 
-  ublox_do_gps_config(_config_step);
+  ublox_cfg_tick(&_cfg, __msec);
+  ublox_update_state();
 }
 
 static void
-ublox_start_gps_config(void)
+ublox_start_config(void)
 {
-  gps_data.state  = gps_state_configuring_gps;
-  _config_step    = 0;
-  ublox_do_gps_config(_config_step);
-}
-
-////////////////////////////////////////////////////////////////////////////////
-//
-// auto baud configure
-//
-////////////////////////////////////////////////////////////////////////////////
-static void
-ublox_reset_baud(uint32_t   baud)
-{
-  HAL_UART_DeInit(_huart);
-  _huart->Init.BaudRate = baud;
-  HAL_UART_Init(_huart);
-
-  ublox_reset_data();
+  uint8_t           hz;
+  uint16_t          msec;
 
-  circ_buffer_init(&_rx_circ, _rx_buf, UBLOX_MAX_PAYLOAD_SIZE,
-      ublox_enter_critical,
-      ublox_leave_critical);
-}
+  gps_data.state = gps_state_configuring_baud;
 
-static void
-ublox_config_baud(uint8_t    target_index)
-{
-  ublox_reset_baud(_avail_bauds[target_index]);
+  if(is_soft_timer_running(&_rx_timeout))
+  {
+    mainloop_timer_cancel(&_rx_timeout);
+  }
 
-  HAL_UART_Transmit_IT(_huart, (uint8_t*)_baud_set_cmds[_target_cmd],
-      strlen(_baud_set_cmds[_target_cmd]));
-}
+  if(GCFG->gps_profile == gps_profile_pvt)
+  {
+    hz    = GCFG->gps_rate_hz;
+    hz    = hz < GPS_PVT_RATE_MIN ? GPS_PVT_RATE_MIN : (hz > GPS_PVT_RATE_MAX ? GPS_PVT_RATE_MAX : hz);
+    msec  = 1000 / hz;
 
-static void
-ublox_config_baud_step(void)
-{
-  _next_baud_index++;
+    for(int i = 0; i < NARRAY(_config_msgs_pvt); i++)
+    {
+      if(_config_msgs_pvt[i].cls == CLASS_CFG && _config_msgs_pvt[i].id == MSG_CFG_RATE)
+      {
+        _config_msgs_pvt[i].payload[0] = msec & 0xff;
+        _config_msgs_pvt[i].payload[1] = msec >> 8;
+      }
+    }
 
-  if(_next_baud_index >= NARRAY(_avail_bauds))
+    ublox_cfg_start(&_cfg, _config_msgs_pvt, NARRAY(_config_msgs_pvt), __msec);
+  }
+  else
   {
-    // done configuring baud
-    ublox_reset_baud(_target_baud);
-    ublox_start_gps_config();
-    return;
+    ublox_cfg_start(&_cfg, _config_msgs_legacy, NARRAY(_config_msgs_legacy), __msec);
   }
-
-  ublox_config_baud(_next_baud_index);
-}
-
-static void
-ublox_start_baud_config(void)
-{
-  gps_data.state = gps_state_configuring_baud;
-  _next_baud_index  = 0;
-  ublox_config_baud(_next_baud_index);
+  mainloop_timer_reschedule(&_cfg_timer, UBLOX_CFG_TICK);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -716,26 +684,15 @@ ublox_rx_event(uint32_t event)
   while(circ_buffer_dequeue(&_rx_circ, &data, 1, false) == true)
   {
     gps_data.rx_bytes++;
+    if(gps_data.state != gps_state_receiving)
+    {
+      ublox_cfg_rx_byte(&_cfg, data, __msec);
+      ublox_update_state();
+    }
     ublox_rx(data);
   }
 }
 
-static void
-ublox_tx_event(uint32_t event)
-{
-  if(gps_data.state == gps_state_configuring_baud)
-  {
-    ublox_config_baud_step();
-    return;
-  }
-
-  if(gps_data.state == gps_state_configuring_gps)
-  {
-    ublox_gps_config_step();
-    return;
-  }
-}
-
 ////////////////////////////////////////////////////////////////////////////////
 //
 // public interfaces
@@ -749,9 +706,30 @@ ublox_init(void)
       ublox_leave_critical);
 
   event_register_handler(ublox_rx_event, DISPATCH_EVENT_UBLOX_RX);
-  event_register_handler(ublox_tx_event, DISPATCH_EVENT_UBLOX_TX);
 
   ublox_reset_data();
 
-  ublox_start_baud_config();
+  soft_timer_init_elem(&_rx_timeout);
+  _rx_timeout.cb  = ublox_rx_timeout_callback;
+  soft_timer_init_elem(&_cfg_timer);
+  _cfg_timer.cb   = ublox_cfg_timer_callback;
+
+  ublox_cfg_init(&_cfg, ublox_send, ublox_set_baud, UBLOX_TARGET_BAUD);
+  ublox_start_config();
+}
+
+//
+// configures the receiver again, for a new GCFG gps_profile/gps_rate_hz
+//
+void
+ublox_reconfigure(void)
+{
+  gps_data.flags.rx_receiving = false;
+  ublox_start_config();
+}
+
+const ublox_cfg_t*
+ublox_get_cfg(void)
+{
+  return &_cfg;
 }
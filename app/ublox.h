@@ -2,10 +2,12 @@
 #define __UBLOX_DEF_H__
 
 #include "app_common.h"
+#include "ublox_cfg.h"
 
 extern void ublox_init(void);
+extern void ublox_reconfigure(void);
+extern const ublox_cfg_t* ublox_get_cfg(void);
 
 extern void ublox_rx_irq(void);
-extern void ublox_tx_irq(void);
 
 #endif /* !__UBLOX_DEF_H__ */
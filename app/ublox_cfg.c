@@ -0,0 +1,552 @@
+#include <string.h>
+#include "ublox_cfg.h"
+#include "ublox_priv.h"
+
+#define UBLOX_CFG_DETECT_WINDOW         250       // msec per candidate baud
+#define UBLOX_CFG_SWITCH_DELAY          100       // msec. PUBX out at old baud
+#define UBLOX_CFG_ACK_TIMEOUT           250       // msec
+#define UBLOX_CFG_RETRIES               3
+#define UBLOX_CFG_NMEA_MAX_LEN          82
+
+#define UBLOX_CFG_PORT_UART1            1
+
+//
+// most likely first. the target, where the receiver is if only the FC
+// rebooted, then the factory default
+//
+static const struct
+{
+  uint32_t      baud;
+  const char*   pubx;
+} _bauds[] =
+{
+  { 115200, "$PUBX,41,1,0003,0001,115200,0*1E\r\n" },
+  {   9600, "$PUBX,41,1,0003,0001,9600,0*16\r\n"   },
+  {  57600, "$PUBX,41,1,0003,0001,57600,0*2D\r\n"  },
+  {  38400, "$PUBX,41,1,0003,0001,38400,0*26\r\n"  },
+  {  19200, "$PUBX,41,1,0003,0001,19200,0*23\r\n"  },
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// private utilities
+//
+////////////////////////////////////////////////////////////////////////////////
+static inline bool
+ublox_cfg_expired(const ublox_cfg_t* cfg, uint32_t now)
+{
+  return (int32_t)(now - cfg->deadline) >= 0;
+}
+
+static void
+ublox_cfg_send_msg(ublox_cfg_t* cfg, uint8_t cls, uint8_t id, const uint8_t* payload, uint16_t len)
+{
+  cfg->send(cfg->tx, ublox_build_msg(cfg->tx, cls, id, payload, len));
+}
+
+static inline void
+ublox_cfg_set_baud(ublox_cfg_t* cfg, uint32_t baud)
+{
+  cfg->baud       = baud;
+  cfg->nmea_state = 0;
+  cfg->set_baud(baud);
+}
+
+static void
+ublox_cfg_probe(ublox_cfg_t* cfg, uint32_t now)
+{
+  const uint8_t   port = UBLOX_CFG_PORT_UART1;
+
+  ublox_cfg_send_msg(cfg, CLASS_CFG, MSG_CFG_PRT, &port, 1);
+  cfg->deadline = now + UBLOX_CFG_DETECT_WINDOW;
+}
+
+static void
+ublox_cfg_detect_begin(ublox_cfg_t* cfg, uint8_t index, uint32_t now)
+{
+  cfg->state      = ublox_cfg_state_detect;
+  cfg->baud_index = index;
+  ublox_cfg_set_baud(cfg, _bauds[index].baud);
+  ublox_cfg_probe(cfg, now);
+}
+
+static void
+ublox_cfg_restart(ublox_cfg_t* cfg, uint32_t now)
+{
+  cfg->restarts++;
+  ublox_cfg_detect_begin(cfg, 0, now);
+}
+
+//
+// only CFG-MSG, 3 bytes, and CFG-RATE, 6 bytes, are polled back.
+// everything else is only acknowledged
+//
+static inline bool
+ublox_cfg_verifiable(const ublox_cfg_msg_t* m)
+{
+  return m->cls == CLASS_CFG &&
+         ((m->id == MSG_CFG_SET_RATE && m->len == 3) ||
+          (m->id == MSG_CFG_RATE && m->len == 6));
+}
+
+static void
+ublox_cfg_send_step(ublox_cfg_t* cfg, uint32_t now)
+{
+  const ublox_cfg_msg_t*  m = &cfg->msgs[cfg->step];
+
+  ublox_cfg_send_msg(cfg, m->cls, m->id, m->payload, m->len);
+  cfg->deadline = now + UBLOX_CFG_ACK_TIMEOUT;
+}
+
+static void
+ublox_cfg_send_poll(ublox_cfg_t* cfg, uint32_t now)
+{
+  const ublox_cfg_msg_t*  m = &cfg->msgs[cfg->step];
+
+  if(m->id == MSG_CFG_SET_RATE)
+  {
+    // class/id only polls the rate
+    ublox_cfg_send_msg(cfg, CLASS_CFG, MSG_CFG_SET_RATE, m->payload, 2);
+  }
+  else
+  {
+    ublox_cfg_send_msg(cfg, CLASS_CFG, MSG_CFG_RATE, NULL, 0);
+  }
+  cfg->deadline = now + UBLOX_CFG_ACK_TIMEOUT;
+}
+
+static void
+ublox_cfg_done(ublox_cfg_t* cfg, uint32_t now)
+{
+  cfg->state      = ublox_cfg_state_done;
+  cfg->ready_msec = now - cfg->start_msec;
+}
+
+static void
+ublox_cfg_verify_next(ublox_cfg_t* cfg, uint32_t now)
+{
+  cfg->tries  = 0;
+  cfg->fixing = false;
+
+  while(cfg->step < cfg->n_msgs && !ublox_cfg_verifiable(&cfg->msgs[cfg->step]))
+  {
+    cfg->step++;
+  }
+
+  if(cfg->step >= cfg->n_msgs)
+  {
+    ublox_cfg_done(cfg, now);
+    return;
+  }
+  ublox_cfg_send_poll(cfg, now);
+}
+
+static void
+ublox_cfg_config_next(ublox_cfg_t* cfg, uint32_t now)
+{
+  cfg->step++;
+  cfg->tries = 0;
+
+  if(cfg->step >= cfg->n_msgs)
+  {
+    cfg->state  = ublox_cfg_state_verify;
+    cfg->step   = 0;
+    ublox_cfg_verify_next(cfg, now);
+    return;
+  }
+  ublox_cfg_send_step(cfg, now);
+}
+
+static void
+ublox_cfg_config_begin(ublox_cfg_t* cfg, uint32_t now)
+{
+  cfg->state  = ublox_cfg_state_config;
+  cfg->step   = 0;
+  cfg->tries  = 0;
+
+  if(cfg->n_msgs == 0)
+  {
+    ublox_cfg_done(cfg, now);
+    return;
+  }
+  ublox_cfg_send_step(cfg, now);
+}
+
+//
+// a frame with a good checksum came in at the current baud
+//
+static void
+ublox_cfg_link_alive(ublox_cfg_t* cfg, uint32_t now)
+{
+  const char*   pubx;
+
+  switch(cfg->state)
+  {
+  case ublox_cfg_state_detect:
+    cfg->detected_baud = cfg->baud;
+    if(cfg->baud == cfg->target_baud)
+    {
+      ublox_cfg_config_begin(cfg, now);
+      break;
+    }
+
+    for(int i = 0; i < NARRAY(_bauds); i++)
+    {
+      if(_bauds[i].baud == cfg->target_baud)
+      {
+        pubx = _bauds[i].pubx;
+        cfg->send((const uint8_t*)pubx, strlen(pubx));
+        break;
+      }
+    }
+    cfg->state    = ublox_cfg_state_switch_baud;
+    cfg->deadline = now + UBLOX_CFG_SWITCH_DELAY;
+    break;
+
+  case ublox_cfg_state_verify_baud:
+    ublox_cfg_config_begin(cfg, now);
+    break;
+
+  default:
+    break;
+  }
+}
+
+//
+// ACK/NAK payload is class and id of the message acknowledged
+//
+static void
+ublox_cfg_rx_ack(ublox_cfg_t* cfg, bool ack, const uint8_t* payload, uint16_t len, uint32_t now)
+{
+  const ublox_cfg_msg_t*  m;
+
+  if(len < 2 || cfg->step >= cfg->n_msgs)
+  {
+    return;
+  }
+
+  m = &cfg->msgs[cfg->step];
+  if(payload[0] != m->cls || payload[1] != m->id)
+  {
+    return;
+  }
+
+  if(cfg->state == ublox_cfg_state_config)
+  {
+    if(!ack)
+    {
+      cfg->naks++;
+    }
+    ublox_cfg_config_next(cfg, now);
+    return;
+  }
+
+  if(cfg->state == ublox_cfg_state_verify && cfg->fixing)
+  {
+    cfg->fixing = false;
+    ublox_cfg_send_poll(cfg, now);
+  }
+}
+
+static void
+ublox_cfg_rx_poll_reply(ublox_cfg_t* cfg, uint8_t id, const uint8_t* payload, uint16_t len, uint32_t now)
+{
+  const ublox_cfg_msg_t*  m = &cfg->msgs[cfg->step];
+  bool                    match;
+
+  if(cfg->state != ublox_cfg_state_verify || cfg->fixing || id != m->id)
+  {
+    return;
+  }
+
+  if(id == MSG_CFG_SET_RATE)
+  {
+    //
+    // 8 bytes with a rate per port or 3 with the rate of this port
+    //
+    if(len < 3 || payload[0] != m->payload[0] || payload[1] != m->payload[1])
+    {
+      return;
+    }
+    match = (len >= 8 ? payload[2 + UBLOX_CFG_PORT_UART1] : payload[2]) == m->payload[2];
+  }
+  else
+  {
+    if(len < 6)
+    {
+      return;
+    }
+    match = memcmp(payload, m->payload, 6) == 0;
+  }
+
+  if(match)
+  {
+    cfg->step++;
+    ublox_cfg_verify_next(cfg, now);
+    return;
+  }
+
+  cfg->mismatches++;
+  if(++cfg->tries > UBLOX_CFG_RETRIES)
+  {
+    ublox_cfg_restart(cfg, now);
+    return;
+  }
+  cfg->fixing = true;
+  ublox_cfg_send_step(cfg, now);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// public interfaces
+//
+////////////////////////////////////////////////////////////////////////////////
+void
+ublox_update_checksum(const uint8_t* data, uint16_t len, uint8_t* ck_a, uint8_t* ck_b)
+{
+  while(len--)
+  {
+    *ck_a += *data;
+    *ck_b += *ck_a;
+    data++;
+  }
+}
+
+//
+// full frame into buf, which needs len + UBLOX_CFG_FRAME_OVERHEAD bytes.
+// returns the frame length
+//
+uint16_t
+ublox_build_msg(uint8_t* buf, uint8_t cls, uint8_t id, const uint8_t* payload, uint16_t len)
+{
+  uint8_t   ck_a = 0,
+            ck_b = 0;
+
+  buf[0] = PREAMBLE1;
+  buf[1] = PREAMBLE2;
+  buf[2] = cls;
+  buf[3] = id;
+  buf[4] = len & 0xff;
+  buf[5] = len >> 8;
+  if(len != 0)
+  {
+    memcpy(&buf[6], payload, len);
+  }
+
+  ublox_update_checksum(&buf[2], len + 4, &ck_a, &ck_b);
+  buf[6 + len] = ck_a;
+  buf[7 + len] = ck_b;
+
+  return len + UBLOX_CFG_FRAME_OVERHEAD;
+}
+
+//
+// MGA-INI-POS_LLH. altitude is taken as is, the accuracy given is far
+// bigger than the geoid separation
+//
+uint16_t
+ublox_build_mga_ini_pos(uint8_t* buf, const gps_location_t* llh, uint32_t acc)
+{
+  ubx_mga_ini_pos_llh_t   pos;
+
+  memset(&pos, 0, sizeof(pos));
+  pos.type      = 0x01;
+  pos.latitude  = llh->lat;
+  pos.longitude = llh->lon;
+  pos.altitude  = llh->alt;
+  pos.accuracy  = acc;
+
+  return ublox_build_msg(buf, CLASS_MGA, MSG_MGA_INI, (const uint8_t*)&pos, sizeof(pos));
+}
+
+//
+// MGA-INI-TIME_UTC, valid on receipt, leap seconds unknown. not sent by
+// ublox.c, only useful once something keeps time while powered off
+//
+uint16_t
+ublox_build_mga_ini_time(uint8_t* buf, const date_time_t* t, uint16_t acc_sec)
+{
+  ubx_mga_ini_time_utc_t  utc;
+
+  memset(&utc, 0, sizeof(utc));
+  utc.type          = 0x10;
+  utc.leap_secs     = -128;
+  utc.year          = t->year;
+  utc.month         = t->month;
+  utc.day           = t->day;
+  utc.hour          = t->hours;
+  utc.min           = t->minutes;
+  utc.sec           = t->seconds;
+  utc.nano          = t->millis * 1000000UL;
+  utc.accuracy_sec  = acc_sec;
+
+  return ublox_build_msg(buf, CLASS_MGA, MSG_MGA_INI, (const uint8_t*)&utc, sizeof(utc));
+}
+
+void
+ublox_cfg_init(ublox_cfg_t* cfg, ublox_cfg_send_t send, ublox_cfg_set_baud_t set_baud,
+    uint32_t target_baud)
+{
+  memset(cfg, 0, sizeof(ublox_cfg_t));
+
+  cfg->send         = send;
+  cfg->set_baud     = set_baud;
+  cfg->target_baud  = target_baud;
+  cfg->state        = ublox_cfg_state_idle;
+}
+
+void
+ublox_cfg_start(ublox_cfg_t* cfg, const ublox_cfg_msg_t* msgs, uint8_t n, uint32_t now)
+{
+  cfg->msgs       = msgs;
+  cfg->n_msgs     = n;
+  cfg->start_msec = now;
+  cfg->ready_msec = 0;
+
+  ublox_cfg_detect_begin(cfg, 0, now);
+}
+
+//
+// every byte received. only looks for NMEA sentences during detection,
+// UBX frames come through ublox_cfg_rx_ubx()
+//
+void
+ublox_cfg_rx_byte(ublox_cfg_t* cfg, uint8_t data, uint32_t now)
+{
+  static const char   hex[] = "0123456789ABCDEF";
+
+  if(cfg->state != ublox_cfg_state_detect && cfg->state != ublox_cfg_state_verify_baud)
+  {
+    return;
+  }
+
+  if(data == '$')
+  {
+    cfg->nmea_state = 1;
+    cfg->nmea_len   = 0;
+    cfg->nmea_ck    = 0;
+    return;
+  }
+
+  switch(cfg->nmea_state)
+  {
+  case 1:   // body
+    if(data == '*')
+    {
+      cfg->nmea_state = 2;
+    }
+    else if(data < 0x20 || data > 0x7e || ++cfg->nmea_len > UBLOX_CFG_NMEA_MAX_LEN)
+    {
+      cfg->nmea_state = 0;
+    }
+    else
+    {
+      cfg->nmea_ck ^= data;
+    }
+    break;
+
+  case 2:   // checksum high
+    cfg->nmea_rx_ck = data;
+    cfg->nmea_state = 3;
+    break;
+
+  case 3:   // checksum low
+    cfg->nmea_state = 0;
+    if(cfg->nmea_rx_ck == hex[cfg->nmea_ck >> 4] && data == hex[cfg->nmea_ck & 0x0f])
+    {
+      ublox_cfg_link_alive(cfg, now);
+    }
+    break;
+
+  default:
+    break;
+  }
+}
+
+//
+// every UBX frame with a good checksum
+//
+void
+ublox_cfg_rx_ubx(ublox_cfg_t* cfg, uint8_t cls, uint8_t id,
+    const uint8_t* payload, uint16_t len, uint32_t now)
+{
+  switch(cfg->state)
+  {
+  case ublox_cfg_state_detect:
+  case ublox_cfg_state_verify_baud:
+    ublox_cfg_link_alive(cfg, now);
+    break;
+
+  case ublox_cfg_state_config:
+  case ublox_cfg_state_verify:
+    if(cls == CLASS_ACK && (id == MSG_ACK_ACK || id == MSG_ACK_NACK))
+    {
+      ublox_cfg_rx_ack(cfg, id == MSG_ACK_ACK, payload, len, now);
+    }
+    else if(cls == CLASS_CFG)
+    {
+      ublox_cfg_rx_poll_reply(cfg, id, payload, len, now);
+    }
+    break;
+
+  default:
+    break;
+  }
+}
+
+void
+ublox_cfg_tick(ublox_cfg_t* cfg, uint32_t now)
+{
+  if(cfg->state == ublox_cfg_state_idle ||
+     cfg->state == ublox_cfg_state_done ||
+     !ublox_cfg_expired(cfg, now))
+  {
+    return;
+  }
+
+  switch(cfg->state)
+  {
+  case ublox_cfg_state_detect:
+    if(cfg->baud_index + 1 >= NARRAY(_bauds))
+    {
+      ublox_cfg_restart(cfg, now);
+    }
+    else
+    {
+      ublox_cfg_detect_begin(cfg, cfg->baud_index + 1, now);
+    }
+    break;
+
+  case ublox_cfg_state_switch_baud:
+    cfg->state = ublox_cfg_state_verify_baud;
+    ublox_cfg_set_baud(cfg, cfg->target_baud);
+    ublox_cfg_probe(cfg, now);
+    break;
+
+  case ublox_cfg_state_verify_baud:
+    ublox_cfg_restart(cfg, now);
+    break;
+
+  case ublox_cfg_state_config:
+  case ublox_cfg_state_verify:
+    cfg->retries++;
+    if(++cfg->tries > UBLOX_CFG_RETRIES)
+    {
+      ublox_cfg_restart(cfg, now);
+      break;
+    }
+
+    if(cfg->state == ublox_cfg_state_config || cfg->fixing)
+    {
+      ublox_cfg_send_step(cfg, now);
+    }
+    else
+    {
+      ublox_cfg_send_poll(cfg, now);
+    }
+    break;
+
+  default:
+    break;
+  }
+}
@@ -0,0 +1,109 @@
+#ifndef __UBLOX_CFG_DEF_H__
+#define __UBLOX_CFG_DEF_H__
+
+#include "app_common.h"
+#include "gps.h"
+
+//
+// uBlox configuration engine.
+//
+// runs from the main loop on received frames and a periodic tick, with
+// no knowledge of the UART. it
+//
+//  1. finds the baud the receiver is at. each candidate gets a CFG-PRT
+//     poll and a listening window. any UBX frame or NMEA sentence with
+//     a good checksum means the baud is right.
+//  2. moves the receiver to the target baud with PUBX,41 if needed and
+//     checks it answers there.
+//  3. sends the configuration table one message at a time, waiting for
+//     ACK-ACK/NAK of each, resending on timeout.
+//  4. polls back every CFG-MSG and CFG-RATE of the table and compares
+//     the rates. a mismatch sends the message again.
+//
+// running out of retries anywhere starts over from 1.
+//
+#define UBLOX_CFG_MAX_PAYLOAD           40
+#define UBLOX_CFG_FRAME_OVERHEAD        8
+
+typedef struct
+{
+  uint8_t     cls;
+  uint8_t     id;
+  uint8_t     len;
+  uint8_t     payload[UBLOX_CFG_MAX_PAYLOAD];
+} ublox_cfg_msg_t;
+
+typedef enum
+{
+  ublox_cfg_state_idle = 0,
+  ublox_cfg_state_detect,
+  ublox_cfg_state_switch_baud,
+  ublox_cfg_state_verify_baud,
+  ublox_cfg_state_config,
+  ublox_cfg_state_verify,
+  ublox_cfg_state_done,
+} ublox_cfg_state_t;
+
+//
+// send returns false if the frame was not queued. the state machine does
+// not need it, a lost frame is resent on ACK timeout
+//
+typedef bool (*ublox_cfg_send_t)(const uint8_t* data, uint16_t len);
+typedef void (*ublox_cfg_set_baud_t)(uint32_t baud);
+
+typedef struct
+{
+  ublox_cfg_state_t       state;
+
+  ublox_cfg_send_t        send;
+  ublox_cfg_set_baud_t    set_baud;
+  uint32_t                target_baud;
+  uint32_t                baud;             // what the UART is at
+
+  const ublox_cfg_msg_t*  msgs;
+  uint8_t                 n_msgs;
+  uint8_t                 step;
+  uint8_t                 tries;
+  bool                    fixing;           // verify found a mismatch, set is resent
+  uint8_t                 baud_index;
+  uint32_t                deadline;
+  uint32_t                start_msec;
+
+  // NMEA sentence checker for baud detection
+  uint8_t                 nmea_state;
+  uint8_t                 nmea_len;
+  uint8_t                 nmea_ck;
+  uint8_t                 nmea_rx_ck;
+
+  uint8_t                 tx[UBLOX_CFG_MAX_PAYLOAD + UBLOX_CFG_FRAME_OVERHEAD];
+
+  // statistics
+  uint32_t                detected_baud;
+  uint32_t                ready_msec;       // start to done
+  uint32_t                retries;
+  uint32_t                naks;
+  uint32_t                mismatches;
+  uint32_t                restarts;
+} ublox_cfg_t;
+
+extern void ublox_update_checksum(const uint8_t* data, uint16_t len, uint8_t* ck_a, uint8_t* ck_b);
+extern uint16_t ublox_build_msg(uint8_t* buf, uint8_t cls, uint8_t id, const uint8_t* payload, uint16_t len);
+
+extern uint16_t ublox_build_mga_ini_pos(uint8_t* buf, const gps_location_t* llh, uint32_t acc);
+extern uint16_t ublox_build_mga_ini_time(uint8_t* buf, const date_time_t* t, uint16_t acc_sec);
+
+extern void ublox_cfg_init(ublox_cfg_t* cfg, ublox_cfg_send_t send, ublox_cfg_set_baud_t set_baud,
+    uint32_t target_baud);
+extern void ublox_cfg_start(ublox_cfg_t* cfg, const ublox_cfg_msg_t* msgs, uint8_t n, uint32_t now);
+extern void ublox_cfg_rx_byte(ublox_cfg_t* cfg, uint8_t data, uint32_t now);
+extern void ublox_cfg_rx_ubx(ublox_cfg_t* cfg, uint8_t cls, uint8_t id,
+    const uint8_t* payload, uint16_t len, uint32_t now);
+extern void ublox_cfg_tick(ublox_cfg_t* cfg, uint32_t now);
+
+static inline bool
+ublox_cfg_is_done(const ublox_cfg_t* cfg)
+{
+  return cfg->state == ublox_cfg_state_done;
+}
+
+#endif /* !__UBLOX_CFG_DEF_H__ */
@@ -11,6 +11,7 @@ typedef enum
   CLASS_ACK = 0x05,
   CLASS_CFG = 0x06,
   CLASS_MON = 0x0A,
+  CLASS_MGA = 0x13,
   MSG_CLASS_UBX = 0x01,
   MSG_CLASS_NMEA = 0xF0,
   MSG_VER = 0x04,
@@ -34,7 +35,8 @@ typedef enum
   MSG_CFG_SET_RATE = 0x01,
   MSG_CFG_NAV_SETTINGS = 0x24,
   MSG_CFG_SBAS = 0x16,
-  MSG_CFG_GNSS = 0x3e
+  MSG_CFG_GNSS = 0x3e,
+  MSG_MGA_INI = 0x40
 } ubx_msg_id_t;
 
 typedef struct
@@ -83,6 +85,36 @@ typedef struct
   ubx_payload_t payload;
 } __attribute__((packed)) ubx_message_t;
 
+typedef struct
+{
+  uint8_t type;               // 0x01
+  uint8_t version;
+  uint8_t reserved[2];
+  int32_t latitude;           // deg * 1e7
+  int32_t longitude;
+  int32_t altitude;           // cm above ellipsoid
+  uint32_t accuracy;          // cm
+} ubx_mga_ini_pos_llh_t;
+
+typedef struct
+{
+  uint8_t type;               // 0x10
+  uint8_t version;
+  uint8_t ref;                // 0 : on receipt of the message
+  int8_t leap_secs;           // -128 : unknown
+  uint16_t year;
+  uint8_t month;
+  uint8_t day;
+  uint8_t hour;
+  uint8_t min;
+  uint8_t sec;
+  uint8_t reserved1;
+  uint32_t nano;
+  uint16_t accuracy_sec;
+  uint8_t reserved2[2];
+  uint32_t accuracy_nano;
+} ubx_mga_ini_time_utc_t;
+
 typedef struct
 {
   char swVersion[30];      // Zero-terminated Software Version String
@@ -194,7 +226,7 @@ typedef struct
   int32_t nano;
   uint8_t fix_type;
   uint8_t fix_status;
-  uint8_t reserved1;
+  uint8_t flags2;
   uint8_t satellites;
   int32_t longitude;
   int32_t latitude;
@@ -210,11 +242,14 @@ typedef struct
   uint32_t speed_accuracy;
   uint32_t heading_accuracy;
   uint16_t position_DOP;
-  uint16_t reserved2;
-  uint16_t reserved3;
+  uint8_t flags3;
+  uint8_t reserved2[5];
+  int32_t heading_vehicle;    // protocol 15 and later from here
+  int16_t mag_dec;
+  uint16_t mag_acc;
 } ubx_nav_pvt_t;
 
-enum
+typedef enum
 {
   FIX_NONE = 0,
   FIX_DEAD_RECKONING = 1,
@@ -0,0 +1,7 @@
+#include "app_common.h"
+
+host_core_debug_t     host_core_debug;
+host_dwt_t            host_dwt;
+
+volatile uint32_t     __uptime;
+volatile uint32_t     __msec;
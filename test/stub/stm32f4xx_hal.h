@@ -0,0 +1,32 @@
+#ifndef __HOST_STM32F4XX_HAL_DEF_H__
+#define __HOST_STM32F4XX_HAL_DEF_H__
+
+//
+// host stand-in for the HAL.
+// only what the hardware independent app modules pull in through
+// app_common.h and cycle_counter.h
+//
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+typedef struct
+{
+  volatile uint32_t   DEMCR;
+} host_core_debug_t;
+
+typedef struct
+{
+  volatile uint32_t   CTRL;
+  volatile uint32_t   CYCCNT;
+} host_dwt_t;
+
+extern host_core_debug_t    host_core_debug;
+extern host_dwt_t           host_dwt;
+
+#define CoreDebug                     (&host_core_debug)
+#define DWT                           (&host_dwt)
+#define CoreDebug_DEMCR_TRCENA_Msk    (1UL << 24)
+#define DWT_CTRL_CYCCNTENA_Msk        (1UL << 0)
+
+#endif /* !__HOST_STM32F4XX_HAL_DEF_H__ */
@@ -0,0 +1,418 @@
+#include <math.h>
+#include "test_common.h"
+#include "ahrs.h"
+#include "math_helper.h"
+
+//
+// AHRS on simulated trajectories at 1KHz.
+//
+// truth is a body to earth quaternion from euler angles, NWU. gyro is the
+// body rate between two truth samples, accel is gravity plus linear accel
+// in G and mag is a fixed earth field, all rotated into body and noised.
+// mag is fused at about 75Hz like the HMC5883 path
+//
+#define SAMPLE_HZ         1000
+#define DT                (1.0 / SAMPLE_HZ)
+#define MAG_EVERY         13
+#define ALIGN_SAMPLES     100         // IMU_ALIGN_SAMPLES
+
+#define GYRO_NOISE        0.1         // dps
+#define ACCEL_NOISE       0.01        // G
+#define MAG_NOISE         0.005
+
+#define D2R               (M_PI / 180.0)
+
+typedef void (*traj_fn_t)(double t, double euler[3], double acc[3]);
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// trajectories
+//
+////////////////////////////////////////////////////////////////////////////////
+static void
+traj_still(double t, double e[3], double a[3])
+{
+  e[0] = 8 * D2R;
+  e[1] = -5 * D2R;
+  e[2] = 70 * D2R;
+  a[0] = a[1] = a[2] = 0.0;
+}
+
+//
+// 35 degree banked turn at 36 dps with a pitch wobble. centripetal accel
+// towards the inside of the turn
+//
+static void
+traj_turn(double t, double e[3], double a[3])
+{
+  const double bank = 35 * D2R * (t < 1.0 ? t : 1.0);
+
+  e[0] = bank;
+  e[1] = 5 * D2R * sin(2 * M_PI * 0.7 * t);
+  e[2] = -36 * D2R * t;
+  a[0] = tan(bank) * sin(e[2]);
+  a[1] = -tan(bank) * cos(e[2]);
+  a[2] = 0.0;
+}
+
+//
+// +-0.5G accelerate and brake with the nose following
+//
+static void
+traj_dash(double t, double e[3], double a[3])
+{
+  const double f = 0.5 * sin(2 * M_PI * 0.25 * t);
+
+  e[0] = 0.0;
+  e[1] = -atan(f);
+  e[2] = 30 * D2R;
+  a[0] = f * cos(e[2]);
+  a[1] = f * sin(e[2]);
+  a[2] = 0.0;
+}
+
+//
+// multi sine on every axis with +-0.3G horizontal accel. stands in for
+// flight logs, which the tree does not have
+//
+static void
+traj_random(double t, double e[3], double a[3])
+{
+  e[0] = 20 * D2R * sin(2 * M_PI * 0.31 * t) + 10 * D2R * sin(2 * M_PI * 1.7 * t);
+  e[1] = 15 * D2R * sin(2 * M_PI * 0.23 * t) + 8 * D2R * sin(2 * M_PI * 2.1 * t);
+  e[2] = 60 * D2R * sin(2 * M_PI * 0.05 * t) + 20 * D2R * sin(2 * M_PI * 0.9 * t);
+  a[0] = 0.2 * sin(2 * M_PI * 0.4 * t) + 0.1 * sin(2 * M_PI * 1.3 * t);
+  a[1] = 0.2 * sin(2 * M_PI * 0.35 * t) + 0.1 * sin(2 * M_PI * 1.1 * t);
+  a[2] = 0.1 * sin(2 * M_PI * 0.6 * t);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// simulation
+//
+////////////////////////////////////////////////////////////////////////////////
+typedef struct
+{
+  double      q[4];           // truth at this sample
+  float       g[3];           // dps
+  float       a[3];           // G
+  float       m[3];
+  bool        mag_fresh;
+} sim_sample_t;
+
+static const double   _mag_earth[3] = { 0.35, 0.0, -0.92 };
+
+static void
+sim_sample(traj_fn_t fn, int k, const double bias[3], sim_sample_t* s)
+{
+  double  e[3], la[3], en[3], lan[3], qn[4], qc[4], dq[4], f[3], v[3];
+
+  fn(k * DT, e, la);
+  fn((k + 1) * DT, en, lan);
+  test_euler_to_quat(e, s->q);
+  test_euler_to_quat(en, qn);
+
+  qc[0] = s->q[0];
+  qc[1] = -s->q[1];
+  qc[2] = -s->q[2];
+  qc[3] = -s->q[3];
+  test_qmul(qc, qn, dq);
+
+  f[0] = la[0];
+  f[1] = la[1];
+  f[2] = la[2] + 1.0;
+  test_earth_to_body(s->q, f, v);
+  for(int i = 0; i < 3; i++)
+  {
+    s->g[i] = 2.0 * dq[i + 1] / DT / D2R + bias[i] + GYRO_NOISE * test_noise();
+    s->a[i] = v[i] + ACCEL_NOISE * test_noise();
+  }
+
+  test_earth_to_body(s->q, _mag_earth, v);
+  for(int i = 0; i < 3; i++)
+  {
+    s->m[i] = v[i] + MAG_NOISE * test_noise();
+  }
+  s->mag_fresh = (k % MAG_EVERY) == 0;
+}
+
+//
+// boot alignment as imu_align() does it. returns samples used
+//
+static int
+sim_align(ahrs_t* ahrs, traj_fn_t fn)
+{
+  static const double   nobias[3] = { 0.0, 0.0, 0.0 };
+  float                 a[3] = { 0.0f, 0.0f, 0.0f },
+                        m[3] = { 0.0f, 0.0f, 0.0f };
+  sim_sample_t          s;
+  int                   k;
+
+  for(k = 0; k < ALIGN_SAMPLES; k++)
+  {
+    sim_sample(fn, k, nobias, &s);
+    for(int i = 0; i < 3; i++)
+    {
+      a[i] += s.a[i];
+      if(s.mag_fresh)
+      {
+        m[i] += s.m[i];
+      }
+    }
+  }
+  ahrs_seed(ahrs, a, m);
+  return k;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// boot. user-036
+//
+////////////////////////////////////////////////////////////////////////////////
+static double
+boot_time_to(ahrs_type_t type, bool seed, double limit, double secs)
+{
+  static const double   nobias[3] = { 0.0, 0.0, 0.0 };
+  ahrs_t                ahrs;
+  sim_sample_t          s;
+  float                 q[4];
+  int                   k = 0;
+
+  test_seed(1);
+  ahrs_init(&ahrs, type, SAMPLE_HZ);
+  if(seed)
+  {
+    k = sim_align(&ahrs, traj_still);
+  }
+
+  for(; k < secs * SAMPLE_HZ; k++)
+  {
+    sim_sample(traj_still, k, nobias, &s);
+    ahrs_update_imu(&ahrs, s.g, s.a);
+    if(s.mag_fresh)
+    {
+      ahrs_update_mag(&ahrs, s.m);
+    }
+
+    ahrs_get_quaternion(&ahrs, q);
+    if(test_quat_error(q, s.q) < limit)
+    {
+      return k * DT;
+    }
+  }
+  return -1.0;
+}
+
+static void
+test_boot(void)
+{
+  for(int t = 0; t < ahrs_type_max; t++)
+  {
+    double seeded   = boot_time_to(t, true, 2.0, 30.0);
+    double unseeded = boot_time_to(t, false, 2.0, 30.0);
+
+    printf("  %-14s boot to < 2 deg : %5.0f ms seeded, %6.0f ms from identity\n",
+        ahrs_type_name(t), seeded * 1000, unseeded * 1000);
+    TEST_CHECK(seeded >= 0.0 && seeded <= (ALIGN_SAMPLES + 5) * DT,
+        "%s seeded boot %.3f s", ahrs_type_name(t), seeded);
+  }
+}
+
+//
+// beta starts high for a fast pull in and decays to the flight value
+//
+static void
+test_beta_decay(void)
+{
+  static const float  g[3] = { 0.0f, 0.0f, 0.0f },
+                      a[3] = { 0.0f, 0.0f, 1.0f };
+  ahrs_t              ahrs;
+  float               beta0;
+
+  ahrs_init(&ahrs, ahrs_type_madgwick, SAMPLE_HZ);
+  beta0 = ahrs.madgwick.beta;
+
+  for(int k = 0; k < 5 * SAMPLE_HZ; k++)
+  {
+    ahrs_update_imu(&ahrs, g, a);
+  }
+  printf("  madgwick beta  : %.3f -> %.3f in 5 s\n", beta0, ahrs.madgwick.beta);
+  TEST_CHECK(beta0 > 1.0f, "boot beta %.3f", beta0);
+  TEST_CHECK(fabsf(ahrs.madgwick.beta - ahrs.madgwick.betaFinal) < 0.01f,
+      "beta %.3f after 5 s, final %.3f", ahrs.madgwick.beta, ahrs.madgwick.betaFinal);
+}
+
+//
+// accel trust. full around 1G, none when clearly accelerating
+//
+static void
+test_accel_gate(void)
+{
+  static const float  g[3] = { 0.0f, 0.0f, 0.0f };
+
+  for(int t = 0; t < ahrs_type_max; t++)
+  {
+    ahrs_t  ahrs;
+    float   a1[3]   = { 0.0f, 0.0f, 1.0f },
+            a2[3]   = { 0.0f, 0.0f, 1.5f },
+            w1, w2;
+
+    ahrs_init(&ahrs, t, SAMPLE_HZ);
+    ahrs_update_imu(&ahrs, g, a1);
+    w1 = ahrs_get_accel_weight(&ahrs);
+    ahrs_update_imu(&ahrs, g, a2);
+    w2 = ahrs_get_accel_weight(&ahrs);
+
+    TEST_CHECK(w1 == 1.0f && w2 == 0.0f, "%s accel weight %.2f at 1G, %.2f at 1.5G",
+        ahrs_type_name(t), w1, w2);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// engine comparison. user-037
+//
+////////////////////////////////////////////////////////////////////////////////
+#define RUN_SECS          60
+#define RUN_SKIP_SECS     5
+
+typedef struct
+{
+  const char*   name;
+  traj_fn_t     fn;
+  double        bias;         // dps on every gyro axis
+  double        max_rms;      // bound on rms total error. degree
+} run_def_t;
+
+//
+// every engine runs every trajectory seeded from truth. the bounds only
+// catch a regression. the turn is a known weak spot of accel based
+// tilt correction and is only checked for not running away
+//
+static const run_def_t  _runs[] =
+{
+  { "hover",      traj_still,   0.0,  1.0 },
+  { "35deg turn", traj_turn,    0.0,  90.0 },
+  { "dash",       traj_dash,    0.0,  15.0 },
+  { "random",     traj_random,  0.0,  10.0 },
+  { "hover+bias", traj_still,   0.5,  2.5 },
+};
+
+static double
+run_rms(ahrs_type_t type, const run_def_t* r)
+{
+  const double  bias[3] = { r->bias, r->bias, r->bias };
+  ahrs_t        ahrs;
+  sim_sample_t  s;
+  double        e[3], la[3], q[4], a[3], m[3];
+  float         fa[3], fm[3], qe[4];
+  double        sum = 0.0;
+  int           n = 0;
+
+  //
+  // noise free vectors at t = 0 give the truth attitude
+  //
+  r->fn(0.0, e, la);
+  test_euler_to_quat(e, q);
+  la[2] += 1.0;
+  test_earth_to_body(q, la, a);
+  test_earth_to_body(q, _mag_earth, m);
+  for(int i = 0; i < 3; i++)
+  {
+    fa[i] = a[i];
+    fm[i] = m[i];
+  }
+
+  test_seed(1);
+  ahrs_init(&ahrs, type, SAMPLE_HZ);
+  ahrs_seed(&ahrs, fa, fm);
+
+  for(int k = 0; k < RUN_SECS * SAMPLE_HZ; k++)
+  {
+    sim_sample(r->fn, k, bias, &s);
+    ahrs_update_imu(&ahrs, s.g, s.a);
+    if(s.mag_fresh)
+    {
+      ahrs_update_mag(&ahrs, s.m);
+    }
+
+    if(k >= RUN_SKIP_SECS * SAMPLE_HZ)
+    {
+      double err;
+
+      ahrs_get_quaternion(&ahrs, qe);
+      err = test_quat_error(qe, s.q);
+      sum += err * err;
+      n++;
+    }
+  }
+  return sqrt(sum / n);
+}
+
+static void
+test_engines(void)
+{
+  printf("  rms total attitude error, degree. %d s runs, first %d s skipped\n", RUN_SECS, RUN_SKIP_SECS);
+  printf("  %-14s", "engine");
+  for(int r = 0; r < NARRAY(_runs); r++)
+  {
+    printf(" %11s", _runs[r].name);
+  }
+  printf("\n");
+
+  for(int t = 0; t < ahrs_type_max; t++)
+  {
+    double rms[NARRAY(_runs)];
+
+    printf("  %-14s", ahrs_type_name(t));
+    for(int r = 0; r < NARRAY(_runs); r++)
+    {
+      rms[r] = run_rms(t, &_runs[r]);
+      printf(" %11.2f", rms[r]);
+    }
+    printf("\n");
+
+    for(int r = 0; r < NARRAY(_runs); r++)
+    {
+      TEST_CHECK(isfinite(rms[r]) && rms[r] < _runs[r].max_rms, "%s %s rms %.2f over %.2f",
+          ahrs_type_name(t), _runs[r].name, rms[r], _runs[r].max_rms);
+    }
+  }
+}
+
+static void
+bench(void)
+{
+  static const double   nobias[3] = { 0.0, 0.0, 0.0 };
+  static sim_sample_t   s[1024];
+  ahrs_t                ahrs;
+
+  test_seed(1);
+  for(int k = 0; k < NARRAY(s); k++)
+  {
+    sim_sample(traj_random, k, nobias, &s[k]);
+  }
+
+  for(int t = 0; t < ahrs_type_max; t++)
+  {
+    char name[40];
+
+    ahrs_init(&ahrs, t, SAMPLE_HZ);
+    snprintf(name, sizeof(name), "ahrs_update_imu %s", ahrs_type_name(t));
+    TEST_BENCH(name, 2000000, ahrs_update_imu(&ahrs, s[__i & 1023].g, s[__i & 1023].a));
+  }
+
+  TEST_BENCH("ahrs_update_mag", 2000000, ahrs_update_mag(&ahrs, s[__i & 1023].m));
+}
+
+int
+main(void)
+{
+  test_boot();
+  test_beta_decay();
+  test_accel_gate();
+  test_engines();
+  bench();
+
+  return test_done("ahrs");
+}
@@ -0,0 +1,231 @@
+#include <math.h>
+#include "test_common.h"
+#include "alt_est.h"
+
+//
+// vertical estimator on synthetic climb profiles at 1KHz.
+//
+// vehicle tilted 5 degree, 0.02G accel bias, 0.05G accel noise.
+// baro at 50Hz with 0.3m noise, averaged over the 9ms pressure
+// conversion and reported 15ms after the middle of it, fed the way
+// altitude.c does.
+//
+// checks altitude and climb rate error once the bias has settled, the
+// accel offset estimate, and that delay compensation helps on a sine
+//
+#define SAMPLE_HZ         1000
+#define DT                (1.0f / SAMPLE_HZ)
+#define RUN_MSEC          40000
+#define SCORE_MSEC        15000       // errors are taken after this
+
+#define TAU               2.0f        // altitude.c
+#define BARO_EVERY        20
+#define BARO_CONVERT      9
+#define BARO_DELAY        15
+#define BARO_NOISE        0.3f
+#define ACCEL_NOISE       0.05f
+#define ACCEL_BIAS_Z      0.02f       // G
+#define ACCEL_BIAS_X      0.03f       // G
+
+#define G                 9.80665f
+
+typedef enum
+{
+  profile_hover,
+  profile_climb,
+  profile_sine,
+  profile_max,
+} profile_t;
+
+static const char*  _profile_name[profile_max] =
+{
+  "hover",
+  "2m/s climb",
+  "3m 0.3Hz sine",
+};
+
+//
+// climb profile accelerates at 2m/s^2 for a second at 20s, climbs 9s at
+// 2m/s and stops the same way at 20m
+//
+static void
+truth(profile_t p, double t, double* h, double* v, double* a)
+{
+  const double  w = 2.0 * M_PI * 0.3;
+
+  *h = *v = *a = 0.0;
+
+  switch(p)
+  {
+  case profile_hover:
+    break;
+
+  case profile_climb:
+    if(t >= 31.0)
+    {
+      *h = 20.0;
+    }
+    else if(t >= 30.0)
+    {
+      *a = -2.0;
+      *v = 2.0 - 2.0 * (t - 30.0);
+      *h = 19.0 + 2.0 * (t - 30.0) - (t - 30.0) * (t - 30.0);
+    }
+    else if(t >= 21.0)
+    {
+      *v = 2.0;
+      *h = 1.0 + 2.0 * (t - 21.0);
+    }
+    else if(t >= 20.0)
+    {
+      *a = 2.0;
+      *v = 2.0 * (t - 20.0);
+      *h = (t - 20.0) * (t - 20.0);
+    }
+    break;
+
+  default:
+    *h = 3.0 * sin(w * t);
+    *v = 3.0 * w * cos(w * t);
+    *a = -3.0 * w * w * sin(w * t);
+    break;
+  }
+}
+
+typedef struct
+{
+  double    alt;          // rms, m
+  double    vel;          // rms, m/s
+  double    baro_vel;     // rms of differentiated raw baro, m/s
+  float     acc_bias;     // m/s^2
+} result_t;
+
+static void
+run(profile_t p, bool delay_comp, result_t* r)
+{
+  static const float  q[4] = { 0.99905f, 0.04362f, 0.0f, 0.0f };   // 5 deg roll
+  alt_est_t           est;
+  double              h, v, a,
+                      sa = 0.0, sv = 0.0, sb = 0.0,
+                      pacc = 0.0, prev = 0.0;
+  int                 n = 0, nb = 0, pcnt = 0;
+  float               r20, r21, r22;
+
+  // third row of body to earth
+  r20 = 2.0f * (q[1] * q[3] - q[0] * q[2]);
+  r21 = 2.0f * (q[2] * q[3] + q[0] * q[1]);
+  r22 = 1.0f - 2.0f * (q[1] * q[1] + q[2] * q[2]);
+
+  test_seed(1);
+  alt_est_init(&est, TAU, 0.0f);
+  truth(p, 0.0, &h, &v, &a);
+  est.vel = v;
+
+  for(int ms = 0; ms < RUN_MSEC; ms++)
+  {
+    double  t = ms / 1000.0;
+    float   f, accel[3];
+
+    truth(p, t, &h, &v, &a);
+
+    //
+    // specific force is straight up in earth frame, seen through the tilt
+    //
+    f = 1.0f + (float)a / G;
+    accel[0] = r20 * f + ACCEL_BIAS_X + ACCEL_NOISE * test_noise();
+    accel[1] = r21 * f + ACCEL_NOISE * test_noise();
+    accel[2] = r22 * f + ACCEL_BIAS_Z + ACCEL_NOISE * test_noise();
+
+    alt_est_predict(&est, q, accel, DT);
+
+    if(ms % BARO_EVERY < BARO_CONVERT)
+    {
+      pacc += h;
+      pcnt++;
+    }
+    if(ms % BARO_EVERY == BARO_EVERY - 1)
+    {
+      float   b = pacc / pcnt + BARO_NOISE * test_noise();
+      double  e = (b - prev) * 1000.0 / BARO_EVERY - v;
+
+      alt_est_correct(&est, b, delay_comp ? BARO_DELAY : 0, BARO_EVERY / 1000.0f);
+      if(ms > SCORE_MSEC)
+      {
+        sb += e * e;
+        nb++;
+      }
+      prev = b;
+      pacc = 0.0;
+      pcnt = 0;
+    }
+
+    if(ms > SCORE_MSEC)
+    {
+      sa += (est.alt - h) * (est.alt - h);
+      sv += (est.vel - v) * (est.vel - v);
+      n++;
+    }
+  }
+
+  r->alt      = sqrt(sa / n);
+  r->vel      = sqrt(sv / n);
+  r->baro_vel = sqrt(sb / nb);
+  r->acc_bias = est.acc_bias;
+}
+
+static void
+test_profiles(void)
+{
+  //
+  // what the accel offset should settle at: the z bias seen through the
+  // tilt. x is level with a pure roll
+  //
+  const float bias = (1.0f - 2.0f * 0.04362f * 0.04362f) * ACCEL_BIAS_Z * G;
+
+  for(profile_t p = 0; p < profile_max; p++)
+  {
+    result_t  on, off;
+
+    run(p, true, &on);
+    run(p, false, &off);
+
+    printf("  %-14s : alt %.3f m, climb %.3f m/s, offset %.3f m/s^2"
+           " (no delay comp %.3f m / %.3f m/s, raw baro climb %.1f m/s)\n",
+        _profile_name[p], on.alt, on.vel, on.acc_bias, off.alt, off.vel, on.baro_vel);
+
+    TEST_CHECK(on.alt < 0.08, "%s alt rms %.3f", _profile_name[p], on.alt);
+    TEST_CHECK(on.vel < 0.05, "%s climb rms %.3f", _profile_name[p], on.vel);
+    TEST_CHECK(fabsf(on.acc_bias - bias) < 0.02f, "%s offset %.3f, want %.3f",
+        _profile_name[p], on.acc_bias, bias);
+    TEST_CHECK(on.vel < on.baro_vel / 100.0, "%s climb %.3f vs raw baro %.2f",
+        _profile_name[p], on.vel, on.baro_vel);
+
+    if(p == profile_sine)
+    {
+      TEST_CHECK(on.alt < off.alt && on.vel < off.vel,
+          "delay comp %.3f / %.3f, without %.3f / %.3f", on.alt, on.vel, off.alt, off.vel);
+    }
+  }
+}
+
+static void
+bench(void)
+{
+  static const float  q[4] = { 0.99905f, 0.04362f, 0.0f, 0.0f },
+                      accel[3] = { 0.01f, 0.08f, 1.0f };
+  alt_est_t           est;
+
+  alt_est_init(&est, TAU, 0.0f);
+
+  TEST_BENCH("alt_est_predict", 10000000, alt_est_predict(&est, q, accel, DT));
+  TEST_BENCH("alt_est_correct", 1000000, alt_est_correct(&est, 0.0f, BARO_DELAY, 0.02f));
+}
+
+int
+main(void)
+{
+  test_profiles();
+  bench();
+
+  return test_done("alt_est");
+}
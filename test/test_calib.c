@@ -0,0 +1,320 @@
+#include <math.h>
+#include "test_common.h"
+#include "calib_stat.h"
+#include "sensor_calib.h"
+
+//
+// still calibration on noisy synthetic sensor data.
+//
+// noise goes through a one pole low pass near 188Hz at 1KHz like the
+// MPU6000 DLPF, so samples are correlated the way they are on the board.
+//
+// checks that gyro and accel sampling stop on confidence with a mean
+// inside the tolerance, that shaking is caught, and that six accel faces
+// through the AN4246 solve give back the offset and gain they were made
+// with
+//
+#define TRIALS                200
+#define SAMPLE_HZ             1000
+#define ONE_G                 4096      // ACCELGYRO_1G_VALUE
+
+//
+// mirrors accelgyro.c
+//
+#define GYRO_CAL_TOL          0.25f
+#define GYRO_CAL_MAX_STD      8.0f
+#define GYRO_CAL_MAX_DEV      50.0f
+#define ACCEL_CAL_TOL         1.0f
+#define ACCEL_CAL_MAX_STD     40.0f
+#define ACCEL_CAL_MAX_DEV     200.0f
+#define CAL_MIN_COUNT         1000
+#define CAL_MAX_COUNT         20000
+
+#define SHAKE_AT              600
+#define SHAKE_LEN             200
+#define SHAKE_AMP             300.0f
+
+typedef struct
+{
+  float     sigma;      // LSB after the low pass
+  float     lp[3];
+} sensor_t;
+
+//
+// 1.6 restores the spread the low pass takes out
+//
+static void
+sensor_sample(sensor_t* s, const float truth[3], int k, bool shake, int16_t raw[3])
+{
+  for(int i = 0; i < 3; i++)
+  {
+    float m = 0.0f;
+
+    s->lp[i] += 0.7f * (s->sigma * 1.6f * test_noise() - s->lp[i]);
+    if(shake && k > SHAKE_AT && k < SHAKE_AT + SHAKE_LEN)
+    {
+      m = SHAKE_AMP * sinf(k * 0.03f);
+    }
+    raw[i] = lrintf(truth[i] + s->lp[i] + m);
+  }
+}
+
+typedef struct
+{
+  double    stop_ms;        // average over trials that finished
+  double    err;            // rms of mean error, LSB
+  double    err_fixed;      // rms error of a plain 20000 sample mean
+  double    inside;         // fraction of axes with the error within tol
+  int       motion;         // trials ending in motion
+} stat_run_t;
+
+static void
+stat_run(float tol, float max_std, float max_dev, float sigma, const float truth[3],
+    bool shake, stat_run_t* r)
+{
+  double  e2 = 0.0, e2f = 0.0, ms = 0.0;
+  int     done = 0, inside = 0;
+
+  r->motion = 0;
+
+  for(int t = 0; t < TRIALS; t++)
+  {
+    calib_stat_t          c;
+    sensor_t              s = { .sigma = sigma };
+    calib_stat_result_t   res = calib_stat_running;
+    double                sum[3] = { 0.0, 0.0, 0.0 };
+
+    calib_stat_init(&c, tol, max_std, max_dev, CAL_MIN_COUNT, CAL_MAX_COUNT);
+
+    for(int k = 0; k < CAL_MAX_COUNT; k++)
+    {
+      int16_t raw[3];
+
+      sensor_sample(&s, truth, k, shake, raw);
+      for(int i = 0; i < 3; i++)
+      {
+        sum[i] += raw[i];
+      }
+
+      if(res != calib_stat_running)
+      {
+        continue;
+      }
+
+      res = calib_stat_push(&c, raw);
+      if(res == calib_stat_done)
+      {
+        ms += (k + 1) * 1000.0 / SAMPLE_HZ;
+        done++;
+        for(int i = 0; i < 3; i++)
+        {
+          e2 += (c.w.mean[i] - truth[i]) * (c.w.mean[i] - truth[i]);
+          inside += fabsf(c.w.mean[i] - truth[i]) <= tol;
+        }
+      }
+      else if(res == calib_stat_motion)
+      {
+        r->motion++;
+      }
+    }
+
+    for(int i = 0; i < 3; i++)
+    {
+      double e = sum[i] / CAL_MAX_COUNT - truth[i];
+
+      e2f += e * e;
+    }
+  }
+
+  r->stop_ms    = done ? ms / done : 0.0;
+  r->err        = done ? sqrt(e2 / (3 * done)) : 0.0;
+  r->err_fixed  = sqrt(e2f / (3 * TRIALS));
+  r->inside     = done ? inside / (3.0 * done) : 0.0;
+}
+
+static void
+still_case(const char* name, float tol, float max_std, float max_dev, float sigma,
+    const float truth[3])
+{
+  stat_run_t  r;
+
+  stat_run(tol, max_std, max_dev, sigma, truth, false, &r);
+  printf("  %-14s : stop %.0f ms, error %.3f LSB rms, %.1f%% within tol"
+         " (fixed 20000: %.3f), motion %d/%d\n",
+      name, r.stop_ms, r.err, r.inside * 100.0, r.err_fixed, r.motion, TRIALS);
+
+  //
+  // 95% confidence. 600 axes give about a percent of slack
+  //
+  TEST_CHECK(r.motion == 0, "%s false motion %d", name, r.motion);
+  TEST_CHECK(r.stop_ms < 3000.0, "%s stop %.0f ms", name, r.stop_ms);
+  TEST_CHECK(r.inside > 0.93, "%s %.1f%% within tol", name, r.inside * 100.0);
+
+  stat_run(tol, max_std, max_dev, sigma, truth, true, &r);
+  printf("  %-14s : motion %d/%d when shaken\n", name, r.motion, TRIALS);
+  TEST_CHECK(r.motion == TRIALS, "%s shake caught %d/%d", name, r.motion, TRIALS);
+}
+
+static void
+test_still(void)
+{
+  static const float  gyro[3]  = { 23.4f, -11.7f, 5.2f },
+                      accel[3] = { 12.3f, -40.6f, ONE_G + 25.1f };
+
+  test_seed(7);
+
+  still_case("gyro 1.5 LSB", GYRO_CAL_TOL, GYRO_CAL_MAX_STD, GYRO_CAL_MAX_DEV, 1.5f, gyro);
+  still_case("gyro 3 LSB", GYRO_CAL_TOL, GYRO_CAL_MAX_STD, GYRO_CAL_MAX_DEV, 3.0f, gyro);
+  still_case("accel 12 LSB", ACCEL_CAL_TOL, ACCEL_CAL_MAX_STD, ACCEL_CAL_MAX_DEV, 12.0f, accel);
+}
+
+//
+// a large constant with small noise is where float sums lose digits
+//
+static void
+test_precision(void)
+{
+  welford3_t  w;
+  float       fsum = 0.0f;
+  double      dsum = 0.0;
+  sensor_t    s = { .sigma = 12.0f };
+  const float truth[3] = { 0.0f, 0.0f, 8000.0f };
+
+  welford3_reset(&w);
+  for(int k = 0; k < CAL_MAX_COUNT; k++)
+  {
+    int16_t raw[3];
+    float   x[3];
+
+    sensor_sample(&s, truth, k, false, raw);
+    for(int i = 0; i < 3; i++)
+    {
+      x[i] = raw[i];
+    }
+    welford3_push(&w, x);
+    fsum += x[2];
+    dsum += x[2];
+  }
+
+  printf("  8000 LSB mean  : welford off by %.4f LSB, float sum %.4f LSB\n",
+      fabs(w.mean[2] - dsum / CAL_MAX_COUNT), fabs(fsum / CAL_MAX_COUNT - dsum / CAL_MAX_COUNT));
+  TEST_CHECK(fabs(w.mean[2] - dsum / CAL_MAX_COUNT) < 0.05, "welford mean off by %.4f",
+      fabs(w.mean[2] - dsum / CAL_MAX_COUNT));
+}
+
+//
+// six faces, each a little off axis, then the same solve as
+// accgyro_accel_cal_finish
+//
+static void
+test_six_face(void)
+{
+  static const float  offset[3] = { 61.0f, -87.0f, 122.0f },
+                      sens[3]   = { ONE_G * 1.02f, ONE_G * 0.98f, ONE_G * 1.01f };
+  int32_t             face[6][3];
+  sensor_calib_t      cal;
+  float               tmp[3];
+  int32_t             off[3], gain[3];
+  double              off_err = 0.0, gain_err = 0.0;
+
+  test_seed(11);
+
+  for(int f = 0; f < 6; f++)
+  {
+    calib_stat_t          c;
+    sensor_t              s = { .sigma = 12.0f };
+    calib_stat_result_t   res = calib_stat_running;
+    float                 g[3] = { 0.0f, 0.0f, 0.0f },
+                          truth[3];
+    int                   axis = f / 2;
+
+    //
+    // about a degree off the face
+    //
+    g[axis]             = (f & 1) ? -1.0f : 1.0f;
+    g[(axis + 1) % 3]   = 0.017f * test_noise();
+    g[(axis + 2) % 3]   = 0.017f * test_noise();
+
+    for(int i = 0; i < 3; i++)
+    {
+      truth[i] = offset[i] + g[i] * sens[i];
+    }
+
+    calib_stat_init(&c, ACCEL_CAL_TOL, ACCEL_CAL_MAX_STD, ACCEL_CAL_MAX_DEV,
+        CAL_MIN_COUNT, CAL_MAX_COUNT);
+    for(int k = 0; res == calib_stat_running; k++)
+    {
+      int16_t raw[3];
+
+      sensor_sample(&s, truth, k, false, raw);
+      res = calib_stat_push(&c, raw);
+    }
+    TEST_CHECK(res == calib_stat_done, "face %d ended in motion", f);
+
+    for(int i = 0; i < 3; i++)
+    {
+      face[f][i] = lrintf(c.w.mean[i]);
+    }
+  }
+
+  sensorCalibrationResetState(&cal);
+  for(int f = 0; f < 6; f++)
+  {
+    sensorCalibrationPushSampleForOffsetCalculation(&cal, face[f]);
+  }
+  sensorCalibrationSolveForOffset(&cal, tmp);
+  for(int i = 0; i < 3; i++)
+  {
+    off[i] = lrintf(tmp[i]);
+  }
+
+  sensorCalibrationResetState(&cal);
+  for(int f = 0; f < 6; f++)
+  {
+    int32_t v[3];
+
+    for(int i = 0; i < 3; i++)
+    {
+      v[i] = face[f][i] - off[i];
+    }
+    sensorCalibrationPushSampleForScaleCalculation(&cal, f / 2, v, ONE_G);
+  }
+  sensorCalibrationSolveForScale(&cal, tmp);
+
+  //
+  // gain maps the axis sensitivity back to ONE_G
+  //
+  for(int i = 0; i < 3; i++)
+  {
+    gain[i]   = lrintf(tmp[i] * ONE_G);
+    off_err   = fmax(off_err, fabs(off[i] - offset[i]));
+    gain_err  = fmax(gain_err, fabs(gain[i] / (double)ONE_G * sens[i] / ONE_G - 1.0));
+  }
+
+  printf("  six face       : offset %ld %ld %ld (off by %.0f LSB), gain %ld %ld %ld (%.3f%% off)\n",
+      (long)off[0], (long)off[1], (long)off[2], off_err,
+      (long)gain[0], (long)gain[1], (long)gain[2], gain_err * 100.0);
+  TEST_CHECK(off_err <= 2.0, "offset off by %.0f LSB", off_err);
+  TEST_CHECK(gain_err < 0.001, "gain off by %.3f%%", gain_err * 100.0);
+}
+
+static void
+bench(void)
+{
+  static const int16_t  raw[3] = { 23, -12, 5 };
+  calib_stat_t          c;
+
+  calib_stat_init(&c, 0.0f, 1e9f, 1e9f, 0xffffffff, 0xffffffff);
+  TEST_BENCH("calib_stat_push", 10000000, calib_stat_push(&c, raw));
+}
+
+int
+main(void)
+{
+  test_still();
+  test_precision();
+  test_six_face();
+  bench();
+
+  return test_done("calib");
+}
@@ -0,0 +1,174 @@
+#ifndef __TEST_COMMON_DEF_H__
+#define __TEST_COMMON_DEF_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include "app_common.h"
+
+//
+// minimal host test support.
+//
+// TEST_CHECK() reports and counts a failure but keeps going so one run
+// shows every broken case. test_done() turns the count into the exit code.
+//
+// TEST_BENCH() times a statement in host nanoseconds and host cycles.
+// these only compare one build against another on the same machine.
+// cycles on the F405 come from the shell bench commands
+//
+static int    _test_failures;
+
+#define TEST_CHECK(cond, ...)                                                 \
+{                                                                             \
+  if(!(cond))                                                                 \
+  {                                                                           \
+    printf("FAIL %s:%d: ", __FILE__, __LINE__);                               \
+    printf(__VA_ARGS__);                                                      \
+    printf("\n");                                                             \
+    _test_failures++;                                                         \
+  }                                                                           \
+}
+
+static inline double
+test_nsec(void)
+{
+  struct timespec   ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static inline uint64_t
+test_cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return __builtin_ia32_rdtsc();
+#else
+  return (uint64_t)test_nsec();
+#endif
+}
+
+#define TEST_BENCH(name, n, stmt)                                             \
+{                                                                             \
+  uint64_t  __c0 = test_cycles();                                             \
+  double    __t0 = test_nsec();                                               \
+  for(long __i = 0; __i < (n); __i++)                                         \
+  {                                                                           \
+    stmt;                                                                     \
+  }                                                                           \
+  printf("  %-28s : %8.1f ns, %8.0f host cycles per call\n", name,           \
+      (test_nsec() - __t0) / (n), (double)(test_cycles() - __c0) / (n));      \
+}
+
+//
+// the same LCG everywhere so a seed gives the same run on every host.
+// test_noise() is unit gaussian by Box-Muller, test_uniform() is -1 .. 1
+//
+static uint32_t   _test_seed;
+
+static inline void
+test_seed(uint32_t seed)
+{
+  _test_seed = seed;
+}
+
+static inline uint32_t
+test_rand(void)
+{
+  _test_seed = _test_seed * 1664525u + 1013904223u;
+  return _test_seed >> 8;
+}
+
+static inline float
+test_uniform(void)
+{
+  return (float)test_rand() / (1 << 24) * 2.0f - 1.0f;
+}
+
+static inline double
+test_noise(void)
+{
+  double u, v;
+
+  u = (test_rand() + 1.0) / (double)(1 << 24);
+  v = test_rand() / (double)(1 << 24);
+
+  return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+}
+
+//
+// double precision truth for attitude tests. q is w x y z, earth to body
+// is the transpose of the rotation q describes
+//
+static inline void
+test_qmul(const double a[4], const double b[4], double r[4])
+{
+  r[0] = a[0] * b[0] - a[1] * b[1] - a[2] * b[2] - a[3] * b[3];
+  r[1] = a[0] * b[1] + a[1] * b[0] + a[2] * b[3] - a[3] * b[2];
+  r[2] = a[0] * b[2] - a[1] * b[3] + a[2] * b[0] + a[3] * b[1];
+  r[3] = a[0] * b[3] + a[1] * b[2] - a[2] * b[1] + a[3] * b[0];
+}
+
+//
+// q = qz(yaw) qy(pitch) qx(roll), e in radian
+//
+static inline void
+test_euler_to_quat(const double e[3], double q[4])
+{
+  const double  qz[4] = { cos(e[2] / 2), 0, 0, sin(e[2] / 2) },
+                qy[4] = { cos(e[1] / 2), 0, sin(e[1] / 2), 0 },
+                qx[4] = { cos(e[0] / 2), sin(e[0] / 2), 0, 0 };
+  double        t[4];
+
+  test_qmul(qz, qy, t);
+  test_qmul(t, qx, q);
+}
+
+static inline void
+test_rotation(const double q[4], double r[3][3])
+{
+  const double  q0 = q[0], q1 = q[1], q2 = q[2], q3 = q[3];
+
+  r[0][0] = 1 - 2 * (q2 * q2 + q3 * q3);
+  r[0][1] = 2 * (q1 * q2 - q0 * q3);
+  r[0][2] = 2 * (q1 * q3 + q0 * q2);
+  r[1][0] = 2 * (q1 * q2 + q0 * q3);
+  r[1][1] = 1 - 2 * (q1 * q1 + q3 * q3);
+  r[1][2] = 2 * (q2 * q3 - q0 * q1);
+  r[2][0] = 2 * (q1 * q3 - q0 * q2);
+  r[2][1] = 2 * (q2 * q3 + q0 * q1);
+  r[2][2] = 1 - 2 * (q1 * q1 + q2 * q2);
+}
+
+static inline void
+test_earth_to_body(const double q[4], const double v[3], double o[3])
+{
+  double  r[3][3];
+
+  test_rotation(q, r);
+  for(int i = 0; i < 3; i++)
+  {
+    o[i] = r[0][i] * v[0] + r[1][i] * v[1] + r[2][i] * v[2];
+  }
+}
+
+//
+// total attitude error in degree
+//
+static inline double
+test_quat_error(const float e[4], const double t[4])
+{
+  double d = fabs(e[0] * t[0] + e[1] * t[1] + e[2] * t[2] + e[3] * t[3]);
+
+  return 2.0 * acos(d > 1.0 ? 1.0 : d) * 180.0 / M_PI;
+}
+
+static inline int
+test_done(const char* name)
+{
+  printf("%s: %s\n", name, _test_failures ? "FAILED" : "ok");
+  return _test_failures ? 1 : 0;
+}
+
+#endif /* !__TEST_COMMON_DEF_H__ */
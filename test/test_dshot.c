@@ -0,0 +1,142 @@
+#include "test_common.h"
+#include "dshot.h"
+
+//
+// DShot frame, CRC and pulse encoding from dshot.h.
+// the timer/DMA side in dshot.c needs the board
+//
+static uint16_t
+reference_frame(uint16_t value, int telemetry)
+{
+  uint16_t  packet = (value << 1) | telemetry;
+  uint16_t  crc = 0;
+
+  for(int n = 0; n < 3; n++)
+  {
+    crc ^= (packet >> (4 * n)) & 0x0f;
+  }
+  return (packet << 4) | crc;
+}
+
+static void
+test_frames(void)
+{
+  int   bad = 0;
+
+  //
+  // golden frames
+  //
+  TEST_CHECK(dshot_encode_frame(0, false) == 0x0000, "stop %04x", dshot_encode_frame(0, false));
+  TEST_CHECK(dshot_encode_frame(48, false) == 0x0606, "48 %04x", dshot_encode_frame(48, false));
+  TEST_CHECK(dshot_encode_frame(1046, false) == 0x82c6, "1046 %04x", dshot_encode_frame(1046, false));
+  TEST_CHECK(dshot_encode_frame(2047, false) == 0xffee, "2047 %04x", dshot_encode_frame(2047, false));
+  TEST_CHECK(dshot_encode_frame(2047, true) == 0xffff, "2047 telemetry %04x", dshot_encode_frame(2047, true));
+
+  //
+  // every value against the nibble by nibble reference
+  //
+  for(uint16_t v = 0; v <= DSHOT_THROTTLE_MAX; v++)
+  {
+    for(int t = 0; t < 2; t++)
+    {
+      uint16_t f = dshot_encode_frame(v, t);
+
+      if(f != reference_frame(v, t) || (f >> 5) != v || ((f >> 4) & 1) != t)
+      {
+        bad++;
+      }
+    }
+  }
+  TEST_CHECK(bad == 0, "%d frames differ from reference", bad);
+}
+
+static void
+test_pulses(void)
+{
+  uint32_t  buf[DSHOT_FRAME_SLOTS * 4];
+  int       bad = 0;
+
+  //
+  // four interleaved channels like one timer burst. channel 1 gets a frame,
+  // the others must not be touched
+  //
+  for(int i = 0; i < NARRAY(buf); i++)
+  {
+    buf[i] = 0xdeadbeef;
+  }
+  dshot_frame_to_pulses(0x8001, &buf[1], 4, 52, 105);
+
+  for(int i = 0; i < DSHOT_FRAME_SLOTS; i++)
+  {
+    uint32_t expect;
+
+    if(i >= DSHOT_FRAME_BITS)
+    {
+      expect = 0;
+    }
+    else
+    {
+      expect = (i == 0 || i == DSHOT_FRAME_BITS - 1) ? 105 : 52;
+    }
+
+    if(buf[i * 4 + 1] != expect)
+    {
+      bad++;
+    }
+    if(buf[i * 4] != 0xdeadbeef || buf[i * 4 + 2] != 0xdeadbeef || buf[i * 4 + 3] != 0xdeadbeef)
+    {
+      bad++;
+    }
+  }
+  TEST_CHECK(bad == 0, "%d bad pulse slots", bad);
+}
+
+static void
+test_throttle(void)
+{
+  uint16_t  prev = 0;
+  int       bad = 0;
+
+  TEST_CHECK(dshot_throttle_from_pulse(900) == DSHOT_THROTTLE_STOP, "below min");
+  TEST_CHECK(dshot_throttle_from_pulse(DSHOT_PULSE_MIN) == DSHOT_THROTTLE_STOP, "at min");
+  TEST_CHECK(dshot_throttle_from_pulse(DSHOT_PULSE_MIN + 1) >= DSHOT_THROTTLE_MIN, "min + 1 is a command");
+  TEST_CHECK(dshot_throttle_from_pulse(DSHOT_PULSE_MAX) == DSHOT_THROTTLE_MAX, "at max");
+  TEST_CHECK(dshot_throttle_from_pulse(2100) == DSHOT_THROTTLE_MAX, "above max");
+
+  //
+  // never a command value (1-47) and monotonic over the range
+  //
+  for(uint16_t p = DSHOT_PULSE_MIN + 1; p <= DSHOT_PULSE_MAX; p++)
+  {
+    uint16_t t = dshot_throttle_from_pulse(p);
+
+    if(t < DSHOT_THROTTLE_MIN || t < prev)
+    {
+      bad++;
+    }
+    prev = t;
+  }
+  TEST_CHECK(bad == 0, "%d pulses map badly", bad);
+}
+
+static void
+bench(void)
+{
+  static uint32_t   buf[DSHOT_FRAME_SLOTS * 4];
+
+  TEST_BENCH("4 channel frame + pulses", 10000000,
+      for(int c = 0; c < 4; c++)
+        dshot_frame_to_pulses(dshot_encode_frame(dshot_throttle_from_pulse(1000 + (__i & 1023)), false),
+            &buf[c], 4, 52, 105));
+}
+
+int
+main(void)
+{
+  test_frames();
+  test_pulses();
+  test_throttle();
+  bench();
+
+  return test_done("dshot");
+}
@@ -0,0 +1,228 @@
+#include <math.h>
+#include "test_common.h"
+#include "dyn_notch.h"
+#include "math_helper.h"
+
+//
+// dynamic notch tone tracking at 1KHz gyro.
+// synthetic motor tones in white noise. checks that a notch lands on
+// every tone, follows a sweep and takes the tone out of the output
+//
+#define SAMPLE_HZ         1000.0f
+#define BIN_HZ            (SAMPLE_HZ / DYN_NOTCH_DECIMATION / DYN_NOTCH_FFT_SIZE)
+
+static float
+nearest_center(int axis, float hz)
+{
+  float best = 1e9f;
+
+  for(int p = 0; p < DYN_NOTCH_MAX_PEAKS; p++)
+  {
+    if(fabsf(dyn_notch_center[axis][p] - hz) < fabsf(best - hz))
+    {
+      best = dyn_notch_center[axis][p];
+    }
+  }
+  return best;
+}
+
+static void
+run(int n, float (*tone)(int axis, int i), double rms_in[3], double rms_out[3])
+{
+  for(int a = 0; a < 3; a++)
+  {
+    rms_in[a] = rms_out[a] = 0.0;
+  }
+
+  for(int i = 0; i < n; i++)
+  {
+    float   v[3],
+            t[3];
+
+    for(int a = 0; a < 3; a++)
+    {
+      t[a] = tone(a, i);
+      v[a] = t[a] + 0.5f * test_uniform();
+    }
+
+    dyn_notch_push(v);
+    dyn_notch_update();
+    dyn_notch_apply(v);
+
+    //
+    // tone left in the output. noise passes mostly untouched
+    //
+    if(i >= n / 2)
+    {
+      for(int a = 0; a < 3; a++)
+      {
+        rms_in[a]  += t[a] * t[a];
+        rms_out[a] += v[a] * v[a];
+      }
+    }
+  }
+
+  for(int a = 0; a < 3; a++)
+  {
+    rms_in[a]  = sqrt(rms_in[a]  / (n - n / 2));
+    rms_out[a] = sqrt(rms_out[a] / (n - n / 2));
+  }
+}
+
+static float
+tone_fixed(int axis, int i)
+{
+  float t = i / SAMPLE_HZ;
+
+  switch(axis)
+  {
+  case 0:   return 10.0f * sinf(2.0f * M_PIf * 150.0f * t);
+  case 1:   return 8.0f * sinf(2.0f * M_PIf * 180.0f * t) + 4.0f * sinf(2.0f * M_PIf * 95.0f * t);
+  default:  return 0.0f;
+  }
+}
+
+static void
+test_fixed_tones(void)
+{
+  double  in[3], out[3];
+  float   c;
+
+  dyn_notch_init(SAMPLE_HZ);
+  dyn_notch_config(3, 60, 230, 3.5f);
+
+  run(8000, tone_fixed, in, out);
+
+  c = nearest_center(0, 150.0f);
+  printf("  x 150 Hz          : center %.1f, rms %.2f -> %.2f\n", c, in[0], out[0]);
+  TEST_CHECK(fabsf(c - 150.0f) < BIN_HZ / 2, "x center %.1f for 150 Hz", c);
+  TEST_CHECK(out[0] < 0.1 * in[0] + 0.5, "x tone rms %.2f -> %.2f", in[0], out[0]);
+
+  c = nearest_center(1, 180.0f);
+  printf("  y 180 Hz          : center %.1f\n", c);
+  TEST_CHECK(fabsf(c - 180.0f) < BIN_HZ / 2, "y center %.1f for 180 Hz", c);
+
+  c = nearest_center(1, 95.0f);
+  printf("  y  95 Hz          : center %.1f, rms %.2f -> %.2f\n", c, in[1], out[1]);
+  TEST_CHECK(fabsf(c - 95.0f) < BIN_HZ / 2, "y center %.1f for 95 Hz", c);
+  TEST_CHECK(out[1] < 0.1 * in[1] + 0.5, "y tone rms %.2f -> %.2f", in[1], out[1]);
+
+  printf("  updates           : %lu\n", (unsigned long)dyn_notch_stat.update_count);
+  TEST_CHECK(dyn_notch_stat.update_count > 0, "no analysis completed");
+}
+
+//
+// 100 -> 200 Hz over 8 seconds on x. phase is integrated so the sweep
+// is a clean chirp
+//
+static float    _sweep_phase;
+static float    _sweep_hz;
+
+static float
+tone_sweep(int axis, int i)
+{
+  if(axis != 0)
+  {
+    return 0.0f;
+  }
+
+  _sweep_hz     = 100.0f + 100.0f * i / 8000.0f;
+  _sweep_phase += 2.0f * M_PIf * _sweep_hz / SAMPLE_HZ;
+  if(_sweep_phase > 2.0f * M_PIf)
+  {
+    _sweep_phase -= 2.0f * M_PIf;
+  }
+  return 10.0f * sinf(_sweep_phase);
+}
+
+static void
+test_sweep(void)
+{
+  float   worst = 0.0f;
+
+  dyn_notch_init(SAMPLE_HZ);
+  dyn_notch_config(1, 60, 230, 3.5f);
+
+  _sweep_phase = 0.0f;
+
+  //
+  // one second at a time so the tracking error is sampled along the sweep
+  //
+  for(int s = 0; s < 8; s++)
+  {
+    float err;
+
+    for(int i = s * 1000; i < (s + 1) * 1000; i++)
+    {
+      float v[3] = { tone_sweep(0, i) + 0.5f * test_uniform(), 0.0f, 0.0f };
+
+      dyn_notch_push(v);
+      dyn_notch_update();
+      dyn_notch_apply(v);
+    }
+
+    err = fabsf(dyn_notch_center[0][0] - _sweep_hz);
+    if(s > 0 && err > worst)
+    {
+      worst = err;
+    }
+  }
+  printf("  sweep 100-200 Hz  : worst tracking error %.1f Hz\n", worst);
+  TEST_CHECK(worst < BIN_HZ, "sweep tracking error %.1f Hz", worst);
+}
+
+static void
+bench(void)
+{
+  float v[3] = { 0.0f, 0.0f, 0.0f };
+
+  dyn_notch_init(SAMPLE_HZ);
+  dyn_notch_config(3, 60, 230, 3.5f);
+
+  TEST_BENCH("push + slice + 3x3 notches", 2000000,
+      v[0] = tone_fixed(0, __i); v[1] = tone_fixed(1, __i);
+      dyn_notch_push(v); dyn_notch_update(); dyn_notch_apply(v));
+}
+
+//
+// a zero Q from a bad config is clamped, not turned into NaN
+//
+static void
+test_zero_q(void)
+{
+  bool  finite = true;
+
+  dyn_notch_init(SAMPLE_HZ);
+  dyn_notch_config(3, 60, 230, 0.0f);
+
+  for(int i = 0; i < 4000; i++)
+  {
+    float v[3];
+
+    for(int a = 0; a < 3; a++)
+    {
+      v[a] = 10.0f * sinf(2.0f * (float)M_PI * 150.0f * i / SAMPLE_HZ) + test_uniform();
+    }
+    dyn_notch_push(v);
+    dyn_notch_update();
+    dyn_notch_apply(v);
+
+    for(int a = 0; a < 3; a++)
+    {
+      finite = finite && isfinite(v[a]);
+    }
+  }
+  TEST_CHECK(finite, "Q 0 gives a non finite output");
+}
+
+int
+main(void)
+{
+  test_seed(1);
+  test_fixed_tones();
+  test_sweep();
+  test_zero_q();
+  bench();
+
+  return test_done("dyn_notch");
+}
@@ -0,0 +1,156 @@
+#include <math.h>
+#include "test_common.h"
+#include "filter.h"
+#include "math_helper.h"
+
+//
+// filter library response at 1KHz.
+// amplitude of a settled sine through each stage against the textbook
+// response, plus filter3 against three single channel filters
+//
+#define SAMPLE_HZ         1000.0f
+#define SETTLE            2000
+#define MEASURE           2000
+
+//
+// amplitude by correlating against the tone over a whole number of periods
+//
+static float
+filter_gain(filter_type_t type, float hz, float q, float tone)
+{
+  filter_t    f;
+  double      si = 0.0,
+              co = 0.0;
+
+  filter_init(&f, type, hz, q, SAMPLE_HZ);
+
+  for(int i = 0; i < SETTLE + MEASURE; i++)
+  {
+    double  ph = 2.0 * M_PI * tone * i / SAMPLE_HZ;
+    float   y = filter_apply(&f, (float)sin(ph));
+
+    if(i >= SETTLE)
+    {
+      si += y * sin(ph);
+      co += y * cos(ph);
+    }
+  }
+  return (float)(2.0 * hypot(si, co) / MEASURE);
+}
+
+static void
+check_gain(const char* name, filter_type_t type, float hz, float q, float tone, float lo, float hi)
+{
+  float   g = filter_gain(type, hz, q, tone);
+
+  printf("  %-6s %5.0f Hz @ %5.0f Hz : %.3f\n", filter_type_name(type), hz, tone, g);
+  TEST_CHECK(g >= lo && g <= hi, "%s gain %.3f out of %.3f - %.3f", name, g, lo, hi);
+}
+
+//
+// bounds are the textbook response widened for what the discretization does
+// at 1KHz. the forward euler PT1 puts -3dB a bit below the nominal cutoff,
+// more so for the raised PT2 stages, and the bilinear notch is a bit narrower
+// than its analog Q
+//
+static void
+test_response(void)
+{
+  float   notch_q = filter_notch_q(200.0f, 150.0f);
+
+  check_gain("none",                filter_type_none, 100.0f, FILTER_BIQUAD_Q, 300.0f, 0.999f, 1.001f);
+
+  check_gain("pt1 passband",        filter_type_pt1, 100.0f, FILTER_BIQUAD_Q, 10.0f, 0.98f, 1.0f);
+  check_gain("pt1 cutoff",          filter_type_pt1, 100.0f, FILTER_BIQUAD_Q, 100.0f, 0.60f, 0.75f);
+  check_gain("pt1 stopband",        filter_type_pt1, 100.0f, FILTER_BIQUAD_Q, 400.0f, 0.0f, 0.40f);
+
+  check_gain("pt2 passband",        filter_type_pt2, 100.0f, FILTER_BIQUAD_Q, 10.0f, 0.98f, 1.0f);
+  check_gain("pt2 cutoff",          filter_type_pt2, 100.0f, FILTER_BIQUAD_Q, 100.0f, 0.50f, 0.75f);
+  check_gain("pt2 stopband",        filter_type_pt2, 100.0f, FILTER_BIQUAD_Q, 400.0f, 0.0f, 0.25f);
+
+  check_gain("biquad passband",     filter_type_biquad_lpf, 100.0f, FILTER_BIQUAD_Q, 10.0f, 0.99f, 1.01f);
+  check_gain("biquad cutoff",       filter_type_biquad_lpf, 100.0f, FILTER_BIQUAD_Q, 100.0f, 0.68f, 0.74f);
+  check_gain("biquad stopband",     filter_type_biquad_lpf, 100.0f, FILTER_BIQUAD_Q, 400.0f, 0.0f, 0.08f);
+
+  check_gain("notch center",        filter_type_notch, 200.0f, notch_q, 200.0f, 0.0f, 0.02f);
+  check_gain("notch cutoff",        filter_type_notch, 200.0f, notch_q, 150.0f, 0.62f, 0.82f);
+  check_gain("notch passband",      filter_type_notch, 200.0f, notch_q, 30.0f, 0.97f, 1.01f);
+
+  // cutoff above nyquist is clamped and stays stable
+  check_gain("biquad over nyquist", filter_type_biquad_lpf, 900.0f, FILTER_BIQUAD_Q, 50.0f, 0.95f, 1.05f);
+}
+
+static void
+test_filter3_matches_filter(void)
+{
+  static const filter_type_t  types[] =
+  {
+    filter_type_pt1,
+    filter_type_pt2,
+    filter_type_biquad_lpf,
+    filter_type_notch,
+  };
+  float   max_err = 0.0f;
+
+  for(int t = 0; t < NARRAY(types); t++)
+  {
+    filter3_t   f3;
+    filter_t    f[3];
+    float       v[3];
+
+    filter3_init(&f3, types[t], 120.0f, 2.0f, SAMPLE_HZ);
+    for(int a = 0; a < 3; a++)
+    {
+      filter_init(&f[a], types[t], 120.0f, 2.0f, SAMPLE_HZ);
+    }
+
+    for(int i = 0; i < 1000; i++)
+    {
+      for(int a = 0; a < 3; a++)
+      {
+        v[a] = sinf(0.05f * i * (a + 1)) + 0.1f * a;
+      }
+      filter3_apply(&f3, v);
+      for(int a = 0; a < 3; a++)
+      {
+        float y = filter_apply(&f[a], sinf(0.05f * i * (a + 1)) + 0.1f * a);
+
+        if(fabsf(y - v[a]) > max_err)
+        {
+          max_err = fabsf(y - v[a]);
+        }
+      }
+    }
+  }
+  TEST_CHECK(max_err < 1e-5f, "filter3 differs from filter by %g", max_err);
+}
+
+static void
+bench(void)
+{
+  static filter3_t  chain[FILTER_CHAIN_MAX];
+  static filter_t   f;
+  volatile float    sink;
+  float             v[3] = { 1.0f, 2.0f, 3.0f };
+
+  filter_init(&f, filter_type_biquad_lpf, 100.0f, FILTER_BIQUAD_Q, SAMPLE_HZ);
+  filter3_init(&chain[0], filter_type_pt1, 120.0f, FILTER_BIQUAD_Q, SAMPLE_HZ);
+  filter3_init(&chain[1], filter_type_biquad_lpf, 150.0f, FILTER_BIQUAD_Q, SAMPLE_HZ);
+  filter3_init(&chain[2], filter_type_notch, 200.0f, filter_notch_q(200.0f, 150.0f), SAMPLE_HZ);
+
+  TEST_BENCH("filter_apply biquad", 10000000, sink = filter_apply(&f, (float)(__i & 0xff)));
+  TEST_BENCH("3 stage filter3 chain", 10000000,
+      v[0] += 0.1f;
+      for(int k = 0; k < FILTER_CHAIN_MAX; k++) filter3_apply(&chain[k], v));
+  (void)sink;
+}
+
+int
+main(void)
+{
+  test_response();
+  test_filter3_matches_filter();
+  bench();
+
+  return test_done("filter");
+}
@@ -0,0 +1,596 @@
+#include <math.h>
+#include "test_common.h"
+#include "ins_ekf.h"
+#include "math_helper.h"
+
+//
+// INS EKF on a simulated flight.
+//
+// 5 m/s circle with vertical motion and a rocking attitude, constant gyro
+// and accel biases. IMU at 1KHz, GPS 5Hz and 100 ms late, baro 50Hz and
+// 20 ms late, mag 75Hz. fed the way ins.c does it.
+//
+// checks
+//  - position, velocity, attitude and both biases converge
+//  - delay compensation through the history beats fusing late GPS as if
+//    it were current
+//  - the block sparse F*P*F^T matches a dense 15x15 double reference
+//  - P stays symmetric and positive semi definite after every step
+//
+#define SAMPLE_HZ         1000
+#define DT                (1.0 / SAMPLE_HZ)
+#define RUN_SECS          60
+#define SCORE_SECS        30          // errors are taken over the tail
+
+#define GPS_EVERY         200
+#define GPS_DELAY         100
+#define GPS_POS_SIGMA     1.0
+#define GPS_VEL_SIGMA     0.3
+#define BARO_EVERY        20
+#define BARO_PHASE        10          // keep off the GPS step
+#define BARO_DELAY        20
+#define BARO_SIGMA        0.5
+#define MAG_EVERY         13
+#define MAG_SIGMA         0.005
+#define MAG_VAR           sq(0.0873f)
+
+#define GYRO_NOISE        0.1         // dps
+#define ACCEL_NOISE       0.01        // G
+
+#define G                 9.80665
+#define D2R               (M_PI / 180.0)
+
+//
+// mirrors the process noise in ins_ekf.c for the dense reference
+//
+#define REF_GYRO_NOISE    1.0e-3
+#define REF_ACCEL_NOISE   0.1
+#define REF_GBIAS_WALK    2.0e-5
+#define REF_ABIAS_WALK    5.0e-4
+
+#define N                 INS_EKF_NUM_STATES
+
+static const double   _gbias[3] = { 0.3, -0.2, 0.5 };         // dps
+static const double   _abias[3] = { 0.05, -0.05, 0.1 };       // m/s^2
+static const double   _mag_earth[3] = { 0.35, 0.0, -0.92 };
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// truth
+//
+////////////////////////////////////////////////////////////////////////////////
+typedef struct
+{
+  double    q[4];
+  double    p[3];
+  double    v[3];
+  double    a[3];
+} truth_t;
+
+//
+// 20 m radius circle at 0.25 rad/s, +-2 m vertical. nose along the track
+// with roll and pitch rocking so every axis is excited
+//
+static void
+truth_at(double t, truth_t* s)
+{
+  const double  r = 20.0, w = 0.25, wz = 0.3;
+  const double  e[3] = { 8 * D2R * sin(0.5 * t), 5 * D2R * sin(0.37 * t), w * t + M_PI / 2 };
+
+  s->p[0] = r * cos(w * t);
+  s->p[1] = r * sin(w * t);
+  s->p[2] = 2.0 * sin(wz * t);
+  s->v[0] = -r * w * sin(w * t);
+  s->v[1] = r * w * cos(w * t);
+  s->v[2] = 2.0 * wz * cos(wz * t);
+  s->a[0] = -r * w * w * cos(w * t);
+  s->a[1] = -r * w * w * sin(w * t);
+  s->a[2] = -2.0 * wz * wz * sin(wz * t);
+
+  test_euler_to_quat(e, s->q);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// covariance checks
+//
+////////////////////////////////////////////////////////////////////////////////
+static void
+full_cov(const ins_ekf_t* ekf, double P[N][N])
+{
+  int b = 0;
+
+  //
+  // upper triangle of 3x3 blocks, row by row
+  //
+  for(int i = 0; i < INS_EKF_NUM_GROUPS; i++)
+  {
+    for(int j = i; j < INS_EKF_NUM_GROUPS; j++, b++)
+    {
+      for(int r = 0; r < 3; r++)
+      {
+        for(int c = 0; c < 3; c++)
+        {
+          P[i * 3 + r][j * 3 + c] = ekf->P[b][r * 3 + c];
+          P[j * 3 + c][i * 3 + r] = ekf->P[b][r * 3 + c];
+        }
+      }
+    }
+  }
+}
+
+//
+// relative to the largest diagonal entry. predict makes the diagonal
+// blocks exactly symmetric, a fusion leaves float rounding
+//
+static double
+cov_asymmetry(const ins_ekf_t* ekf)
+{
+  double  worst = 0.0,
+          dmax = 0.0;
+  int     b = 0;
+
+  for(int i = 0; i < INS_EKF_NUM_GROUPS; i++)
+  {
+    for(int j = i; j < INS_EKF_NUM_GROUPS; j++, b++)
+    {
+      if(i != j)
+      {
+        continue;
+      }
+      for(int r = 0; r < 3; r++)
+      {
+        for(int c = 0; c < 3; c++)
+        {
+          worst = fmax(worst, fabs(ekf->P[b][r * 3 + c] - ekf->P[b][c * 3 + r]));
+        }
+        dmax = fmax(dmax, ekf->P[b][r * 3 + r]);
+      }
+    }
+  }
+  return worst / dmax;
+}
+
+//
+// smallest cholesky pivot relative to the largest diagonal entry.
+// negative means P is not positive semi definite
+//
+static double
+cov_min_pivot(const ins_ekf_t* ekf)
+{
+  double  P[N][N], L[N][N] = { { 0 } };
+  double  dmax = 0.0,
+          worst = 1.0;
+
+  full_cov(ekf, P);
+  for(int i = 0; i < N; i++)
+  {
+    dmax = fmax(dmax, P[i][i]);
+  }
+
+  for(int j = 0; j < N; j++)
+  {
+    double d = P[j][j];
+
+    for(int k = 0; k < j; k++)
+    {
+      d -= L[j][k] * L[j][k];
+    }
+    worst = fmin(worst, d / dmax);
+    if(d <= 0.0)
+    {
+      // semi definite direction. keep going with it zeroed
+      L[j][j] = 0.0;
+      continue;
+    }
+    L[j][j] = sqrt(d);
+
+    for(int i = j + 1; i < N; i++)
+    {
+      double s = P[i][j];
+
+      for(int k = 0; k < j; k++)
+      {
+        s -= L[i][k] * L[j][k];
+      }
+      L[i][j] = s / L[j][j];
+    }
+  }
+  return worst;
+}
+
+//
+// dense P = F * P * F^T + Q in double from the state before the step
+//
+static void
+dense_predict(const ins_ekf_t* ekf, const float accel[3], double P[N][N])
+{
+  double  R[3][3], F[N][N] = { { 0 } }, T[N][N], f[3], fe[3], q[4];
+
+  for(int i = 0; i < 4; i++)
+  {
+    q[i] = ekf->q[i];
+  }
+  test_rotation(q, R);
+
+  for(int i = 0; i < 3; i++)
+  {
+    f[i] = (double)accel[i] * (float)INS_EKF_GRAVITY - ekf->ba[i];
+  }
+  for(int i = 0; i < 3; i++)
+  {
+    fe[i] = R[i][0] * f[0] + R[i][1] * f[1] + R[i][2] * f[2];
+  }
+
+  for(int i = 0; i < N; i++)
+  {
+    F[i][i] = 1.0;
+  }
+  for(int r = 0; r < 3; r++)
+  {
+    for(int c = 0; c < 3; c++)
+    {
+      F[INS_EKF_ATT + r][INS_EKF_GBIAS + c] = -R[r][c] * DT;
+      F[INS_EKF_VEL + r][INS_EKF_ABIAS + c] = -R[r][c] * DT;
+    }
+    F[INS_EKF_POS + r][INS_EKF_VEL + r] = DT;
+  }
+
+  // -[fe]x
+  F[INS_EKF_VEL + 0][INS_EKF_ATT + 1] =  fe[2] * DT;
+  F[INS_EKF_VEL + 0][INS_EKF_ATT + 2] = -fe[1] * DT;
+  F[INS_EKF_VEL + 1][INS_EKF_ATT + 0] = -fe[2] * DT;
+  F[INS_EKF_VEL + 1][INS_EKF_ATT + 2] =  fe[0] * DT;
+  F[INS_EKF_VEL + 2][INS_EKF_ATT + 0] =  fe[1] * DT;
+  F[INS_EKF_VEL + 2][INS_EKF_ATT + 1] = -fe[0] * DT;
+
+  full_cov(ekf, P);
+
+  for(int i = 0; i < N; i++)
+  {
+    for(int j = 0; j < N; j++)
+    {
+      T[i][j] = 0.0;
+      for(int k = 0; k < N; k++)
+      {
+        T[i][j] += F[i][k] * P[k][j];
+      }
+    }
+  }
+  for(int i = 0; i < N; i++)
+  {
+    for(int j = 0; j < N; j++)
+    {
+      P[i][j] = 0.0;
+      for(int k = 0; k < N; k++)
+      {
+        P[i][j] += T[i][k] * F[j][k];
+      }
+    }
+  }
+
+  for(int i = 0; i < 3; i++)
+  {
+    P[INS_EKF_ATT + i][INS_EKF_ATT + i]     += sq(REF_GYRO_NOISE) * DT;
+    P[INS_EKF_VEL + i][INS_EKF_VEL + i]     += sq(REF_ACCEL_NOISE) * DT;
+    P[INS_EKF_GBIAS + i][INS_EKF_GBIAS + i] += sq(REF_GBIAS_WALK) * DT;
+    P[INS_EKF_ABIAS + i][INS_EKF_ABIAS + i] += sq(REF_ABIAS_WALK) * DT;
+  }
+}
+
+static double
+dense_diff(const ins_ekf_t* ekf, double ref[N][N])
+{
+  double  P[N][N];
+  double  worst = 0.0,
+          scale = 0.0;
+
+  full_cov(ekf, P);
+  for(int i = 0; i < N; i++)
+  {
+    scale = fmax(scale, fabs(ref[i][i]));
+    for(int j = 0; j < N; j++)
+    {
+      worst = fmax(worst, fabs(P[i][j] - ref[i][j]));
+    }
+  }
+  return worst / scale;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// simulation
+//
+////////////////////////////////////////////////////////////////////////////////
+typedef struct
+{
+  bool      delay_comp;
+  bool      check_cov;
+
+  // rms over the tail
+  double    pos, vel, att;
+  double    gbias_err;        // dps, worst axis
+  double    abias_err;        // m/s^2, z
+  double    asym, min_pivot, dense_err;
+  uint32_t  fused, rejected;
+} run_t;
+
+static void
+run(run_t* r)
+{
+  static ins_ekf_t  ekf;
+  truth_t           s, late;
+  float             q[4], p[3] = { 0.0f, 0.0f, 0.0f };
+  double            ref[N][N];
+  double            sp = 0.0, sv = 0.0, sa = 0.0;
+  int               n = 0;
+  bool              home = false;
+
+  test_seed(7);
+  r->asym = r->dense_err = 0.0;
+  r->min_pivot = 1.0;
+
+  //
+  // attitude from the AHRS with a 5 degree heading error, position at home
+  //
+  truth_at(0.0, &s);
+  {
+    const double  dyaw[4] = { cos(2.5 * D2R), 0, 0, sin(2.5 * D2R) };
+    double        qe[4];
+
+    test_qmul(dyaw, s.q, qe);
+    for(int i = 0; i < 4; i++)
+    {
+      q[i] = qe[i];
+    }
+  }
+  p[2] = s.p[2];
+  ins_ekf_init(&ekf, q, p, 0);
+
+  for(int k = 1; k <= RUN_SECS * SAMPLE_HZ; k++)
+  {
+    double  t = k * DT;
+    double  f[3], v[3], qn[4], qc[4], dq[4];
+    float   gyro[3], accel[3], m[3];
+    truth_t next;
+
+    //
+    // IMU over the step from t - dt to t
+    //
+    truth_at(t - DT, &s);
+    truth_at(t, &next);
+    qc[0] = s.q[0];
+    qc[1] = -s.q[1];
+    qc[2] = -s.q[2];
+    qc[3] = -s.q[3];
+    for(int i = 0; i < 4; i++)
+    {
+      qn[i] = next.q[i];
+    }
+    test_qmul(qc, qn, dq);
+
+    for(int i = 0; i < 3; i++)
+    {
+      f[i] = s.a[i] / G + (i == 2 ? 1.0 : 0.0);
+    }
+    test_earth_to_body(s.q, f, v);
+    for(int i = 0; i < 3; i++)
+    {
+      gyro[i]   = 2.0 * dq[i + 1] / DT / D2R + _gbias[i] + GYRO_NOISE * test_noise();
+      accel[i]  = v[i] + _abias[i] / G + ACCEL_NOISE * test_noise();
+    }
+
+    if(r->check_cov && (k % 10) == 0)
+    {
+      dense_predict(&ekf, accel, ref);
+    }
+    ins_ekf_predict(&ekf, gyro, accel, DT, k);
+    if(r->check_cov && (k % 10) == 0)
+    {
+      r->dense_err = fmax(r->dense_err, dense_diff(&ekf, ref));
+    }
+
+    s = next;
+
+    //
+    // GPS of 100 ms ago
+    //
+    if(k % GPS_EVERY == 0 && k >= GPS_DELAY)
+    {
+      truth_at(t - GPS_DELAY * DT, &late);
+
+      if(!home)
+      {
+        for(int i = 0; i < 2; i++)
+        {
+          ins_ekf_reset_pos(&ekf, i, late.p[i], sq(GPS_POS_SIGMA));
+          ins_ekf_reset_vel(&ekf, i, late.v[i], sq(GPS_VEL_SIGMA));
+        }
+        home = true;
+      }
+      else
+      {
+        uint32_t delay = r->delay_comp ? GPS_DELAY : 0;
+
+        for(int i = 0; i < 2; i++)
+        {
+          ins_ekf_fuse_pos(&ekf, i, late.p[i] + GPS_POS_SIGMA * test_noise(), sq(GPS_POS_SIGMA), delay);
+        }
+        for(int i = 0; i < 3; i++)
+        {
+          ins_ekf_fuse_vel(&ekf, i, late.v[i] + GPS_VEL_SIGMA * test_noise(), sq(GPS_VEL_SIGMA), delay);
+        }
+      }
+    }
+    else if(k % BARO_EVERY == BARO_PHASE)
+    {
+      truth_at(t - BARO_DELAY * DT, &late);
+      ins_ekf_fuse_pos(&ekf, 2, late.p[2] + BARO_SIGMA * test_noise(), sq(BARO_SIGMA),
+          r->delay_comp ? BARO_DELAY : 0);
+    }
+    else if(k % MAG_EVERY == 0)
+    {
+      test_earth_to_body(s.q, _mag_earth, v);
+      for(int i = 0; i < 3; i++)
+      {
+        m[i] = v[i] + MAG_SIGMA * test_noise();
+      }
+      ins_ekf_fuse_heading(&ekf, m, 0.0f, MAG_VAR);
+    }
+
+    if(r->check_cov)
+    {
+      r->asym       = fmax(r->asym, cov_asymmetry(&ekf));
+      r->min_pivot  = fmin(r->min_pivot, cov_min_pivot(&ekf));
+    }
+
+    if(t > RUN_SECS - SCORE_SECS)
+    {
+      for(int i = 0; i < 3; i++)
+      {
+        sp += sq(ekf.p[i] - s.p[i]);
+        sv += sq(ekf.v[i] - s.v[i]);
+      }
+      sa += sq(test_quat_error(ekf.q, s.q));
+      n++;
+    }
+  }
+
+  r->pos = sqrt(sp / n);
+  r->vel = sqrt(sv / n);
+  r->att = sqrt(sa / n);
+
+  r->gbias_err = 0.0;
+  for(int i = 0; i < 3; i++)
+  {
+    r->gbias_err = fmax(r->gbias_err, fabs(ekf.bg[i] / D2R - _gbias[i]));
+  }
+  r->abias_err  = fabs(ekf.ba[2] - _abias[2]);
+  r->fused      = ekf.fuse_count;
+  r->rejected   = ekf.reject_count;
+}
+
+static void
+test_convergence(void)
+{
+  run_t   full    = { .delay_comp = true,  .check_cov = true },
+          nocomp  = { .delay_comp = false };
+
+  run(&full);
+  run(&nocomp);
+
+  printf("  rms over the last %d s of %d s\n", SCORE_SECS, RUN_SECS);
+  printf("  GPS+baro+mag       : pos %.2f m, vel %.3f m/s, att %.2f deg, %lu fused %lu rejected\n",
+      full.pos, full.vel, full.att, (unsigned long)full.fused, (unsigned long)full.rejected);
+  printf("  no delay comp      : pos %.2f m, vel %.3f m/s, att %.2f deg\n",
+      nocomp.pos, nocomp.vel, nocomp.att);
+  printf("  bias               : gyro %.4f dps worst axis, accel z %.4f m/s^2\n",
+      full.gbias_err, full.abias_err);
+  printf("  covariance         : dense diff %.1e, asymmetry %.1e, min pivot %.1e\n",
+      full.dense_err, full.asym, full.min_pivot);
+
+  TEST_CHECK(full.pos < 0.6 && full.vel < 0.15 && full.att < 1.5,
+      "GPS+baro+mag pos %.2f vel %.3f att %.2f", full.pos, full.vel, full.att);
+  TEST_CHECK(full.pos < nocomp.pos, "delay comp pos %.2f, without %.2f", full.pos, nocomp.pos);
+  TEST_CHECK(full.gbias_err < 0.05, "gyro bias error %.4f dps", full.gbias_err);
+  TEST_CHECK(full.abias_err < 0.03, "accel z bias error %.4f", full.abias_err);
+
+  TEST_CHECK(full.dense_err < 1e-5, "sparse F*P*F' off dense by %.1e", full.dense_err);
+  TEST_CHECK(full.asym < 1e-6, "diagonal blocks asymmetric by %.1e", full.asym);
+  TEST_CHECK(full.min_pivot > -1e-6, "P not PSD, pivot %.1e", full.min_pivot);
+}
+
+//
+// newest entry at or before msec, the oldest one if none is
+//
+static const ins_ekf_hist_t*
+hist_at(const ins_ekf_t* ekf, uint32_t msec)
+{
+  const ins_ekf_hist_t* best = NULL;
+  const ins_ekf_hist_t* oldest = NULL;
+
+  for(int i = 0; i < ekf->hist_count; i++)
+  {
+    const ins_ekf_hist_t* h = &ekf->hist[i];
+
+    if(h->msec <= msec && (best == NULL || h->msec > best->msec))
+    {
+      best = h;
+    }
+    if(oldest == NULL || h->msec < oldest->msec)
+    {
+      oldest = h;
+    }
+  }
+  return best ? best : oldest;
+}
+
+//
+// a delayed measurement is compared against the history entry at its
+// time, past the window against the oldest entry. a reset moves the
+// history with the state so the innovation is formed against the
+// reset value
+//
+static void
+test_history(void)
+{
+  static ins_ekf_t    ekf;
+  static const float  q[4] = { 1.0f, 0.0f, 0.0f, 0.0f },
+                      p[3] = { 0.0f, 0.0f, 0.0f },
+                      g[3] = { 0.0f, 0.0f, 0.0f },
+                      a[3] = { 0.1f, 0.0f, 1.0f };
+  const ins_ekf_hist_t* h;
+  float               before;
+
+  ins_ekf_init(&ekf, q, p, 0);
+  for(int k = 1; k <= 1000; k++)
+  {
+    ins_ekf_predict(&ekf, g, a, DT, k);
+  }
+  TEST_CHECK(ekf.hist_count == INS_EKF_HIST_LEN, "history %u entries", ekf.hist_count);
+
+  ins_ekf_reset_pos(&ekf, 0, 100.0f, 1.0f);
+  h = hist_at(&ekf, 900);
+  before = ekf.p[0];
+  ins_ekf_fuse_pos(&ekf, 0, h->p[0], 1.0f, 100);
+  TEST_CHECK(fabsf(ekf.p[0] - before) < 1e-4f && h->p[0] > 99.0f,
+      "delayed fuse after reset moved x by %.5f", ekf.p[0] - before);
+
+  //
+  // the same value as current would have been a real correction
+  //
+  TEST_CHECK(fabsf(ekf.p[0] - h->p[0]) > 0.05f, "history entry equals now, test moves nothing");
+
+  h = hist_at(&ekf, 0);
+  before = ekf.v[0];
+  ins_ekf_fuse_vel(&ekf, 0, h->v[0], 1.0f, 5000);
+  TEST_CHECK(fabsf(ekf.v[0] - before) < 1e-4f, "fuse past the window moved vx by %.5f",
+      ekf.v[0] - before);
+}
+
+static void
+bench(void)
+{
+  static ins_ekf_t    ekf;
+  static const float  q[4] = { 1.0f, 0.0f, 0.0f, 0.0f },
+                      p[3] = { 0.0f, 0.0f, 0.0f },
+                      g[3] = { 0.3f, -0.2f, 0.5f },
+                      a[3] = { 0.01f, -0.02f, 1.0f },
+                      m[3] = { 0.35f, 0.0f, -0.92f };
+
+  ins_ekf_init(&ekf, q, p, 0);
+
+  TEST_BENCH("ins_ekf_predict", 1000000, ins_ekf_predict(&ekf, g, a, DT, __i));
+  TEST_BENCH("ins_ekf_fuse_pos", 1000000, ins_ekf_fuse_pos(&ekf, __i % 3, 0.0f, 1.0f, 50));
+  TEST_BENCH("ins_ekf_fuse_heading", 1000000, ins_ekf_fuse_heading(&ekf, m, 0.0f, MAG_VAR));
+}
+
+int
+main(void)
+{
+  test_convergence();
+  test_history();
+  bench();
+
+  return test_done("ins_ekf");
+}
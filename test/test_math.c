@@ -0,0 +1,136 @@
+#include <math.h>
+#include "test_common.h"
+#include "math_helper.h"
+
+//
+// error sweep of the math_helper.h approximations against double libm.
+// the bounds are the figures quoted in math_helper.h with a little room.
+// AHRS and EKF run on these with MATH_FAST_APPROX=1
+//
+#define MATH_ATAN2_MAX_ERR      1.5e-5      // rad
+#define MATH_ASIN_MAX_ERR       8.0e-5      // rad
+#define MATH_SIN_MAX_ERR        5.0e-6
+#define MATH_RSQRT_MAX_REL_ERR  6.0e-6
+
+#define SWEEP                   2000000
+
+static void
+test_atan2(void)
+{
+  double  worst = 0.0;
+
+  //
+  // full circle at radii from 1e-3 to 1e3
+  //
+  for(int i = 0; i < SWEEP; i++)
+  {
+    double t = -M_PI + 2.0 * M_PI * i / SWEEP;
+
+    for(double r = 1e-3; r < 1e3; r *= 31.6)
+    {
+      float   y = (float)(r * sin(t)),
+              x = (float)(r * cos(t));
+      double  e = fabs(fast_atan2f(y, x) - atan2((double)y, (double)x));
+
+      if(e > M_PI)
+      {
+        e = 2.0 * M_PI - e;
+      }
+      worst = fmax(worst, e);
+    }
+  }
+  printf("  fast_atan2f  : max err %.2e rad\n", worst);
+  TEST_CHECK(worst < MATH_ATAN2_MAX_ERR, "atan2 error %.2e", worst);
+
+  TEST_CHECK(fast_atan2f(0.0f, 0.0f) == 0.0f, "atan2(0, 0) %g", fast_atan2f(0.0f, 0.0f));
+  TEST_CHECK(fabsf(fast_atan2f(1.0f, 0.0f) - M_PIf / 2) < MATH_ATAN2_MAX_ERR, "atan2(1, 0)");
+  TEST_CHECK(fabsf(fast_atan2f(0.0f, -1.0f) - M_PIf) < MATH_ATAN2_MAX_ERR, "atan2(0, -1)");
+}
+
+static void
+test_asin(void)
+{
+  double  worst = 0.0;
+
+  for(int i = 0; i <= SWEEP; i++)
+  {
+    float x = -1.0f + 2.0f * i / SWEEP;
+
+    worst = fmax(worst, fabs(fast_asinf(x) - asin((double)x)));
+  }
+  printf("  fast_asinf   : max err %.2e rad\n", worst);
+  TEST_CHECK(worst < MATH_ASIN_MAX_ERR, "asin error %.2e", worst);
+
+  //
+  // accel noise can push the argument past 1. clamps instead of NaN
+  //
+  TEST_CHECK(fabsf(fast_asinf(1.001f) - M_PIf / 2) < MATH_ASIN_MAX_ERR, "asin(1.001) %g", fast_asinf(1.001f));
+  TEST_CHECK(fabsf(fast_asinf(-1.001f) + M_PIf / 2) < MATH_ASIN_MAX_ERR, "asin(-1.001) %g", fast_asinf(-1.001f));
+}
+
+static void
+test_sin_cos(void)
+{
+  double  worst_sin = 0.0,
+          worst_cos = 0.0;
+
+  for(int i = 0; i <= SWEEP; i++)
+  {
+    float x = -20.0f + 40.0f * i / SWEEP;
+
+    worst_sin = fmax(worst_sin, fabs(fast_sinf(x) - sin((double)x)));
+    worst_cos = fmax(worst_cos, fabs(fast_cosf(x) - cos((double)x)));
+  }
+  printf("  fast_sinf    : max err %.2e, |x| < 20\n", worst_sin);
+  printf("  fast_cosf    : max err %.2e, |x| < 20\n", worst_cos);
+  TEST_CHECK(worst_sin < MATH_SIN_MAX_ERR, "sin error %.2e", worst_sin);
+  TEST_CHECK(worst_cos < MATH_SIN_MAX_ERR, "cos error %.2e", worst_cos);
+}
+
+static void
+test_rsqrt(void)
+{
+  double  worst = 0.0;
+
+  //
+  // 1e-4 to 1e4 log spaced. covers squared norms of every sensor vector
+  //
+  for(int i = 0; i <= SWEEP; i++)
+  {
+    float x = (float)(1e-4 * pow(1e8, (double)i / SWEEP));
+
+    worst = fmax(worst, fabs(fast_rsqrtf(x) * sqrt((double)x) - 1.0));
+  }
+  printf("  fast_rsqrtf  : max rel err %.2e\n", worst);
+  TEST_CHECK(worst < MATH_RSQRT_MAX_REL_ERR, "rsqrt error %.2e", worst);
+}
+
+static void
+bench(void)
+{
+  volatile float  sink = 0.0f;
+
+#define BENCH_X   (-0.99f + (__i & 1023) * (1.98f / 1024))
+  TEST_BENCH("atan2f",      10000000, sink += atan2f(BENCH_X, 0.3f));
+  TEST_BENCH("fast_atan2f", 10000000, sink += fast_atan2f(BENCH_X, 0.3f));
+  TEST_BENCH("asinf",       10000000, sink += asinf(BENCH_X));
+  TEST_BENCH("fast_asinf",  10000000, sink += fast_asinf(BENCH_X));
+  TEST_BENCH("sinf",        10000000, sink += sinf(BENCH_X * 3.0f));
+  TEST_BENCH("fast_sinf",   10000000, sink += fast_sinf(BENCH_X * 3.0f));
+  TEST_BENCH("1/sqrtf",     10000000, sink += 1.0f / sqrtf(BENCH_X + 1.0f));
+  TEST_BENCH("fast_rsqrtf", 10000000, sink += fast_rsqrtf(BENCH_X + 1.0f));
+#undef BENCH_X
+  (void)sink;
+}
+
+int
+main(void)
+{
+  test_atan2();
+  test_asin();
+  test_sin_cos();
+  test_rsqrt();
+  bench();
+
+  return test_done("math");
+}
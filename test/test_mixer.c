@@ -0,0 +1,176 @@
+#include <math.h>
+#include "test_common.h"
+#include "mixer.h"
+
+//
+// mixer saturation behaviour on every preset.
+//
+// the roll/pitch/yaw part of the output is found by taking out the mean,
+// as every preset has a flat throttle column and zero sum axis columns.
+// it has to be the unsaturated axis mix times one common scale, which is
+// what keeps the ratio between axes
+//
+#define OUT_MIN           1000.0f
+#define OUT_MAX           2000.0f
+
+typedef struct
+{
+  float   scale;          // common axis scale found in the output
+  float   ratio_err;      // worst deviation from scale * unsaturated mix
+  float   throttle;       // collective left in the output
+  float   lo, hi;
+} mix_result_t;
+
+static mix_result_t
+mix(const mixer_config_t* m, float throttle, const float axis[3])
+{
+  mix_result_t  r = { 0 };
+  float         out[MIXER_MAX_MOTORS],
+                a[MIXER_MAX_MOTORS];
+  double        da = 0.0,
+                aa = 0.0;
+
+  mixer_run(m, OUT_MIN, OUT_MAX, throttle, axis, out);
+
+  r.lo = r.hi = out[0];
+  for(int i = 0; i < m->num_motors; i++)
+  {
+    a[i] = m->coeff[i][MIXER_ROLL] * axis[0] + m->coeff[i][MIXER_PITCH] * axis[1] +
+      m->coeff[i][MIXER_YAW] * axis[2];
+    r.throttle += out[i] / m->num_motors;
+    r.lo = fminf(r.lo, out[i]);
+    r.hi = fmaxf(r.hi, out[i]);
+  }
+
+  for(int i = 0; i < m->num_motors; i++)
+  {
+    da += (out[i] - r.throttle) * a[i];
+    aa += a[i] * a[i];
+  }
+  r.scale = aa > 0.0 ? da / aa : 1.0f;
+
+  for(int i = 0; i < m->num_motors; i++)
+  {
+    r.ratio_err = fmaxf(r.ratio_err, fabsf(out[i] - r.throttle - r.scale * a[i]));
+  }
+  return r;
+}
+
+static void
+test_preset(mixer_preset_t p)
+{
+  static const float  zero[3]   = { 0.0f, 0.0f, 0.0f };
+  static const float  small[3]  = { 50.0f, -30.0f, 20.0f };
+  static const float  big[3]    = { 600.0f, 300.0f, -200.0f };
+  const char*         name = mixer_preset_name(p);
+  mixer_config_t      m;
+  mix_result_t        r;
+  float               col[MIXER_AXIS_NUM] = { 0 };
+  uint32_t            shift,
+                      desat;
+
+  mixer_load_preset(&m, p);
+  TEST_CHECK(m.num_motors == mixer_preset_motors(p), "%s motors %u", name, m.num_motors);
+
+  //
+  // table shape the desaturation relies on
+  //
+  for(int i = 0; i < m.num_motors; i++)
+  {
+    TEST_CHECK(m.coeff[i][MIXER_THROTTLE] == 1.0f, "%s motor %d throttle %.2f", name, i, m.coeff[i][MIXER_THROTTLE]);
+    for(int j = 0; j < MIXER_AXIS_NUM; j++)
+    {
+      col[j] += m.coeff[i][j];
+    }
+  }
+  for(int j = MIXER_ROLL; j < MIXER_AXIS_NUM; j++)
+  {
+    TEST_CHECK(fabsf(col[j]) < 1e-4f, "%s column %d sums to %g", name, j, col[j]);
+  }
+
+  //
+  // hover, and a small demand in the middle of the range is passed untouched
+  //
+  r = mix(&m, 1500.0f, zero);
+  TEST_CHECK(r.lo == 1500.0f && r.hi == 1500.0f, "%s hover %.1f - %.1f", name, r.lo, r.hi);
+
+  shift = mixer_stat.shift_count;
+  desat = mixer_stat.desat_count;
+  r = mix(&m, 1500.0f, small);
+  TEST_CHECK(fabsf(r.scale - 1.0f) < 1e-4f && r.ratio_err < 1e-3f && fabsf(r.throttle - 1500.0f) < 1e-3f,
+      "%s unsaturated scale %.4f err %g throttle %.1f", name, r.scale, r.ratio_err, r.throttle);
+  TEST_CHECK(mixer_stat.shift_count == shift && mixer_stat.desat_count == desat, "%s unsaturated counted", name);
+
+  //
+  // top rail. throttle gives way, axis demand is kept in full
+  //
+  r = mix(&m, 1990.0f, small);
+  TEST_CHECK(fabsf(r.hi - OUT_MAX) < 1e-3f && r.throttle < 1990.0f, "%s top rail hi %.1f throttle %.1f", name, r.hi, r.throttle);
+  TEST_CHECK(fabsf(r.scale - 1.0f) < 1e-4f && r.ratio_err < 1e-3f, "%s top rail scale %.4f err %g", name, r.scale, r.ratio_err);
+  TEST_CHECK(mixer_stat.shift_count == shift + 1, "%s top rail shift not counted", name);
+
+  //
+  // bottom rail. motors idle at minimum still get the full correction
+  //
+  r = mix(&m, 1010.0f, small);
+  TEST_CHECK(fabsf(r.lo - OUT_MIN) < 1e-3f && r.throttle > 1010.0f, "%s bottom rail lo %.1f throttle %.1f", name, r.lo, r.throttle);
+  TEST_CHECK(fabsf(r.scale - 1.0f) < 1e-4f && r.ratio_err < 1e-3f, "%s bottom rail scale %.4f err %g", name, r.scale, r.ratio_err);
+  TEST_CHECK(mixer_stat.shift_count == shift + 2, "%s bottom rail shift not counted", name);
+
+  //
+  // demand wider than the output range. axes are scaled together and the
+  // result uses the whole range
+  //
+  r = mix(&m, 1500.0f, big);
+  printf("  %-6s saturated      : scale %.3f, ratio err %.2e, out %.1f - %.1f\n", name, r.scale, r.ratio_err, r.lo, r.hi);
+  TEST_CHECK(r.scale < 1.0f && r.ratio_err < 1e-2f, "%s saturated scale %.4f err %g", name, r.scale, r.ratio_err);
+  TEST_CHECK(fabsf(r.lo - OUT_MIN) < 1e-2f && fabsf(r.hi - OUT_MAX) < 1e-2f, "%s saturated %.1f - %.1f", name, r.lo, r.hi);
+  TEST_CHECK(mixer_stat.desat_count == desat + 1, "%s desat not counted", name);
+
+  //
+  // same at either rail. throttle can not save it, ratio still holds
+  //
+  for(int t = 0; t < 2; t++)
+  {
+    float throttle = t ? OUT_MAX : OUT_MIN;
+
+    r = mix(&m, throttle, big);
+    TEST_CHECK(r.ratio_err < 1e-2f && r.lo >= OUT_MIN && r.hi <= OUT_MAX,
+        "%s saturated at %.0f err %g out %.1f - %.1f", name, throttle, r.ratio_err, r.lo, r.hi);
+  }
+}
+
+static void
+bench(void)
+{
+  mixer_config_t    m;
+  float             out[MIXER_MAX_MOTORS];
+  float             axis[3];
+  volatile float    sink = 0.0f;
+
+  for(int p = 0; p < mixer_preset_max; p++)
+  {
+    char  name[32];
+
+    mixer_load_preset(&m, p);
+    snprintf(name, sizeof(name), "mixer_run %s", mixer_preset_name(p));
+
+    TEST_BENCH(name, 10000000,
+        axis[0] = (float)(__i & 511); axis[1] = -(float)(__i & 255); axis[2] = (float)(__i & 127);
+        mixer_run(&m, OUT_MIN, OUT_MAX, OUT_MIN + (__i & 1023), axis, out);
+        sink += out[0]);
+  }
+  (void)sink;
+}
+
+int
+main(void)
+{
+  for(int p = 0; p < mixer_preset_max; p++)
+  {
+    test_preset(p);
+  }
+  bench();
+
+  return test_done("mixer");
+}
@@ -0,0 +1,552 @@
+#include <string.h>
+#include "test_common.h"
+#include "ublox_cfg.h"
+#include "ublox_priv.h"
+
+//
+// uBlox configuration engine against a scripted receiver.
+//
+// the receiver sits on a simulated UART with a baud of its own. bytes
+// sent at the wrong baud arrive as garbage on both ends. it checks frame
+// checksums, follows PUBX,41, ACKs or NAKs every CFG set after a 5ms
+// think, answers CFG-PRT, CFG-MSG and CFG-RATE polls and emits GGA once
+// a second while GGA is on. frames take their wire time at the baud.
+//
+// every scenario runs the engine on a 10ms tick like ublox.c and checks
+// the receiver ends up at 115200 with every rate of the table set
+//
+#define SIM_MSEC            20000
+#define SIM_TICK            10          // UBLOX_CFG_TICK
+#define SIM_QUEUE           256
+#define SIM_FRAME_MAX       64
+#define SIM_ACK_DELAY       5
+#define SIM_TARGET_BAUD     115200
+#define SIM_PORT_UART1      1
+
+typedef struct
+{
+  uint32_t  t;                // arrival msec
+  uint32_t  baud;             // sent at
+  uint16_t  len;
+  bool      ubx;              // receiver side frames are handed over parsed
+  uint8_t   cls, id;
+  uint8_t   d[SIM_FRAME_MAX];
+} sim_frame_t;
+
+typedef struct
+{
+  sim_frame_t f[SIM_QUEUE];
+  int         n;
+} sim_queue_t;
+
+//
+// receiver behaviour of a scenario
+//
+typedef struct
+{
+  const char*             name;
+  uint32_t                baud;             // receiver starts at
+  int                     drop_pct;         // CFG frames lost or ignored
+  bool                    nak_sbas;
+  bool                    ignore_timeutc;   // first TIMEUTC set ACKed, not applied
+  bool                    silent;           // no receiver at all
+  const ublox_cfg_msg_t*  msgs;
+  uint8_t                 n_msgs;
+  uint32_t                max_ready;        // msec
+} scenario_t;
+
+static sim_queue_t  _to_rx, _to_fc;
+static uint32_t     _now;
+static uint32_t     _fc_baud, _fc_busy;
+static uint32_t     _rx_baud, _rx_baud_next, _rx_baud_at;
+static uint8_t      _rx_rate[256][256];     // CFG-MSG rates on UART1
+static uint8_t      _rx_cfg_rate[6];
+static int          _rx_bad_ck;
+static int          _rx_timeutc_sets;
+static uint32_t     _fc_bauds_tried;        // bitmap of candidate index
+static int          _fc_frames;
+
+static const scenario_t*  _sc;
+static ublox_cfg_t        _cfg;
+
+static const uint32_t     _bauds[] = { 115200, 9600, 57600, 38400, 19200 };
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// wire
+//
+////////////////////////////////////////////////////////////////////////////////
+static uint32_t
+wire_msec(uint32_t baud, int len)
+{
+  return (len * 10 * 1000 + baud - 1) / baud;
+}
+
+static sim_frame_t*
+queue_add(sim_queue_t* q)
+{
+  if(q->n >= SIM_QUEUE)
+  {
+    printf("FAIL simulated queue overflow\n");
+    exit(1);
+  }
+  return &q->f[q->n++];
+}
+
+static bool
+queue_pop_due(sim_queue_t* q, sim_frame_t* out)
+{
+  for(int i = 0; i < q->n; i++)
+  {
+    if((int32_t)(_now - q->f[i].t) >= 0)
+    {
+      *out = q->f[i];
+      memmove(&q->f[i], &q->f[i + 1], (q->n - i - 1) * sizeof(sim_frame_t));
+      q->n--;
+      return true;
+    }
+  }
+  return false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// simulated receiver
+//
+////////////////////////////////////////////////////////////////////////////////
+static void
+rx_send_ubx(uint8_t cls, uint8_t id, const uint8_t* p, int len)
+{
+  sim_frame_t*  f = queue_add(&_to_fc);
+
+  f->ubx  = true;
+  f->cls  = cls;
+  f->id   = id;
+  f->len  = len;
+  f->baud = _rx_baud;
+  f->t    = _now + SIM_ACK_DELAY + wire_msec(_rx_baud, len + UBLOX_CFG_FRAME_OVERHEAD);
+  memcpy(f->d, p, len);
+}
+
+static void
+rx_send_nmea(const char* s)
+{
+  sim_frame_t*  f = queue_add(&_to_fc);
+
+  f->ubx  = false;
+  f->len  = strlen(s);
+  f->baud = _rx_baud;
+  f->t    = _now + wire_msec(_rx_baud, f->len);
+  memcpy(f->d, s, f->len);
+}
+
+static void
+rx_ack(uint8_t id, bool ack)
+{
+  const uint8_t a[2] = { CLASS_CFG, id };
+
+  rx_send_ubx(CLASS_ACK, ack ? MSG_ACK_ACK : MSG_ACK_NACK, a, 2);
+}
+
+//
+// $PUBX,41,1,0003,0001,<baud>,0*cs
+//
+static void
+rx_handle_nmea(const sim_frame_t* f)
+{
+  uint8_t ck = 0;
+  char    hex[3];
+  int     i;
+
+  for(i = 1; i < f->len && f->d[i] != '*'; i++)
+  {
+    ck ^= f->d[i];
+  }
+  snprintf(hex, sizeof(hex), "%02X", ck);
+  if(i + 2 >= f->len || memcmp(&f->d[i + 1], hex, 2) != 0)
+  {
+    _rx_bad_ck++;
+    return;
+  }
+
+  if(memcmp(f->d, "$PUBX,41,1,", 11) == 0)
+  {
+    _rx_baud_next = atoi((const char*)&f->d[21]);
+    _rx_baud_at   = _now + 1;
+  }
+}
+
+static void
+rx_handle(const sim_frame_t* f)
+{
+  uint8_t         a = 0, b = 0;
+  uint8_t         cls, id;
+  uint16_t        len;
+  const uint8_t*  p;
+
+  if(_sc->silent || f->baud != _rx_baud)
+  {
+    return;
+  }
+
+  if(f->d[0] == '$')
+  {
+    rx_handle_nmea(f);
+    return;
+  }
+
+  ublox_update_checksum(&f->d[2], f->len - 4, &a, &b);
+  if(a != f->d[f->len - 2] || b != f->d[f->len - 1])
+  {
+    _rx_bad_ck++;
+    return;
+  }
+
+  cls = f->d[2];
+  id  = f->d[3];
+  len = f->d[4] | f->d[5] << 8;
+  p   = &f->d[6];
+
+  if(cls != CLASS_CFG || (int)(test_rand() % 100) < _sc->drop_pct)
+  {
+    return;
+  }
+
+  //
+  // polls
+  //
+  if(id == MSG_CFG_PRT && len == 1)
+  {
+    const uint8_t r[20] = { SIM_PORT_UART1 };
+
+    rx_send_ubx(CLASS_CFG, MSG_CFG_PRT, r, sizeof(r));
+    return;
+  }
+  if(id == MSG_CFG_SET_RATE && len == 2)
+  {
+    const uint8_t r[8] = { p[0], p[1], 0, _rx_rate[p[0]][p[1]] };
+
+    rx_send_ubx(CLASS_CFG, MSG_CFG_SET_RATE, r, sizeof(r));
+    return;
+  }
+  if(id == MSG_CFG_RATE && len == 0)
+  {
+    rx_send_ubx(CLASS_CFG, MSG_CFG_RATE, _rx_cfg_rate, sizeof(_rx_cfg_rate));
+    return;
+  }
+
+  //
+  // sets
+  //
+  if(id == MSG_CFG_SET_RATE && len == 3)
+  {
+    if(p[1] == MSG_TIMEUTC && _sc->ignore_timeutc && _rx_timeutc_sets++ == 0)
+    {
+      rx_ack(id, true);
+      return;
+    }
+    _rx_rate[p[0]][p[1]] = p[2];
+  }
+  if(id == MSG_CFG_RATE && len == 6)
+  {
+    memcpy(_rx_cfg_rate, p, 6);
+  }
+  rx_ack(id, !(id == MSG_CFG_SBAS && _sc->nak_sbas));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// FC side
+//
+////////////////////////////////////////////////////////////////////////////////
+static bool
+fc_send(const uint8_t* data, uint16_t len)
+{
+  sim_frame_t*  f = queue_add(&_to_rx);
+  uint32_t      start = (int32_t)(_fc_busy - _now) > 0 ? _fc_busy : _now;
+
+  memcpy(f->d, data, len);
+  f->len  = len;
+  f->baud = _fc_baud;
+  f->t    = start + wire_msec(_fc_baud, len);
+  _fc_busy = f->t;
+  _fc_frames++;
+
+  return true;
+}
+
+static void
+fc_set_baud(uint32_t baud)
+{
+  _fc_baud = baud;
+
+  for(int i = 0; i < (int)(sizeof(_bauds) / sizeof(_bauds[0])); i++)
+  {
+    if(_bauds[i] == baud)
+    {
+      _fc_bauds_tried |= 1 << i;
+    }
+  }
+}
+
+static void
+fc_receive(const sim_frame_t* f)
+{
+  if(f->baud != _fc_baud)
+  {
+    for(int i = 0; i < f->len; i++)
+    {
+      ublox_cfg_rx_byte(&_cfg, test_rand() & 0xff, _now);
+    }
+    return;
+  }
+
+  if(f->ubx)
+  {
+    ublox_cfg_rx_ubx(&_cfg, f->cls, f->id, f->d, f->len, _now);
+    return;
+  }
+  for(int i = 0; i < f->len; i++)
+  {
+    ublox_cfg_rx_byte(&_cfg, f->d[i], _now);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// tables. same shape as ublox.c
+//
+////////////////////////////////////////////////////////////////////////////////
+#define CFG_MSG(cls, id, rate)    { CLASS_CFG, MSG_CFG_SET_RATE, 3, { cls, id, rate } }
+#define CFG_RATE(msec)            { CLASS_CFG, MSG_CFG_RATE, 6, { (msec) & 0xff, (msec) >> 8, 1, 0, 1, 0 } }
+
+#define CFG_NAV5                                                          \
+  {                                                                       \
+    CLASS_CFG, MSG_CFG_NAV_SETTINGS, 0x24,                                \
+    {                                                                     \
+      0xFF, 0xFF, 0x06, 0x03, 0x00,                                       \
+      0x00, 0x00, 0x00, 0x10, 0x27, 0x00, 0x00, 0x05, 0x00, 0xFA, 0x00,   \
+      0xFA, 0x00, 0x64, 0x00, 0x2C, 0x01, 0x00, 0x3C, 0x00, 0x00, 0x00,   \
+      0x00, 0xC8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00                \
+    },                                                                    \
+  }
+
+#define CFG_NMEA_OFF                                                      \
+  CFG_MSG(MSG_CLASS_NMEA, MSG_NMEA_GGA, 0),                               \
+  CFG_MSG(MSG_CLASS_NMEA, MSG_NMEA_GLL, 0),                               \
+  CFG_MSG(MSG_CLASS_NMEA, MSG_NMEA_GSA, 0),                               \
+  CFG_MSG(MSG_CLASS_NMEA, MSG_NMEA_GSV, 0),                               \
+  CFG_MSG(MSG_CLASS_NMEA, MSG_NMEA_RMC, 0),                               \
+  CFG_MSG(MSG_CLASS_NMEA, MSG_NMEA_VGS, 0)
+
+#define CFG_SBAS_OFF              { CLASS_CFG, MSG_CFG_SBAS, 8, { 2, 3, 3, 0, 0, 0, 0, 0 } }
+
+static const ublox_cfg_msg_t  _legacy[] =
+{
+  CFG_NAV5,
+  CFG_NMEA_OFF,
+  CFG_MSG(MSG_CLASS_UBX, MSG_POSLLH,  1),
+  CFG_MSG(MSG_CLASS_UBX, MSG_STATUS,  1),
+  CFG_MSG(MSG_CLASS_UBX, MSG_SOL,     1),
+  CFG_MSG(MSG_CLASS_UBX, MSG_VELNED,  1),
+  CFG_MSG(MSG_CLASS_UBX, MSG_SVINFO,  0),
+  CFG_MSG(MSG_CLASS_UBX, MSG_TIMEUTC, 10),
+  CFG_MSG(MSG_CLASS_UBX, MSG_PVT,     0),
+  CFG_RATE(200),
+  CFG_SBAS_OFF,
+};
+
+// 18Hz
+static const ublox_cfg_msg_t  _pvt[] =
+{
+  CFG_NAV5,
+  CFG_NMEA_OFF,
+  CFG_MSG(MSG_CLASS_UBX, MSG_POSLLH,  0),
+  CFG_MSG(MSG_CLASS_UBX, MSG_STATUS,  0),
+  CFG_MSG(MSG_CLASS_UBX, MSG_SOL,     0),
+  CFG_MSG(MSG_CLASS_UBX, MSG_VELNED,  0),
+  CFG_MSG(MSG_CLASS_UBX, MSG_SVINFO,  0),
+  CFG_MSG(MSG_CLASS_UBX, MSG_TIMEUTC, 0),
+  CFG_MSG(MSG_CLASS_UBX, MSG_PVT,     1),
+  CFG_RATE(55),
+  CFG_SBAS_OFF,
+};
+
+#define LEGACY    _legacy, sizeof(_legacy) / sizeof(_legacy[0])
+#define PVT       _pvt, sizeof(_pvt) / sizeof(_pvt[0])
+
+static const scenario_t   _scenarios[] =
+{
+  { "115200 warm",            115200,  0, false, false, false, LEGACY,  500 },
+  { "9600 factory",             9600,  0, false, false, false, LEGACY, 1000 },
+  { "38400",                   38400,  0, false, false, false, LEGACY, 1500 },
+  { "19200, 20% drops",        19200, 20, false, false, false, LEGACY, 5000 },
+  { "9600, SBAS NAK",           9600,  0, true,  false, false, LEGACY, 1000 },
+  { "115200, set ignored",    115200,  0, false, true,  false, LEGACY,  500 },
+  { "57600, 40% drops",        57600, 40, false, false, false, LEGACY, SIM_MSEC },
+  { "pvt 18Hz, 115200",       115200,  0, false, false, false, PVT,     500 },
+  { "pvt 18Hz, 9600, 20%",      9600, 20, false, false, false, PVT,    5000 },
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// scenario runner
+//
+////////////////////////////////////////////////////////////////////////////////
+static void
+sim_reset(const scenario_t* sc)
+{
+  static const uint8_t  factory_rate[6] = { 0xe8, 0x03, 1, 0, 1, 0 };
+
+  _sc = sc;
+  memset(_rx_rate, 0, sizeof(_rx_rate));
+  for(int i = MSG_NMEA_GGA; i <= MSG_NMEA_VGS; i++)
+  {
+    _rx_rate[MSG_CLASS_NMEA][i] = 1;
+  }
+  memcpy(_rx_cfg_rate, factory_rate, sizeof(factory_rate));
+
+  _rx_baud          = sc->baud;
+  _rx_baud_at       = 0;
+  _rx_bad_ck        = 0;
+  _rx_timeutc_sets  = 0;
+  _to_rx.n          = 0;
+  _to_fc.n          = 0;
+  _fc_busy          = 0;
+  _fc_frames        = 0;
+  _fc_bauds_tried   = 0;
+  test_seed(1234);
+}
+
+static void
+sim_run(uint32_t msec)
+{
+  sim_frame_t   f;
+
+  for(; _now < msec && !ublox_cfg_is_done(&_cfg); _now++)
+  {
+    if(_rx_baud_at != 0 && (int32_t)(_now - _rx_baud_at) >= 0)
+    {
+      _rx_baud    = _rx_baud_next;
+      _rx_baud_at = 0;
+    }
+
+    while(queue_pop_due(&_to_rx, &f))
+    {
+      rx_handle(&f);
+    }
+    while(queue_pop_due(&_to_fc, &f))
+    {
+      fc_receive(&f);
+    }
+
+    if(!_sc->silent && _now % 1000 == 500 && _rx_rate[MSG_CLASS_NMEA][MSG_NMEA_GGA])
+    {
+      rx_send_nmea("$GPGGA,,,,,,0,00,99.99,,,,,,*48\r\n");
+    }
+
+    if(_now % SIM_TICK == 0)
+    {
+      ublox_cfg_tick(&_cfg, _now);
+    }
+  }
+}
+
+static bool
+receiver_matches(const scenario_t* sc)
+{
+  for(int i = 0; i < sc->n_msgs; i++)
+  {
+    const ublox_cfg_msg_t*  m = &sc->msgs[i];
+
+    if(m->id == MSG_CFG_SET_RATE && _rx_rate[m->payload[0]][m->payload[1]] != m->payload[2])
+    {
+      return false;
+    }
+    if(m->id == MSG_CFG_RATE && memcmp(_rx_cfg_rate, m->payload, 6) != 0)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void
+test_scenarios(void)
+{
+  for(int s = 0; s < (int)(sizeof(_scenarios) / sizeof(_scenarios[0])); s++)
+  {
+    const scenario_t*   sc = &_scenarios[s];
+
+    sim_reset(sc);
+    _now = 0;
+    ublox_cfg_init(&_cfg, fc_send, fc_set_baud, SIM_TARGET_BAUD);
+    ublox_cfg_start(&_cfg, sc->msgs, sc->n_msgs, _now);
+    sim_run(SIM_MSEC);
+
+    printf("  %-22s : ready %5lu ms at %6lu, retries %lu, naks %lu, mismatches %lu,"
+           " restarts %lu, %d frames\n",
+        sc->name, (unsigned long)_cfg.ready_msec, (unsigned long)_cfg.detected_baud,
+        (unsigned long)_cfg.retries, (unsigned long)_cfg.naks,
+        (unsigned long)_cfg.mismatches, (unsigned long)_cfg.restarts, _fc_frames);
+
+    TEST_CHECK(ublox_cfg_is_done(&_cfg), "%s never configured", sc->name);
+    TEST_CHECK(_cfg.ready_msec <= sc->max_ready, "%s ready %lu ms", sc->name,
+        (unsigned long)_cfg.ready_msec);
+    //
+    // after a restart the receiver may already have moved to the target
+    //
+    TEST_CHECK(_cfg.detected_baud == (_cfg.restarts ? _rx_baud : sc->baud),
+        "%s detected %lu", sc->name, (unsigned long)_cfg.detected_baud);
+    TEST_CHECK(_rx_baud == SIM_TARGET_BAUD && _fc_baud == SIM_TARGET_BAUD,
+        "%s receiver at %lu, FC at %lu", sc->name, (unsigned long)_rx_baud, (unsigned long)_fc_baud);
+    TEST_CHECK(receiver_matches(sc), "%s receiver state differs from the table", sc->name);
+    TEST_CHECK(_rx_bad_ck == 0, "%s %d bad checksums at the receiver", sc->name, _rx_bad_ck);
+
+    if(sc->nak_sbas)
+    {
+      TEST_CHECK(_cfg.naks >= 1, "%s NAK not counted", sc->name);
+    }
+    if(sc->ignore_timeutc)
+    {
+      TEST_CHECK(_cfg.mismatches >= 1, "%s ignored set not found by verify", sc->name);
+    }
+    if(sc->drop_pct > 0)
+    {
+      TEST_CHECK(_cfg.retries >= 1, "%s drops but no retries", sc->name);
+    }
+  }
+}
+
+//
+// nothing on the wire. every candidate baud is tried in turn, over and
+// over, and the engine never claims to be done
+//
+static void
+test_no_receiver(void)
+{
+  static const scenario_t sc = { "no receiver", 9600, 0, false, false, true, LEGACY, 0 };
+
+  sim_reset(&sc);
+  _now = 0;
+  ublox_cfg_init(&_cfg, fc_send, fc_set_baud, SIM_TARGET_BAUD);
+  ublox_cfg_start(&_cfg, sc.msgs, sc.n_msgs, _now);
+  sim_run(10000);
+
+  printf("  %-22s : %lu restarts, %d probes in 10 s, bauds tried 0x%02lx\n",
+      sc.name, (unsigned long)_cfg.restarts, _fc_frames, (unsigned long)_fc_bauds_tried);
+
+  TEST_CHECK(!ublox_cfg_is_done(&_cfg), "done without a receiver");
+  TEST_CHECK(_cfg.restarts >= 5, "only %lu restarts in 10 s", (unsigned long)_cfg.restarts);
+  TEST_CHECK(_fc_bauds_tried == (1u << (sizeof(_bauds) / sizeof(_bauds[0]))) - 1,
+      "bauds tried 0x%02lx", (unsigned long)_fc_bauds_tried);
+}
+
+int
+main(void)
+{
+  test_scenarios();
+  test_no_receiver();
+
+  return test_done("ublox_cfg");
+}
@@ -0,0 +1,161 @@
+#include <string.h>
+#include "test_common.h"
+#include "ublox_cfg.h"
+#include "ublox_priv.h"
+
+//
+// UBX frame builders against fixed golden frames.
+//
+// the MGA-INI goldens were packed by hand from the u-blox M8 protocol
+// description, little endian, and their checksums cross checked with a
+// plain Fletcher-8 below. the CFG polls are the well known frames u-center
+// sends
+//
+//
+// MGA-INI-POS_LLH. 37.5665N 126.9780E, 38.50m, 100km
+//
+static const uint8_t  _pos_north_east[] =
+{
+  0xb5, 0x62, 0x13, 0x40, 0x14, 0x00,
+  0x01, 0x00, 0x00, 0x00,                 // type, version, reserved
+  0x68, 0x31, 0x64, 0x16,                 // lat 375665000
+  0x20, 0x4e, 0xaf, 0x4b,                 // lon 1269780000
+  0x0a, 0x0f, 0x00, 0x00,                 // alt 3850 cm
+  0x80, 0x96, 0x98, 0x00,                 // acc 10000000 cm
+  0xaa, 0x47,
+};
+
+//
+// 33.8688S 151.2093W, -12.00m, 5m. negative fields are two's complement
+//
+static const uint8_t  _pos_south_west[] =
+{
+  0xb5, 0x62, 0x13, 0x40, 0x14, 0x00,
+  0x01, 0x00, 0x00, 0x00,
+  0x00, 0x08, 0xd0, 0xeb,                 // lat -338688000
+  0xb8, 0x4a, 0xdf, 0xa5,                 // lon -1512093000
+  0x50, 0xfb, 0xff, 0xff,                 // alt -1200 cm
+  0xf4, 0x01, 0x00, 0x00,                 // acc 500 cm
+  0xef, 0x91,
+};
+
+//
+// MGA-INI-TIME_UTC. 2026-10-19 13:45:07.250, leap seconds unknown, 12h
+//
+static const uint8_t  _time_utc[] =
+{
+  0xb5, 0x62, 0x13, 0x40, 0x18, 0x00,
+  0x10, 0x00, 0x00, 0x80,                 // type, version, ref, leap -128
+  0xea, 0x07, 0x0a, 0x13,                 // 2026, 10, 19
+  0x0d, 0x2d, 0x07, 0x00,                 // 13:45:07, reserved
+  0x80, 0xb2, 0xe6, 0x0e,                 // nano 250000000
+  0xc0, 0xa8, 0x00, 0x00,                 // acc 43200 s, reserved
+  0x00, 0x00, 0x00, 0x00,                 // acc ns
+  0xd8, 0x95,
+};
+
+//
+// CFG-PRT poll of UART1 and CFG-RATE poll
+//
+static const uint8_t  _poll_prt[]  = { 0xb5, 0x62, 0x06, 0x00, 0x01, 0x00, 0x01, 0x08, 0x22 };
+static const uint8_t  _poll_rate[] = { 0xb5, 0x62, 0x06, 0x08, 0x00, 0x00, 0x0e, 0x30 };
+
+static void
+fletcher8(const uint8_t* d, int n, uint8_t* a, uint8_t* b)
+{
+  *a = *b = 0;
+  for(int i = 0; i < n; i++)
+  {
+    *a += d[i];
+    *b += *a;
+  }
+}
+
+static void
+check_frame(const char* name, const uint8_t* f, uint16_t n, const uint8_t* golden, uint16_t golden_len)
+{
+  uint8_t   a = 0, b = 0, ra, rb;
+
+  TEST_CHECK(n == golden_len, "%s length %u, want %u", name, n, golden_len);
+  if(n != golden_len)
+  {
+    return;
+  }
+
+  for(int i = 0; i < n; i++)
+  {
+    TEST_CHECK(f[i] == golden[i], "%s byte %d is 0x%02x, want 0x%02x", name, i, f[i], golden[i]);
+  }
+
+  //
+  // checksum runs over class, id, length and payload
+  //
+  ublox_update_checksum(&golden[2], golden_len - 4, &a, &b);
+  fletcher8(&golden[2], golden_len - 4, &ra, &rb);
+  TEST_CHECK(a == golden[n - 2] && b == golden[n - 1], "%s ublox_update_checksum %02x %02x",
+      name, a, b);
+  TEST_CHECK(ra == golden[n - 2] && rb == golden[n - 1], "%s golden checksum %02x %02x", name, ra, rb);
+}
+
+static void
+test_golden(void)
+{
+  static const gps_location_t ne = {  375665000,  1269780000,  3850 },
+                              sw = { -338688000, -1512093000, -1200 };
+  static const date_time_t    t  = { 2026, 10, 19, 13, 45, 7, 250 };
+  const uint8_t               port = 1;
+  uint8_t                     buf[64];
+  uint16_t                    n, m;
+
+  TEST_CHECK(sizeof(ubx_mga_ini_pos_llh_t) == 20, "pos payload %u bytes",
+      (unsigned)sizeof(ubx_mga_ini_pos_llh_t));
+  TEST_CHECK(sizeof(ubx_mga_ini_time_utc_t) == 24, "time payload %u bytes",
+      (unsigned)sizeof(ubx_mga_ini_time_utc_t));
+
+  n = ublox_build_mga_ini_pos(buf, &ne, 10000000);
+  check_frame("MGA-INI-POS N/E", buf, n, _pos_north_east, sizeof(_pos_north_east));
+
+  n = ublox_build_mga_ini_pos(buf, &sw, 500);
+  check_frame("MGA-INI-POS S/W", buf, n, _pos_south_west, sizeof(_pos_south_west));
+
+  //
+  // ublox.c sends only the position, there is no RTC to trust the time.
+  // both still fit its 64 byte tx buffer back to back
+  //
+  m = ublox_build_mga_ini_time(&buf[n], &t, 43200);
+  check_frame("MGA-INI-TIME", &buf[n], m, _time_utc, sizeof(_time_utc));
+  TEST_CHECK(n + m <= sizeof(buf), "pos+time %u bytes", n + m);
+
+  n = ublox_build_msg(buf, CLASS_CFG, MSG_CFG_PRT, &port, 1);
+  check_frame("CFG-PRT poll", buf, n, _poll_prt, sizeof(_poll_prt));
+
+  n = ublox_build_msg(buf, CLASS_CFG, MSG_CFG_RATE, NULL, 0);
+  check_frame("CFG-RATE poll", buf, n, _poll_rate, sizeof(_poll_rate));
+
+  printf("  5 golden frames, MGA pos+time %u bytes\n",
+      (unsigned)(sizeof(_pos_south_west) + sizeof(_time_utc)));
+}
+
+//
+// ublox_update_checksum accumulates so a frame can be summed in pieces
+//
+static void
+test_checksum_pieces(void)
+{
+  uint8_t   a = 0, b = 0;
+
+  ublox_update_checksum(&_time_utc[2], 4, &a, &b);
+  ublox_update_checksum(&_time_utc[6], 10, &a, &b);
+  ublox_update_checksum(&_time_utc[16], sizeof(_time_utc) - 18, &a, &b);
+  TEST_CHECK(a == _time_utc[sizeof(_time_utc) - 2] && b == _time_utc[sizeof(_time_utc) - 1],
+      "piecewise checksum %02x %02x", a, b);
+}
+
+int
+main(void)
+{
+  test_golden();
+  test_checksum_pieces();
+
+  return test_done("ublox_mga");
+}